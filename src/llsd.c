@@ -18,30 +18,69 @@
 #include <stdarg.h>
 #include <sys/uio.h>
 #include <math.h>
-#include <time.h>
 
 #define DEBUG_ON
 #include <cutil/debug.h>
 #include <cutil/macros.h>
-#include <cutil/pair.h>
 
 #include "llsd.h"
+#include "llsd_arena.h"
+#include "llsd_date.h"
+#include "llsd_hash.h"
+#include "llsd_number.h"
 
 /* the llsd types */
 typedef int				llsd_bool_t;
 typedef int32_t			llsd_int_t;
 typedef double			llsd_real_t;
 typedef uint8_t			llsd_uuid_t[UUID_LEN];
-typedef uint8_t *		llsd_string_t;
+typedef struct llsd_string_s
+{
+	uint8_t *			ptr;	/* null terminated unless borrowed */
+	uint32_t			len;	/* byte count, not counting the null terminator */
+} llsd_string_t;
 typedef double			llsd_date_t;
-typedef uint8_t *		llsd_uri_t;
+typedef llsd_string_t	llsd_uri_t;
 typedef struct iovec	llsd_binary_t;
 typedef list_t			llsd_array_t;
-typedef ht_t			llsd_map_t;
+
+typedef struct llsd_map_s
+{
+	ht_t				ht;
+	llsd_arena_t *		arena;	/* where the map pairs come from, NULL for the heap */
+} llsd_map_t;
+
+/* a container that hasn't been parsed yet */
+typedef struct llsd_lazy_s
+{
+	uint8_t const *		buf;	/* the container's encoded bytes */
+	size_t				len;
+	llsd_lazy_fill_fn	fill;	/* parses buf into the container */
+	llsd_arena_t *		arena;
+	uint32_t			count;	/* size hint from the encoding */
+} llsd_lazy_t;
+
+/* flags */
+#define LLSD_FLAG_ARENA (0x0001)	/* node lives in an arena, llsd_delete leaves it alone */
+#define LLSD_FLAG_INLINE (0x0002)	/* string/uri bytes are stored in the node itself */
+#define LLSD_FLAG_INTERNED (0x0004)	/* shared key owned by an intern table, llsd_delete leaves it alone */
+#define LLSD_FLAG_HASHED (0x0008)	/* hash_ holds the key hash */
+#define LLSD_FLAG_BORROWED (0x0010)	/* string/binary data belongs to the caller, it is never freed */
+#define LLSD_FLAG_LAZY (0x0020)	/* array/map holds lazy_ until it is first used */
+
+/* short strings and uris live in the union, null terminated, with their
+ * length kept in ilen_ */
+#define LLSD_INLINE_MAX (UUID_LEN - 1)
+#define STR_IS_INLINE( x ) ((x)->flags_ & LLSD_FLAG_INLINE)
+#define STR_PTR( x, m ) (STR_IS_INLINE( x ) ? (x)->inline_ : (x)->m.ptr)
+#define STR_LEN( x, m ) (STR_IS_INLINE( x ) ? (x)->ilen_ : (x)->m.len)
 
 typedef struct llsd_s
 {
-	llsd_type_t			type_;
+	uint8_t				type_;
+	uint8_t				ilen_;	/* length of an inline string/uri */
+	uint16_t			flags_;
+	uint32_t			hash_;	/* cached map key hash */
 	union
 	{
 		llsd_bool_t		bool_;
@@ -54,11 +93,24 @@ typedef struct llsd_s
 		llsd_binary_t	binary_;
 		llsd_array_t	array_;
 		llsd_map_t		map_;
-
+		llsd_lazy_t		lazy_;
+		uint8_t			inline_[LLSD_INLINE_MAX + 1];
 	};
 
 } llsd_t;
 
+/* a map entry */
+typedef struct llsd_pair_s
+{
+	llsd_t *			key;
+	llsd_t *			value;
+} llsd_pair_t;
+
+struct llsd_intern_s
+{
+	ht_t				atoms;
+};
+
 int8_t const * const llsd_type_strings[LLSD_TYPE_COUNT] =
 {
 	T("UNDEF"),
@@ -90,55 +142,161 @@ int8_t const * const llsd_notation_bin_enc_type_strings[LLSD_BIN_ENC_COUNT] =
 	T("b85")
 };
 
-#if defined(PORTABLE_64_BIT)
-#define FNV_OFFSET (0xCBF29CE484222325ULL)
-#define FNV_PRIME  (0x0001099511628211ULL)
-#else /* 32-bit */
-#define FNV_OFFSET (0x811C9DC5)
-#define FNV_PRIME  (0x01000193)
-#endif
-static uint_t llsd_pair_hash( void const * const data )
+/* keys are hashed once over their full length and the hash is kept in the
+ * node, so the table never rehashes a key while probing or growing */
+static uint_t llsd_key_hash( llsd_t * const key )
 {
-	int i;
-	pair_t * pair = (pair_t*)data;
-	llsd_t * key = pair_first( pair );
-	uint_t hash = FNV_OFFSET;
-	uint8_t const * p = (uint8_t const *)key->string_;
-	uint32_t const len = ( p ? strnlen( p, 64 ) : 0 );
 	CHECK_RET( (key->type_ == LLSD_STRING), 0 );
-	for( i = 0; i < len; i++ )
+
+	if ( !(key->flags_ & LLSD_FLAG_HASHED) )
 	{
-		hash *= FNV_PRIME;
-		hash ^= p[i];
+		key->hash_ = (uint32_t)llsd_hash( STR_PTR( key, string_ ), STR_LEN( key, string_ ) );
+		key->flags_ |= LLSD_FLAG_HASHED;
 	}
-	return hash;
+	return key->hash_;
+}
+
+static uint_t llsd_pair_hash( void const * const data )
+{
+	llsd_pair_t const * pair = (llsd_pair_t const *)data;
+	return llsd_key_hash( pair->key );
 }
 
 static int_t llsd_pair_eq(void const * const l, void const * const r)
 {
-	pair_t * left = (pair_t*)l;
-	pair_t * right = (pair_t*)r;
-	llsd_t * lval = pair_first( left );
-	llsd_t * rval = pair_first( right );
-	return llsd_equal( lval, rval );
+	llsd_pair_t const * left = (llsd_pair_t const *)l;
+	llsd_pair_t const * right = (llsd_pair_t const *)r;
+
+	/* interned keys are shared so most matches are the same object */
+	if ( left->key == right->key )
+		return TRUE;
+
+	/* different cached hashes can't be the same key */
+	if ( (left->key->flags_ & right->key->flags_ & LLSD_FLAG_HASHED) && (left->key->hash_ != right->key->hash_) )
+		return FALSE;
+	return llsd_equal( left->key, right->key );
 }
 
 static void llsd_pair_delete(void * value)
 {
-	pair_t * p = (pair_t*)value;
-	llsd_delete( pair_first( p ) );
-	llsd_delete( pair_second( p ) );
-	pair_delete( p );
+	llsd_pair_t * p = (llsd_pair_t*)value;
+	llsd_delete( p->key );
+	llsd_delete( p->value );
+	FREE( p );
 }
 
-static int_t llsd_initialize( llsd_t * llsd, llsd_type_t type_, ... )
+static void llsd_arena_pair_delete(void * value)
+{
+	/* the pair itself belongs to the arena */
+	llsd_pair_t * p = (llsd_pair_t*)value;
+	llsd_delete( p->key );
+	llsd_delete( p->value );
+}
+
+static void llsd_arena_array_cleanup( void * p )
+{
+	llsd_t * llsd = (llsd_t*)p;
+	list_deinitialize( &(llsd->array_) );
+}
+
+static void llsd_arena_map_cleanup( void * p )
+{
+	llsd_t * llsd = (llsd_t*)p;
+	ht_deinitialize( &(llsd->map_.ht) );
+}
+
+/* stores a string/binary payload, either in the arena or on the heap.
+ * borrowed payloads are pointed at where they are */
+static int_t llsd_store( llsd_arena_t * const arena, void ** const dst, uint8_t * const p, size_t const len, int const own_it )
+{
+	(*dst) = p;
+	if ( (p == NULL) || (own_it == LLSD_BORROW) )
+		return TRUE;
+
+	if ( arena != NULL )
+	{
+		(*dst) = llsd_arena_memdup( arena, p, len );
+		CHECK_PTR_RET( (*dst), FALSE );
+		if ( own_it )
+			FREE( p );
+	}
+	else if ( !own_it )
+	{
+		(*dst) = MALLOC( len + 1 );
+		CHECK_PTR_RET( (*dst), FALSE );
+		MEMCPY( (*dst), p, len );
+		((uint8_t*)(*dst))[len] = '\0';
+	}
+	return TRUE;
+}
+
+/* short strings are copied into the node, anything else goes through llsd_store */
+static int_t llsd_store_string( llsd_t * const llsd, llsd_arena_t * const arena, llsd_string_t * const dst, uint8_t * const p, uint32_t len, int const own_it )
+{
+	if ( len == LLSD_NUL_TERMINATED )
+		len = ( p ? strlen( p ) : 0 );
+
+	if ( (p != NULL) && (len <= LLSD_INLINE_MAX) )
+	{
+		MEMCPY( llsd->inline_, p, len );
+		llsd->inline_[len] = '\0';
+		llsd->ilen_ = (uint8_t)len;
+		llsd->flags_ |= LLSD_FLAG_INLINE;
+		if ( own_it == TRUE )
+			FREE( p );
+		return TRUE;
+	}
+
+	if ( own_it == LLSD_BORROW )
+		llsd->flags_ |= LLSD_FLAG_BORROWED;
+
+	dst->len = len;
+	return llsd_store( arena, (void**)&(dst->ptr), p, len, own_it );
+}
+
+static int_t llsd_initialize_container( llsd_t * llsd, llsd_arena_t * const arena, uint32_t const len )
+{
+	switch( llsd->type_ )
+	{
+		case LLSD_ARRAY:
+			CHECK_RET( list_initialize( &(llsd->array_), len, &llsd_delete ), FALSE );
+			if ( arena != NULL )
+			{
+				if ( !llsd_arena_add_cleanup( arena, &llsd_arena_array_cleanup, llsd ) )
+				{
+					list_deinitialize( &(llsd->array_) );
+					return FALSE;
+				}
+			}
+			break;
+
+		case LLSD_MAP:
+			llsd->map_.arena = arena;
+			CHECK_RET( ht_initialize( &(llsd->map_.ht), len, &llsd_pair_hash, &llsd_pair_eq, 
+									  (arena ? &llsd_arena_pair_delete : &llsd_pair_delete) ), FALSE );
+			if ( arena != NULL )
+			{
+				if ( !llsd_arena_add_cleanup( arena, &llsd_arena_map_cleanup, llsd ) )
+				{
+					ht_deinitialize( &(llsd->map_.ht) );
+					return FALSE;
+				}
+			}
+			break;
+
+		default:
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static int_t llsd_initialize( llsd_t * llsd, llsd_arena_t * const arena, llsd_type_t type_, va_list args )
 {
-	va_list args;
 	uint8_t * p;
 	uint32_t len;
-	int_t own_it;
+	int own_it;
 
-	CHECK_PTR( llsd );
+	CHECK_PTR_RET( llsd, FALSE );
 	
 	llsd->type_ = type_;
 
@@ -148,25 +306,18 @@ static int_t llsd_initialize( llsd_t * llsd, llsd_type_t type_, ... )
 			break;
 
 		case LLSD_BOOLEAN:
-			va_start( args, type_ );
 			llsd->bool_ = va_arg( args, int );
-			va_end(args);
 			break;
 
 		case LLSD_INTEGER:
-			va_start( args, type_ );
-			llsd->int_ = va_arg(args, int );
-			va_end(args);
+			llsd->int_ = va_arg( args, int );
 			break;
 
 		case LLSD_REAL:
-			va_start( args, type_ );
-			llsd->real_ = va_arg(args, double );
-			va_end(args);
+			llsd->real_ = va_arg( args, double );
 			break;
 
 		case LLSD_UUID:
-			va_start( args, type_ );
 			p = va_arg( args, uint8_t* );
 			
 			if ( p != NULL )
@@ -177,159 +328,103 @@ static int_t llsd_initialize( llsd_t * llsd, llsd_type_t type_, ... )
 			{
 				MEMSET( llsd->uuid_, 0, UUID_LEN );
 			}
-			va_end( args );
 			break;
 
 		case LLSD_STRING:
-			va_start( args, type_ );
 			p = va_arg( args, uint8_t* );
-			own_it = va_arg( args, int_t );
-			va_end( args );
-
-			if ( !own_it && p )
-			{
-				llsd->string_ = strdup( p );
-				CHECK_PTR_RET( llsd->string_, FALSE );
-			}
-			else
-				llsd->string_ = p;
-
+			len = va_arg( args, uint32_t );
+			own_it = va_arg( args, int );
+			CHECK_RET( llsd_store_string( llsd, arena, &(llsd->string_), p, len, own_it ), FALSE );
 			break;
 
 		case LLSD_DATE:
-			va_start( args, type_ );
 			llsd->date_ = va_arg( args, double );
-			va_end( args );
 			break;
 
 		case LLSD_URI:
-			va_start( args, type_ );
 			p = va_arg( args, uint8_t* );
-			own_it = va_arg( args, int_t );
-			va_end( args );
-
-			if ( !own_it && p )
-			{
-				llsd->uri_ = strdup( p );
-				CHECK_PTR_RET( llsd->uri_, FALSE );
-			}
-			else
-				llsd->string_ = p;
+			len = va_arg( args, uint32_t );
+			own_it = va_arg( args, int );
+			CHECK_RET( llsd_store_string( llsd, arena, &(llsd->uri_), p, len, own_it ), FALSE );
 			break;
 
 		case LLSD_BINARY:
-			va_start( args, type_ );
 			p = va_arg( args, uint8_t* );
 			llsd->binary_.iov_len = va_arg( args, uint32_t );
-			own_it = va_arg( args, int_t );
-			va_end( args );
-
-			if ( !own_it && p )
-			{
-				llsd->binary_.iov_base = CALLOC( llsd->binary_.iov_len, sizeof(uint8_t) );
-				CHECK_PTR_RET( llsd->binary_.iov_base, FALSE );
-				MEMCPY( llsd->binary_.iov_base, p, llsd->binary_.iov_len );
-			}
-			else
-				llsd->binary_.iov_base = p;
+			own_it = va_arg( args, int );
+			if ( own_it == LLSD_BORROW )
+				llsd->flags_ |= LLSD_FLAG_BORROWED;
+			CHECK_RET( llsd_store( arena, &(llsd->binary_.iov_base), p, llsd->binary_.iov_len, own_it ), FALSE );
 			break;
 
 		case LLSD_ARRAY:
-			va_start( args, type_ );
-			len = va_arg( args, uint32_t );
-			va_end( args );
-			CHECK_RET( list_initialize( &(llsd->array_), len, &llsd_delete ), FALSE );
-			break;
-
 		case LLSD_MAP:
-			va_start( args, type_ );
 			len = va_arg( args, uint32_t );
-			va_end( args );
-			CHECK_RET( ht_initialize( &(llsd->map_), len, &llsd_pair_hash, &llsd_pair_eq, &llsd_pair_delete ), FALSE );
+			CHECK_RET( llsd_initialize_container( llsd, arena, len ), FALSE );
 			break;
 	}
 	return TRUE;
 }
 
-llsd_t * llsd_new( llsd_type_t type_, ... )
+static llsd_t * llsd_new_va( llsd_arena_t * const arena, llsd_type_t type_, va_list args )
 {
-	va_list args;
-	llsd_t * llsd;
-	int a1;
-	uint8_t * a2;
-	double a3;
-	uint32_t a4;
-	
+	llsd_t * llsd = NULL;
+
+	if ( arena != NULL )
+	{
+		/* allocate the llsd object in the arena */
+		llsd = (llsd_t*)llsd_arena_alloc( arena, sizeof(llsd_t) );
+		CHECK_PTR_RET_MSG( llsd, NULL, "failed to arena allocate llsd object\n" );
+		MEMSET( llsd, 0, sizeof(llsd_t) );
+		llsd->flags_ = LLSD_FLAG_ARENA;
+		CHECK_RET( llsd_initialize( llsd, arena, type_, args ), NULL );
+		return llsd;
+	}
+
 	/* allocate the llsd object */
 	llsd = (llsd_t*)CALLOC(1, sizeof(llsd_t));
 	CHECK_PTR_RET_MSG( llsd, NULL, "failed to heap allocate llsd object\n" );
 
-	switch( type_ )
+	if ( !llsd_initialize( llsd, NULL, type_, args ) )
 	{
-		case LLSD_UNDEF:
-			CHECK_GOTO( llsd_initialize( llsd, type_ ), fail_llsd_new );
-			break;
+		FREE( llsd );
+		return NULL;
+	}
 
-		case LLSD_BOOLEAN:
-		case LLSD_INTEGER:
-			va_start( args, type_ );
-			a1 = va_arg( args, int );
-			va_end( args );
-			CHECK_GOTO( llsd_initialize( llsd, type_, a1 ), fail_llsd_new );
-			break;
+	return llsd;
+}
 
-		case LLSD_REAL:
-		case LLSD_DATE:
-			va_start( args, type_ );
-			a3 = va_arg( args, double );
-			va_end( args );
-			CHECK_GOTO( llsd_initialize( llsd, type_, a3 ), fail_llsd_new );
-			break;
+llsd_t * llsd_new( llsd_type_t type_, ... )
+{
+	va_list args;
+	llsd_t * llsd = NULL;
 
-		case LLSD_UUID:
-			va_start( args, type_ );
-			a2 = va_arg( args, uint8_t* );
-			va_end( args );
-			CHECK_GOTO( llsd_initialize( llsd, type_, a2 ), fail_llsd_new );
-			break;
+	va_start( args, type_ );
+	llsd = llsd_new_va( NULL, type_, args );
+	va_end( args );
 
-		case LLSD_STRING:
-		case LLSD_URI:
-			va_start( args, type_ );
-			a2 = va_arg( args, uint8_t* );
-			a1 = va_arg( args, int );
-			va_end( args );
-			CHECK_GOTO( llsd_initialize( llsd, type_, a2, a1 ), fail_llsd_new );
-			break;
+	return llsd;
+}
 
-		case LLSD_BINARY:
-			va_start( args, type_ );
-			a2 = va_arg( args, uint8_t* );	/* pointer to buffer */
-			a4 = va_arg( args, uint32_t );	/* size */
-			a1 = va_arg( args, int );
-			va_end( args );
-			CHECK_GOTO( llsd_initialize( llsd, type_, a2, a4, a1 ), fail_llsd_new );
-			break;
+llsd_t * llsd_new_in( llsd_arena_t * const arena, llsd_type_t type_, ... )
+{
+	va_list args;
+	llsd_t * llsd = NULL;
 
-		case LLSD_ARRAY:
-		case LLSD_MAP:
-			va_start( args, type_ );
-			a4 = va_arg( args, uint32_t ); /* initial capacity */
-			va_end( args );
-			CHECK_GOTO( llsd_initialize( llsd, type_, a4 ), fail_llsd_new );
-			break;
-	}
+	va_start( args, type_ );
+	llsd = llsd_new_va( arena, type_, args );
+	va_end( args );
 
 	return llsd;
-
-fail_llsd_new:
-	llsd_delete( llsd );
-	return NULL;
 }
 
 static void llsd_deinitialize( llsd_t * llsd )
 {
 	CHECK_PTR( llsd );
+
+	/* an unparsed container owns nothing */
+	if ( llsd->flags_ & LLSD_FLAG_LAZY )
+		return;
 	
 	switch( llsd->type_ )
 	{
@@ -342,15 +437,18 @@ static void llsd_deinitialize( llsd_t * llsd )
 			return;
 
 		case LLSD_STRING:
-			FREE( llsd->string_ );
+			if ( !(llsd->flags_ & (LLSD_FLAG_INLINE | LLSD_FLAG_BORROWED)) )
+				FREE( llsd->string_.ptr );
 			break;
 
 		case LLSD_URI:
-			FREE( llsd->uri_ );
+			if ( !(llsd->flags_ & (LLSD_FLAG_INLINE | LLSD_FLAG_BORROWED)) )
+				FREE( llsd->uri_.ptr );
 			break;
 
 		case LLSD_BINARY:
-			FREE( llsd->binary_.iov_base );
+			if ( !(llsd->flags_ & LLSD_FLAG_BORROWED) )
+				FREE( llsd->binary_.iov_base );
 			break;
 
 		case LLSD_ARRAY:
@@ -358,7 +456,7 @@ static void llsd_deinitialize( llsd_t * llsd )
 			break;
 
 		case LLSD_MAP:
-			ht_deinitialize( &llsd->map_ );
+			ht_deinitialize( &llsd->map_.ht );
 			break;
 	}
 }
@@ -368,12 +466,69 @@ void llsd_delete( void * p )
 	llsd_t * llsd = (llsd_t *)p;
 	CHECK_PTR( llsd );
 
+	/* arena nodes are released with the arena, interned keys with their table */
+	if ( llsd->flags_ & (LLSD_FLAG_ARENA | LLSD_FLAG_INTERNED) )
+		return;
+
 	/* deinitialize it */
 	llsd_deinitialize( llsd );
 
 	FREE( llsd );
 }
 
+llsd_t * llsd_new_lazy( llsd_arena_t * const arena, llsd_type_t const type_, uint32_t const count, uint8_t const * const buf, size_t const len, llsd_lazy_fill_fn fill )
+{
+	llsd_t * llsd = NULL;
+
+	CHECK_RET( (type_ == LLSD_ARRAY) || (type_ == LLSD_MAP), NULL );
+	CHECK_PTR_RET( buf, NULL );
+	CHECK_PTR_RET( fill, NULL );
+
+	if ( arena != NULL )
+	{
+		llsd = (llsd_t*)llsd_arena_alloc( arena, sizeof(llsd_t) );
+		CHECK_PTR_RET_MSG( llsd, NULL, "failed to arena allocate llsd object\n" );
+		MEMSET( llsd, 0, sizeof(llsd_t) );
+		llsd->flags_ = LLSD_FLAG_ARENA;
+	}
+	else
+	{
+		llsd = (llsd_t*)CALLOC(1, sizeof(llsd_t));
+		CHECK_PTR_RET_MSG( llsd, NULL, "failed to heap allocate llsd object\n" );
+	}
+
+	llsd->type_ = type_;
+	llsd->flags_ |= LLSD_FLAG_LAZY;
+	llsd->lazy_.buf = buf;
+	llsd->lazy_.len = len;
+	llsd->lazy_.fill = fill;
+	llsd->lazy_.arena = arena;
+	llsd->lazy_.count = count;
+	return llsd;
+}
+
+/* parses a lazy container the first time it is used */
+static int_t llsd_materialize( llsd_t * const llsd )
+{
+	llsd_lazy_t lazy;
+
+	if ( !(llsd->flags_ & LLSD_FLAG_LAZY) )
+		return TRUE;
+
+	lazy = llsd->lazy_;
+	llsd->flags_ &= ~LLSD_FLAG_LAZY;
+	if ( !llsd_initialize_container( llsd, lazy.arena, lazy.count ) )
+	{
+		llsd->lazy_ = lazy;
+		llsd->flags_ |= LLSD_FLAG_LAZY;
+		return FALSE;
+	}
+
+	/* on failure it stays a container with whatever was filled in */
+	CHECK_RET_MSG( (*(lazy.fill))( llsd, lazy.arena, lazy.buf, lazy.len ), FALSE, "failed to parse lazy %s\n", llsd_get_type_string( llsd->type_ ) );
+	return TRUE;
+}
+
 llsd_type_t llsd_get_type( llsd_t * llsd )
 {
 	CHECK_PTR_RET( llsd, LLSD_UNDEF );
@@ -406,29 +561,40 @@ int_t llsd_array_append( llsd_t * arr, llsd_t * value )
 	CHECK_PTR_RET( arr, FALSE );
 	CHECK_PTR_RET( value, FALSE );
 	CHECK_RET( llsd_get_type( arr ) == LLSD_ARRAY, FALSE );
+	CHECK_RET( llsd_materialize( arr ), FALSE );
 	list_push_tail( &(arr->array_), (void*)value );
+	return TRUE;
 }
 
 int_t llsd_array_unappend( llsd_t * arr )
 {
 	CHECK_PTR_RET( arr, FALSE );
 	CHECK_RET( llsd_get_type( arr ) == LLSD_ARRAY, FALSE );
+	CHECK_RET( llsd_materialize( arr ), FALSE );
 	list_pop_tail( &(arr->array_) );
+	return TRUE;
 }
 
 int_t llsd_map_insert( llsd_t * map, llsd_t * key, llsd_t * value )
 {
-	pair_t * p = NULL;
+	llsd_pair_t * p = NULL;
 	CHECK_PTR_RET( map, FALSE );
 	CHECK_PTR_RET( key, FALSE );
 	CHECK_PTR_RET( value, FALSE );
 	CHECK_RET( llsd_get_type( map ) == LLSD_MAP, FALSE );
 	CHECK_RET( llsd_get_type( key ) == LLSD_STRING, FALSE );
-	p = pair_new( key, value );
+	CHECK_RET( llsd_materialize( map ), FALSE );
+	if ( map->map_.arena != NULL )
+		p = (llsd_pair_t*)llsd_arena_alloc( map->map_.arena, sizeof(llsd_pair_t) );
+	else
+		p = (llsd_pair_t*)MALLOC( sizeof(llsd_pair_t) );
 	CHECK_PTR_RET( p, FALSE );
-	if ( !ht_insert( &(map->map_), (void*)p ) )
+	p->key = key;
+	p->value = value;
+	if ( !ht_insert( &(map->map_.ht), (void*)p ) )
 	{
-		pair_delete( p );
+		if ( map->map_.arena == NULL )
+			FREE( p );
 		return FALSE;
 	}
 	return TRUE;
@@ -437,40 +603,43 @@ int_t llsd_map_insert( llsd_t * map, llsd_t * key, llsd_t * value )
 int_t llsd_map_remove( llsd_t * map, llsd_t * key )
 {
 	int ret = FALSE;
-	pair_t * p = NULL;
+	llsd_pair_t probe;
+	llsd_pair_t * p = NULL;
 	ht_itr_t itr;
 	CHECK_PTR_RET( map, FALSE );
 	CHECK_PTR_RET( key, FALSE );
 	CHECK_RET( llsd_get_type(map) == LLSD_MAP, FALSE );
 	CHECK_RET( llsd_get_type(key) == LLSD_STRING, FALSE );
+	CHECK_RET( llsd_materialize( map ), FALSE );
 
-	p = pair_new( key, NULL );
-	CHECK_PTR_RET( p, FALSE );
-	itr = ht_find( &map->map_, (void*)p );
-	pair_delete( p );
-	CHECK_RET( !ITR_EQ( itr, ht_itr_end( &map->map_ ) ), FALSE );
+	probe.key = key;
+	probe.value = NULL;
+	itr = ht_find( &map->map_.ht, (void*)&probe );
+	CHECK_RET( !ITR_EQ( itr, ht_itr_end( &map->map_.ht ) ), FALSE );
 
 	/* get the pair object */
-	p = ht_get( &map->map_, itr );
+	p = ht_get( &map->map_.ht, itr );
 	CHECK_PTR_RET( p, FALSE );
 
 	/* remove the pair from the map */
-	ret = ht_remove( &map->map_, itr );
+	ret = ht_remove( &map->map_.ht, itr );
 
 	/* now delete the two parts of the pair and the pair itself */
-	llsd_delete( pair_first( p ) );
-	llsd_delete( pair_second( p ) );
-	pair_delete( p );
+	llsd_delete( p->key );
+	llsd_delete( p->value );
+	if ( map->map_.arena == NULL )
+		FREE( p );
 
 	return ret;
 }
 
 llsd_itr_t llsd_itr_begin( llsd_t * llsd )
 {
-	llsd_itr_t itr;
+	llsd_itr_t itr = llsd_itr_end( llsd );
 	CHECK_PTR_RET( llsd, itr );
+	CHECK_RET( llsd_materialize( llsd ), itr );
 	itr.li = list_itr_end( &llsd->array_ );
-	itr.hi = ht_itr_end( &llsd->map_ );
+	itr.hi = ht_itr_end( &llsd->map_.ht );
 
 	switch ( llsd_get_type( llsd ) )
 	{
@@ -478,7 +647,7 @@ llsd_itr_t llsd_itr_begin( llsd_t * llsd )
 			itr.li = list_itr_begin( &llsd->array_ );
 			break;
 		case LLSD_MAP:
-			itr.hi = ht_itr_begin( &llsd->map_ );
+			itr.hi = ht_itr_begin( &llsd->map_.ht );
 			break;
 	}
 	return itr;
@@ -499,10 +668,11 @@ llsd_itr_t llsd_itr_end( llsd_t * llsd )
 
 llsd_itr_t llsd_itr_rbegin( llsd_t * llsd )
 {
-	llsd_itr_t itr;
+	llsd_itr_t itr = llsd_itr_rend( llsd );
 	CHECK_PTR_RET( llsd, itr );
+	CHECK_RET( llsd_materialize( llsd ), itr );
 	itr.li = list_itr_rend( &llsd->array_ );
-	itr.hi = ht_itr_rend( &llsd->map_ );
+	itr.hi = ht_itr_rend( &llsd->map_.ht );
 	
 	switch ( llsd_get_type( llsd ) )
 	{
@@ -510,7 +680,7 @@ llsd_itr_t llsd_itr_rbegin( llsd_t * llsd )
 			itr.li = list_itr_rbegin( &llsd->array_ );
 			break;
 		case LLSD_MAP:
-			itr.hi = ht_itr_rbegin( &llsd->map_ );
+			itr.hi = ht_itr_rbegin( &llsd->map_.ht );
 			break;
 	}
 	return itr;
@@ -527,7 +697,7 @@ llsd_itr_t llsd_itr_next( llsd_t * llsd, llsd_itr_t itr )
 			ret.li = list_itr_next( &llsd->array_, ret.li );
 			break;
 		case LLSD_MAP:
-			ret.hi = ht_itr_next( &llsd->map_, ret.hi );
+			ret.hi = ht_itr_next( &llsd->map_.ht, ret.hi );
 			break;
 	}
 	return ret;
@@ -544,7 +714,7 @@ llsd_itr_t llsd_itr_rnext( llsd_t * llsd, llsd_itr_t itr )
 			ret.li = list_itr_rnext( &llsd->array_, ret.li );
 			break;
 		case LLSD_MAP:
-			ret.hi = ht_itr_rnext( &llsd->map_, ret.hi );
+			ret.hi = ht_itr_rnext( &llsd->map_.ht, ret.hi );
 			break;
 	}
 	return ret;
@@ -552,11 +722,12 @@ llsd_itr_t llsd_itr_rnext( llsd_t * llsd, llsd_itr_t itr )
 
 int_t llsd_get( llsd_t * llsd, llsd_itr_t itr, llsd_t ** value, llsd_t ** key )
 {
-	pair_t * p;
+	llsd_pair_t * p;
 	CHECK_PTR_RET( value, FALSE );
 	CHECK_PTR_RET( key, FALSE );
 	CHECK_PTR_RET( llsd, FALSE );
 	CHECK_RET( !LLSD_ITR_EQ( itr, llsd_itr_end( llsd ) ), FALSE );
+	CHECK_RET( llsd_materialize( llsd ), FALSE );
 
 	switch ( llsd_get_type( llsd ) )
 	{
@@ -565,9 +736,9 @@ int_t llsd_get( llsd_t * llsd, llsd_itr_t itr, llsd_t ** value, llsd_t ** key )
 			(*key) = NULL;
 			return TRUE;
 		case LLSD_MAP:
-			p = (pair_t*)ht_get( &llsd->map_, itr.hi );
-			(*key) = pair_first( p );
-			(*value) = pair_second( p );
+			p = (llsd_pair_t*)ht_get( &llsd->map_.ht, itr.hi );
+			(*key) = p->key;
+			(*value) = p->value;
 			return TRUE;
 	}
 
@@ -579,40 +750,159 @@ int_t llsd_get( llsd_t * llsd, llsd_itr_t itr, llsd_t ** value, llsd_t ** key )
 
 llsd_t * llsd_map_find_llsd( llsd_t * map, llsd_t * key )
 {
-	pair_t * p = NULL;
+	llsd_pair_t probe;
+	llsd_pair_t * p = NULL;
 	ht_itr_t itr;
 	CHECK_PTR_RET( map, NULL );
 	CHECK_PTR_RET( key, NULL );
 	CHECK_RET( llsd_get_type(map) == LLSD_MAP, NULL );
 	CHECK_RET( llsd_get_type(key) == LLSD_STRING, NULL );
+	CHECK_RET( llsd_materialize( map ), NULL );
 
-	p = pair_new( key, NULL );
-	CHECK_PTR_RET( p, NULL );
-	itr = ht_find( &map->map_, (void*)p );
-	pair_delete( p );
-	CHECK_RET( !ITR_EQ( itr, ht_itr_end( &map->map_ ) ), NULL );
+	probe.key = key;
+	probe.value = NULL;
+	itr = ht_find( &map->map_.ht, (void*)&probe );
+	CHECK_RET( !ITR_EQ( itr, ht_itr_end( &map->map_.ht ) ), NULL );
 
-	p = ht_get( &map->map_, itr );
+	p = ht_get( &map->map_.ht, itr );
 	CHECK_PTR_RET( p, NULL );
 
-	return (llsd_t*)pair_second( p );
+	return p->value;
 }
 
 llsd_t * llsd_map_find( llsd_t * map, uint8_t const * const key )
+{
+	CHECK_PTR_RET( key, NULL );
+	return llsd_map_find_len( map, key, strlen( key ) );
+}
+
+llsd_t * llsd_map_find_len( llsd_t * map, uint8_t const * const key, uint32_t const len )
 {
 	llsd_t t;
-	ht_itr_t itr;
 	CHECK_PTR_RET( map, NULL );
 	CHECK_PTR_RET( key, NULL );
-	CHECK_MSG( llsd_get_type(map) == LLSD_MAP, "trying to insert k-v-p into non map\n" );
 
-	/* wrap the key in an llsd struct */
-	memset( &t, 0, sizeof( llsd_t ) );
+	/* wrap the key in an llsd struct on the stack */
+	MEMSET( &t, 0, sizeof( llsd_t ) );
 	t.type_ = LLSD_STRING;
-	t.string_ = (uint8_t*)key;
+	t.string_.ptr = (uint8_t*)key;
+	t.string_.len = len;
 	return llsd_map_find_llsd( map, &t );
 }
 
+int_t llsd_key_initialize( llsd_key_t * const key, uint8_t const * const str, uint32_t len )
+{
+	CHECK_PTR_RET( key, FALSE );
+	CHECK_PTR_RET( str, FALSE );
+
+	if ( len == LLSD_NUL_TERMINATED )
+		len = strlen( str );
+
+	key->ptr = str;
+	key->len = len;
+	key->hash = (uint32_t)llsd_hash( str, len );
+	return TRUE;
+}
+
+llsd_t * llsd_map_find_key( llsd_t * map, llsd_key_t const * const key )
+{
+	llsd_t t;
+	CHECK_PTR_RET( map, NULL );
+	CHECK_PTR_RET( key, NULL );
+
+	/* the probe carries the precomputed hash so it is never rehashed */
+	MEMSET( &t, 0, sizeof( llsd_t ) );
+	t.type_ = LLSD_STRING;
+	t.flags_ = LLSD_FLAG_HASHED;
+	t.hash_ = key->hash;
+	t.string_.ptr = (uint8_t*)key->ptr;
+	t.string_.len = key->len;
+	return llsd_map_find_llsd( map, &t );
+}
+
+static uint_t llsd_atom_hash( void const * const data )
+{
+	return llsd_key_hash( (llsd_t*)data );
+}
+
+static int_t llsd_atom_eq( void const * const l, void const * const r )
+{
+	return llsd_equal( (llsd_t*)l, (llsd_t*)r );
+}
+
+static void llsd_atom_delete( void * p )
+{
+	llsd_t * atom = (llsd_t*)p;
+	CHECK_PTR( atom );
+	if ( !STR_IS_INLINE( atom ) )
+		FREE( atom->string_.ptr );
+	FREE( atom );
+}
+
+llsd_intern_t * llsd_intern_new( uint_t const size )
+{
+	llsd_intern_t * intern = NULL;
+
+	intern = (llsd_intern_t*)CALLOC( 1, sizeof(llsd_intern_t) );
+	CHECK_PTR_RET( intern, NULL );
+
+	if ( !ht_initialize( &(intern->atoms), (size ? size : 64), &llsd_atom_hash, &llsd_atom_eq, &llsd_atom_delete ) )
+	{
+		FREE( intern );
+		return NULL;
+	}
+	return intern;
+}
+
+void llsd_intern_delete( void * p )
+{
+	llsd_intern_t * intern = (llsd_intern_t*)p;
+	CHECK_PTR( intern );
+	ht_deinitialize( &(intern->atoms) );
+	FREE( intern );
+}
+
+llsd_t * llsd_intern( llsd_intern_t * const intern, uint8_t const * const key, uint32_t len )
+{
+	llsd_t probe;
+	llsd_t * atom = NULL;
+	ht_itr_t itr;
+	CHECK_PTR_RET( intern, NULL );
+	CHECK_PTR_RET( key, NULL );
+
+	if ( len == LLSD_NUL_TERMINATED )
+		len = strlen( key );
+
+	/* wrap the key in a probe and look for it */
+	MEMSET( &probe, 0, sizeof(llsd_t) );
+	probe.type_ = LLSD_STRING;
+	probe.string_.ptr = (uint8_t*)key;
+	probe.string_.len = len;
+
+	itr = ht_find( &(intern->atoms), (void*)&probe );
+	if ( !ITR_EQ( itr, ht_itr_end( &(intern->atoms) ) ) )
+		return (llsd_t*)ht_get( &(intern->atoms), itr );
+
+	/* first time we have seen this key, it keeps the hash from the probe */
+	atom = (llsd_t*)CALLOC( 1, sizeof(llsd_t) );
+	CHECK_PTR_RET( atom, NULL );
+	atom->type_ = LLSD_STRING;
+	if ( !llsd_store_string( atom, NULL, &(atom->string_), (uint8_t*)key, len, FALSE ) )
+	{
+		FREE( atom );
+		return NULL;
+	}
+	atom->hash_ = probe.hash_;
+	atom->flags_ |= (probe.flags_ & LLSD_FLAG_HASHED) | LLSD_FLAG_INTERNED;
+
+	if ( !ht_insert( &(intern->atoms), (void*)atom ) )
+	{
+		llsd_atom_delete( atom );
+		return NULL;
+	}
+	return atom;
+}
+
 static llsd_uuid_t zero_uuid = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
 int_t llsd_as_boolean( llsd_t * llsd, int * v )
@@ -646,7 +936,7 @@ int_t llsd_as_boolean( llsd_t * llsd, int * v )
 			(*v) = (llsd->real_ != 0.0);
 			break;
 		case LLSD_STRING:
-			(*v) = (strlen( llsd->string_ ) != 0);
+			(*v) = (STR_LEN( llsd, string_ ) != 0);
 			break;
 		case LLSD_BINARY:
 			(*v) = (llsd->binary_.iov_len != 0);
@@ -655,10 +945,24 @@ int_t llsd_as_boolean( llsd_t * llsd, int * v )
 	return TRUE;
 }
 
+/* the bytes of a string being converted to a number, past any leading
+ * space like atoi skips */
+static uint8_t const * llsd_number_start( llsd_t * llsd, uint8_t const ** end )
+{
+	uint8_t const * p = STR_PTR( llsd, string_ );
+
+	(*end) = p + STR_LEN( llsd, string_ );
+	while ( (p < (*end)) && isspace( *p ) )
+		p++;
+	return p;
+}
+
 int_t llsd_as_integer( llsd_t * llsd, int32_t * v )
 {
 	int i;
 	uint32_t be = 0;
+	uint8_t const * p = NULL;
+	uint8_t const * end = NULL;
 	CHECK_PTR_RET( llsd, FALSE );
 	CHECK_PTR_RET( v, FALSE );
 	(*v) = 0;
@@ -694,7 +998,10 @@ int_t llsd_as_integer( llsd_t * llsd, int32_t * v )
 			(*v) = lrint( llsd->date_ );
 			break;
 		case LLSD_STRING:
-			(*v) = atoi( llsd->string_ );
+			/* like atoi, it is zero if it isn't a number */
+			p = llsd_number_start( llsd, &end );
+			if ( !llsd_number_parse_integer( &p, end, v ) )
+				(*v) = 0;
 			break;
 		case LLSD_BINARY:
 			if ( llsd->binary_.iov_len == 0 )
@@ -720,6 +1027,8 @@ int_t llsd_as_double( llsd_t * llsd, double * v )
 {
 	int i;
 	uint64_t be;
+	uint8_t const * p = NULL;
+	uint8_t const * end = NULL;
 	CHECK_PTR_RET( llsd, FALSE );
 	CHECK_PTR_RET( v, FALSE );
 	(*v) = 0.0;
@@ -744,7 +1053,10 @@ int_t llsd_as_double( llsd_t * llsd, double * v )
 			(*v) = llsd->real_;
 			break;
 		case LLSD_STRING:
-			(*v) = atof( llsd->string_ );
+			/* like atof, it is zero if it isn't a number */
+			p = llsd_number_start( llsd, &end );
+			if ( !llsd_number_parse_real( &p, end, v ) )
+				(*v) = 0.0;
 			break;
 		case LLSD_DATE:
 			(*v) = llsd->date_;
@@ -820,10 +1132,10 @@ int_t llsd_as_uuid( llsd_t * llsd, uint8_t uuid[UUID_LEN] )
 
 		case LLSD_STRING:
 			/* if len < UUID_STR_LEN, return null uuid */
-			if ( strlen( llsd->string_ ) < UUID_STR_LEN )
+			if ( STR_LEN( llsd, string_ ) < UUID_STR_LEN )
 				return TRUE;
 
-			p = llsd->string_;
+			p = STR_PTR( llsd, string_ );
 
 			/* check for 8-4-4-4-12 */
 			for ( i = 0; i < 36; i++ )
@@ -881,10 +1193,6 @@ int_t llsd_as_uuid( llsd_t * llsd, uint8_t uuid[UUID_LEN] )
 
 int_t llsd_as_string( llsd_t * llsd, uint8_t ** v )
 {
-	double int_time;
-	int32_t useconds;
-	time_t seconds;
-	struct tm parts;
 	uint8_t * p = NULL;
 	static uint8_t buf[UUID_STR_LEN + 1];
 	CHECK_PTR_RET( llsd, FALSE );
@@ -903,11 +1211,11 @@ int_t llsd_as_string( llsd_t * llsd, uint8_t ** v )
 			(*v) = buf;
 			break;
 		case LLSD_INTEGER:
-			snprintf( buf, UUID_STR_LEN, "%d", llsd->int_ );
+			llsd_number_format_integer( llsd->int_, buf );
 			(*v) = buf;
 			break;
 		case LLSD_REAL:
-			snprintf( buf, UUID_STR_LEN, "%f", llsd->real_ );
+			llsd_number_format_real( llsd->real_, buf );
 			(*v) = buf;
 			break;
 		case LLSD_UUID:
@@ -922,26 +1230,17 @@ int_t llsd_as_string( llsd_t * llsd, uint8_t ** v )
 			(*v) = buf;
 			break;
 		case LLSD_STRING:
-			(*v) = llsd->string_;
+			/* borrowed bytes may run on past len, there's no string to hand out */
+			CHECK_RET( !(llsd->flags_ & LLSD_FLAG_BORROWED), FALSE );
+			(*v) = STR_PTR( llsd, string_ );
 			break;
 		case LLSD_DATE:
-			int_time = floor( llsd->date_ );
-			seconds = (time_t)int_time;
-			useconds = (int32_t)( ( llsd->date_ - int_time) * 1000000.0 );
-			parts = *gmtime(&seconds);
-			snprintf( buf, UUID_STR_LEN + 1, 
-					  "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
-					  parts.tm_year + 1900,
-					  parts.tm_mon + 1,
-					  parts.tm_mday,
-					  parts.tm_hour,
-					  parts.tm_min,
-					  parts.tm_sec,
-					  ((useconds != 0) ? (int32_t)(useconds / 1000.f + 0.5f) : 0) );
+			CHECK_RET( llsd_date_format( llsd->date_, buf ) == DATE_STR_LEN, FALSE );
 			(*v) = buf;
 			break;
 		case LLSD_URI:
-			(*v) = llsd->uri_;
+			CHECK_RET( !(llsd->flags_ & LLSD_FLAG_BORROWED), FALSE );
+			(*v) = STR_PTR( llsd, uri_ );
 			break;
 		case LLSD_BINARY:
 			DEBUG( "Be careful! Binary to string conversion doesn't guarantee NULL termination\n" );
@@ -989,12 +1288,12 @@ int_t llsd_as_binary( llsd_t * llsd, uint8_t ** v, uint32_t * len )
 			(*v) = llsd->uuid_;
 			(*len) = UUID_LEN;
 		case LLSD_STRING:
-			(*v) = llsd->string_;
-			(*len) = strlen( llsd->string_ );
+			(*v) = STR_PTR( llsd, string_ );
+			(*len) = STR_LEN( llsd, string_ );
 			break;
 		case LLSD_URI:
-			(*v) = llsd->uri_;
-			(*len) = strlen( llsd->uri_ );
+			(*v) = STR_PTR( llsd, uri_ );
+			(*len) = STR_LEN( llsd, uri_ );
 			break;
 		case LLSD_BINARY:
 			(*v) = llsd->binary_.iov_base;
@@ -1028,13 +1327,19 @@ int_t llsd_equal( llsd_t * l, llsd_t * r )
 		case LLSD_UUID:
 			return (MEMCMP( l->uuid_, r->uuid_, UUID_LEN) == 0);
 		case LLSD_STRING:
-			return (STRCMP( l->string_, r->string_ ) == 0);
+			CHECK_RET( STR_LEN( l, string_ ) == STR_LEN( r, string_ ), FALSE );
+			return (MEMCMP( STR_PTR( l, string_ ), STR_PTR( r, string_ ), STR_LEN( l, string_ ) ) == 0);
 		case LLSD_URI:
-			return (STRCMP( l->uri_, r->uri_ ) == 0);
+			CHECK_RET( STR_LEN( l, uri_ ) == STR_LEN( r, uri_ ), FALSE );
+			return (MEMCMP( STR_PTR( l, uri_ ), STR_PTR( r, uri_ ), STR_LEN( l, uri_ ) ) == 0);
 		case LLSD_BINARY:
 			CHECK_RET( l->binary_.iov_len == r->binary_.iov_len, FALSE );
+			/* empty binaries may have no buffer at all */
+			if ( l->binary_.iov_len == 0 )
+				return TRUE;
 			return (MEMCMP( l->binary_.iov_base, r->binary_.iov_base, l->binary_.iov_len ) == 0);
 		case LLSD_ARRAY:
+			CHECK_RET( llsd_materialize( l ) && llsd_materialize( r ), FALSE );
 			CHECK_RET( list_count( &l->array_ ) == list_count( &r->array_ ), FALSE );
 			litr = llsd_itr_begin( l );
 			ritr = llsd_itr_begin( r );
@@ -1056,7 +1361,8 @@ int_t llsd_equal( llsd_t * l, llsd_t * r )
 			}
 			return ret;
 		case LLSD_MAP:
-			CHECK_RET( ht_count( &l->map_ ) == ht_count( &r->map_ ), FALSE );
+			CHECK_RET( llsd_materialize( l ) && llsd_materialize( r ), FALSE );
+			CHECK_RET( ht_count( &l->map_.ht ) == ht_count( &r->map_.ht ), FALSE );
 			litr = llsd_itr_begin( l );
 			lend = llsd_itr_end( l );
 			for ( ; !LLSD_ITR_EQ( litr, lend ); litr = llsd_itr_next( l, litr ) )
@@ -1096,19 +1402,21 @@ uint_t llsd_get_count( llsd_t * llsd )
 			return 1;
 
 		case LLSD_STRING:
-			return strlen( llsd->string_ );
+			return STR_LEN( llsd, string_ );
 
 		case LLSD_URI:
-			return strlen( llsd->uri_ );
+			return STR_LEN( llsd, uri_ );
 
 		case LLSD_BINARY:
 			return llsd->binary_.iov_len;
 
 		case LLSD_ARRAY:
+			CHECK_RET( llsd_materialize( llsd ), 0 );
 			return list_count( &llsd->array_ );
 
 		case LLSD_MAP:
-			return ht_count( &llsd->map_ );
+			CHECK_RET( llsd_materialize( llsd ), 0 );
+			return ht_count( &llsd->map_.ht );
 	}
 	return 0;
 }
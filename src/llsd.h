@@ -21,6 +21,8 @@
 #include <cutil/list.h>
 #include <cutil/hashtable.h>
 
+#include "llsd_arena.h"
+
 /* different sig lengths */
 
 typedef enum llsd_type_e
@@ -55,6 +57,7 @@ extern int8_t const * const llsd_type_strings[LLSD_TYPE_COUNT];
 
 typedef enum llsd_serializer_s
 {
+	LLSD_ENC_AUTODETECT = -1,	/* parsing only, pick the format from the data */
 	LLSD_ENC_XML,
 	LLSD_ENC_BINARY,
 	LLSD_ENC_NOTATION,
@@ -91,20 +94,47 @@ extern int8_t const * const llsd_notation_bin_enc_type_strings[LLSD_BIN_ENC_COUN
 #define UUID_STR_LEN (36)
 #define DATE_STR_LEN (24)
 
+/* pass as the length of a string/uri to have it measured with strlen */
+#define LLSD_NUL_TERMINATED (UINT32_MAX)
+
 typedef struct llsd_s llsd_t;
 
-/* new/delete llsd objects */
+/* pass as own_it to borrow string/uri/binary memory: the object points at it
+ * and never frees it, the caller keeps it alive as long as the object.
+ * borrowed strings and uris may not be null terminated, llsd_as_string fails
+ * on them, use llsd_as_binary to get their bytes and length. */
+#define LLSD_BORROW (2)
+
+/* new/delete llsd objects.  strings and uris take ( ptr, len, own_it ), the
+ * length may contain embedded nulls.  memory handed over with own_it must
+ * have a null byte at ptr[len]. */
 llsd_t * llsd_new( llsd_type_t type_, ... );
 void llsd_delete( void * p );
 
+/* same as llsd_new but the object and its string/binary data are allocated
+ * from the arena.  llsd_delete does nothing for these, they are released by
+ * llsd_arena_reset/llsd_arena_delete.  string/binary data passed in with
+ * own_it set is copied into the arena and FREE'd right away. */
+llsd_t * llsd_new_in( llsd_arena_t * const arena, llsd_type_t type_, ... );
+
+/* lazy containers, for parsers that can find a container's bytes without
+ * building its children.  the array/map keeps buf and calls fill the first
+ * time it is used, fill adds the children with llsd_array_append or
+ * llsd_map_insert, allocating them from arena if it isn't NULL.  count is
+ * only a size hint and buf must outlive the container. */
+typedef int_t (*llsd_lazy_fill_fn)( llsd_t * const container, llsd_arena_t * const arena, uint8_t const * const buf, size_t const len );
+llsd_t * llsd_new_lazy( llsd_arena_t * const arena, llsd_type_t const type_, uint32_t const count, uint8_t const * const buf, size_t const len, llsd_lazy_fill_fn fill );
+
 /* utility macros */
 #define llsd_new_undef() llsd_new( LLSD_UNDEF )
 #define llsd_new_boolean( val ) llsd_new ( LLSD_BOOLEAN, val )
 #define llsd_new_integer( val ) llsd_new ( LLSD_INTEGER, val )
 #define llsd_new_real( val ) llsd_new ( LLSD_REAL, val )
 #define llsd_new_uuid( bits ) llsd_new ( LLSD_UUID, bits )
-#define llsd_new_string( s, o ) llsd_new( LLSD_STRING, s, o )
-#define llsd_new_uri( s, o ) llsd_new( LLSD_URI, s, o )
+#define llsd_new_string( s, o ) llsd_new( LLSD_STRING, s, LLSD_NUL_TERMINATED, o )
+#define llsd_new_string_len( s, len, o ) llsd_new( LLSD_STRING, s, len, o )
+#define llsd_new_uri( s, o ) llsd_new( LLSD_URI, s, LLSD_NUL_TERMINATED, o )
+#define llsd_new_uri_len( s, len, o ) llsd_new( LLSD_URI, s, len, o )
 #define llsd_new_binary( p, len, o ) llsd_new( LLSD_BINARY, p, len, o )
 #define llsd_new_date( d ) llsd_new( LLSD_DATE, d )
 #define llsd_new_array( s ) llsd_new( LLSD_ARRAY, s )
@@ -140,6 +170,30 @@ llsd_itr_t llsd_itr_rnext( llsd_t * llsd, llsd_itr_t itr );
 int_t llsd_get( llsd_t * llsd, llsd_itr_t itr, llsd_t ** value, llsd_t ** key );
 llsd_t * llsd_map_find_llsd( llsd_t * map, llsd_t * key );
 llsd_t * llsd_map_find( llsd_t * map, uint8_t const * const key );
+llsd_t * llsd_map_find_len( llsd_t * map, uint8_t const * const key, uint32_t const len );
+
+/* a map key with its hash precomputed, for looking up the same field names
+ * over and over.  the key bytes are not copied and must outlive the handle.
+ * the hash depends on the process hash key so initialize handles after any
+ * call to llsd_hash_seed. */
+typedef struct llsd_key_s
+{
+	uint8_t const *	ptr;
+	uint32_t		len;
+	uint32_t		hash;
+} llsd_key_t;
+int_t llsd_key_initialize( llsd_key_t * const key, uint8_t const * const str, uint32_t len );
+llsd_t * llsd_map_find_key( llsd_t * map, llsd_key_t const * const key );
+
+/* map key interning.  llsd_intern returns the table's one shared string
+ * object for the key, with its hash computed once, so maps skip hashing it
+ * and match it by pointer.  interned keys are immutable and llsd_delete
+ * ignores them; they are freed with the table, so the table must outlive
+ * every map that uses them. */
+typedef struct llsd_intern_s llsd_intern_t;
+llsd_intern_t * llsd_intern_new( uint_t const size );
+void llsd_intern_delete( void * p );
+llsd_t * llsd_intern( llsd_intern_t * const intern, uint8_t const * const key, uint32_t len );
 
 /* conversion interface */
 int_t llsd_as_boolean( llsd_t * llsd, int * v );
@@ -156,6 +210,12 @@ int_t llsd_equal( llsd_t * l, llsd_t * r );
 uint_t llsd_get_count( llsd_t * llsd );
 #define llsd_is_empty(x) (llsd_get_count(x) == 0)
 
+/* a string_fn called for a map key may return this instead of TRUE to have
+ * the parser pass over the key's value.  the value is still checked, but the
+ * ops only see map_value_begin_fn and map_value_end_fn for it, as if it held
+ * nothing.  no value callback and nothing inside it is reported. */
+#define LLSD_SKIP (2)
+
 /* callback functions used for parsing/serializing */
 typedef struct llsd_ops_s
 {
@@ -164,9 +224,9 @@ typedef struct llsd_ops_s
 	int_t (*integer_fn)( int32_t const value, void * const user_data );
 	int_t (*real_fn)( double const value, void * const user_data );
 	int_t (*uuid_fn)( uint8_t const value[UUID_LEN], void * const user_data );
-	int_t (*string_fn)( uint8_t const * str, int const own_it, void * const user_data );
+	int_t (*string_fn)( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data );
 	int_t (*date_fn)( double const value, void * const user_data );
-	int_t (*uri_fn)( uint8_t const * uri, int const own_it, void * const user_data );
+	int_t (*uri_fn)( uint8_t const * uri, uint32_t const len, int const own_it, void * const user_data );
 	int_t (*binary_fn)( uint8_t const * data, uint32_t const len, int const own_it, void * const user_data );
 	int_t (*array_begin_fn)( uint_t const size, void * const user_data );
 	int_t (*array_value_begin_fn)(void * const user_data);
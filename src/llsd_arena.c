@@ -0,0 +1,216 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd_arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN (16)
+#define ALIGN_UP(x) (((x) + (ARENA_ALIGN - 1)) & ~((size_t)ARENA_ALIGN - 1))
+
+typedef struct arena_block_s
+{
+	struct arena_block_s * next;
+	size_t size;
+	size_t used;
+} arena_block_t;
+
+/* the block header is padded so the data after it stays aligned */
+#define BLOCK_HEADER_SIZE ALIGN_UP(sizeof(arena_block_t))
+#define BLOCK_DATA(b) (((uint8_t*)(b)) + BLOCK_HEADER_SIZE)
+
+typedef struct arena_cleanup_s
+{
+	struct arena_cleanup_s * next;
+	llsd_arena_cleanup_fn fn;
+	void * p;
+} arena_cleanup_t;
+
+struct llsd_arena_s
+{
+	arena_block_t * blocks;		/* current block first */
+	size_t block_size;
+	arena_cleanup_t * cleanups;	/* most recent first */
+};
+
+static arena_block_t * arena_block_new( size_t const size )
+{
+	arena_block_t * block = NULL;
+	block = (arena_block_t*)MALLOC( BLOCK_HEADER_SIZE + size );
+	CHECK_PTR_RET( block, NULL );
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+llsd_arena_t * llsd_arena_new( size_t const block_size )
+{
+	llsd_arena_t * arena = NULL;
+
+	arena = CALLOC( 1, sizeof(llsd_arena_t) );
+	CHECK_PTR_RET( arena, NULL );
+
+	arena->block_size = ALIGN_UP( block_size ? block_size : ARENA_BLOCK_SIZE );
+	arena->blocks = arena_block_new( arena->block_size );
+	if ( arena->blocks == NULL )
+	{
+		FREE( arena );
+		return NULL;
+	}
+
+	return arena;
+}
+
+static void arena_run_cleanups( llsd_arena_t * const arena )
+{
+	arena_cleanup_t * c = NULL;
+
+	/* the cleanup records live in the arena, so grab next before running fn */
+	while ( arena->cleanups != NULL )
+	{
+		c = arena->cleanups;
+		arena->cleanups = c->next;
+		(*(c->fn))( c->p );
+	}
+}
+
+void llsd_arena_delete( void * p )
+{
+	arena_block_t * b = NULL;
+	llsd_arena_t * arena = (llsd_arena_t*)p;
+	CHECK_PTR( arena );
+
+	arena_run_cleanups( arena );
+
+	while ( arena->blocks != NULL )
+	{
+		b = arena->blocks;
+		arena->blocks = b->next;
+		FREE( b );
+	}
+
+	FREE( arena );
+}
+
+void llsd_arena_reset( llsd_arena_t * const arena )
+{
+	arena_block_t * b = NULL;
+	arena_block_t * keep = NULL;
+	CHECK_PTR( arena );
+
+	arena_run_cleanups( arena );
+
+	/* keep one standard sized block, oversized ones go back to the heap */
+	while ( arena->blocks != NULL )
+	{
+		b = arena->blocks;
+		arena->blocks = b->next;
+		if ( (keep == NULL) && (b->size == arena->block_size) )
+			keep = b;
+		else
+			FREE( b );
+	}
+
+	if ( keep != NULL )
+	{
+		keep->next = NULL;
+		keep->used = 0;
+	}
+	arena->blocks = keep;
+}
+
+void * llsd_arena_alloc( llsd_arena_t * const arena, size_t const size )
+{
+	void * p = NULL;
+	size_t n = ALIGN_UP( size );
+	arena_block_t * b = NULL;
+	CHECK_PTR_RET( arena, NULL );
+	CHECK_RET( n >= size, NULL );
+
+	b = arena->blocks;
+	if ( (b != NULL) && ((b->size - b->used) >= n) )
+	{
+		p = BLOCK_DATA( b ) + b->used;
+		b->used += n;
+		return p;
+	}
+
+	if ( n > (arena->block_size / 4) )
+	{
+		/* big allocations get their own block behind the current one so
+		 * the free space left in the current block isn't wasted */
+		b = arena_block_new( n );
+		CHECK_PTR_RET( b, NULL );
+		b->used = n;
+		if ( arena->blocks != NULL )
+		{
+			b->next = arena->blocks->next;
+			arena->blocks->next = b;
+		}
+		else
+			arena->blocks = b;
+		return BLOCK_DATA( b );
+	}
+
+	/* start a new current block */
+	b = arena_block_new( arena->block_size );
+	CHECK_PTR_RET( b, NULL );
+	b->next = arena->blocks;
+	arena->blocks = b;
+
+	p = BLOCK_DATA( b );
+	b->used = n;
+	return p;
+}
+
+uint8_t * llsd_arena_memdup( llsd_arena_t * const arena, void const * const p, size_t const len )
+{
+	uint8_t * d = NULL;
+	CHECK_PTR_RET( arena, NULL );
+	CHECK_RET( (p != NULL) || (len == 0), NULL );
+
+	d = (uint8_t*)llsd_arena_alloc( arena, len + 1 );
+	CHECK_PTR_RET( d, NULL );
+	if ( len > 0 )
+		MEMCPY( d, p, len );
+	d[len] = '\0';
+
+	return d;
+}
+
+int llsd_arena_add_cleanup( llsd_arena_t * const arena, llsd_arena_cleanup_fn fn, void * p )
+{
+	arena_cleanup_t * c = NULL;
+	CHECK_PTR_RET( arena, FALSE );
+	CHECK_PTR_RET( fn, FALSE );
+
+	c = (arena_cleanup_t*)llsd_arena_alloc( arena, sizeof(arena_cleanup_t) );
+	CHECK_PTR_RET( c, FALSE );
+	c->fn = fn;
+	c->p = p;
+	c->next = arena->cleanups;
+	arena->cleanups = c;
+
+	return TRUE;
+}
+
@@ -0,0 +1,49 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef LLSD_ARENA_H
+#define LLSD_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* a bump allocator for request scoped llsd documents.  everything allocated
+ * from an arena is released at once by llsd_arena_reset or llsd_arena_delete,
+ * there is no way to free a single allocation. */
+typedef struct llsd_arena_s llsd_arena_t;
+
+/* pass 0 for the default block size */
+llsd_arena_t * llsd_arena_new( size_t const block_size );
+void llsd_arena_delete( void * p );
+
+/* runs the cleanups and releases everything, keeping the first block around
+ * so a reused arena doesn't go back to the heap */
+void llsd_arena_reset( llsd_arena_t * const arena );
+
+/* returns size bytes aligned for any type, or NULL */
+void * llsd_arena_alloc( llsd_arena_t * const arena, size_t const size );
+
+/* copies len bytes into the arena and NUL terminates them */
+uint8_t * llsd_arena_memdup( llsd_arena_t * const arena, void const * const p, size_t const len );
+
+/* registers fn( p ) to run when the arena is reset, cleanups run in reverse
+ * order of registration.  used for memory the arena doesn't own, like the
+ * storage of the cutil containers. */
+typedef void (*llsd_arena_cleanup_fn)( void * p );
+int llsd_arena_add_cleanup( llsd_arena_t * const arena, llsd_arena_cleanup_fn fn, void * p );
+
+#endif/*LLSD_ARENA_H*/
+
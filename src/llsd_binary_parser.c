@@ -16,10 +16,10 @@
 
 #include <cutil/debug.h>
 #include <cutil/macros.h>
-#include <cutil/list.h>
 
 #include "llsd.h"
 #include "llsd_binary_parser.h"
+#include "llsd_stack.h"
 
 #define BINARY_SIG_LEN (18)
 static uint8_t const * const binary_header = "<? LLSD/Binary ?>\n";
@@ -43,14 +43,19 @@ int llsd_binary_check_sig_file( FILE * fin )
 
 typedef struct bs_state_s
 {
-	list_t * state_stack;
-	llsd_ops_t * ops;
+	llsd_stack_t state_stack;
+	llsd_ops_t const * ops;
 	void * user_data;
+	size_t need;	/* bytes needed to finish a value cut off at the end of a chunk */
+	int borrow;		/* hand out pointers into the buffer instead of copies */
+	int skip;		/* the string_fn for a map key asked to skip its value */
+	int step;		/* stop after each token, see llsd_binary_parser_next */
 } bs_state_t;
 
-#define PUSH(x) (list_push_head( parser_state->state_stack, (void*)x ))
-#define TOP		((uint_t)list_get_head( parser_state->state_stack ))
-#define POP		(list_pop_head( parser_state->state_stack))
+#define PUSH(x) (llsd_stack_push( &(parser_state->state_stack), (uintptr_t)(x) ))
+#define TOP		((uint_t)llsd_stack_top( &(parser_state->state_stack) ))
+#define POP		(llsd_stack_pop( &(parser_state->state_stack) ))
+#define SET(x)	(llsd_stack_set_top( &(parser_state->state_stack), (uintptr_t)(x) ))
 
 #define BEGIN_VALUE_STATES ( TOP_LEVEL | ARRAY_BEGIN | ARRAY_VALUE_END | MAP_KEY_END )
 #define BEGIN_STRING_STATES ( BEGIN_VALUE_STATES | MAP_VALUE_END | MAP_BEGIN )
@@ -63,7 +68,6 @@ static int begin_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * p
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -87,13 +91,11 @@ static int begin_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * p
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -106,19 +108,16 @@ static int begin_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * p
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_BEGIN:
 				case MAP_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->map_key_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_KEY_BEGIN );
+					SET( MAP_KEY_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -140,7 +139,6 @@ static int value( uint32_t valid_states, llsd_type_t type_, bs_state_t * parser_
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -162,12 +160,10 @@ static int value( uint32_t valid_states, llsd_type_t type_, bs_state_t * parser_
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -178,16 +174,13 @@ static int value( uint32_t valid_states, llsd_type_t type_, bs_state_t * parser_
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					break;
 				case MAP_KEY_BEGIN:
-					POP;
-					PUSH( MAP_KEY );
+					SET( MAP_KEY );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -209,7 +202,6 @@ static int end_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * par
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -232,13 +224,11 @@ static int end_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * par
 			{
 				case ARRAY_VALUE:
 					CHECK_RET( (*(parser_state->ops->array_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_END );
+					SET( ARRAY_VALUE_END );
 					break;
 				case MAP_VALUE:
 					CHECK_RET( (*(parser_state->ops->map_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_END );
+					SET( MAP_VALUE_END );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -250,18 +240,15 @@ static int end_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * par
 			{
 				case ARRAY_VALUE:
 					CHECK_RET( (*(parser_state->ops->array_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_END );
+					SET( ARRAY_VALUE_END );
 					break;
 				case MAP_VALUE:
 					CHECK_RET( (*(parser_state->ops->map_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_END );
+					SET( MAP_VALUE_END );
 					break;
 				case MAP_KEY:
 					CHECK_RET( (*(parser_state->ops->map_key_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_KEY_END );
+					SET( MAP_KEY_END );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -272,216 +259,786 @@ static int end_value( uint32_t valid_states, llsd_type_t type_, bs_state_t * par
 	return TRUE;
 }
 
-int llsd_binary_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data )
+/* reads a big endian 32-bit integer from the buffer and advances the pointer */
+#define READ_BE32( p, v ) { MEMCPY( &(v), (p), sizeof(uint32_t) ); (v) = ntohl( (v) ); (p) += sizeof(uint32_t); }
+
+/* reads a big endian 64-bit value from the buffer and advances the pointer */
+#define READ_BE64( p, v ) { MEMCPY( &(v), (p), sizeof(uint64_t) ); (v) = be64toh( (v) ); (p) += sizeof(uint64_t); }
+
+/* checks that there are at least n bytes left in the buffer */
+#define HAS_BYTES( p, end, n ) ( (size_t)((end) - (p)) >= (size_t)(n) )
+
+int llsd_binary_check_sig_buffer( uint8_t const * const buf, size_t const len )
+{
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( len >= BINARY_SIG_LEN, FALSE );
+
+	/* if it matches the signature, return TRUE, otherwise FALSE */
+	return ( memcmp( buf, binary_header, BINARY_SIG_LEN ) == 0 );
+}
+
+/* checks that n more bytes are there.  if the chunk ends mid value and more
+ * data is coming, rewind to the start of the value and wait for the rest */
+#define NEED( n ) \
+	do { \
+		if ( !HAS_BYTES( p, end, (n) ) ) \
+		{ \
+			if ( more ) \
+			{ \
+				parser_state->need = (size_t)(p - tok) + (size_t)(n); \
+				p = tok; \
+				goto need_more; \
+			} \
+			goto fail_binary_parse; \
+		} \
+	} while(0)
+
+/* copies a string/uri/binary value out of the buffer with a null byte added
+ * at the end, or points right at it when borrowing */
+static int copy_value( bs_state_t * const parser_state, uint8_t const * const p, uint32_t const len, uint8_t ** const buffer )
+{
+	if ( parser_state->borrow )
+	{
+		(*buffer) = (uint8_t*)p;
+		return TRUE;
+	}
+
+	(*buffer) = CALLOC( len + 1, sizeof(uint8_t) );
+	CHECK_PTR_RET( (*buffer), FALSE );
+	MEMCPY( (*buffer), p, len );
+	return TRUE;
+}
+
+/* returns the end of the value at p without building anything */
+static uint8_t const * binary_skip_value( uint8_t const * p, uint8_t const * const end )
 {
-	size_t ret;
-	uint8_t p = '\0';
-	uint8_t uuid[UUID_LEN];
-	uint8_t * buffer;
 	uint32_t be_int;
-	uint64_t be_real;
-	bs_state_t * parser_state = NULL;
+	uint_t depth = 0;
 
-	CHECK_PTR_RET( fin, FALSE );
-	CHECK_PTR_RET( ops, FALSE );
+	do
+	{
+		CHECK_RET( p < end, NULL );
+		switch( *p++ )
+		{
+			case '!':
+			case '1':
+			case '0':
+				break;
 
-	/* set up step stack, used to synthesize array value end, map key end, 
-	 * and map value end callbacks */
-	parser_state = CALLOC( 1, sizeof(bs_state_t) );
-	CHECK_PTR_RET( parser_state, FALSE );
-	parser_state->state_stack = list_new( 1, NULL );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
-	parser_state->ops = ops;
-	parser_state->user_data = user_data;
+			case 'i':
+				CHECK_RET( HAS_BYTES( p, end, sizeof(uint32_t) ), NULL );
+				p += sizeof(uint32_t);
+				break;
 
-	/* start in the top level state */
-	PUSH( TOP_LEVEL );
+			case 'r':
+			case 'd':
+				CHECK_RET( HAS_BYTES( p, end, sizeof(uint64_t) ), NULL );
+				p += sizeof(uint64_t);
+				break;
 
-	/* seek past signature */
-	fseek( fin, BINARY_SIG_LEN, SEEK_SET );
+			case 'u':
+				CHECK_RET( HAS_BYTES( p, end, UUID_LEN ), NULL );
+				p += UUID_LEN;
+				break;
+
+			case 's':
+			case 'l':
+			case 'b':
+				CHECK_RET( HAS_BYTES( p, end, sizeof(uint32_t) ), NULL );
+				READ_BE32( p, be_int );
+				CHECK_RET( HAS_BYTES( p, end, be_int ), NULL );
+				p += be_int;
+				break;
 
-	while( TRUE )
+			case '[':
+			case '{':
+				CHECK_RET( HAS_BYTES( p, end, sizeof(uint32_t) ), NULL );
+				p += sizeof(uint32_t);
+				depth++;
+				break;
+
+			case ']':
+			case '}':
+				CHECK_RET( depth > 0, NULL );
+				depth--;
+				break;
+
+			default:
+				DEBUG("invalid type byte: %c\n", *(p - 1) );
+				return NULL;
+		}
+	} while ( depth > 0 );
+
+	return p;
+}
+
+/* parses the values in buf, (*used) is set to how many bytes were consumed.
+ * when more is TRUE a value cut off at the end of buf is left for the next
+ * call instead of being an error. */
+static int llsd_binary_parse_values( bs_state_t * const parser_state, uint8_t const * const buf, size_t const len, int const more, size_t * const used )
+{
+	uint8_t t = '\0';
+	uint8_t const * p = buf;
+	uint8_t const * tok = buf;
+	uint8_t const * const end = buf + len;
+	uint8_t * buffer;
+	uint32_t be_int;
+	uint64_t be_real;
+	int_t ret;
+	llsd_ops_t const * const ops = parser_state->ops;
+	void * const user_data = parser_state->user_data;
+	int const own_it = (parser_state->borrow ? LLSD_BORROW : TRUE);
+
+	parser_state->need = 0;
+
+	while( p < end )
 	{
-		/* read the type marker */
-		ret = fread( &p, sizeof(uint8_t), 1, fin );
-		if ( feof( fin ) )
-			return TRUE;
+		if ( parser_state->skip )
+		{
+			/* jump over the value, the ops still see it begin and end */
+			parser_state->skip = FALSE;
+			p = binary_skip_value( p, end );
+			CHECK_GOTO( p != NULL, fail_binary_parse );
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_binary_parse );
+			CHECK_GOTO( value( VALUE_STATES, LLSD_UNDEF, parser_state ), fail_binary_parse );
+			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_binary_parse );
+			if ( parser_state->step )
+				break;
+			continue;
+		}
 
-		CHECK_RET( ret == 1, FALSE );
+		/* read the type marker */
+		tok = p;
+		t = *p++;
 
-		switch( p )
+		switch( t )
 		{
 
 			case '!':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), FALSE );
-				CHECK_RET( (*(ops->undef_fn))( user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_UNDEF, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_UNDEF, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->undef_fn))( user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_UNDEF, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_binary_parse );
 				break;
 
 			case '1':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( (*(ops->boolean_fn))( TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->boolean_fn))( TRUE, user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_binary_parse );
 				break;
 
 			case '0':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( (*(ops->boolean_fn))( FALSE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->boolean_fn))( FALSE, user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_binary_parse );
 				break;
 
 			case 'i':
-				CHECK_RET( fread( &be_int, sizeof(uint32_t), 1, fin ) == 1, FALSE );
+				NEED( sizeof(uint32_t) );
+				READ_BE32( p, be_int );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_INTEGER, parser_state ), FALSE );
-				CHECK_RET( (*(ops->integer_fn))( ntohl( be_int ), user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_INTEGER, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_INTEGER, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_INTEGER, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->integer_fn))( (int32_t)be_int, user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_INTEGER, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_INTEGER, parser_state ), fail_binary_parse );
 				break;
 
 			case 'r':
-				CHECK_RET( fread( &be_real, sizeof(uint64_t), 1, fin ) == 1, FALSE );
-				be_real = be64toh( be_real );
+				NEED( sizeof(uint64_t) );
+				READ_BE64( p, be_real );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_REAL, parser_state ), FALSE );
-				CHECK_RET( (*(ops->real_fn))( *((double*)&be_real), user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_REAL, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_REAL, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_REAL, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->real_fn))( *((double*)&be_real), user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_REAL, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_REAL, parser_state ), fail_binary_parse );
 				break;
 
 			case 'u':
-				CHECK_RET( fread( uuid, sizeof(uint8_t), UUID_LEN, fin ) == UUID_LEN, FALSE );
+				NEED( UUID_LEN );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_UUID, parser_state ), FALSE );
-				CHECK_RET( (*(ops->uuid_fn))( uuid, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_UUID, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_UUID, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UUID, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->uuid_fn))( p, user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_UUID, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_UUID, parser_state ), fail_binary_parse );
+				p += UUID_LEN;
 				break;
 
 			case 'b':
-				CHECK_RET( fread( &be_int, sizeof(uint32_t), 1, fin ) == 1, FALSE );
-				be_int = ntohl( be_int );
-				buffer = CALLOC( be_int, sizeof(uint8_t) );
-				CHECK_PTR_RET( buffer, FALSE );
-				ret = fread( buffer, sizeof(uint8_t), be_int, fin );
-				if ( ret != be_int )
+				NEED( sizeof(uint32_t) );
+				READ_BE32( p, be_int );
+				NEED( be_int );
+				CHECK_GOTO( copy_value( parser_state, p, be_int, &buffer ), fail_binary_parse );
+				p += be_int;
+
+				if ( !begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ) )
 				{
-					FREE( buffer );
-					return FALSE;
+					if ( !parser_state->borrow )
+						FREE( buffer );
+					goto fail_binary_parse;
 				}
-
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->binary_fn))( buffer, be_int, TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BINARY, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_BINARY, parser_state ), FALSE );
+				/* tell it to take ownership of the memory, or borrow it */
+				CHECK_GOTO( (*(ops->binary_fn))( buffer, be_int, own_it, user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BINARY, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_BINARY, parser_state ), fail_binary_parse );
 
 				buffer = NULL;
 				break;
 
 			case 's':
 				/* in the binary format, strings are the raw byte values */
-				CHECK_RET( fread( &be_int, sizeof(uint32_t), 1, fin ) == 1, FALSE );
-				be_int = ntohl( be_int );
-				buffer = CALLOC( be_int + 1, sizeof(uint8_t) ); /* add a null byte at the end */
-				CHECK_PTR_RET( buffer, FALSE );
-				ret = fread( buffer, sizeof(uint8_t), be_int, fin );
-				if ( ret != be_int )
+				NEED( sizeof(uint32_t) );
+				READ_BE32( p, be_int );
+				NEED( be_int );
+				CHECK_GOTO( copy_value( parser_state, p, be_int, &buffer ), fail_binary_parse );
+				p += be_int;
+
+				if ( !begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ) )
 				{
-					FREE( buffer );
-					return FALSE;
+					if ( !parser_state->borrow )
+						FREE( buffer );
+					goto fail_binary_parse;
 				}
+				/* tell it to take ownership of the memory, or borrow it */
+				ret = (*(ops->string_fn))( buffer, be_int, own_it, user_data );
+				CHECK_GOTO( ret, fail_binary_parse );
+				CHECK_GOTO( value( STRING_STATES, LLSD_STRING, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_STRING_STATES, LLSD_STRING, parser_state ), fail_binary_parse );
 
-				CHECK_RET( begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->string_fn))( buffer, TRUE, user_data ), FALSE );
-				CHECK_RET( value( STRING_STATES, LLSD_STRING, parser_state ), FALSE );
-				CHECK_RET( end_value( END_STRING_STATES, LLSD_STRING, parser_state ), FALSE );
+				/* a skipped key's value is only jumped over when the whole
+				 * value is in this buffer */
+				if ( (ret == LLSD_SKIP) && (TOP == MAP_KEY_END) && !more )
+					parser_state->skip = TRUE;
 
 				buffer = NULL;
 				break;
 
 			case 'l':
 				/* in the binary format, uri's are the raw byte values */
-				CHECK_RET( fread( &be_int, sizeof(uint32_t), 1, fin ) == 1, FALSE );
-				be_int = ntohl( be_int );
-				buffer = CALLOC( be_int + 1, sizeof(uint8_t) ); /* add a null byte at the end */
-				CHECK_PTR_RET( buffer, FALSE );
-				ret = fread( buffer, sizeof(uint8_t), be_int, fin );
-				if ( ret != be_int )
+				NEED( sizeof(uint32_t) );
+				READ_BE32( p, be_int );
+				NEED( be_int );
+				CHECK_GOTO( copy_value( parser_state, p, be_int, &buffer ), fail_binary_parse );
+				p += be_int;
+
+				if ( !begin_value( BEGIN_VALUE_STATES, LLSD_URI, parser_state ) )
 				{
-					FREE( buffer );
-					return FALSE;
+					if ( !parser_state->borrow )
+						FREE( buffer );
+					goto fail_binary_parse;
 				}
-
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_URI, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->uri_fn))( buffer, TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_URI, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_URI, parser_state ), FALSE );
+				/* tell it to take ownership of the memory, or borrow it */
+				CHECK_GOTO( (*(ops->uri_fn))( buffer, be_int, own_it, user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_URI, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_URI, parser_state ), fail_binary_parse );
 
 				buffer = NULL;
 				break;
 
 			case 'd':
-				CHECK_RET( fread( &be_real, sizeof(double), 1, fin ) == 1, FALSE );
-				be_real = be64toh( be_real );
+				NEED( sizeof(double) );
+				READ_BE64( p, be_real );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_DATE, parser_state ), FALSE );
-				CHECK_RET( (*(ops->date_fn))( *((double*)&be_real), user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_DATE, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_DATE, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_DATE, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->date_fn))( *((double*)&be_real), user_data ), fail_binary_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_DATE, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_DATE, parser_state ), fail_binary_parse );
 				break;
 
 			case '[':
-				CHECK_RET( fread( &be_int, sizeof(uint32_t), 1, fin ) == 1, FALSE );
-				be_int = ntohl( be_int );
+				NEED( sizeof(uint32_t) );
+				READ_BE32( p, be_int );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ), FALSE );
-				CHECK_RET( (*(ops->array_begin_fn))( be_int, user_data ), FALSE );
-				PUSH( ARRAY_BEGIN );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->array_begin_fn))( be_int, user_data ), fail_binary_parse );
+				CHECK_GOTO( PUSH( ARRAY_BEGIN ), fail_binary_parse );
 				break;
 
 			case ']':
-				CHECK_RET( (*(ops->array_end_fn))( 0, user_data ), FALSE );
+				CHECK_GOTO( (*(ops->array_end_fn))( 0, user_data ), fail_binary_parse );
 				POP;
-				CHECK_RET( value( VALUE_STATES, LLSD_ARRAY, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_ARRAY, parser_state ), FALSE );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_ARRAY, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_ARRAY, parser_state ), fail_binary_parse );
 				break;
 			
 			case '{':
-				CHECK_RET( fread( &be_int, sizeof(uint32_t), 1, fin ) == 1, FALSE );
-				be_int = ntohl( be_int );
+				NEED( sizeof(uint32_t) );
+				READ_BE32( p, be_int );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ), FALSE );
-				CHECK_RET( (*(ops->map_begin_fn))( be_int, user_data ), FALSE );
-				PUSH( MAP_BEGIN );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ), fail_binary_parse );
+				CHECK_GOTO( (*(ops->map_begin_fn))( be_int, user_data ), fail_binary_parse );
+				CHECK_GOTO( PUSH( MAP_BEGIN ), fail_binary_parse );
 				break;
 
 			case '}':
-				CHECK_RET( (*(ops->map_end_fn))( 0, user_data ), FALSE );
+				CHECK_GOTO( (*(ops->map_end_fn))( 0, user_data ), fail_binary_parse );
 				POP;
-				CHECK_RET( value( VALUE_STATES, LLSD_MAP, parser_state ), FALSE );
-				CHECK_RET( end_value( END_VALUE_STATES, LLSD_MAP, parser_state ), FALSE );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_MAP, parser_state ), fail_binary_parse );
+				CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_MAP, parser_state ), fail_binary_parse );
 				break;
 
 			default:
-				DEBUG("invalid type byte: %c\n", p );
-				return FALSE;
+				DEBUG("invalid type byte: %c\n", t );
+				goto fail_binary_parse;
 		}
+
+		if ( parser_state->step )
+			break;
 	}
 
-	/* clean up the step stack */
-	CHECK_RET( TOP == TOP_LEVEL, FALSE );
-	list_delete( parser_state->state_stack );
+need_more:
+	(*used) = (size_t)(p - buf);
+	return TRUE;
+
+fail_binary_parse:
+	return FALSE;
+}
+
+int llsd_binary_parse_buffer_ctx( llsd_binary_parser_t * const state, uint8_t const * const buf, size_t const len, int const borrow, llsd_ops_t const * const ops, void * const user_data )
+{
+	size_t skip = 0;
+	size_t used = 0;
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( llsd_binary_parser_reset( state, ops, user_data ), FALSE );
+	state->borrow = borrow;
+
+	/* skip past signature */
+	if ( llsd_binary_check_sig_buffer( buf, len ) )
+		skip = BINARY_SIG_LEN;
+
+	return llsd_binary_parser_feed( state, buf + skip, len - skip, TRUE, &used );
+}
+
+static int binary_parse_buffer( uint8_t const * const buf, size_t const len, int const borrow, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	llsd_binary_parser_t * state = NULL;
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	state = llsd_binary_parser_new( ops, user_data );
+	CHECK_PTR_RET( state, FALSE );
+
+	ret = llsd_binary_parse_buffer_ctx( state, buf, len, borrow, ops, user_data );
+
+	llsd_binary_parser_delete( state );
+
+	return ret;
+}
+
+int llsd_binary_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	return binary_parse_buffer( buf, len, FALSE, ops, user_data );
+}
+
+int llsd_binary_parse_buffer_borrowed( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	return binary_parse_buffer( buf, len, TRUE, ops, user_data );
+}
+
+llsd_binary_parser_t * llsd_binary_parser_new( llsd_ops_t const * const ops, void * const user_data )
+{
+	bs_state_t * parser_state = NULL;
+
+	CHECK_PTR_RET( ops, NULL );
+
+	parser_state = (bs_state_t*)CALLOC( 1, sizeof(bs_state_t) );
+	CHECK_PTR_RET( parser_state, NULL );
+
+	/* set up step stack, used to synthesize array value end, map key end, 
+	 * and map value end callbacks */
+	llsd_stack_initialize( &(parser_state->state_stack) );
+	parser_state->ops = ops;
+	parser_state->user_data = user_data;
+
+	/* start in the top level state */
+	PUSH( TOP_LEVEL );
+
+	return parser_state;
+}
+
+int llsd_binary_parser_reset( llsd_binary_parser_t * const parser_state, llsd_ops_t const * const ops, void * const user_data )
+{
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	/* empty the step stack and start over at the top level */
+	llsd_stack_clear( &(parser_state->state_stack) );
+	parser_state->ops = ops;
+	parser_state->user_data = user_data;
+	parser_state->need = 0;
+	parser_state->borrow = FALSE;
+	parser_state->skip = FALSE;
+	parser_state->step = FALSE;
+	PUSH( TOP_LEVEL );
 
-	/* clean up the parser_state */
+	return TRUE;
+}
+
+void llsd_binary_parser_delete( void * p )
+{
+	bs_state_t * parser_state = (bs_state_t*)p;
+	CHECK_PTR( parser_state );
+	llsd_stack_deinitialize( &(parser_state->state_stack) );
 	FREE( parser_state );
+}
+
+int llsd_binary_parser_feed( llsd_binary_parser_t * const parser_state, uint8_t const * const buf, size_t const len, int const final, size_t * const used )
+{
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( used, FALSE );
+	CHECK_RET( (buf != NULL) || (len == 0), FALSE );
+
+	(*used) = 0;
+	CHECK_RET( llsd_binary_parse_values( parser_state, buf, len, !final, used ), FALSE );
+
+	/* the last chunk has to leave us back at the top level */
+	if ( final )
+		CHECK_RET( TOP == TOP_LEVEL, FALSE );
 
 	return TRUE;
 }
 
+size_t llsd_binary_parser_need( llsd_binary_parser_t * const parser_state )
+{
+	CHECK_PTR_RET( parser_state, 0 );
+	return parser_state->need;
+}
+
+int llsd_binary_parser_next( llsd_binary_parser_t * const parser_state, uint8_t const * const buf, size_t const len, int * const skip, size_t * const used )
+{
+	int ret = FALSE;
+
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( used, FALSE );
+
+	parser_state->step = TRUE;
+	parser_state->borrow = TRUE;
+	parser_state->skip = ((skip != NULL) && (*skip));
+	(*used) = 0;
+	ret = llsd_binary_parse_values( parser_state, buf, len, FALSE, used );
+	if ( skip != NULL )
+		(*skip) = parser_state->skip;
+
+	return ret;
+}
+
+/* lazy parsing: each container records where its bytes are and is parsed
+ * one level at a time when it is first used.  the bytes of a child
+ * container are only scanned to find where it ends. */
+
+static int_t binary_lazy_fill( llsd_t * const container, llsd_arena_t * const arena, uint8_t const * const buf, size_t const len );
+
+/* reads the value at (*p), strings point into the buffer and containers
+ * come back unparsed */
+static llsd_t * binary_lazy_value( uint8_t const ** const p, uint8_t const * const end, llsd_arena_t * const arena )
+{
+	uint8_t const * q = (*p);
+	uint8_t t;
+	uint32_t be_int;
+	uint64_t be_real;
+	double real;
+	llsd_t * v = NULL;
+
+	CHECK_RET( q < end, NULL );
+	t = *q++;
+
+	switch( t )
+	{
+		case '!':
+			v = llsd_new_in( arena, LLSD_UNDEF );
+			break;
+
+		case '1':
+		case '0':
+			v = llsd_new_in( arena, LLSD_BOOLEAN, (t == '1') );
+			break;
+
+		case 'i':
+			CHECK_RET( HAS_BYTES( q, end, sizeof(uint32_t) ), NULL );
+			READ_BE32( q, be_int );
+			v = llsd_new_in( arena, LLSD_INTEGER, (int32_t)be_int );
+			break;
+
+		case 'r':
+		case 'd':
+			CHECK_RET( HAS_BYTES( q, end, sizeof(uint64_t) ), NULL );
+			READ_BE64( q, be_real );
+			MEMCPY( &real, &be_real, sizeof(double) );
+			v = llsd_new_in( arena, ((t == 'r') ? LLSD_REAL : LLSD_DATE), real );
+			break;
+
+		case 'u':
+			CHECK_RET( HAS_BYTES( q, end, UUID_LEN ), NULL );
+			v = llsd_new_in( arena, LLSD_UUID, q );
+			q += UUID_LEN;
+			break;
+
+		case 's':
+		case 'l':
+		case 'b':
+			CHECK_RET( HAS_BYTES( q, end, sizeof(uint32_t) ), NULL );
+			READ_BE32( q, be_int );
+			CHECK_RET( HAS_BYTES( q, end, be_int ), NULL );
+			v = llsd_new_in( arena, ((t == 's') ? LLSD_STRING : ((t == 'l') ? LLSD_URI : LLSD_BINARY)), q, be_int, LLSD_BORROW );
+			q += be_int;
+			break;
+
+		case '[':
+		case '{':
+			CHECK_RET( HAS_BYTES( q, end, sizeof(uint32_t) ), NULL );
+			READ_BE32( q, be_int );
+			q = binary_skip_value( (*p), end );
+			CHECK_PTR_RET( q, NULL );
+			v = llsd_new_lazy( arena, ((t == '[') ? LLSD_ARRAY : LLSD_MAP), be_int, (*p), (size_t)(q - (*p)), &binary_lazy_fill );
+			break;
+
+		default:
+			DEBUG("invalid type byte: %c\n", t );
+			return NULL;
+	}
+
+	(*p) = q;
+	return v;
+}
+
+/* adds the children of the container encoded in buf */
+static int_t binary_lazy_fill( llsd_t * const container, llsd_arena_t * const arena, uint8_t const * const buf, size_t const len )
+{
+	int const map = (llsd_get_type( container ) == LLSD_MAP);
+	uint8_t const * p = buf + 1 + sizeof(uint32_t);	/* past the marker and the count */
+	uint8_t const * const end = buf + len - 1;		/* the closing marker */
+	llsd_t * k = NULL;
+	llsd_t * v = NULL;
+
+	CHECK_RET( len >= (2 + sizeof(uint32_t)), FALSE );
+	CHECK_RET( (*end) == (map ? '}' : ']'), FALSE );
+
+	while ( p < end )
+	{
+		if ( map )
+		{
+			/* map keys are always strings */
+			CHECK_RET( (*p) == 's', FALSE );
+			k = binary_lazy_value( &p, end, arena );
+			CHECK_PTR_RET( k, FALSE );
+		}
+
+		v = binary_lazy_value( &p, end, arena );
+		CHECK_GOTO( v != NULL, fail_lazy_fill );
+
+		if ( map )
+		{
+			CHECK_GOTO( llsd_map_insert( container, k, v ), fail_lazy_fill );
+		}
+		else
+		{
+			CHECK_GOTO( llsd_array_append( container, v ), fail_lazy_fill );
+		}
+		k = NULL;
+	}
+
+	return TRUE;
+
+fail_lazy_fill:
+	llsd_delete( k );
+	llsd_delete( v );
+	return FALSE;
+}
+
+llsd_t * llsd_binary_parse_lazy( uint8_t const * const buf, size_t const len, llsd_arena_t * const arena )
+{
+	uint8_t const * p = buf;
+
+	CHECK_PTR_RET( buf, NULL );
+
+	/* skip past signature */
+	if ( llsd_binary_check_sig_buffer( buf, len ) )
+		p += BINARY_SIG_LEN;
+
+	return binary_lazy_value( &p, buf + len, arena );
+}
+
+/* direct tree building: values are made where they are read and added to
+ * the open container, there are no ops calls and the structure is checked
+ * once per value instead of in the parser and again in the tree builder */
+llsd_t * llsd_binary_parse_tree( uint8_t const * const buf, size_t const len, llsd_arena_t * const arena, llsd_intern_t * const intern, int const borrow )
+{
+	uint8_t const * p = buf;
+	uint8_t const * end = NULL;
+	uint8_t t;
+	uint32_t be_int;
+	uint64_t be_real;
+	double real;
+	int map = FALSE;			/* the open container is a map */
+	int const own_it = (borrow ? LLSD_BORROW : FALSE);
+	llsd_t * root = NULL;
+	llsd_t * container = NULL;	/* the open container, NULL at the top level */
+	llsd_t * key = NULL;		/* a map key waiting for its value */
+	llsd_t * v = NULL;
+	llsd_stack_t containers;
+
+	CHECK_PTR_RET( buf, NULL );
+	end = buf + len;
+
+	/* skip past signature */
+	if ( llsd_binary_check_sig_buffer( buf, len ) )
+		p += BINARY_SIG_LEN;
+
+	llsd_stack_initialize( &containers );
+
+	while ( p < end )
+	{
+		t = *p++;
+
+		/* where a map key goes only a key or the end of the map can be */
+		if ( map && (key == NULL) && (t == 's') )
+		{
+			CHECK_GOTO( HAS_BYTES( p, end, sizeof(uint32_t) ), fail_binary_parse_tree );
+			READ_BE32( p, be_int );
+			CHECK_GOTO( HAS_BYTES( p, end, be_int ), fail_binary_parse_tree );
+			if ( intern != NULL )
+				key = llsd_intern( intern, p, be_int );
+			else
+				key = llsd_new_in( arena, LLSD_STRING, p, be_int, own_it );
+			CHECK_GOTO( key != NULL, fail_binary_parse_tree );
+			p += be_int;
+			continue;
+		}
+		CHECK_GOTO( !map || (key != NULL) || (t == '}'), fail_binary_parse_tree );
+
+		switch( t )
+		{
+			case '!':
+				v = llsd_new_in( arena, LLSD_UNDEF );
+				break;
+
+			case '1':
+			case '0':
+				v = llsd_new_in( arena, LLSD_BOOLEAN, (t == '1') );
+				break;
+
+			case 'i':
+				CHECK_GOTO( HAS_BYTES( p, end, sizeof(uint32_t) ), fail_binary_parse_tree );
+				READ_BE32( p, be_int );
+				v = llsd_new_in( arena, LLSD_INTEGER, (int32_t)be_int );
+				break;
+
+			case 'r':
+			case 'd':
+				CHECK_GOTO( HAS_BYTES( p, end, sizeof(uint64_t) ), fail_binary_parse_tree );
+				READ_BE64( p, be_real );
+				MEMCPY( &real, &be_real, sizeof(double) );
+				v = llsd_new_in( arena, ((t == 'r') ? LLSD_REAL : LLSD_DATE), real );
+				break;
+
+			case 'u':
+				CHECK_GOTO( HAS_BYTES( p, end, UUID_LEN ), fail_binary_parse_tree );
+				v = llsd_new_in( arena, LLSD_UUID, p );
+				p += UUID_LEN;
+				break;
+
+			case 's':
+			case 'l':
+			case 'b':
+				CHECK_GOTO( HAS_BYTES( p, end, sizeof(uint32_t) ), fail_binary_parse_tree );
+				READ_BE32( p, be_int );
+				CHECK_GOTO( HAS_BYTES( p, end, be_int ), fail_binary_parse_tree );
+				v = llsd_new_in( arena, ((t == 's') ? LLSD_STRING : ((t == 'l') ? LLSD_URI : LLSD_BINARY)), p, be_int, own_it );
+				p += be_int;
+				break;
+
+			case '[':
+			case '{':
+				CHECK_GOTO( HAS_BYTES( p, end, sizeof(uint32_t) ), fail_binary_parse_tree );
+				READ_BE32( p, be_int );
+				v = llsd_new_in( arena, ((t == '[') ? LLSD_ARRAY : LLSD_MAP), be_int );
+				break;
+
+			case ']':
+			case '}':
+				/* close the open container, it must be the same kind and a
+				 * map can't have a key left over */
+				CHECK_GOTO( (container != NULL) && (map == (t == '}')) && (key == NULL), fail_binary_parse_tree );
+				llsd_stack_pop( &containers );
+				container = (llsd_t*)llsd_stack_top( &containers );
+				map = ((container != NULL) && (llsd_get_type( container ) == LLSD_MAP));
+				continue;
+
+			default:
+				DEBUG( "invalid type byte: %c\n", t );
+				goto fail_binary_parse_tree;
+		}
+		CHECK_GOTO( v != NULL, fail_binary_parse_tree );
+
+		/* containers stay open until their end marker */
+		if ( (t == '[') || (t == '{') )
+		{
+			CHECK_GOTO( containers.count < LLSD_MAX_DEPTH, fail_binary_parse_tree );
+			CHECK_GOTO( llsd_stack_push( &containers, (uintptr_t)v ), fail_binary_parse_tree );
+		}
+
+		/* add it to the open container, there is only one top level value */
+		if ( container == NULL )
+		{
+			CHECK_GOTO( root == NULL, fail_binary_parse_tree );
+			root = v;
+		}
+		else if ( map )
+		{
+			CHECK_GOTO( llsd_map_insert( container, key, v ), fail_binary_parse_tree );
+			key = NULL;
+		}
+		else
+		{
+			CHECK_GOTO( llsd_array_append( container, v ), fail_binary_parse_tree );
+		}
+
+		/* the tree owns it now */
+		if ( (t == '[') || (t == '{') )
+		{
+			container = v;
+			map = (t == '{');
+		}
+		v = NULL;
+	}
+
+	/* every container has to be closed */
+	CHECK_GOTO( (root != NULL) && (container == NULL), fail_binary_parse_tree );
+
+	llsd_stack_deinitialize( &containers );
+	return root;
+
+fail_binary_parse_tree:
+	/* the root owns everything that was added to the tree */
+	if ( v != NULL )
+		llsd_delete( v );
+	if ( key != NULL )
+		llsd_delete( key );
+	if ( root != NULL )
+		llsd_delete( root );
+	llsd_stack_deinitialize( &containers );
+	return NULL;
+}
+
+int llsd_binary_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	/* read the whole file into memory and parse it from there */
+	CHECK_RET( llsd_read_file( fin, &buf, &len ), FALSE );
+	ret = llsd_binary_parse_buffer( buf, len, ops, user_data );
+	FREE( buf );
+
+	return ret;
+}
 
@@ -20,7 +20,48 @@
 #include "llsd_parser.h"
 
 int llsd_binary_check_sig_file( FILE * fin );
-int llsd_binary_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data );
+int llsd_binary_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data );
+int llsd_binary_check_sig_buffer( uint8_t const * const buf, size_t const len );
+int llsd_binary_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* same as llsd_binary_parse_buffer but strings, uris and binary values are
+ * handed to the callbacks as LLSD_BORROW pointers into buf, nothing is
+ * copied and they are not null terminated */
+int llsd_binary_parse_buffer_borrowed( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* builds the top level value only, arrays and maps are parsed one level at a
+ * time when they are first used and strings, uris and binary values are
+ * borrowed from buf.  buf must outlive the tree. */
+llsd_t * llsd_binary_parse_lazy( uint8_t const * const buf, size_t const len, llsd_arena_t * const arena );
+
+/* builds the whole tree without going through llsd_ops_t, for when the tree
+ * is all that is wanted.  arena and intern may be NULL, with borrow set the
+ * strings, uris and binary values point into buf like LLSD_BORROW. */
+llsd_t * llsd_binary_parse_tree( uint8_t const * const buf, size_t const len, llsd_arena_t * const arena, llsd_intern_t * const intern, int const borrow );
+
+/* push parser, fed with the document after the signature.  each call parses
+ * every whole value in buf and sets (*used) to the bytes it consumed, the
+ * rest must be passed in again with more data.  llsd_binary_parser_need says
+ * how many bytes the cut off value needs so callers can wait for them.  pass
+ * final as TRUE with the last of the data. */
+typedef struct bs_state_s llsd_binary_parser_t;
+llsd_binary_parser_t * llsd_binary_parser_new( llsd_ops_t const * const ops, void * const user_data );
+void llsd_binary_parser_delete( void * p );
+int llsd_binary_parser_feed( llsd_binary_parser_t * const state, uint8_t const * const buf, size_t const len, int const final, size_t * const used );
+size_t llsd_binary_parser_need( llsd_binary_parser_t * const state );
+
+/* steps a parser through a whole document for llsd_reader, like
+ * llsd_json_parser_next.  strings, uris and binary values are all passed as
+ * LLSD_BORROW. */
+int llsd_binary_parser_next( llsd_binary_parser_t * const state, uint8_t const * const buf, size_t const len, int * const skip, size_t * const used );
+
+/* puts a used parser back in its starting state with new callbacks, so one
+ * parser can be kept and used for many documents */
+int llsd_binary_parser_reset( llsd_binary_parser_t * const state, llsd_ops_t const * const ops, void * const user_data );
+
+/* llsd_binary_parse_buffer, or with borrow set llsd_binary_parse_buffer_borrowed,
+ * run on a parser that is reset first instead of a new one */
+int llsd_binary_parse_buffer_ctx( llsd_binary_parser_t * const state, uint8_t const * const buf, size_t const len, int const borrow, llsd_ops_t const * const ops, void * const user_data );
 
 #endif/*LLSD_BINARY_PARSER_H*/
 
@@ -14,20 +14,31 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
  */
 
+#include <string.h>
+
 #include <cutil/list.h>
 #include "llsd_serializer.h"
 #include "llsd_binary_serializer.h"
 
 typedef struct bs_state_s
 {
-	FILE * fout;
+	llsd_buffer_t * out;
 } bs_state_t;
 
+/* the type marker and its fixed size payload go out in a single write */
+static inline int binary_write_tagged( llsd_buffer_t * const out, uint8_t const tag, void const * const data, size_t const len )
+{
+	uint8_t tmp[1 + UUID_LEN];
+	tmp[0] = tag;
+	memcpy( &tmp[1], data, len );
+	return llsd_buffer_write( out, tmp, len + 1 );
+}
+
 static int_t llsd_binary_undef( void * const user_data )
 {
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "!", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "!", 1 ), FALSE );
 	return TRUE;
 }
 
@@ -35,7 +46,7 @@ static int_t llsd_binary_boolean( int const value, void * const user_data )
 {
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( (value ? "1" : "0"), sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, (value ? "1" : "0"), 1 ), FALSE );
 	return TRUE;
 }
 
@@ -44,8 +55,7 @@ static int_t llsd_binary_integer( int32_t const value, void * const user_data )
 	uint32_t be = htonl( value );
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "i", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint32_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 'i', &be, sizeof(uint32_t) ), FALSE );
 	return TRUE;
 }
 
@@ -54,8 +64,7 @@ static int_t llsd_binary_real( double const value, void * const user_data )
 	uint64_t be = htobe64( *((uint64_t*)&value) );
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "r", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint64_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 'r', &be, sizeof(uint64_t) ), FALSE );
 	return TRUE;
 }
 
@@ -63,22 +72,18 @@ static int_t llsd_binary_uuid( uint8_t const value[UUID_LEN], void * const user_
 {
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "u", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( value, sizeof(uint8_t), UUID_LEN, state->fout ) == UUID_LEN, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 'u', value, UUID_LEN ), FALSE );
 	return TRUE;
 }
 
-static int_t llsd_binary_string( uint8_t const * str, int const own_it, void * const user_data )
+static int_t llsd_binary_string( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
 {
 	uint32_t be = 0;
-	uint32_t len = 0;
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	len = strlen( str );
 	be = htonl( len );
-	CHECK_RET( fwrite( "s", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint32_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( str, sizeof(uint8_t), len, state->fout ) == len, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 's', &be, sizeof(uint32_t) ), FALSE );
+	CHECK_RET( llsd_buffer_write_ref( state->out, str, len ), FALSE );
 	return TRUE;
 }
 
@@ -87,22 +92,18 @@ static int_t llsd_binary_date( double const value, void * const user_data )
 	uint64_t be = htobe64( *((uint64_t*)&value) );
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "d", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint64_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 'd', &be, sizeof(uint64_t) ), FALSE );
 	return TRUE;
 }
 
-static int_t llsd_binary_uri( uint8_t const * uri, int const own_it, void * const user_data )
+static int_t llsd_binary_uri( uint8_t const * uri, uint32_t const len, int const own_it, void * const user_data )
 {
 	uint32_t be = 0;
-	uint32_t len = 0;
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	len = strlen( uri );
 	be = htonl( len );
-	CHECK_RET( fwrite( "l", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint32_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( uri, sizeof(uint8_t), len, state->fout ) == len, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 'l', &be, sizeof(uint32_t) ), FALSE );
+	CHECK_RET( llsd_buffer_write_ref( state->out, uri, len ), FALSE );
 	return TRUE;
 }
 
@@ -112,9 +113,8 @@ static int_t llsd_binary_binary( uint8_t const * data, uint32_t const len, int c
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	be = htonl( len );
-	CHECK_RET( fwrite( "b", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint32_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( data, sizeof(uint8_t), len, state->fout ) == len, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, 'b', &be, sizeof(uint32_t) ), FALSE );
+	CHECK_RET( llsd_buffer_write_ref( state->out, data, len ), FALSE );
 	return TRUE;
 }
 
@@ -124,8 +124,7 @@ static int_t llsd_binary_array_begin( uint_t const size, void * const user_data
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	be = htonl( size );
-	CHECK_RET( fwrite( "[", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint32_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, '[', &be, sizeof(uint32_t) ), FALSE );
 	return TRUE;
 }
 
@@ -147,7 +146,7 @@ static int_t llsd_binary_array_end( uint_t const size, void * const user_data )
 {
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "]", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "]", 1 ), FALSE );
 	return TRUE;
 }
 
@@ -157,8 +156,7 @@ static int_t llsd_binary_map_begin( uint_t const size, void * const user_data )
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	be = htonl( size );
-	CHECK_RET( fwrite( "{", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-	CHECK_RET( fwrite( &be, sizeof(uint32_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( binary_write_tagged( state->out, '{', &be, sizeof(uint32_t) ), FALSE );
 	return TRUE;
 }
 
@@ -194,17 +192,17 @@ static int_t llsd_binary_map_end( uint_t const size, void * const user_data )
 {
 	bs_state_t * state = (bs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "}", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "}", 1 ), FALSE );
 	return TRUE;
 }
 
 #define BINARY_SIG_LEN (18)
 static uint8_t const * const binary_header = "<? LLSD/Binary ?>\n";
 
-int llsd_binary_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pretty, void ** const user_data )
+int llsd_binary_serializer_init( llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data )
 {
 	bs_state_t * state = NULL;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( ops, FALSE );
 	CHECK_PTR_RET( user_data, FALSE );
 
@@ -232,12 +230,12 @@ int llsd_binary_serializer_init( FILE * fout, llsd_ops_t * const ops, int const
 	};
 
 	/* write out the binary signature */
-	CHECK_RET( fwrite( binary_header, sizeof(uint8_t), BINARY_SIG_LEN, fout ) == BINARY_SIG_LEN, FALSE );
+	CHECK_RET( llsd_buffer_write( out, binary_header, BINARY_SIG_LEN ), FALSE );
 
-	/* allocate the serializer state and store the file pointer */
+	/* allocate the serializer state and store the output buffer */
 	state = CALLOC( 1, sizeof(bs_state_t) );
 	CHECK_PTR_RET( state, FALSE );
-	state->fout = fout;
+	state->out = out;
 
 	/* return the state as the user_date */
 	(*user_data) = state;
@@ -246,13 +244,42 @@ int llsd_binary_serializer_init( FILE * fout, llsd_ops_t * const ops, int const
 }
 
 
-int llsd_binary_serializer_deinit( FILE * fout, void * user_data )
+int llsd_binary_serializer_deinit( llsd_buffer_t * const out, void * user_data )
 {
 	bs_state_t * state = (bs_state_t*)user_data;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( state, FALSE );
 	FREE( state );
 	return TRUE;
 }
 
-
+#define WALK_FN	llsd_binary_walk
+#define WALK_STATE_T	bs_state_t
+#define EMIT_UNDEF( s )	llsd_binary_undef( s )
+#define EMIT_BOOLEAN( s, v )	llsd_binary_boolean( v, s )
+#define EMIT_INTEGER( s, v )	llsd_binary_integer( v, s )
+#define EMIT_REAL( s, v )	llsd_binary_real( v, s )
+#define EMIT_DATE( s, v )	llsd_binary_date( v, s )
+#define EMIT_UUID( s, v )	llsd_binary_uuid( v, s )
+#define EMIT_STRING( s, p, len )	llsd_binary_string( p, len, FALSE, s )
+#define EMIT_URI( s, p, len )	llsd_binary_uri( p, len, FALSE, s )
+#define EMIT_BINARY( s, p, len )	llsd_binary_binary( p, len, FALSE, s )
+#define EMIT_ARRAY_BEGIN( s, n )	llsd_binary_array_begin( n, s )
+#define EMIT_ARRAY_VALUE_BEGIN( s )	TRUE
+#define EMIT_ARRAY_VALUE_END( s )	TRUE
+#define EMIT_ARRAY_END( s, n )	llsd_binary_array_end( n, s )
+#define EMIT_MAP_BEGIN( s, n )	llsd_binary_map_begin( n, s )
+#define EMIT_MAP_KEY_BEGIN( s )	TRUE
+#define EMIT_MAP_KEY_END( s )	TRUE
+#define EMIT_MAP_VALUE_BEGIN( s )	TRUE
+#define EMIT_MAP_VALUE_END( s )	TRUE
+#define EMIT_MAP_END( s, n )	llsd_binary_map_end( n, s )
+#include "llsd_walk.h"
+
+int llsd_binary_serializer_walk( llsd_t * const llsd, void * user_data )
+{
+	bs_state_t * state = (bs_state_t*)user_data;
+	CHECK_PTR_RET( llsd, FALSE );
+	CHECK_PTR_RET( state, FALSE );
+	return llsd_binary_walk( llsd, state );
+}
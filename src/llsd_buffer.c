@@ -0,0 +1,359 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd_buffer.h"
+#include "base64.h"
+
+#define BUFFER_MIN_SIZE (1024)
+#define PRINTF_TMP_SIZE (64)
+
+int llsd_buffer_initialize( llsd_buffer_t * const buf, uint8_t * const data, size_t const size )
+{
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( (data != NULL) || (size == 0), FALSE );
+
+	buf->data = data;
+	buf->len = 0;
+	buf->size = size;
+	buf->own_it = (data == NULL);
+	buf->failed = FALSE;
+	buf->zero_copy = FALSE;
+	buf->counting = FALSE;
+	buf->refs = NULL;
+	buf->nrefs = 0;
+	buf->refs_size = 0;
+
+	return TRUE;
+}
+
+int llsd_buffer_initialize_zero_copy( llsd_buffer_t * const buf )
+{
+	CHECK_RET( llsd_buffer_initialize( buf, NULL, 0 ), FALSE );
+	buf->zero_copy = TRUE;
+	return TRUE;
+}
+
+int llsd_buffer_initialize_counter( llsd_buffer_t * const buf )
+{
+	CHECK_RET( llsd_buffer_initialize( buf, NULL, 0 ), FALSE );
+	buf->counting = TRUE;
+	return TRUE;
+}
+
+void llsd_buffer_deinitialize( llsd_buffer_t * const buf )
+{
+	CHECK_PTR( buf );
+
+	if ( buf->own_it )
+		FREE( buf->data );
+	FREE( buf->refs );
+
+	buf->data = NULL;
+	buf->len = 0;
+	buf->size = 0;
+	buf->refs = NULL;
+	buf->nrefs = 0;
+	buf->refs_size = 0;
+}
+
+uint8_t * llsd_buffer_release( llsd_buffer_t * const buf, size_t * const len )
+{
+	uint8_t * data = NULL;
+	CHECK_PTR_RET( buf, NULL );
+
+	data = buf->data;
+	if ( len != NULL )
+		(*len) = buf->len;
+
+	buf->data = NULL;
+	buf->len = 0;
+	buf->size = 0;
+	buf->own_it = TRUE;
+	buf->failed = FALSE;
+	FREE( buf->refs );
+	buf->refs = NULL;
+	buf->nrefs = 0;
+	buf->refs_size = 0;
+
+	return data;
+}
+
+int llsd_buffer_consume( llsd_buffer_t * const buf, size_t const n )
+{
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( n <= buf->len, FALSE );
+	CHECK_RET( !buf->counting, FALSE );
+	CHECK_RET( buf->nrefs == 0, FALSE );
+
+	if ( n < buf->len )
+		memmove( buf->data, buf->data + n, buf->len - n );
+	buf->len -= n;
+	return TRUE;
+}
+
+uint8_t * llsd_buffer_reserve( llsd_buffer_t * const buf, size_t const n )
+{
+	size_t size = 0;
+	uint8_t * tmp = NULL;
+	CHECK_PTR_RET( buf, NULL );
+	CHECK_RET( !buf->counting, NULL );
+
+	if ( (buf->size - buf->len) < n )
+	{
+		/* caller storage cannot grow */
+		CHECK_GOTO( buf->own_it, fail_reserve );
+
+		/* grow geometrically so a large document only reallocs a few times */
+		size = (buf->size ? buf->size : BUFFER_MIN_SIZE);
+		while ( (size - buf->len) < n )
+		{
+			CHECK_GOTO( size < (SIZE_MAX / 2), fail_reserve );
+			size *= 2;
+		}
+
+		tmp = REALLOC( buf->data, size );
+		CHECK_GOTO( tmp != NULL, fail_reserve );
+		buf->data = tmp;
+		buf->size = size;
+	}
+
+	return &(buf->data[buf->len]);
+
+fail_reserve:
+	buf->failed = TRUE;
+	return NULL;
+}
+
+int llsd_buffer_write( llsd_buffer_t * const buf, void const * const data, size_t const len )
+{
+	uint8_t * p = NULL;
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( (data != NULL) || (len == 0), FALSE );
+
+	if ( buf->counting )
+	{
+		buf->len += len;
+		return TRUE;
+	}
+
+	if ( len == 0 )
+		return TRUE;
+
+	p = llsd_buffer_reserve( buf, len );
+	CHECK_PTR_RET( p, FALSE );
+	MEMCPY( p, data, len );
+	buf->len += len;
+
+	return TRUE;
+}
+
+int llsd_buffer_fill( llsd_buffer_t * const buf, uint8_t const c, size_t const n )
+{
+	uint8_t * p = NULL;
+	CHECK_PTR_RET( buf, FALSE );
+
+	if ( buf->counting )
+	{
+		buf->len += n;
+		return TRUE;
+	}
+
+	if ( n == 0 )
+		return TRUE;
+
+	p = llsd_buffer_reserve( buf, n );
+	CHECK_PTR_RET( p, FALSE );
+	MEMSET( p, c, n );
+	buf->len += n;
+
+	return TRUE;
+}
+
+int llsd_buffer_printf( llsd_buffer_t * const buf, char const * const fmt, ... )
+{
+	int ret = 0;
+	size_t avail = 0;
+	uint8_t * p = NULL;
+	char tmp[PRINTF_TMP_SIZE];
+	va_list args;
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( fmt, FALSE );
+
+	if ( buf->counting )
+	{
+		va_start( args, fmt );
+		ret = vsnprintf( NULL, 0, fmt, args );
+		va_end( args );
+		CHECK_RET( ret >= 0, FALSE );
+		buf->len += ret;
+		return TRUE;
+	}
+
+	/* try formatting straight into the free space first */
+	avail = buf->size - buf->len;
+	p = (avail > 0) ? &(buf->data[buf->len]) : NULL;
+	va_start( args, fmt );
+	ret = vsnprintf( (char*)p, avail, fmt, args );
+	va_end( args );
+	CHECK_RET( ret >= 0, FALSE );
+
+	if ( (ret == avail) && !buf->own_it && (ret < PRINTF_TMP_SIZE) )
+	{
+		/* it fits exactly except for the NUL, so format it on the side */
+		va_start( args, fmt );
+		vsnprintf( tmp, PRINTF_TMP_SIZE, fmt, args );
+		va_end( args );
+		MEMCPY( p, tmp, ret );
+	}
+	else if ( (size_t)ret >= avail )
+	{
+		/* make room for the output plus the terminating NUL and try again */
+		p = llsd_buffer_reserve( buf, (size_t)ret + 1 );
+		CHECK_PTR_RET( p, FALSE );
+		va_start( args, fmt );
+		ret = vsnprintf( (char*)p, (size_t)ret + 1, fmt, args );
+		va_end( args );
+		CHECK_RET( ret >= 0, FALSE );
+	}
+
+	buf->len += ret;
+
+	return TRUE;
+}
+
+int llsd_buffer_write_base64( llsd_buffer_t * const buf, uint8_t const * const data, uint32_t const len )
+{
+	uint8_t * p = NULL;
+	uint32_t outlen = 0;
+	CHECK_PTR_RET( buf, FALSE );
+
+	if ( len == 0 )
+		return TRUE;
+
+	CHECK_PTR_RET( data, FALSE );
+	outlen = BASE64_LENGTH( len );
+
+	if ( buf->counting )
+	{
+		buf->len += outlen;
+		return TRUE;
+	}
+
+	/* encode straight into the output buffer */
+	p = llsd_buffer_reserve( buf, outlen );
+	CHECK_PTR_RET( p, FALSE );
+	CHECK_RET( base64_encode( data, len, p, &outlen ), FALSE );
+	buf->len += outlen;
+
+	return TRUE;
+}
+
+int llsd_buffer_write_ref( llsd_buffer_t * const buf, void const * const data, size_t const len )
+{
+	size_t size = 0;
+	llsd_buffer_ref_t * tmp = NULL;
+	CHECK_PTR_RET( buf, FALSE );
+
+	if ( !buf->zero_copy || (len < LLSD_ZERO_COPY_MIN_LEN) )
+		return llsd_buffer_write( buf, data, len );
+
+	CHECK_PTR_RET( data, FALSE );
+
+	if ( buf->nrefs == buf->refs_size )
+	{
+		size = (buf->refs_size ? (buf->refs_size * 2) : 16);
+		tmp = REALLOC( buf->refs, size * sizeof(llsd_buffer_ref_t) );
+		if ( tmp == NULL )
+		{
+			buf->failed = TRUE;
+			return FALSE;
+		}
+		buf->refs = tmp;
+		buf->refs_size = size;
+	}
+
+	buf->refs[buf->nrefs].offset = buf->len;
+	buf->refs[buf->nrefs].data = (uint8_t const *)data;
+	buf->refs[buf->nrefs].len = len;
+	buf->nrefs++;
+
+	return TRUE;
+}
+
+size_t llsd_buffer_gather( llsd_buffer_t * const buf, struct iovec ** const iov )
+{
+	size_t i = 0;
+	size_t n = 0;
+	size_t count = 0;
+	size_t offset = 0;
+	uint8_t * copy = NULL;
+	struct iovec * v = NULL;
+	CHECK_PTR_RET( buf, 0 );
+	CHECK_PTR_RET( iov, 0 );
+	CHECK_RET( !buf->failed, 0 );
+
+	/* one entry per reference plus one per run of copied bytes between them */
+	for ( i = 0; i < buf->nrefs; i++ )
+	{
+		if ( buf->refs[i].offset > offset )
+			count++;
+		count++;
+		offset = buf->refs[i].offset;
+	}
+	if ( (buf->len > offset) || (count == 0) )
+		count++;
+
+	v = MALLOC( (count * sizeof(struct iovec)) + buf->len );
+	CHECK_PTR_RET( v, 0 );
+
+	/* the copied bytes live right after the iovec array */
+	copy = (uint8_t*)&(v[count]);
+	if ( buf->len > 0 )
+		MEMCPY( copy, buf->data, buf->len );
+
+	offset = 0;
+	for ( i = 0; i < buf->nrefs; i++ )
+	{
+		if ( buf->refs[i].offset > offset )
+		{
+			v[n].iov_base = &(copy[offset]);
+			v[n].iov_len = buf->refs[i].offset - offset;
+			n++;
+		}
+		v[n].iov_base = (void*)buf->refs[i].data;
+		v[n].iov_len = buf->refs[i].len;
+		n++;
+		offset = buf->refs[i].offset;
+	}
+	if ( (buf->len > offset) || (n == 0) )
+	{
+		v[n].iov_base = &(copy[offset]);
+		v[n].iov_len = buf->len - offset;
+		n++;
+	}
+
+	(*iov) = v;
+	return n;
+}
+
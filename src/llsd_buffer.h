@@ -0,0 +1,91 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef LLSD_BUFFER_H
+#define LLSD_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* payloads shorter than this are cheaper to copy than to give their own iovec */
+#define LLSD_ZERO_COPY_MIN_LEN (256)
+
+/* a span of caller memory left in place, it goes before data[offset] */
+typedef struct llsd_buffer_ref_s
+{
+	size_t offset;
+	uint8_t const * data;
+	size_t len;
+} llsd_buffer_ref_t;
+
+/* output buffer the serializers write into.  if it is initialized without
+ * storage, the buffer owns its memory and grows as needed; if it is given
+ * caller storage, writes past the end of that storage fail instead. */
+typedef struct llsd_buffer_s
+{
+	uint8_t * data;		/* the serialized bytes */
+	size_t len;			/* number of bytes written to data */
+	size_t size;		/* number of bytes available in data */
+	int own_it;			/* TRUE if data was allocated by the buffer */
+	int failed;			/* set once a write did not fit, so dropped bytes are noticed */
+	int zero_copy;		/* TRUE if large payloads are referenced instead of copied */
+	int counting;		/* TRUE if writes only count bytes in len and store nothing */
+	llsd_buffer_ref_t * refs;
+	size_t nrefs;
+	size_t refs_size;
+} llsd_buffer_t;
+
+/* pass NULL/0 for a growable buffer, or caller storage for a fixed one */
+int llsd_buffer_initialize( llsd_buffer_t * const buf, uint8_t * const data, size_t const size );
+void llsd_buffer_deinitialize( llsd_buffer_t * const buf );
+
+/* a growable buffer that keeps large payloads passed to llsd_buffer_write_ref
+ * in place, use llsd_buffer_gather to get the output as an iovec array */
+int llsd_buffer_initialize_zero_copy( llsd_buffer_t * const buf );
+
+/* a buffer with no storage that only adds up the length of what is written */
+int llsd_buffer_initialize_counter( llsd_buffer_t * const buf );
+
+/* hands the data over to the caller, who must FREE it, and resets the buffer */
+uint8_t * llsd_buffer_release( llsd_buffer_t * const buf, size_t * const len );
+
+/* drops the first n bytes and moves the rest to the front */
+int llsd_buffer_consume( llsd_buffer_t * const buf, size_t const n );
+
+/* makes sure there is room for n more bytes and returns a pointer to them,
+ * the caller adds what it actually wrote to len.  a counter has nowhere to
+ * put the bytes so it returns NULL */
+uint8_t * llsd_buffer_reserve( llsd_buffer_t * const buf, size_t const n );
+
+int llsd_buffer_write( llsd_buffer_t * const buf, void const * const data, size_t const len );
+int llsd_buffer_fill( llsd_buffer_t * const buf, uint8_t const c, size_t const n );
+int llsd_buffer_printf( llsd_buffer_t * const buf, char const * const fmt, ... );
+
+/* base64 encodes data straight into the buffer */
+int llsd_buffer_write_base64( llsd_buffer_t * const buf, uint8_t const * const data, uint32_t const len );
+
+/* like llsd_buffer_write, but in zero copy mode a large payload is only
+ * referenced, so it must stay valid until the gathered output is written */
+int llsd_buffer_write_ref( llsd_buffer_t * const buf, void const * const data, size_t const len );
+
+/* builds the iovec array for the output, returns the number of entries or 0
+ * on failure.  the array and the copied bytes share one allocation so the
+ * caller only has to FREE (*iov) */
+size_t llsd_buffer_gather( llsd_buffer_t * const buf, struct iovec ** const iov );
+
+#endif/*LLSD_BUFFER_H*/
+
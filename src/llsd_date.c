@@ -0,0 +1,193 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd_date.h"
+
+#define IS_DIGIT( c ) ( ((c) >= '0') && ((c) <= '9') )
+
+#define SECS_PER_DAY (86400)
+#define MSECS_PER_DAY (86400000LL)
+
+/* the days from 1970-01-01 to 0000-03-01, the start of the first era */
+#define EPOCH_DAYS (719468)
+
+/* the seconds from the epoch to 0000-01-01T00:00:00Z and 10000-01-01T00:00:00Z */
+#define MIN_SECS (-62167219200.0)
+#define MAX_SECS (253402300800.0)
+
+/* the calendar repeats every 400 years (an era) of 146097 days.  counting the
+ * years from March puts the leap day last, so the day of the year maps to the
+ * month with (5 * doy + 2) / 153, no table or leap year check needed.  see
+ * Howard Hinnant's "chrono-Compatible Low-Level Date Algorithms". */
+
+static int64_t days_from_civil( int32_t y, uint32_t const m, uint32_t const d )
+{
+	int32_t era;
+	uint32_t yoe, doy, doe;
+
+	y -= (m <= 2);
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = (uint32_t)(y - era * 400);
+	doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return (int64_t)era * 146097 + (int64_t)doe - EPOCH_DAYS;
+}
+
+static void civil_from_days( int64_t z, int32_t * const y, uint32_t * const m, uint32_t * const d )
+{
+	int64_t era;
+	uint32_t doe, yoe, doy, mp;
+
+	z += EPOCH_DAYS;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = (uint32_t)(z - era * 146097);
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	(*d) = doy - (153 * mp + 2) / 5 + 1;
+	(*m) = (mp < 10 ? mp + 3 : mp - 9);
+	(*y) = (int32_t)(yoe + era * 400) + ((*m) <= 2);
+}
+
+static uint32_t days_in_month( int32_t const y, uint32_t const m )
+{
+	static uint8_t const days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if ( (m == 2) && ((y % 4) == 0) && (((y % 100) != 0) || ((y % 400) == 0)) )
+		return 29;
+	return days[m - 1];
+}
+
+/* read n digits, fails if any of them isn't one */
+static int get_digits( uint8_t const * const p, uint32_t const n, uint32_t * const v )
+{
+	uint32_t i;
+	(*v) = 0;
+	for ( i = 0; i < n; i++ )
+	{
+		CHECK_RET( IS_DIGIT( p[i] ), FALSE );
+		(*v) = ((*v) * 10) + (p[i] - '0');
+	}
+	return TRUE;
+}
+
+static void put_digits( uint8_t * const p, uint32_t v, uint32_t const n )
+{
+	uint32_t i;
+	for ( i = n; i > 0; i-- )
+	{
+		p[i - 1] = '0' + (v % 10);
+		v /= 10;
+	}
+}
+
+int llsd_date_parse( uint8_t const * const p, size_t const len, double * const v )
+{
+	static double const scale[10] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+	size_t i;
+	uint32_t year, month, day, hour, minute, second, frac = 0, nfrac = 0;
+
+	CHECK_PTR_RET( p, FALSE );
+	CHECK_PTR_RET( v, FALSE );
+
+	/* YYYY-MM-DDTHH:MM:SS then Z or a fraction and Z */
+	CHECK_RET( len >= 20, FALSE );
+	CHECK_RET( (p[4] == '-') && (p[7] == '-') && (p[10] == 'T') && (p[13] == ':') && (p[16] == ':'), FALSE );
+	CHECK_RET( get_digits( &p[0], 4, &year ), FALSE );
+	CHECK_RET( get_digits( &p[5], 2, &month ), FALSE );
+	CHECK_RET( get_digits( &p[8], 2, &day ), FALSE );
+	CHECK_RET( get_digits( &p[11], 2, &hour ), FALSE );
+	CHECK_RET( get_digits( &p[14], 2, &minute ), FALSE );
+	CHECK_RET( get_digits( &p[17], 2, &second ), FALSE );
+
+	i = 19;
+	if ( p[i] == '.' )
+	{
+		/* at least one digit, only the first nine count */
+		for ( i++; (i < len) && IS_DIGIT( p[i] ); i++ )
+		{
+			if ( nfrac < 9 )
+			{
+				frac = (frac * 10) + (p[i] - '0');
+				nfrac++;
+			}
+		}
+		CHECK_RET( i > 20, FALSE );
+	}
+	CHECK_RET( (i + 1 == len) && (p[i] == 'Z'), FALSE );
+
+	CHECK_RET( (month >= 1) && (month <= 12), FALSE );
+	CHECK_RET( (day >= 1) && (day <= days_in_month( (int32_t)year, month )), FALSE );
+	CHECK_RET( (hour < 24) && (minute < 60) && (second < 61), FALSE );
+
+	(*v) = (double)(days_from_civil( (int32_t)year, month, day ) * SECS_PER_DAY + 
+					(int64_t)(hour * 3600 + minute * 60 + second));
+	(*v) += (double)frac / scale[nfrac];
+
+	return TRUE;
+}
+
+size_t llsd_date_format( double const v, uint8_t buf[LLSD_DATE_STR_LEN] )
+{
+	int64_t ms, days;
+	int32_t year;
+	uint32_t month, day, msecs;
+
+	CHECK_PTR_RET( buf, 0 );
+	buf[0] = '\0';
+
+	/* also false for NaN */
+	CHECK_RET( (v >= MIN_SECS) && (v < MAX_SECS), 0 );
+
+	/* round to the millisecond first so that the carry reaches the date */
+	ms = (int64_t)floor( (v * 1000.0) + 0.5 );
+	CHECK_RET( ms < (int64_t)MAX_SECS * 1000, 0 );
+
+	days = ms / MSECS_PER_DAY;
+	ms -= days * MSECS_PER_DAY;
+	if ( ms < 0 )
+	{
+		days--;
+		ms += MSECS_PER_DAY;
+	}
+	msecs = (uint32_t)ms;
+	civil_from_days( days, &year, &month, &day );
+
+	put_digits( &buf[0], (uint32_t)year, 4 );
+	buf[4] = '-';
+	put_digits( &buf[5], month, 2 );
+	buf[7] = '-';
+	put_digits( &buf[8], day, 2 );
+	buf[10] = 'T';
+	put_digits( &buf[11], msecs / 3600000, 2 );
+	buf[13] = ':';
+	put_digits( &buf[14], (msecs / 60000) % 60, 2 );
+	buf[16] = ':';
+	put_digits( &buf[17], (msecs / 1000) % 60, 2 );
+	buf[19] = '.';
+	put_digits( &buf[20], msecs % 1000, 3 );
+	buf[23] = 'Z';
+	buf[24] = '\0';
+
+	return DATE_STR_LEN;
+}
+
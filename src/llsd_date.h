@@ -0,0 +1,44 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#ifndef LLSD_DATE_H
+#define LLSD_DATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "llsd.h"
+
+/* ISO-8601 dates for the text formats, e.g. 2006-02-01T14:29:53.460Z.  dates
+ * are seconds since the epoch, UTC.  the conversion is plain calendar
+ * arithmetic so it doesn't depend on the time zone or locale and is safe to
+ * use from any thread. */
+
+/* length of a date written by llsd_date_format, with the null */
+#define LLSD_DATE_STR_LEN (DATE_STR_LEN + 1)
+
+/* parse YYYY-MM-DDTHH:MM:SS[.fraction]Z filling all len bytes of p.  fails
+ * on anything else, including out of range fields. */
+int llsd_date_parse( uint8_t const * const p, size_t const len, double * const v );
+
+/* write YYYY-MM-DDTHH:MM:SS.mmmZ and a null into buf, rounded to the nearest
+ * millisecond.  returns the length without the null, or 0 if the date is NaN,
+ * infinite or outside of the years 0000-9999. */
+size_t llsd_date_format( double const v, uint8_t buf[LLSD_DATE_STR_LEN] );
+
+#endif/*LLSD_DATE_H*/
+
@@ -0,0 +1,135 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd_hash.h"
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+	do { \
+		v0 += v1; v1 = ROTL( v1, 13 ); v1 ^= v0; v0 = ROTL( v0, 32 ); \
+		v2 += v3; v3 = ROTL( v3, 16 ); v3 ^= v2; \
+		v0 += v3; v3 = ROTL( v3, 21 ); v3 ^= v0; \
+		v2 += v1; v1 = ROTL( v1, 17 ); v1 ^= v2; v2 = ROTL( v2, 32 ); \
+	} while(0)
+
+/* little endian load that doesn't care about alignment */
+#define READ_LE64( p ) \
+	(((uint64_t)(p)[0]) | ((uint64_t)(p)[1] << 8) | ((uint64_t)(p)[2] << 16) | ((uint64_t)(p)[3] << 24) | \
+	 ((uint64_t)(p)[4] << 32) | ((uint64_t)(p)[5] << 40) | ((uint64_t)(p)[6] << 48) | ((uint64_t)(p)[7] << 56))
+
+static uint64_t k0 = 0;
+static uint64_t k1 = 0;
+static pthread_once_t seed_once = PTHREAD_ONCE_INIT;
+
+static void llsd_hash_init( void )
+{
+	uint8_t key[LLSD_HASH_KEY_LEN];
+	FILE * f = NULL;
+	size_t n = 0;
+
+	f = fopen( "/dev/urandom", "rb" );
+	if ( f != NULL )
+	{
+		n = fread( key, 1, LLSD_HASH_KEY_LEN, f );
+		fclose( f );
+	}
+
+	if ( n != LLSD_HASH_KEY_LEN )
+	{
+		/* no urandom, this is weaker but still differs between processes */
+		k0 = (uint64_t)time( NULL ) ^ ((uint64_t)getpid() << 32);
+		k1 = (uint64_t)(uintptr_t)&k0 ^ (uint64_t)clock();
+		return;
+	}
+
+	k0 = READ_LE64( key );
+	k1 = READ_LE64( key + 8 );
+}
+
+void llsd_hash_seed( uint8_t const key[LLSD_HASH_KEY_LEN] )
+{
+	CHECK_PTR( key );
+
+	/* run the one time init first so it can't overwrite this key later */
+	pthread_once( &seed_once, &llsd_hash_init );
+	k0 = READ_LE64( key );
+	k1 = READ_LE64( key + 8 );
+}
+
+static inline uint64_t siphash13( uint64_t const key0, uint64_t const key1, void const * const data, size_t const len )
+{
+	int i;
+	uint64_t m;
+	uint64_t b = ((uint64_t)len) << 56;
+	uint8_t const * p = (uint8_t const *)data;
+	uint8_t const * const end = p + (len & ~((size_t)7));
+	uint64_t v0, v1, v2, v3;
+
+	v0 = key0 ^ 0x736f6d6570736575ULL;
+	v1 = key1 ^ 0x646f72616e646f6dULL;
+	v2 = key0 ^ 0x6c7967656e657261ULL;
+	v3 = key1 ^ 0x7465646279746573ULL;
+
+	/* one compression round per 8 byte word */
+	for ( ; p < end; p += 8 )
+	{
+		m = READ_LE64( p );
+		v3 ^= m;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	/* the last 0-7 bytes and the length go in the final word */
+	for ( i = 0; i < (int)(len & 7); i++ )
+		b |= ((uint64_t)p[i]) << (8 * i);
+
+	v3 ^= b;
+	SIPROUND;
+	v0 ^= b;
+
+	/* three finalization rounds */
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint64_t llsd_hash( void const * const data, size_t const len )
+{
+	/* every thread sees the same key, however many hash first at once */
+	pthread_once( &seed_once, &llsd_hash_init );
+	return siphash13( k0, k1, data, len );
+}
+
+uint64_t llsd_hash_keyed( uint8_t const key[LLSD_HASH_KEY_LEN], void const * const data, size_t const len )
+{
+	CHECK_PTR_RET( key, 0 );
+	return siphash13( READ_LE64( key ), READ_LE64( key + 8 ), data, len );
+}
@@ -0,0 +1,40 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef LLSD_HASH_H
+#define LLSD_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LLSD_HASH_KEY_LEN (16)
+
+/* SipHash-1-3 over all len bytes, keyed with a per-process secret so peers
+ * can't pick keys that collide.  the key is read from /dev/urandom exactly
+ * once, the first time any thread needs a hash. */
+uint64_t llsd_hash( void const * const data, size_t const len );
+
+/* SipHash-1-3 with the given key, the per-process key isn't touched */
+uint64_t llsd_hash_keyed( uint8_t const key[LLSD_HASH_KEY_LEN], void const * const data, size_t const len );
+
+/* replaces the per-process key.  hashes are cached in llsd strings, in
+ * llsd_key_t and in interned keys, and they'd silently stop matching, so this
+ * must be called before anything is hashed, before any other thread uses the
+ * library, and at most once. */
+void llsd_hash_seed( uint8_t const key[LLSD_HASH_KEY_LEN] );
+
+#endif/*LLSD_HASH_H*/
+
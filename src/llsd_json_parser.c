@@ -14,10 +14,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
  */
 
-#include <time.h>
-
 #include "llsd.h"
 #include "llsd_json_parser.h"
+#include "llsd_date.h"
+#include "llsd_number.h"
+#include "llsd_stack.h"
+#include "llsd_scan.h"
 
 int llsd_json_check_sig_file( FILE * fin )
 {
@@ -28,19 +30,25 @@ int llsd_json_check_sig_file( FILE * fin )
 
 typedef struct js_state_s
 {
-	llsd_ops_t * ops;
+	llsd_ops_t const * ops;
 	void * user_data;
-	list_t * count_stack;
-	list_t * state_stack;
+	llsd_stack_t count_stack;
+	llsd_stack_t state_stack;
+	size_t need;		/* held input wanted before a cut off token is tried again */
+	int skip;			/* the string_fn for a map key asked to skip its value */
+	int borrow;			/* strings with nothing to decode point into the buffer */
+	int step;			/* stop after each token, see llsd_json_parser_next */
 } js_state_t;
 
-#define PUSH(x)		(list_push_head( parser_state->state_stack, (void*)x ))
-#define TOP			((uint_t)list_get_head( parser_state->state_stack ))
-#define POP			(list_pop_head( parser_state->state_stack ))
+#define PUSH(x)		(llsd_stack_push( &(parser_state->state_stack), (uintptr_t)(x) ))
+#define TOP			((uint_t)llsd_stack_top( &(parser_state->state_stack) ))
+#define POP			(llsd_stack_pop( &(parser_state->state_stack) ))
+#define SET(x)		(llsd_stack_set_top( &(parser_state->state_stack), (uintptr_t)(x) ))
 
-#define PUSHC(x)	(list_push_head( parser_state->count_stack, (void*)x ))
-#define TOPC		((int_t)list_get_head( parser_state->count_stack ))
-#define POPC		(list_pop_head( parser_state->count_stack ))
+#define PUSHC(x)	(llsd_stack_push( &(parser_state->count_stack), (uintptr_t)(x) ))
+#define TOPC		((int_t)llsd_stack_top( &(parser_state->count_stack) ))
+#define POPC		(llsd_stack_pop( &(parser_state->count_stack) ))
+#define SETC(x)		(llsd_stack_set_top( &(parser_state->count_stack), (uintptr_t)(x) ))
 
 #define BEGIN_VALUE_STATES ( TOP_LEVEL | ARRAY_BEGIN | ARRAY_VALUE_END | MAP_KEY_END )
 #define BEGIN_STRING_STATES ( BEGIN_VALUE_STATES | MAP_VALUE_END | MAP_BEGIN )
@@ -53,7 +61,6 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, js_state_t * par
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -77,13 +84,11 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, js_state_t * par
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -96,19 +101,16 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, js_state_t * par
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_BEGIN:
 				case MAP_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->map_key_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_KEY_BEGIN );
+					SET( MAP_KEY_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -124,10 +126,8 @@ static int incc( js_state_t * parser_state )
 	int_t c = 0;
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->count_stack, FALSE );
 	c = TOPC;
-	POPC;
-	PUSHC( ++c );
+	SETC( ++c );
 	return TRUE;
 }
 
@@ -142,7 +142,6 @@ static int value( uint_t valid_states, llsd_type_t type_, js_state_t * parser_st
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -164,13 +163,11 @@ static int value( uint_t valid_states, llsd_type_t type_, js_state_t * parser_st
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					incc( parser_state );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					incc( parser_state );
 					break;
 				case TOP_LEVEL:
@@ -182,18 +179,15 @@ static int value( uint_t valid_states, llsd_type_t type_, js_state_t * parser_st
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					incc( parser_state );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					incc( parser_state );
 					break;
 				case MAP_KEY_BEGIN:
-					POP;
-					PUSH( MAP_KEY );
+					SET( MAP_KEY );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -212,7 +206,6 @@ static int end_value( uint_t valid_states, js_state_t * parser_state )
 
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -222,18 +215,15 @@ static int end_value( uint_t valid_states, js_state_t * parser_state )
 	{
 		case ARRAY_VALUE:
 			CHECK_RET( (*(parser_state->ops->array_value_end_fn))( parser_state->user_data ), FALSE );
-			POP;
-			PUSH( ARRAY_VALUE_END );
+			SET( ARRAY_VALUE_END );
 			break;
 		case MAP_VALUE:
 			CHECK_RET( (*(parser_state->ops->map_value_end_fn))( parser_state->user_data ), FALSE );
-			POP;
-			PUSH( MAP_VALUE_END );
+			SET( MAP_VALUE_END );
 			break;
 		case MAP_KEY:
 			CHECK_RET( (*(parser_state->ops->map_key_end_fn))( parser_state->user_data ), FALSE );
-			POP;
-			PUSH( MAP_KEY_END );
+			SET( MAP_KEY_END );
 			break;
 		case TOP_LEVEL:
 			break;
@@ -242,43 +232,33 @@ static int end_value( uint_t valid_states, js_state_t * parser_state )
 	return TRUE;
 }
 
-/* parse a JSON number into either an integer or a real */
-static int llsd_json_parse_number( FILE * fin, llsd_type_t * const type_, int * const ival, double * dval )
+/* checks that there are at least n bytes left in the buffer */
+#define HAS_BYTES( p, end, n ) ( (size_t)((end) - (p)) >= (size_t)(n) )
+
+#define IS_SPACE( c ) ( ((c) == ' ') || ((c) == '\t') || ((c) == '\r') || ((c) == '\n') )
+
+/* parse a JSON number into either an integer or a real.  it is an integer
+ * if it has no fraction or exponent and fits in 32 bits. */
+static int llsd_json_parse_number( uint8_t const ** p, uint8_t const * const end, llsd_type_t * const type_, int32_t * const ival, double * dval )
 {
-	long pos;
-	uint32_t whole, frac;
-	CHECK_PTR_RET( fin, FALSE );
+	uint8_t const * q = NULL;
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( type_, FALSE );
 	CHECK_PTR_RET( ival, FALSE );
 	CHECK_PTR_RET( dval, FALSE );
 
-	/* remember where we are in the stream */
-	pos = ftell( fin );
-
-	whole = 0;
-	frac = 0;
-
-	/* try to parse a long float from the stream */
-	if ( fscanf( fin, "%d.%d", &whole, &frac ) == 2 )
+	q = (*p);
+	if ( llsd_number_parse_integer( &q, end, ival ) &&
+		 ((q == end) || (((*q) != '.') && ((*q) != 'e') && ((*q) != 'E'))) )
 	{
-		fseek( fin, pos, SEEK_SET );
-		if ( fscanf( fin, "%lf", dval ) == 1 )
-		{
-			(*type_) = LLSD_REAL;
-			return TRUE;
-		}
-	}
-	else 
-	{
-		fseek( fin, pos, SEEK_SET );
-		if ( fscanf( fin, "%d", ival ) == 1 )
-		{
-			(*type_) = LLSD_INTEGER;
-			return TRUE;
-		}
+		(*type_) = LLSD_INTEGER;
+		(*p) = q;
+		return TRUE;
 	}
 
-	return FALSE;
+	CHECK_RET( llsd_number_parse_real( p, end, dval ), FALSE );
+	(*type_) = LLSD_REAL;
+	return TRUE;
 }
 
 
@@ -304,104 +284,32 @@ static uint8_t hex_to_byte( uint8_t hi, uint8_t lo )
 }
 
 
-static int llsd_json_parse_quoted( FILE * fin, uint8_t ** buffer, uint32_t * len, uint8_t quote )
+/* finds the closing quote, jumping between quotes and backslashes with the
+ * vector scanner.  escaped is set if there were any backslashes. */
+static int llsd_json_find_quoted( uint8_t const ** p, uint8_t const * const end, uint8_t const ** start, uint32_t * len, int * const escaped )
 {
-	int i;
-	int done = FALSE;
-	int escaped = FALSE;
-	static uint8_t buf[1024];
-	CHECK_PTR_RET( fin, FALSE );
-	CHECK_PTR_RET( buffer, FALSE );
+	uint8_t const * q;
+	CHECK_PTR_RET( p, FALSE );
+	CHECK_PTR_RET( start, FALSE );
 	CHECK_PTR_RET( len, FALSE );
+	CHECK_PTR_RET( escaped, FALSE );
 
-	(*buffer) = NULL;
-	(*len) = 0;
-	MEMSET( buf, 0, 1024 );
-
-	while( !done )
+	(*escaped) = FALSE;
+	q = llsd_scan_find2( (*p), end, '\"', '\\' );
+	while ( (q < end) && ((*q) == '\\') )
 	{
-		for ( i = 0; (i < 1024) && (!done); i++ )
-		{
-			CHECK_RET( fread( &buf[i], sizeof(uint8_t), 1, fin ) == 1, FALSE );
-
-			/* handle escaped quotes */
-			if ( !escaped )
-			{
-				if ( buf[i] == '\\' )
-				{
-					/* found escaping char */
-					escaped = TRUE;
-				}
-				else if ( buf[i] == '\"' )
-				{
-					/* found an unescaped double quote, must be done */
-					done = TRUE;
-				}
-			}
-			else
-			{
-				escaped = FALSE;
-			}
-		}
-
-		if ( done && (((*len) + i) == 0) )
-		{
-			/* make sure there is at least one byte in the buffer */
-			(*buffer) = REALLOC( (*buffer), 1 );
-			CHECK_PTR_RET( (*buffer), FALSE );
-		}
-		else
-		{
-			/* increase the buffer size */
-			(*buffer) = REALLOC( (*buffer), (*len) + i );
-			CHECK_PTR_RET( (*buffer), FALSE );
-
-			/* copy the data over */
-			MEMCPY( &((*buffer)[(*len)]), buf, i - (done ? 1 : 0) );
-			(*len) += (i - (done ? 1 : 0));
-		}
-
-		/* null terminate */
-		if ( done )
-			(*buffer)[(*len)] = '\0';
+		/* step over the escaped char, it may be a quote */
+		(*escaped) = TRUE;
+		CHECK_RET( (q + 1) < end, FALSE );
+		q = llsd_scan_find2( q + 2, end, '\"', '\\' );
 	}
-	
-	return TRUE;
-}
-
-/* timezone value gets set to the number of seconds offset from GMT for local time */
-extern long timezone;
-
-static int llsd_json_decode_date( uint8_t const * const data, double * real_val )
-{
-	int useconds;
-	struct tm parts;
-	double seconds;
-	uint32_t tmp = 0;
-
-	CHECK_PTR_RET( data, FALSE );
-	CHECK_PTR_RET( real_val, FALSE );
-
-	MEMSET( &parts, 0, sizeof(struct tm) );
-
-	CHECK_RET( sscanf( data, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", &parts.tm_year, &parts.tm_mon, &parts.tm_mday, &parts.tm_hour, &parts.tm_min, &parts.tm_sec, &useconds ) == 7, FALSE );
+	CHECK_RET( q < end, FALSE );
 
-	/* adjust a few things */
-	parts.tm_year -= 1900;
-	parts.tm_mon -= 1;
-
-	/* convert to seconds */
-	tmp = mktime(&parts);
-	
-	/* correct for localtime variation */
-	tmp -= timezone;
-
-	/* convert to double */
-	(*real_val) = (double)tmp;
-
-	/* add in the miliseconds */
-	(*real_val) += ((double)useconds * 1000.0);
+	(*start) = (*p);
+	(*len) = (uint32_t)(q - (*p));
 
+	/* move past the closing quote */
+	(*p) = q + 1;
 	return TRUE;
 }
 
@@ -658,7 +566,7 @@ static int llsd_json_utf8_decode( uint8_t const * const first, uint8_t const * c
 }
 
 /* strings are backslash encoded, empty strings are valid */
-static int llsd_json_decode_string( uint8_t const * const encoded, uint32_t const enc_len,
+static int llsd_json_decode_string( uint8_t const * const encoded, uint32_t const enc_len, int const escapes,
 									uint8_t ** const buffer, uint32_t * const len )
 {
 	uint8_t const * p = NULL;
@@ -678,6 +586,16 @@ static int llsd_json_decode_string( uint8_t const * const encoded, uint32_t cons
 		return TRUE;
 	}
 
+	/* find_quoted already knows there is nothing to decode */
+	if ( !escapes )
+	{
+		(*buffer) = CALLOC( enc_len + 1, sizeof(uint8_t) );
+		CHECK_PTR_RET( (*buffer), FALSE );
+		MEMCPY( (*buffer), encoded, enc_len );
+		(*len) = enc_len;
+		return TRUE;
+	}
+
 	(*len) = 0;
 
 	escaped = FALSE;
@@ -814,13 +732,17 @@ static int llsd_json_decode_string( uint8_t const * const encoded, uint32_t cons
 		}
 	}
 
+	/* the first pass over counts \uXXXX escapes so get the exact length */
+	(*len) = (uint32_t)(q - (*buffer));
+
 	return TRUE;
 }
 
 /* takes a string and length and tries to decode the string to a date, uuid, binary, or uri.
- * if all of those fail, then it stays as a string.
+ * if all of those fail, then it stays as a string.  with borrow set a string
+ * without escapes is not copied, (*buffer) points at encoded.
  * NOTE: empty strings will always be returned as an LLSD_STRING */
-static int llsd_json_convert_quoted( uint8_t const * const encoded, uint32_t const enc_len, 
+static int llsd_json_convert_quoted( uint8_t const * const encoded, uint32_t const enc_len, int const escapes, int const borrow,
 									 llsd_type_t * const type_, double * const dval, 
 									 uint8_t uuid[UUID_LEN], uint8_t ** const buffer, 
 									 uint32_t * const len )
@@ -833,7 +755,7 @@ static int llsd_json_convert_quoted( uint8_t const * const encoded, uint32_t con
 	CHECK_PTR_RET( len, FALSE );
 
 	/* try to convert it to a date */
-	if ( (enc_len == DATE_STR_LEN) && llsd_json_decode_date( encoded, dval ) )
+	if ( (enc_len == DATE_STR_LEN) && llsd_date_parse( encoded, enc_len, dval ) )
 	{
 		(*type_) = LLSD_DATE;
 		return TRUE;
@@ -843,19 +765,26 @@ static int llsd_json_convert_quoted( uint8_t const * const encoded, uint32_t con
 		(*type_) = LLSD_UUID;
 		return TRUE;
 	}
-	else if ( (strncmp( encoded, "||b64||", 7 ) == 0) && 
+	else if ( (enc_len >= JSON_BINARY_TAG_LEN) && (strncmp( encoded, "||b64||", 7 ) == 0) && 
 			  llsd_json_decode_binary( encoded, enc_len, buffer, len ) )
 	{
 		(*type_) = LLSD_BINARY;
 		return TRUE;
 	}
-	else if ( (strncmp( encoded, "||uri||", 7 ) == 0) && 
+	else if ( (enc_len >= JSON_URI_TAG_LEN) && (strncmp( encoded, "||uri||", 7 ) == 0) && 
 			  llsd_json_decode_uri( encoded, enc_len, buffer, len ) )
 	{
 		(*type_) = LLSD_URI;
 		return TRUE;
 	}
-	else if ( llsd_json_decode_string( encoded, enc_len, buffer, len ) )
+	else if ( borrow && !escapes )
+	{
+		(*buffer) = (uint8_t *)encoded;
+		(*len) = enc_len;
+		(*type_) = LLSD_STRING;
+		return TRUE;
+	}
+	else if ( llsd_json_decode_string( encoded, enc_len, escapes, buffer, len ) )
 	{
 		(*type_) = LLSD_STRING;
 		return TRUE;
@@ -864,87 +793,351 @@ static int llsd_json_convert_quoted( uint8_t const * const encoded, uint32_t con
 	return FALSE;
 }
 
-int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data )
+int llsd_json_check_sig_buffer( uint8_t const * const buf, size_t const len )
 {
-	int i;
-	uint8_t p;
-	size_t ret;
-	int bool_val;
-	int32_t int_val;
-	double real_val;
-	uint8_t uuid[UUID_LEN];
-	uint8_t * buffer = NULL;
-	uint8_t * encoded = NULL;
-	uint32_t len;
-	uint32_t enc_len;
-	int32_t line;
-	long line_start;
-	long err_column;
-	long text_start;
-	llsd_type_t type_ = LLSD_NONE;
-	js_state_t* parser_state = NULL;
+	CHECK_PTR_RET( buf, FALSE );
+	/* there is no header in JSON files */
+	return TRUE;
+}
 
-	CHECK_PTR_RET( fin, FALSE );
-	CHECK_PTR_RET( ops, FALSE );
+static int json_state_initialize( js_state_t * const parser_state )
+{
+	MEMSET( parser_state, 0, sizeof(js_state_t) );
 
 	/* set up step stack, used to synthesize array value end, map key end, 
 	 * and map value end callbacks */
+	llsd_stack_initialize( &(parser_state->count_stack) );
+	llsd_stack_initialize( &(parser_state->state_stack) );
+
+	return TRUE;
+}
+
+static void json_state_deinitialize( js_state_t * const parser_state )
+{
+	llsd_stack_deinitialize( &(parser_state->count_stack) );
+	llsd_stack_deinitialize( &(parser_state->state_stack) );
+}
+
+/* empties the stacks, a failed parse leaves whatever it had pushed on them */
+static void json_state_reset( js_state_t * const parser_state, llsd_ops_t const * const ops, void * const user_data )
+{
+	llsd_stack_clear( &(parser_state->count_stack) );
+	llsd_stack_clear( &(parser_state->state_stack) );
+	parser_state->ops = ops;
+	parser_state->user_data = user_data;
+	parser_state->need = 0;
+	parser_state->skip = FALSE;
+	parser_state->borrow = FALSE;
+	parser_state->step = FALSE;
+
+	/* start at top level state */
+	PUSH( TOP_LEVEL );
+}
+
+llsd_json_ctx_t * llsd_json_ctx_new( void )
+{
+	js_state_t * parser_state = NULL;
+
 	parser_state = CALLOC( 1, sizeof(js_state_t) );
-	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( parser_state, NULL );
 
-	parser_state->count_stack = list_new( 0, NULL );
-	if ( parser_state->count_stack == NULL )
+	if ( !json_state_initialize( parser_state ) )
 	{
 		FREE( parser_state );
-		return FALSE;
+		return NULL;
 	}
 
-	parser_state->state_stack = list_new( 1, NULL );
-	if ( parser_state->state_stack == NULL )
+	return parser_state;
+}
+
+void llsd_json_ctx_delete( void * p )
+{
+	js_state_t * parser_state = (js_state_t*)p;
+	CHECK_PTR( parser_state );
+
+	json_state_deinitialize( parser_state );
+	FREE( parser_state );
+}
+
+int llsd_json_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	js_state_t state;
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	CHECK_RET( json_state_initialize( &state ), FALSE );
+	ret = llsd_json_parse_buffer_ctx( &state, buf, len, ops, user_data );
+	json_state_deinitialize( &state );
+
+	return ret;
+}
+
+/* what json_skip_value expects next */
+#define SKIP_VALUE	(0)		/* a value, or the end of an empty array */
+#define SKIP_KEY	(1)		/* a key, or the end of an empty map */
+#define SKIP_COLON	(2)
+#define SKIP_NEXT	(3)		/* a comma or the end of the container */
+
+/* checks the quoted text at p like the parser would without keeping it.
+ * only strings with escapes can be bad, those are decoded and let go */
+static int json_skip_string( uint8_t const ** p, uint8_t const * const end )
+{
+	uint8_t const * start;
+	uint8_t * buffer = NULL;
+	uint32_t len;
+	int escaped;
+
+	CHECK_RET( llsd_json_find_quoted( p, end, &start, &len, &escaped ), FALSE );
+	if ( escaped )
 	{
-		list_delete( parser_state->count_stack );
-		FREE( parser_state );
-		return FALSE;
+		CHECK_RET( llsd_json_decode_string( start, len, escaped, &buffer, &len ), FALSE );
+		FREE( buffer );
 	}
-	parser_state->ops = ops;
-	parser_state->user_data = user_data;
+	return TRUE;
+}
 
-	/* start at top level state */
-	PUSH( TOP_LEVEL );
+/* returns the end of the value at p without building anything.  it is held
+ * to the same grammar as the parser so a projection never takes a document
+ * that a whole parse would turn down.  the bit for each depth is set when
+ * that container is a map. */
+static uint8_t const * json_skip_value( uint8_t const * p, uint8_t const * const end )
+{
+	uint8_t maps[LLSD_MAX_DEPTH / 8];
+	uint_t depth = 0;
+	int want = SKIP_VALUE;
+	int first = FALSE;
+	int32_t int_val;
+	double real_val;
+	llsd_type_t type_;
+
+#define IN_MAP ( (maps[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1 )
+
+	while ( TRUE )
+	{
+		p = llsd_scan_space( p, end );
+		CHECK_RET( p < end, NULL );
+
+		switch ( want )
+		{
+			case SKIP_KEY:
+				if ( first && ((*p) == '}') )
+					break;
+				CHECK_RET( (*p) == '\"', NULL );
+				p++;
+				CHECK_RET( json_skip_string( &p, end ), NULL );
+				want = SKIP_COLON;
+				continue;
+
+			case SKIP_COLON:
+				CHECK_RET( (*p) == ':', NULL );
+				p++;
+				want = SKIP_VALUE;
+				continue;
+
+			case SKIP_NEXT:
+				if ( (*p) == ',' )
+				{
+					p++;
+					want = (IN_MAP ? SKIP_KEY : SKIP_VALUE);
+					first = FALSE;
+					continue;
+				}
+				break;
+
+			default:
+				if ( first && ((*p) == ']') )
+					break;
+
+				switch ( *p )
+				{
+					case '\"':
+						p++;
+						CHECK_RET( json_skip_string( &p, end ), NULL );
+						break;
+
+					case 'n':
+						CHECK_RET( HAS_BYTES( p, end, 4 ) && (memcmp( p, "null", 4 ) == 0), NULL );
+						p += 4;
+						break;
+
+					case 't':
+						CHECK_RET( HAS_BYTES( p, end, 4 ) && (memcmp( p, "true", 4 ) == 0), NULL );
+						p += 4;
+						break;
+
+					case 'f':
+						CHECK_RET( HAS_BYTES( p, end, 5 ) && (memcmp( p, "false", 5 ) == 0), NULL );
+						p += 5;
+						break;
+
+					case '[':
+					case '{':
+						CHECK_RET( depth < LLSD_MAX_DEPTH, NULL );
+						if ( (*p) == '{' )
+							maps[depth / 8] |= (uint8_t)(1 << (depth % 8));
+						else
+							maps[depth / 8] &= (uint8_t)~(1 << (depth % 8));
+						depth++;
+						want = (((*p++) == '{') ? SKIP_KEY : SKIP_VALUE);
+						first = TRUE;
+						continue;
+
+					default:
+						CHECK_RET( ((*p) == '-') || isdigit( *p ), NULL );
+						CHECK_RET( llsd_json_parse_number( &p, end, &type_, &int_val, &real_val ), NULL );
+						break;
+				}
+
+				/* a whole value, at the top it is the end */
+				if ( depth == 0 )
+					return p;
+				want = SKIP_NEXT;
+				continue;
+		}
+
+		/* the end of the container, it has to match the one it began with */
+		CHECK_RET( (*p) == (IN_MAP ? '}' : ']'), NULL );
+		p++;
+		depth--;
+		if ( depth == 0 )
+			return p;
+		want = SKIP_NEXT;
+		first = FALSE;
+	}
 
+#undef IN_MAP
+}
+
+/* prints the line the error is on with the failed token marked */
+static void json_report_error( uint8_t const * const buf, uint8_t const * const end, uint8_t const * const p )
+{
+	int i;
+	int32_t line;
+	uint8_t const * line_start;
+	uint8_t const * line_end;
+	uint8_t const * text_start;
+
+	/* find the line the error is on */
 	line = 0;
-	line_start = ftell( fin );
+	line_start = buf;
+	for ( line_end = buf; line_end < p; line_end++ )
+	{
+		if ( (*line_end) == '\n' )
+		{
+			line++;
+			line_start = line_end + 1;
+		}
+	}
+
+	/* find the end of the line the error is on */
+	for ( line_end = line_start; (line_end < end) && (*line_end != '\n'); line_end++ );
+
+	text_start = line_start;
+	for( i = 0; i < (int)(p - line_start); i++ )
+	{
+		if ( (line_start[i] == ' ') || (line_start[i] == '\t') || (line_start[i] == '\r') )
+		{
+			text_start++;
+		}
+	}
+
+	fprintf(stderr, "\n");
+	fprintf(stderr, "%.*s\n", (int)(line_end - line_start), line_start );
+	fprintf(stderr, "%*s^", (int)(text_start - line_start), " " );
+	fprintf(stderr, "%*s^\n", (int)((p - text_start) - 1), " " );
+	fprintf(stderr, "%*s%lu\n", (int)(text_start - line_start), " ", (unsigned long)(text_start - buf) );
+	fprintf(stderr, "Parse failed on line %d, column %d\n", line, (int)(p - line_start) );
+}
 
-	while( TRUE )
+/* a token that can't be read yet is left for the next call when more data is
+ * coming.  need asks for twice what is held so a long string arriving in small
+ * chunks is only scanned a few times. */
+#define NEED( x ) \
+	do { \
+		if ( !(x) ) \
+		{ \
+			p = tok; \
+			if ( more ) \
+			{ \
+				parser_state->need = (2 * (size_t)(end - tok)) + 1; \
+				goto need_more; \
+			} \
+			goto fail_json_parse; \
+		} \
+	} while ( 0 )
+
+/* parses the tokens in buf and sets (*used) to the bytes consumed.  with more
+ * set, a token cut off at the end of buf is left there for the next call. */
+static int json_parse_tokens( js_state_t * const parser_state, uint8_t const * const buf, size_t const len, int const more, size_t * const used )
+{
+	uint8_t t;
+	uint8_t const * p = buf;
+	uint8_t const * tok = buf;
+	uint8_t const * const end = buf + len;
+	int32_t int_val;
+	double real_val;
+	uint8_t uuid[UUID_LEN];
+	uint8_t * buffer = NULL;
+	uint8_t const * encoded = NULL;
+	uint32_t blen;
+	uint32_t enc_len;
+	int escapes = FALSE;
+	int ok;
+	int_t ret;
+	llsd_type_t type_ = LLSD_NONE;
+	llsd_ops_t const * const ops = parser_state->ops;
+	void * const user_data = parser_state->user_data;
+
+	parser_state->need = 0;
+
+	while( p < end )
 	{
 		/* read the type marker */
-		ret = fread( &p, sizeof(uint8_t), 1, fin );
-		if ( feof( fin ) )
-			break;
+		tok = p;
+		t = *p++;
 
-		CHECK_RET( ret == 1, FALSE );
+		if ( parser_state->skip && (t != ',') && (t != ':') && !IS_SPACE( t ) )
+		{
+			/* jump over the value, the ops still see it begin and end */
+			p = json_skip_value( tok, end );
+			NEED( (p != NULL) && (!more || (p < end)) );
+			parser_state->skip = FALSE;
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_json_parse );
+			CHECK_GOTO( value( VALUE_STATES, LLSD_UNDEF, parser_state ), fail_json_parse );
+			if ( parser_state->step )
+				break;
+			continue;
+		}
 
-		switch( p )
+		switch( t )
 		{
 
 			case 'n': /* null */
+				NEED( HAS_BYTES( p, end, 3 ) );
+				CHECK_GOTO( memcmp( p, "ull", 3 ) == 0, fail_json_parse );
+				p += 3;
 				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_json_parse );
 				CHECK_GOTO( (*(ops->undef_fn))( user_data ), fail_json_parse );
-				fseek( fin, 3, SEEK_CUR );
 				CHECK_GOTO( value( VALUE_STATES, LLSD_UNDEF, parser_state ), fail_json_parse );
 				break;
 
 			case 't': /* true */
+				NEED( HAS_BYTES( p, end, 3 ) );
+				CHECK_GOTO( memcmp( p, "rue", 3 ) == 0, fail_json_parse );
+				p += 3;
 				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_json_parse );
 				CHECK_GOTO( (*(ops->boolean_fn))( TRUE, user_data ), fail_json_parse );
-				fseek( fin, 3, SEEK_CUR );
 				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_json_parse );
 				break;
 
 			case 'f': /* false */
+				NEED( HAS_BYTES( p, end, 4 ) );
+				CHECK_GOTO( memcmp( p, "alse", 4 ) == 0, fail_json_parse );
+				p += 4;
 				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_json_parse );
 				CHECK_GOTO( (*(ops->boolean_fn))( FALSE, user_data ), fail_json_parse );
-				fseek( fin, 4, SEEK_CUR );
 				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_json_parse );
 				break;
 
@@ -960,9 +1153,12 @@ int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_
 			case '8':
 			case '9': /* number */
 				/* back up one character so that we can parse the number */
-				fseek( fin, -1, SEEK_CUR );
-				CHECK_GOTO( llsd_json_parse_number( fin, &type_, &int_val, &real_val ), fail_json_parse );
-				
+				p--;
+				ok = llsd_json_parse_number( &p, end, &type_, &int_val, &real_val );
+
+				/* a number that runs up to the end may go on in the next chunk */
+				NEED( ok && (!more || (p < end)) );
+
 				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, type_, parser_state ), fail_json_parse );
 				switch( type_ )
 				{
@@ -977,19 +1173,12 @@ int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_
 				break;
 
 			case '\"':
-				/* read the quoted string */
-				CHECK_GOTO( llsd_json_parse_quoted( fin, &encoded, &enc_len, p ), fail_json_parse );
+				/* find the quoted string, it is decoded straight from the buffer */
+				NEED( llsd_json_find_quoted( &p, end, &encoded, &enc_len, &escapes ) );
 
 				/* try to convert it to date, uuid, uri, binary, or leave it as a string */
-				if ( !llsd_json_convert_quoted( encoded, enc_len, &type_, &real_val, uuid, &buffer, &len ) )
-				{
-					FREE( encoded );
-					goto fail_json_parse;
-				}
-				
-				FREE( encoded );
-				encoded = NULL;
-				
+				CHECK_GOTO( llsd_json_convert_quoted( encoded, enc_len, escapes, parser_state->borrow, &type_, &real_val, uuid, &buffer, &blen ), fail_json_parse );
+
 				switch ( type_ )
 				{
 					case LLSD_DATE:
@@ -1005,38 +1194,42 @@ int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_
 					case LLSD_BINARY:
 						CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ), fail_json_parse );
 						/* tell it to take ownership of the memory */
-						CHECK_GOTO( (*(ops->binary_fn))( buffer, len, TRUE, user_data ), fail_json_parse );
+						CHECK_GOTO( (*(ops->binary_fn))( buffer, blen, TRUE, user_data ), fail_json_parse );
 						CHECK_GOTO( value( VALUE_STATES, LLSD_BINARY, parser_state ), fail_json_parse );
 						buffer = NULL;
 						break;
 					case LLSD_URI:
 						CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_URI, parser_state ), fail_json_parse );
 						/* tell it to take ownership of the memory */
-						CHECK_GOTO( (*(ops->uri_fn))( buffer, TRUE, user_data ), fail_json_parse );
+						CHECK_GOTO( (*(ops->uri_fn))( buffer, blen, TRUE, user_data ), fail_json_parse );
 						CHECK_GOTO( value( VALUE_STATES, LLSD_URI, parser_state ), fail_json_parse );
 						buffer = NULL;
 						break;
 					case LLSD_STRING:
 						CHECK_GOTO( begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ), fail_json_parse );
-						/* tell it to take ownership of the memory */
-						CHECK_GOTO( (*(ops->string_fn))( buffer, TRUE, user_data ), fail_json_parse );
-						CHECK_GOTO( value( STRING_STATES, LLSD_STRING, parser_state ), fail_json_parse );
+						/* tell it to take ownership of the memory, or borrow it */
+						ret = (*(ops->string_fn))( buffer, blen, ((buffer == encoded) ? LLSD_BORROW : TRUE), user_data );
 						buffer = NULL;
+						CHECK_GOTO( ret, fail_json_parse );
+						CHECK_GOTO( value( STRING_STATES, LLSD_STRING, parser_state ), fail_json_parse );
+
+						/* the value after a skipped key is passed over */
+						if ( (ret == LLSD_SKIP) && (TOP == MAP_KEY) )
+							parser_state->skip = TRUE;
 						break;
 				}
-			
+
 				break;
 
 			case '[':
 				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ), fail_json_parse );
 				CHECK_GOTO( (*(ops->array_begin_fn))( 0, user_data ), fail_json_parse );
-				PUSH( ARRAY_BEGIN );
-				PUSHC( 0 );
+				CHECK_GOTO( PUSH( ARRAY_BEGIN ) && PUSHC( 0 ), fail_json_parse );
 				break;
 
 			case ']':
 				/* if there were any items in this array, we need to generate the end_value
-				 * callbacks here because there isn't a comma to mark the end of the last 
+				 * callbacks here because there isn't a comma to mark the end of the last
 				 * value */
 				if ( TOPC )
 				{
@@ -1048,17 +1241,16 @@ int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_
 				CHECK_GOTO( (*(ops->array_end_fn))( 0, user_data ), fail_json_parse );
 				CHECK_GOTO( value( VALUE_STATES, LLSD_ARRAY, parser_state ), fail_json_parse );
 				break;
-			
+
 			case '{':
 				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ), fail_json_parse );
 				CHECK_GOTO( (*(ops->map_begin_fn))( 0, user_data ), fail_json_parse );
-				PUSH( MAP_BEGIN );
-				PUSHC( 0 );
+				CHECK_GOTO( PUSH( MAP_BEGIN ) && PUSHC( 0 ), fail_json_parse );
 				break;
 
 			case '}':
 				/* if there were any items in this array, we need to generate the end_value
-				 * callbacks here because there isn't a comma to mark the end of the last 
+				 * callbacks here because there isn't a comma to mark the end of the last
 				 * value */
 				if ( TOPC )
 				{
@@ -1079,70 +1271,124 @@ int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_
 				CHECK_GOTO( end_value( MAP_KEY, parser_state ), fail_json_parse );
 				break;
 
-			/* eat whitespace and commas */
+			/* eat whitespace, lines are only counted if there is an error */
 			case '\n':
-				line++;
-				line_start = ftell( fin );
-				break;
 			case ' ':
 			case '\t':
 			case '\r':
+				p = llsd_scan_space( p, end );
 				break;
 			default:
-				WARN( "garbage byte %c at 0x%08x\n", p, (unsigned int)ftell( fin ) - 1 );
+				WARN( "garbage byte %c at 0x%08x\n", t, (unsigned int)(p - buf) - 1 );
 				goto fail_json_parse;
 		}
+
+		/* separators and space don't reach the ops as tokens */
+		if ( parser_state->step && (t != ',') && (t != ':') && !IS_SPACE( t ) )
+			break;
 	}
 
-	/* clean up the count stack */
-	list_delete( parser_state->count_stack );
+need_more:
+	(*used) = (size_t)(p - buf);
+	return TRUE;
 
-	/* clean up the step stack */
-	CHECK_RET( TOP == TOP_LEVEL, FALSE );
-	list_delete( parser_state->state_stack );
+fail_json_parse:
+	json_report_error( buf, end, p );
+	(*used) = (size_t)(p - buf);
+	return FALSE;
+}
 
-	/* free the parser_state */
-	FREE( parser_state );
+int llsd_json_parse_buffer_ctx( llsd_json_ctx_t * const ctx, uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	size_t used = 0;
+	js_state_t * parser_state = ctx;
 
-	return TRUE;
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
 
-fail_json_parse:
-	err_column = ftell( fin );
-	fseek( fin, line_start, SEEK_SET );
-	buffer = CALLOC( (err_column - line_start) + 1, sizeof(uint8_t) );
-	if ( (i = fread( buffer, sizeof(uint8_t), (err_column - line_start), fin )) != (err_column - line_start) )
-	{
-		fprintf( stderr, "Only read %d bytes from the file when generating error report\n", i );
-	}
+	json_state_reset( parser_state, ops, user_data );
+	CHECK_RET( json_parse_tokens( parser_state, buf, len, FALSE, &used ), FALSE );
 
-	text_start = line_start;
-	for( i = 0; i < (int)(err_column - line_start); i++ )
+	/* the stacks are emptied by the next parse */
+	return ( TOP == TOP_LEVEL );
+}
+
+llsd_json_parser_t * llsd_json_parser_new( llsd_ops_t const * const ops, void * const user_data )
+{
+	js_state_t * parser_state = NULL;
+
+	CHECK_PTR_RET( ops, NULL );
+
+	parser_state = llsd_json_ctx_new();
+	CHECK_PTR_RET( parser_state, NULL );
+	json_state_reset( parser_state, ops, user_data );
+
+	return parser_state;
+}
+
+void llsd_json_parser_delete( void * p )
+{
+	llsd_json_ctx_delete( p );
+}
+
+int llsd_json_parser_feed( llsd_json_parser_t * const state, uint8_t const * const buf, size_t const len, int const final, size_t * const used )
+{
+	js_state_t * parser_state = state;
+
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_RET( (buf != NULL) || (len == 0), FALSE );
+	CHECK_PTR_RET( used, FALSE );
+
+	(*used) = 0;
+	if ( len > 0 )
 	{
-		if ( (buffer[i] == ' ') || (buffer[i] == '\t') || (buffer[i] == '\r') )
-		{
-			text_start++;
-		}
+		CHECK_RET( json_parse_tokens( parser_state, buf, len, !final, used ), FALSE );
 	}
 
-	fprintf(stderr, "\n");
-	fprintf(stderr, "%s\n", buffer );
-	fprintf(stderr, "%*s^", (int)(text_start - line_start), " " );
-	fprintf(stderr, "%*s^\n", (int)((err_column - text_start) - 1), " " );
-	fprintf(stderr, "%*s%lu\n", (int)(text_start - line_start), " ", text_start );
-	fprintf(stderr, "Parse failed on line %d, column %d\n", line, (int)(err_column - line_start) );
-	FREE( buffer );
+	/* the document can't end inside an array or map */
+	return ( !final || (TOP == TOP_LEVEL) );
+}
 
-	/* clean up the count stack */
-	list_delete( parser_state->count_stack );
+size_t llsd_json_parser_need( llsd_json_parser_t * const state )
+{
+	CHECK_PTR_RET( state, 0 );
+	return state->need;
+}
 
-	/* clean up the step stack */
-	CHECK_RET( TOP == TOP_LEVEL, FALSE );
-	list_delete( parser_state->state_stack );
+int llsd_json_parser_next( llsd_json_parser_t * const state, uint8_t const * const buf, size_t const len, int * const skip, size_t * const used )
+{
+	int ret = FALSE;
+	js_state_t * parser_state = state;
 
-	/* free the parser_state */
-	FREE( parser_state );
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( used, FALSE );
 
-	return FALSE;
+	parser_state->step = TRUE;
+	parser_state->borrow = TRUE;
+	parser_state->skip = ((skip != NULL) && (*skip));
+	ret = json_parse_tokens( parser_state, buf, len, FALSE, used );
+	if ( skip != NULL )
+		(*skip) = parser_state->skip;
+
+	return ret;
 }
 
+int llsd_json_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	/* read the whole file into memory and parse it from there */
+	CHECK_RET( llsd_read_file( fin, &buf, &len ), FALSE );
+	ret = llsd_json_parse_buffer( buf, len, ops, user_data );
+	FREE( buf );
+
+	return ret;
+}
 
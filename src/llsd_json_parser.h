@@ -21,7 +21,35 @@
 #include "llsd_parser.h"
 
 int llsd_json_check_sig_file( FILE * fin );
-int llsd_json_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data );
+int llsd_json_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data );
+int llsd_json_check_sig_buffer( uint8_t const * const buf, size_t const len );
+int llsd_json_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* the parse state, kept between documents so that parsing many of them does
+ * not allocate stacks for each one, see llsd_parse_ctx_t */
+typedef struct js_state_s llsd_json_ctx_t;
+llsd_json_ctx_t * llsd_json_ctx_new( void );
+void llsd_json_ctx_delete( void * p );
+int llsd_json_parse_buffer_ctx( llsd_json_ctx_t * const ctx, uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* push parser.  each call parses every whole token in buf and sets (*used)
+ * to the bytes it consumed, the rest must be passed in again with more data.
+ * llsd_json_parser_need says how much input to hold before calling again so
+ * a long string isn't rescanned for every small chunk.  pass final as TRUE
+ * with the last of the data. */
+typedef struct js_state_s llsd_json_parser_t;
+llsd_json_parser_t * llsd_json_parser_new( llsd_ops_t const * const ops, void * const user_data );
+void llsd_json_parser_delete( void * p );
+int llsd_json_parser_feed( llsd_json_parser_t * const state, uint8_t const * const buf, size_t const len, int const final, size_t * const used );
+size_t llsd_json_parser_need( llsd_json_parser_t * const state );
+
+/* steps a parser through a whole document for llsd_reader.  it parses from
+ * buf until one token has reached the ops and sets (*used) to the bytes that
+ * took.  strings without escapes are passed as LLSD_BORROW.  when skip is set
+ * the next value is passed over without being decoded instead, and (*skip)
+ * is cleared once it has been.  at the end of the data, feed with final
+ * checks that the document was whole. */
+int llsd_json_parser_next( llsd_json_parser_t * const state, uint8_t const * const buf, size_t const len, int * const skip, size_t * const used );
 
 #endif/*LLSD_JSON_PARSER_H*/
 
@@ -15,17 +15,18 @@
  */
 
 #include <math.h>
-#include <time.h>
 
+#include "llsd_date.h"
+#include "llsd_number.h"
 #include "llsd_serializer.h"
 #include "llsd_json_serializer.h"
-#include "base64.h"
 
 typedef struct js_state_s
 {
 	int pretty;
 	int indent;
-	FILE * fout;
+	int map_value;
+	llsd_buffer_t * out;
 	list_t * count_stack;
 	list_t * multiline_stack;
 } js_state_t;
@@ -38,23 +39,21 @@ typedef struct js_state_s
 #define TOPC	  ((int_t)list_get_head( state->count_stack ))
 #define POPC	  (list_pop_head( state->count_stack ))
 
-#define WRITE_STR(x,y) (fwrite( x, sizeof(uint8_t), y, state->fout ))
+#define WRITE_STR(x,y) (llsd_buffer_write( state->out, x, y ))
 #define COMMA { if(TOPC) WRITE_STR(",", 1); }
 #define COLON WRITE_STR(":", 1)
 #define NL { if(state->pretty && TOPML) WRITE_STR("\n", 1); }
 
 #define INDENT_SPACES (4)
-#define INDENT { if(state->pretty && state->indent && TOPML) fprintf( state->fout, "%*s", state->indent * INDENT_SPACES, " " ); }
+#define INDENT { if(state->pretty && state->indent && TOPML) llsd_buffer_fill( state->out, ' ', state->indent * INDENT_SPACES ); }
 #define INC_INDENT { if(state->pretty) state->indent++; }
 #define DEC_INDENT { if(state->pretty) state->indent--; }
 
-static int_t map_value = FALSE;
-
 static int_t llsd_json_undef( void * const user_data )
 {
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "null", sizeof(uint8_t), 4, state->fout ) == 4, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "null", 4 ), FALSE );
 	return TRUE;
 }
 
@@ -63,25 +62,27 @@ static int_t llsd_json_boolean( int const value, void * const user_data )
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	if ( value )
-		CHECK_RET( fwrite( "true", sizeof(uint8_t), 4, state->fout ) == 4, FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, "true", 4 ), FALSE );
 	else
-		CHECK_RET( fwrite( "false", sizeof(uint8_t), 5, state->fout ) == 5, FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, "false", 5 ), FALSE );
 	return TRUE;
 }
 
 static int_t llsd_json_integer( int32_t const value, void * const user_data )
 {
+	uint8_t num[LLSD_NUMBER_STR_LEN];
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fprintf( state->fout, "%d", value ) >= 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, num, llsd_number_format_integer( value, num ) ), FALSE );
 	return TRUE;
 }
 
 static int_t llsd_json_real( double const value, void * const user_data )
 {
+	uint8_t num[LLSD_NUMBER_STR_LEN];
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fprintf( state->fout, "%F", value ) > 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, num, llsd_number_format_real( value, num ) ), FALSE );
 	return TRUE;
 }
 
@@ -90,28 +91,24 @@ static int_t llsd_json_uuid( uint8_t const value[UUID_LEN], void * const user_da
 	int ret = 0;
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	ret = fprintf( state->fout, 
+	ret = llsd_buffer_printf( state->out, 
 		"\"%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x\"", 
 		value[0], value[1], value[2], value[3], 
 		value[4], value[5], 
 		value[6], value[7], 
 		value[8], value[9], 
 		value[10], value[11], value[12], value[13], value[14], value[15] );
-	CHECK_RET( ret == 38, FALSE );
+	CHECK_RET( ret, FALSE );
 	return TRUE;
 }
 
-static int_t llsd_json_string( uint8_t const * str, int const own_it, void * const user_data )
+static int_t llsd_json_string( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
 {
-	int i;
-	size_t len = 0;
+	uint32_t i;
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	CHECK_PTR( str );
 
-	/* get the len */
-	len = strlen( str );
-
 	/* write out the string, escaping backslash, double quote, and control chars */
 	WRITE_STR( "\"", 1 );
 	for ( i = 0; i < len; i++ )
@@ -153,35 +150,26 @@ static int_t llsd_json_string( uint8_t const * str, int const own_it, void * con
 
 static int_t llsd_json_date( double const value, void * const user_data )
 {
-	double int_time;
-	int32_t useconds;
-	time_t seconds;
-	struct tm parts;
+	/* the date between quotes */
+	uint8_t date[LLSD_DATE_STR_LEN + 1];
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	int_time = floor( value );
-	seconds = (time_t)int_time;
-	useconds = (int32_t)( ( value - int_time) * 1000000.0 );
-	parts = *gmtime(&seconds);
-	fprintf( state->fout,
-		"\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"",
-		parts.tm_year + 1900,
-		parts.tm_mon + 1,
-		parts.tm_mday,
-		parts.tm_hour,
-		parts.tm_min,
-		parts.tm_sec,
-		((useconds != 0) ? (int32_t)(useconds / 1000.f + 0.5f) : 0) );
+	date[0] = '\"';
+	CHECK_RET( llsd_date_format( value, &date[1] ) == DATE_STR_LEN, FALSE );
+	date[DATE_STR_LEN + 1] = '\"';
+	CHECK_RET( llsd_buffer_write( state->out, date, DATE_STR_LEN + 2 ), FALSE );
 
 	return TRUE;
 }
 
-static int_t llsd_json_uri( uint8_t const * uri, int const own_it, void * const user_data )
+static int_t llsd_json_uri( uint8_t const * uri, uint32_t const len, int const own_it, void * const user_data )
 {
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	CHECK_PTR_RET( uri, FALSE );
-	fprintf( state->fout, "\"||uri||%s\"", uri );
+	CHECK_RET( WRITE_STR( "\"||uri||", 8 ), FALSE );
+	CHECK_RET( WRITE_STR( uri, len ), FALSE );
+	CHECK_RET( WRITE_STR( "\"", 1 ), FALSE );
 	return TRUE;
 }
 
@@ -192,25 +180,18 @@ static int_t llsd_json_binary( uint8_t const * data, uint32_t const len, int con
 	 * this sounds great, except for the fact that the parser cannot distinguish between
 	 * binary data and an actual array of integers.  so I am making an executive decision
 	 * to encode binary data as a JSON string with the value being BASE64 encoded binary. */
-	uint8_t * buf;
-	uint32_t outlen = 0;
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	if ( len > 0 )
 	{
 		CHECK_PTR_RET( data, FALSE );
-		outlen = BASE64_LENGTH( len );
-		buf = CALLOC( outlen, sizeof(uint8_t) );
-		CHECK_PTR_RET( buf, FALSE );
-		CHECK_RET( base64_encode( data, len, buf, &outlen ), FALSE );
-		CHECK_RET( fwrite( "\"||b64||", sizeof(uint8_t), 8, state->fout ) == 8, FALSE );
-		CHECK_RET( fwrite( buf, sizeof(uint8_t), outlen, state->fout ) == outlen, FALSE );
-		CHECK_RET( fwrite( "\"", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-		FREE( buf );
+		CHECK_RET( llsd_buffer_write( state->out, "\"||b64||", 8 ), FALSE );
+		CHECK_RET( llsd_buffer_write_base64( state->out, data, len ), FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, "\"", 1 ), FALSE );
 	}
 	else
 	{
-		CHECK_RET( fwrite( "\"||b64||\"", sizeof(uint8_t), 9, state->fout ) == 9, FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, "\"||b64||\"", 9 ), FALSE );
 	}
 
 	return TRUE;
@@ -227,13 +208,13 @@ static int_t llsd_json_array_begin( uint_t const size, void * const user_data )
 	/* if there is > 1 item in this array, we want to output items in multi-line format */
 	PUSHML( (int_t)(size > 1) );
 
-	if ( map_value && (size > 1))
+	if ( state->map_value && (size > 1))
 	{
 		NL;
 		INDENT;
 	}
 
-	CHECK_RET( fwrite( "[", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "[", 1 ), FALSE );
 
 	/* increment indent */
 	INC_INDENT;
@@ -271,7 +252,7 @@ static int_t llsd_json_array_end( uint_t const size, void * const user_data )
 	NL;
 	DEC_INDENT;
 	INDENT;
-	CHECK_RET( fwrite( "]", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "]", 1 ), FALSE );
 	POPML;
 	POPC;
 	return TRUE;
@@ -288,13 +269,13 @@ static int_t llsd_json_map_begin( uint_t const size, void * const user_data )
 	/* if there is > 1 item in this array, we want to output items in multi-line format */
 	PUSHML( (int_t)(size > 1) );
 
-	if ( map_value && (size > 1))
+	if ( state->map_value && (size > 1))
 	{
 		NL;
 		INDENT;
 	}
 
-	CHECK_RET( fwrite( "{", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "{", 1 ), FALSE );
 
 	/* increment indent */
 	INC_INDENT;
@@ -325,7 +306,7 @@ static int_t llsd_json_map_value_begin( void * const user_data )
 {
 	js_state_t * state = (js_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	map_value = TRUE;
+	state->map_value = TRUE;
 	return TRUE;
 }
 
@@ -337,7 +318,7 @@ static int_t llsd_json_map_value_end( void * const user_data )
 	c = TOPC;
 	POPC;
 	PUSHC( ++c );
-	map_value = FALSE;
+	state->map_value = FALSE;
 	return TRUE;
 }
 
@@ -348,16 +329,16 @@ static int_t llsd_json_map_end( uint_t const size, void * const user_data )
 	NL;
 	DEC_INDENT;
 	INDENT;
-	CHECK_RET( fwrite( "}", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "}", 1 ), FALSE );
 	POPML;
 	POPC;
 	return TRUE;
 }
 
-int llsd_json_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pretty, void ** const user_data )
+int llsd_json_serializer_init( llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data )
 {
 	js_state_t * state = NULL;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( ops, FALSE );
 	CHECK_PTR_RET( user_data, FALSE );
 
@@ -384,13 +365,13 @@ int llsd_json_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pr
 		&llsd_json_map_end 
 	};
 
-	/* allocate the serializer state and store the file pointer */
+	/* allocate the serializer state and store the output buffer */
 	state = CALLOC( 1, sizeof(js_state_t) );
 	CHECK_PTR_RET( state, FALSE );
 
 	state->pretty = pretty;
 	state->indent = 0;
-	state->fout = fout;
+	state->out = out;
 
 	state->count_stack = list_new( 0, NULL );
 	if ( state->count_stack == NULL )
@@ -415,19 +396,51 @@ int llsd_json_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pr
 }
 
 
-int llsd_json_serializer_deinit( FILE * fout, void * user_data )
+int llsd_json_serializer_deinit( llsd_buffer_t * const out, void * user_data )
 {
+	int ret = FALSE;
 	js_state_t * state = (js_state_t*)user_data;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( state, FALSE );
 
 	list_delete( state->count_stack );
 
-	CHECK_RET( TOPML == FALSE, FALSE );
+	/* free the state even if the serialization was cut short */
+	ret = (TOPML == FALSE);
 	list_delete( state->multiline_stack );
 
 	FREE( state );
+	CHECK_RET( ret, FALSE );
 	return TRUE;
 }
 
-
+#define WALK_FN	llsd_json_walk
+#define WALK_STATE_T	js_state_t
+#define EMIT_UNDEF( s )	llsd_json_undef( s )
+#define EMIT_BOOLEAN( s, v )	llsd_json_boolean( v, s )
+#define EMIT_INTEGER( s, v )	llsd_json_integer( v, s )
+#define EMIT_REAL( s, v )	llsd_json_real( v, s )
+#define EMIT_DATE( s, v )	llsd_json_date( v, s )
+#define EMIT_UUID( s, v )	llsd_json_uuid( v, s )
+#define EMIT_STRING( s, p, len )	llsd_json_string( p, len, FALSE, s )
+#define EMIT_URI( s, p, len )	llsd_json_uri( p, len, FALSE, s )
+#define EMIT_BINARY( s, p, len )	llsd_json_binary( p, len, FALSE, s )
+#define EMIT_ARRAY_BEGIN( s, n )	llsd_json_array_begin( n, s )
+#define EMIT_ARRAY_VALUE_BEGIN( s )	llsd_json_array_value_begin( s )
+#define EMIT_ARRAY_VALUE_END( s )	llsd_json_array_value_end( s )
+#define EMIT_ARRAY_END( s, n )	llsd_json_array_end( n, s )
+#define EMIT_MAP_BEGIN( s, n )	llsd_json_map_begin( n, s )
+#define EMIT_MAP_KEY_BEGIN( s )	llsd_json_map_key_begin( s )
+#define EMIT_MAP_KEY_END( s )	llsd_json_map_key_end( s )
+#define EMIT_MAP_VALUE_BEGIN( s )	llsd_json_map_value_begin( s )
+#define EMIT_MAP_VALUE_END( s )	llsd_json_map_value_end( s )
+#define EMIT_MAP_END( s, n )	llsd_json_map_end( n, s )
+#include "llsd_walk.h"
+
+int llsd_json_serializer_walk( llsd_t * const llsd, void * user_data )
+{
+	js_state_t * state = (js_state_t*)user_data;
+	CHECK_PTR_RET( llsd, FALSE );
+	CHECK_PTR_RET( state, FALSE );
+	return llsd_json_walk( llsd, state );
+}
@@ -14,10 +14,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
  */
 
-#include <time.h>
-
 #include "llsd.h"
 #include "llsd_notation_parser.h"
+#include "llsd_date.h"
+#include "llsd_number.h"
+#include "llsd_stack.h"
 
 #define NOTATION_SIG_LEN (18)
 static uint8_t const * const notation_header = "<?llsd/notation?>\n";
@@ -41,19 +42,25 @@ int llsd_notation_check_sig_file( FILE * fin )
 
 typedef struct ns_state_s
 {
-	llsd_ops_t * ops;
+	llsd_ops_t const * ops;
 	void * user_data;
-	list_t * count_stack;
-	list_t * state_stack;
+	llsd_stack_t count_stack;
+	llsd_stack_t state_stack;
+	size_t need;		/* held input wanted before a cut off token is tried again */
+	int skip;			/* the string_fn for a map key asked to skip its value */
+	int borrow;			/* text and raw data point into the buffer instead of being copied */
+	int step;			/* stop after each token, see llsd_notation_parser_next */
 } ns_state_t;
 
-#define PUSH(x)		(list_push_head( parser_state->state_stack, (void*)x ))
-#define TOP			((uint_t)list_get_head( parser_state->state_stack ))
-#define POP			(list_pop_head( parser_state->state_stack ))
+#define PUSH(x)		(llsd_stack_push( &(parser_state->state_stack), (uintptr_t)(x) ))
+#define TOP			((uint_t)llsd_stack_top( &(parser_state->state_stack) ))
+#define POP			(llsd_stack_pop( &(parser_state->state_stack) ))
+#define SET(x)		(llsd_stack_set_top( &(parser_state->state_stack), (uintptr_t)(x) ))
 
-#define PUSHC(x)	(list_push_head( parser_state->count_stack, (void*)x ))
-#define TOPC		((int_t)list_get_head( parser_state->count_stack ))
-#define POPC		(list_pop_head( parser_state->count_stack ))
+#define PUSHC(x)	(llsd_stack_push( &(parser_state->count_stack), (uintptr_t)(x) ))
+#define TOPC		((int_t)llsd_stack_top( &(parser_state->count_stack) ))
+#define POPC		(llsd_stack_pop( &(parser_state->count_stack) ))
+#define SETC(x)		(llsd_stack_set_top( &(parser_state->count_stack), (uintptr_t)(x) ))
 
 #define BEGIN_VALUE_STATES ( TOP_LEVEL | ARRAY_BEGIN | ARRAY_VALUE_END | MAP_KEY_END )
 #define BEGIN_STRING_STATES ( BEGIN_VALUE_STATES | MAP_VALUE_END | MAP_BEGIN )
@@ -66,7 +73,6 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, ns_state_t * par
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -90,13 +96,11 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, ns_state_t * par
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -109,19 +113,16 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, ns_state_t * par
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_BEGIN:
 				case MAP_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->map_key_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_KEY_BEGIN );
+					SET( MAP_KEY_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -137,10 +138,8 @@ static int incc( ns_state_t * parser_state )
 	int_t c = 0;
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->count_stack, FALSE );
 	c = TOPC;
-	POPC;
-	PUSHC( ++c );
+	SETC( ++c );
 	return TRUE;
 }
 
@@ -155,7 +154,6 @@ static int value( uint_t valid_states, llsd_type_t type_, ns_state_t * parser_st
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -177,13 +175,11 @@ static int value( uint_t valid_states, llsd_type_t type_, ns_state_t * parser_st
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					incc( parser_state );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					incc( parser_state );
 					break;
 				case TOP_LEVEL:
@@ -195,18 +191,15 @@ static int value( uint_t valid_states, llsd_type_t type_, ns_state_t * parser_st
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					incc( parser_state );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					incc( parser_state );
 					break;
 				case MAP_KEY_BEGIN:
-					POP;
-					PUSH( MAP_KEY );
+					SET( MAP_KEY );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -225,7 +218,6 @@ static int end_value( uint_t valid_states, ns_state_t * parser_state )
 
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -235,18 +227,15 @@ static int end_value( uint_t valid_states, ns_state_t * parser_state )
 	{
 		case ARRAY_VALUE:
 			CHECK_RET( (*(parser_state->ops->array_value_end_fn))( parser_state->user_data ), FALSE );
-			POP;
-			PUSH( ARRAY_VALUE_END );
+			SET( ARRAY_VALUE_END );
 			break;
 		case MAP_VALUE:
 			CHECK_RET( (*(parser_state->ops->map_value_end_fn))( parser_state->user_data ), FALSE );
-			POP;
-			PUSH( MAP_VALUE_END );
+			SET( MAP_VALUE_END );
 			break;
 		case MAP_KEY:
 			CHECK_RET( (*(parser_state->ops->map_key_end_fn))( parser_state->user_data ), FALSE );
-			POP;
-			PUSH( MAP_KEY_END );
+			SET( MAP_KEY_END );
 			break;
 		case TOP_LEVEL:
 			break;
@@ -256,36 +245,40 @@ static int end_value( uint_t valid_states, ns_state_t * parser_state )
 }
 
 
-static int llsd_notation_consume_boolean( FILE * fin, int bval )
+/* checks that there are at least n bytes left in the buffer */
+#define HAS_BYTES( p, end, n ) ( (size_t)((end) - (p)) >= (size_t)(n) )
+
+static void llsd_notation_consume_boolean( uint8_t const ** p, uint8_t const * const end, int bval )
 {
-	uint8_t p;
-	long offset;
-	CHECK_PTR_RET( fin, FALSE );
+	size_t offset = (bval ? 3 : 4 );
 
-	if ( (fread( &p, sizeof(uint8_t), 1, fin ) == 1) && isalpha(p) )
-	{
-		offset = (bval ? 2 : 3 );
-		/* move to where we need to be for the rest of the parse */
-		fseek( fin, offset, SEEK_CUR );
-	}
+	/* skip the "rue" or "alse" if the long form is used */
+	if ( ((*p) < end) && isalpha( **p ) && HAS_BYTES( (*p), end, offset ) )
+		(*p) += offset;
+}
 
-	return TRUE;
+static void llsd_notation_skip_ws( uint8_t const ** p, uint8_t const * const end )
+{
+	while ( ((*p) < end) && isspace( **p ) )
+		(*p)++;
 }
 
-static int llsd_notation_parse_integer( FILE * fin, int * ival )
+static int llsd_notation_parse_integer( uint8_t const ** p, uint8_t const * const end, int32_t * ival )
 {
-	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( ival, FALSE );
-	CHECK_RET( fscanf( fin, "%d", ival ) == 1, FALSE );
-	return TRUE;
+
+	llsd_notation_skip_ws( p, end );
+	return llsd_number_parse_integer( p, end, ival );
 }
 
-static int llsd_notation_parse_real( FILE * fin, double * dval )
+static int llsd_notation_parse_real( uint8_t const ** p, uint8_t const * const end, double * dval )
 {
-	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( dval, FALSE );
-	CHECK_RET( fscanf( fin, "%lf", dval ) == 1, FALSE );
-	return TRUE;
+
+	llsd_notation_skip_ws( p, end );
+	return llsd_number_parse_real( p, end, dval );
 }
 
 static uint8_t hex_to_byte( uint8_t hi, uint8_t lo )
@@ -309,15 +302,17 @@ static uint8_t hex_to_byte( uint8_t hi, uint8_t lo )
 	}
 }
 
-static int llsd_notation_parse_uuid( FILE * fin, uint8_t uuid[UUID_LEN] )
+static int llsd_notation_parse_uuid( uint8_t const ** p, uint8_t const * const end, uint8_t uuid[UUID_LEN] )
 {
 	int i;
-	uint8_t buf[UUID_STR_LEN];
+	uint8_t const * buf;
 
-	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( uuid, FALSE );
 
-	CHECK_RET( fread( buf, sizeof(uint8_t), UUID_STR_LEN, fin ) == UUID_STR_LEN, FALSE );
+	CHECK_RET( HAS_BYTES( (*p), end, UUID_STR_LEN ), FALSE );
+	buf = (*p);
+	(*p) += UUID_STR_LEN;
 
 	/* check for 8-4-4-4-12 */
 	for ( i = 0; i < UUID_STR_LEN; i++ )
@@ -368,22 +363,42 @@ static int llsd_notation_parse_uuid( FILE * fin, uint8_t uuid[UUID_LEN] )
 	return TRUE;
 }
 
-static int llsd_notation_parse_paren_size( FILE * fin, uint32_t * len )
+static int llsd_notation_parse_paren_size( uint8_t const ** p, uint8_t const * const end, uint32_t * len )
 {
-	CHECK_PTR_RET( fin, FALSE );
+	uint32_t v = 0;
+	uint8_t const * start;
+
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( len, FALSE );
-	CHECK_RET( fscanf( fin, "(%u)", len ) == 1, FALSE );
+
+	/* opening paren */
+	CHECK_RET( ((*p) < end) && (**p == '('), FALSE );
+	(*p)++;
+
+	/* the size */
+	start = (*p);
+	while ( ((*p) < end) && isdigit( **p ) )
+	{
+		v = (v * 10) + (**p - '0');
+		(*p)++;
+	}
+	CHECK_RET( (*p) > start, FALSE );
+
+	/* closing paren */
+	CHECK_RET( ((*p) < end) && (**p == ')'), FALSE );
+	(*p)++;
+
+	(*len) = v;
 	return TRUE;
 }
 
-static int llsd_notation_parse_base_number( FILE * fin, llsd_bin_enc_t * enc )
+static int llsd_notation_parse_base_number( uint8_t const ** p, uint8_t const * const end, llsd_bin_enc_t * enc )
 {
-	uint8_t p[2];
-	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( enc, FALSE );
 
-	CHECK_RET( fread( p, sizeof(uint8_t), 2, fin ) == 2, FALSE );
-	switch ( p[0] )
+	CHECK_RET( HAS_BYTES( (*p), end, 2 ), FALSE );
+	switch ( (*p)[0] )
 	{
 		case '1':
 			(*enc) = LLSD_BASE16;
@@ -395,319 +410,566 @@ static int llsd_notation_parse_base_number( FILE * fin, llsd_bin_enc_t * enc )
 			(*enc) = LLSD_BASE85;
 			break;
 	}
+	(*p) += 2;
 
 	return TRUE;
 }
 
-static int llsd_notation_parse_raw( FILE * fin, uint8_t ** buffer, uint32_t len, int str )
+/* with borrow set (*buffer) points at the data in the buffer instead of a copy */
+static int llsd_notation_parse_raw( uint8_t const ** p, uint8_t const * const end, uint8_t ** buffer, uint32_t len, int str, int const borrow )
 {
-	uint8_t c;
-	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( p, FALSE );
 	CHECK_PTR_RET( buffer, FALSE );
 	(*buffer) = NULL;
 
-	/* read first double quote */
-	CHECK_RET( fread( &c, sizeof(uint8_t), 1, fin ) == 1, FALSE );
-	CHECK_RET( c == '\"', FALSE );
+	/* the data must be surrounded by double quotes */
+	CHECK_RET( HAS_BYTES( (*p), end, (size_t)len + 2 ), FALSE );
+	CHECK_RET( (*p)[0] == '\"', FALSE );
+	CHECK_RET( (*p)[len + 1] == '\"', FALSE );
+
+	if ( borrow )
+	{
+		(*buffer) = (uint8_t *)&((*p)[1]);
+		(*p) += len + 2;
+		return TRUE;
+	}
 
 	/* add 1 for null termination on strings */
 	(*buffer) = CALLOC( len + (str ? 1 : 0), sizeof(uint8_t) );
 	CHECK_PTR_RET( (*buffer), FALSE );
 
-	/* read the raw data */
-	CHECK_RET( fread( (*buffer), sizeof(uint8_t), len, fin ) == len, FALSE );
-
-	/* read second double quote */
-	CHECK_RET( fread( &c, sizeof(uint8_t), 1, fin ) == 1, FALSE );
-	CHECK_RET( c == '\"', FALSE );
+	/* copy the raw data */
+	MEMCPY( (*buffer), &((*p)[1]), len );
+	(*p) += len + 2;
 
 	return TRUE;
 }
 
-static int llsd_notation_parse_quoted( FILE * fin, uint8_t ** buffer, uint32_t * len, uint8_t quote )
+static int llsd_notation_find_quoted( uint8_t const ** p, uint8_t const * const end, uint8_t const ** start, uint32_t * len, uint8_t quote )
 {
-	int i;
-	int done = FALSE;
-	static uint8_t buf[1024];
-	CHECK_PTR_RET( fin, FALSE );
-	CHECK_PTR_RET( buffer, FALSE );
+	uint8_t const * q;
+	CHECK_PTR_RET( p, FALSE );
+	CHECK_PTR_RET( start, FALSE );
 	CHECK_PTR_RET( len, FALSE );
 
-	(*len) = 0;
+	/* look for an unescaped matching quote character */
+	for ( q = (*p); q < end; q++ )
+	{
+		if ( ((*q) == quote) && ((q == (*p)) || (q[-1] != '\\')) )
+			break;
+	}
+	CHECK_RET( q < end, FALSE );
+
+	(*start) = (*p);
+	(*len) = (uint32_t)(q - (*p));
+
+	/* move past the closing quote */
+	(*p) = q + 1;
+	return TRUE;
+}
+
+/* what notation_skip_value expects next */
+#define SKIP_VALUE	(0)		/* a value, or the end of an empty array */
+#define SKIP_KEY	(1)		/* a key, or the end of an empty map */
+#define SKIP_COLON	(2)
+#define SKIP_NEXT	(3)		/* a comma or the end of the container */
+
+#define IS_SPACE( c ) ( ((c) == ' ') || ((c) == '\t') || ((c) == '\r') || ((c) == '\n') )
+
+/* checks the value at p that isn't an array or map like the parser would
+ * without keeping it.  string is set for the values that can be map keys */
+static int notation_skip_scalar( uint8_t const ** p, uint8_t const * const end, int * const string )
+{
+	uint8_t t;
+	uint32_t len;
+	uint32_t enc_len;
+	int32_t int_val;
+	double real_val;
+	uint8_t uuid[UUID_LEN];
+	uint8_t const * start;
+	uint8_t * buffer = NULL;
+	llsd_bin_enc_t encoding = 0;
+	int ok = FALSE;
+
+	(*string) = FALSE;
+	t = *(*p)++;
 
-	while( !done )
+	switch ( t )
 	{
-		for ( i = 0; (i < 1024) && (!done); i++ )
-		{
-			CHECK_RET( fread( &buf[i], sizeof(uint8_t), 1, fin ) == 1, FALSE );
+		case '!':
+		case '0':
+		case '1':
+			return TRUE;
+
+		case 't':
+		case 'T':
+			llsd_notation_consume_boolean( p, end, TRUE );
+			return TRUE;
 
-			/* check for an unescaped matching quote character */
-			if ( buf[i] == quote ) 
+		case 'f':
+		case 'F':
+			llsd_notation_consume_boolean( p, end, FALSE );
+			return TRUE;
+
+		case 'i':
+			return llsd_notation_parse_integer( p, end, &int_val );
+
+		case 'r':
+			return llsd_notation_parse_real( p, end, &real_val );
+
+		case 'u':
+			return llsd_notation_parse_uuid( p, end, uuid );
+
+		case '\'':
+		case '\"':
+			(*string) = TRUE;
+			return llsd_notation_find_quoted( p, end, &start, &len, t );
+
+		case 's':
+			(*string) = TRUE;
+			CHECK_RET( llsd_notation_parse_paren_size( p, end, &len ), FALSE );
+			return llsd_notation_parse_raw( p, end, &buffer, len, TRUE, TRUE );
+
+		case 'b':
+			if ( ((*p) < end) && ((**p) == '(') )
 			{
-				if ( (i == 0) || ((i > 0) && (buf[i-1] != '\\')) )
-					done = TRUE;
+				CHECK_RET( llsd_notation_parse_paren_size( p, end, &len ), FALSE );
+				return llsd_notation_parse_raw( p, end, &buffer, len, FALSE, TRUE );
 			}
-		}
 
-		if ( done && (((*len) + i) == 0) )
-		{
-			/* make sure there is at least one byte in the buffer */
-			(*buffer) = REALLOC( (*buffer), 1 );
-			CHECK_PTR_RET( (*buffer), FALSE );
-		}
-		else
+			/* encoded binary is only known to be good once it is decoded */
+			CHECK_RET( HAS_BYTES( (*p), end, 3 ), FALSE );
+			CHECK_RET( llsd_notation_parse_base_number( p, end, &encoding ), FALSE );
+			CHECK_RET( (encoding >= LLSD_BASE16) && (encoding <= LLSD_BASE85), FALSE );
+			t = *(*p)++;
+			CHECK_RET( llsd_notation_find_quoted( p, end, &start, &enc_len, t ), FALSE );
+			switch ( encoding )
+			{
+				case LLSD_BASE16:
+					len = base16_decoded_len( start, enc_len );
+					break;
+				case LLSD_BASE64:
+					len = base64_decoded_len( start, enc_len );
+					break;
+				case LLSD_BASE85:
+					len = base85_decoded_len( start, enc_len );
+					break;
+			}
+			buffer = CALLOC( len, sizeof(uint8_t) );
+			CHECK_PTR_RET( buffer, FALSE );
+			switch ( encoding )
+			{
+				case LLSD_BASE16:
+					ok = base16_decode( start, enc_len, buffer, &len );
+					break;
+				case LLSD_BASE64:
+					ok = base64_decode( start, enc_len, buffer, &len );
+					break;
+				case LLSD_BASE85:
+					ok = base85_decode( start, enc_len, buffer, &len );
+					break;
+			}
+			FREE( buffer );
+			return ok;
+
+		case 'l':
+			/* any quote character opens it, a double quote closes it */
+			CHECK_RET( (*p) < end, FALSE );
+			(*p)++;
+			return llsd_notation_find_quoted( p, end, &start, &len, '\"' );
+
+		case 'd':
+			CHECK_RET( (*p) < end, FALSE );
+			(*p)++;
+			CHECK_RET( llsd_notation_find_quoted( p, end, &start, &len, '\"' ), FALSE );
+			return llsd_date_parse( start, len, &real_val );
+	}
+
+	return FALSE;
+}
+
+/* returns the end of the value at p without building anything.  it is held
+ * to the same grammar as the parser so a projection never takes a document
+ * that a whole parse would turn down.  the bit for each depth is set when
+ * that container is a map. */
+static uint8_t const * notation_skip_value( uint8_t const * p, uint8_t const * const end )
+{
+	uint8_t maps[LLSD_MAX_DEPTH / 8];
+	uint_t depth = 0;
+	int want = SKIP_VALUE;
+	int first = FALSE;
+	int string;
+
+#define IN_MAP ( (maps[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1 )
+
+	while ( TRUE )
+	{
+		while ( (p < end) && IS_SPACE( *p ) )
+			p++;
+		CHECK_RET( p < end, NULL );
+
+		switch ( want )
 		{
-			/* increase the buffer size */
-			(*buffer) = REALLOC( (*buffer), (*len) + i );
-			CHECK_PTR_RET( (*buffer), FALSE );
+			case SKIP_KEY:
+				if ( first && ((*p) == '}') )
+					break;
+				CHECK_RET( notation_skip_scalar( &p, end, &string ) && string, NULL );
+				want = SKIP_COLON;
+				continue;
+
+			case SKIP_COLON:
+				CHECK_RET( (*p) == ':', NULL );
+				p++;
+				want = SKIP_VALUE;
+				continue;
+
+			case SKIP_NEXT:
+				if ( (*p) == ',' )
+				{
+					p++;
+					want = (IN_MAP ? SKIP_KEY : SKIP_VALUE);
+					first = FALSE;
+					continue;
+				}
+				break;
+
+			default:
+				if ( first && ((*p) == ']') )
+					break;
+
+				if ( ((*p) == '[') || ((*p) == '{') )
+				{
+					CHECK_RET( depth < LLSD_MAX_DEPTH, NULL );
+					if ( (*p) == '{' )
+						maps[depth / 8] |= (uint8_t)(1 << (depth % 8));
+					else
+						maps[depth / 8] &= (uint8_t)~(1 << (depth % 8));
+					depth++;
+					want = (((*p++) == '{') ? SKIP_KEY : SKIP_VALUE);
+					first = TRUE;
+					continue;
+				}
 
-			/* copy the data over */
-			MEMCPY( &((*buffer)[(*len)]), buf, i - (done ? 1 : 0) );
-			(*len) += (i - (done ? 1 : 0));
+				CHECK_RET( notation_skip_scalar( &p, end, &string ), NULL );
+
+				/* a whole value, at the top it is the end */
+				if ( depth == 0 )
+					return p;
+				want = SKIP_NEXT;
+				continue;
 		}
 
-		/* null terminate */
-		if ( done )
-			(*buffer)[(*len)] = '\0';
+		/* the end of the container, it has to match the one it began with */
+		CHECK_RET( (*p) == (IN_MAP ? '}' : ']'), NULL );
+		p++;
+		depth--;
+		if ( depth == 0 )
+			return p;
+		want = SKIP_NEXT;
+		first = FALSE;
 	}
-	
-	return TRUE;
-}
 
-/* timezone value gets set to the number of seconds offset from GMT for local time */
-extern long timezone;
+#undef IN_MAP
+}
 
-static int llsd_notation_decode_date( uint8_t * data, double * real_val )
+/* copies the text found by llsd_notation_find_quoted and null terminates it */
+static uint8_t * llsd_notation_copy_quoted( uint8_t const * const start, uint32_t const len )
 {
-	int useconds;
-	struct tm parts;
-	double seconds;
-	uint32_t tmp = 0;
-
-	CHECK_PTR_RET( data, FALSE );
-	CHECK_PTR_RET( real_val, FALSE );
+	uint8_t * buffer = NULL;
 
-	MEMSET( &parts, 0, sizeof(struct tm) );
+	buffer = CALLOC( len + 1, sizeof(uint8_t) );
+	CHECK_PTR_RET( buffer, NULL );
+	MEMCPY( buffer, start, len );
 
-	CHECK_RET( sscanf( data, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", &parts.tm_year, &parts.tm_mon, &parts.tm_mday, &parts.tm_hour, &parts.tm_min, &parts.tm_sec, &useconds ) == 7, FALSE );
+	return buffer;
+}
 
-	/* adjust a few things */
-	parts.tm_year -= 1900;
-	parts.tm_mon -= 1;
+int llsd_notation_check_sig_buffer( uint8_t const * const buf, size_t const len )
+{
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( len >= NOTATION_SIG_LEN, FALSE );
 
-	/* convert to seconds */
-	tmp = mktime(&parts);
-	
-	/* correct for localtime variation */
-	tmp -= timezone;
+	/* if it matches the signature, return TRUE, otherwise FALSE */
+	return ( memcmp( buf, notation_header, NOTATION_SIG_LEN ) == 0 );
+}
 
-	/* convert to double */
-	(*real_val) = (double)tmp;
+static int notation_state_initialize( ns_state_t * const parser_state )
+{
+	MEMSET( parser_state, 0, sizeof(ns_state_t) );
 
-	/* add in the miliseconds */
-	(*real_val) += ((double)useconds * 1000.0);
+	/* set up step stack, used to synthesize array value end, map key end, 
+	 * and map value end callbacks */
+	llsd_stack_initialize( &(parser_state->count_stack) );
+	llsd_stack_initialize( &(parser_state->state_stack) );
 
 	return TRUE;
 }
 
-int llsd_notation_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data )
+static void notation_state_deinitialize( ns_state_t * const parser_state )
 {
-	uint8_t p;
-	size_t ret;
-	int bool_val;
-	int32_t int_val;
-	double real_val;
-	uint8_t uuid[UUID_LEN];
-	uint8_t * buffer = NULL;
-	uint8_t * encoded = NULL;
-	uint32_t len;
-	uint32_t enc_len;
-	llsd_bin_enc_t encoding = 0;
-	ns_state_t* parser_state = NULL;
+	llsd_stack_deinitialize( &(parser_state->count_stack) );
+	llsd_stack_deinitialize( &(parser_state->state_stack) );
+}
 
-	CHECK_PTR_RET( fin, FALSE );
-	CHECK_PTR_RET( ops, FALSE );
+/* empties the stacks, a failed parse leaves whatever it had pushed on them */
+static void notation_state_reset( ns_state_t * const parser_state, llsd_ops_t const * const ops, void * const user_data )
+{
+	llsd_stack_clear( &(parser_state->count_stack) );
+	llsd_stack_clear( &(parser_state->state_stack) );
+	parser_state->ops = ops;
+	parser_state->user_data = user_data;
+	parser_state->need = 0;
+	parser_state->skip = FALSE;
+	parser_state->borrow = FALSE;
+	parser_state->step = FALSE;
+
+	/* start at top level state */
+	PUSH( TOP_LEVEL );
+}
+
+llsd_notation_ctx_t * llsd_notation_ctx_new( void )
+{
+	ns_state_t * parser_state = NULL;
 
-	/* set up step stack, used to synthesize array value end, map key end, 
-	 * and map value end callbacks */
 	parser_state = CALLOC( 1, sizeof(ns_state_t) );
-	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( parser_state, NULL );
 
-	parser_state->count_stack = list_new( 0, NULL );
-	if ( parser_state->count_stack == NULL )
+	if ( !notation_state_initialize( parser_state ) )
 	{
 		FREE( parser_state );
-		return FALSE;
+		return NULL;
 	}
 
-	parser_state->state_stack = list_new( 1, NULL );
-	if ( parser_state->state_stack == NULL )
-	{
-		list_delete( parser_state->count_stack );
-		FREE( parser_state );
-		return FALSE;
-	}
-	parser_state->ops = ops;
-	parser_state->user_data = user_data;
+	return parser_state;
+}
 
-	/* start at top level state */
-	PUSH( TOP_LEVEL );
+void llsd_notation_ctx_delete( void * p )
+{
+	ns_state_t * parser_state = (ns_state_t*)p;
+	CHECK_PTR( parser_state );
+
+	notation_state_deinitialize( parser_state );
+	FREE( parser_state );
+}
+
+int llsd_notation_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	ns_state_t state;
 
-	/* seek past signature */
-	fseek( fin, NOTATION_SIG_LEN, SEEK_SET );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
 
-	while( TRUE )
+	CHECK_RET( notation_state_initialize( &state ), FALSE );
+	ret = llsd_notation_parse_buffer_ctx( &state, buf, len, ops, user_data );
+	notation_state_deinitialize( &state );
+
+	return ret;
+}
+
+/* a token that can't be read yet is left for the next call when more data is
+ * coming.  need asks for twice what is held so a long string arriving in small
+ * chunks is only scanned a few times. */
+#define NEED( x ) \
+	do { \
+		if ( !(x) ) \
+		{ \
+			p = tok; \
+			if ( more ) \
+			{ \
+				parser_state->need = (2 * (size_t)(end - tok)) + 1; \
+				goto need_more; \
+			} \
+			goto fail_notation_parse; \
+		} \
+	} while ( 0 )
+
+/* parses the tokens in buf and sets (*used) to the bytes consumed.  with more
+ * set, a token cut off at the end of buf is left there for the next call. */
+static int notation_parse_tokens( ns_state_t * const parser_state, uint8_t const * const buf, size_t const len, int const more, size_t * const used )
+{
+	uint8_t t;
+	uint8_t const * p = buf;
+	uint8_t const * tok = buf;
+	uint8_t const * const end = buf + len;
+	int32_t int_val;
+	double real_val;
+	uint8_t uuid[UUID_LEN];
+	uint8_t * buffer = NULL;
+	uint8_t * encoded = NULL;
+	uint8_t const * quoted = NULL;
+	uint32_t blen;
+	uint32_t enc_len;
+	int ok;
+	int own_it;
+	int_t ret;
+	llsd_bin_enc_t encoding = 0;
+	llsd_ops_t const * const ops = parser_state->ops;
+	void * const user_data = parser_state->user_data;
+
+	parser_state->need = 0;
+
+	while( p < end )
 	{
 		/* read the type marker */
-		ret = fread( &p, sizeof(uint8_t), 1, fin );
-		if ( feof( fin ) )
-			break;
+		tok = p;
+		t = *p++;
 
-		CHECK_RET( ret == 1, FALSE );
+		if ( parser_state->skip && (t != ',') && (t != ':') && (t != ' ') && (t != '\t') && (t != '\r') && (t != '\n') )
+		{
+			/* jump over the value, the ops still see it begin and end */
+			p = notation_skip_value( tok, end );
+			NEED( (p != NULL) && (!more || (p < end)) );
+			parser_state->skip = FALSE;
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_notation_parse );
+			CHECK_GOTO( value( VALUE_STATES, LLSD_UNDEF, parser_state ), fail_notation_parse );
+			if ( parser_state->step )
+				break;
+			continue;
+		}
 
-		switch( p )
+		switch( t )
 		{
 
 			case '!':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), FALSE );
-				CHECK_RET( (*(ops->undef_fn))( user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_UNDEF, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UNDEF, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->undef_fn))( user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_UNDEF, parser_state ), fail_notation_parse );
 				break;
 
 			case '1':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( (*(ops->boolean_fn))( TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->boolean_fn))( TRUE, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
 				break;
 
 			case '0':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( (*(ops->boolean_fn))( FALSE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->boolean_fn))( FALSE, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
 				break;
 
 			case 't':
 			case 'T':
-				CHECK_RET( llsd_notation_consume_boolean( fin, TRUE ), FALSE );
-				
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( (*(ops->boolean_fn))( TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
+				/* the "rue" of the long form may still be coming */
+				NEED( !more || HAS_BYTES( p, end, 3 ) );
+				llsd_notation_consume_boolean( &p, end, TRUE );
+
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->boolean_fn))( TRUE, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
 				break;
 
 			case 'f':
 			case 'F':
-				CHECK_RET( llsd_notation_consume_boolean( fin, FALSE ), FALSE );
-				
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
-				CHECK_RET( (*(ops->boolean_fn))( FALSE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), FALSE );
+				NEED( !more || HAS_BYTES( p, end, 4 ) );
+				llsd_notation_consume_boolean( &p, end, FALSE );
+
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->boolean_fn))( FALSE, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), fail_notation_parse );
 				break;
 
 			case 'i':
-				CHECK_RET( llsd_notation_parse_integer( fin, &int_val ), FALSE );
-				
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_INTEGER, parser_state ), FALSE );
-				CHECK_RET( (*(ops->integer_fn))( int_val, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_INTEGER, parser_state ), FALSE );
+				ok = llsd_notation_parse_integer( &p, end, &int_val );
+
+				/* a number that runs up to the end may go on in the next chunk */
+				NEED( ok && (!more || (p < end)) );
+
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_INTEGER, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->integer_fn))( int_val, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_INTEGER, parser_state ), fail_notation_parse );
 				break;
 
 			case 'r':
-				CHECK_RET( llsd_notation_parse_real( fin, &real_val ), FALSE );
-				
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_REAL, parser_state ), FALSE );
-				CHECK_RET( (*(ops->real_fn))( real_val, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_REAL, parser_state ), FALSE );
+				ok = llsd_notation_parse_real( &p, end, &real_val );
+				NEED( ok && (!more || (p < end)) );
+
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_REAL, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->real_fn))( real_val, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_REAL, parser_state ), fail_notation_parse );
 				break;
 
 			case 'u':
-				CHECK_RET( llsd_notation_parse_uuid( fin, uuid ), FALSE );
-				
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_UUID, parser_state ), FALSE );
-				CHECK_RET( (*(ops->uuid_fn))( uuid, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_UUID, parser_state ), FALSE );
+				NEED( HAS_BYTES( p, end, UUID_STR_LEN ) );
+				CHECK_GOTO( llsd_notation_parse_uuid( &p, end, uuid ), fail_notation_parse );
+
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_UUID, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->uuid_fn))( uuid, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_UUID, parser_state ), fail_notation_parse );
 				break;
 
 			case 'b':
-				CHECK_RET( fread( &p, sizeof(uint8_t), 1, fin ) == 1, FALSE );
-				CHECK_RET( fseek( fin, -1, SEEK_CUR ) == 0, FALSE );
-				if ( p == '(' )
+				NEED( p < end );
+				if ( *p == '(' )
 				{
 					/* it is a binary size in parenthesis */
-					CHECK_RET( llsd_notation_parse_paren_size( fin, &len ), FALSE );
+					NEED( llsd_notation_parse_paren_size( &p, end, &blen ) );
 
 					/* grab the binary data */
-					CHECK_RET( llsd_notation_parse_raw( fin, &buffer, len, FALSE ), FALSE );
+					NEED( HAS_BYTES( p, end, (size_t)blen + 2 ) );
+					CHECK_GOTO( llsd_notation_parse_raw( &p, end, &buffer, blen, FALSE, parser_state->borrow ), fail_notation_parse );
+					own_it = (parser_state->borrow ? LLSD_BORROW : TRUE);
 				}
 				else
 				{
-					/* it is a base encoding number */
-					CHECK_RET( llsd_notation_parse_base_number( fin, &encoding ), FALSE );
-					CHECK_RET( (encoding >= LLSD_BASE16) && (encoding <= LLSD_BASE85), FALSE );
-				
+					/* it is a base encoding number and the quote character */
+					NEED( HAS_BYTES( p, end, 3 ) );
+					own_it = TRUE;
+					CHECK_GOTO( llsd_notation_parse_base_number( &p, end, &encoding ), fail_notation_parse );
+					CHECK_GOTO( (encoding >= LLSD_BASE16) && (encoding <= LLSD_BASE85), fail_notation_parse );
+
 					/* read the quote character */
-					CHECK_RET( fread( &p, sizeof(uint8_t), 1, fin ) == 1, FALSE );
-					
-					/* read the quoted string */
-					CHECK_RET( llsd_notation_parse_quoted( fin, &encoded, &enc_len, p ), FALSE );
+					t = *p++;
+
+					/* find the quoted string, it is decoded straight from the buffer */
+					NEED( llsd_notation_find_quoted( &p, end, &quoted, &enc_len, t ) );
 
 					/* decode the binary */
 					switch( encoding )
 					{
 						case LLSD_BASE16:
-							len = base16_decoded_len( encoded, enc_len );
-							buffer = CALLOC( len, sizeof(uint8_t) );
-							if ( buffer == NULL )
-							{
-								FREE( encoded );
-								return FALSE;
-							}
-							if ( !base16_decode( encoded, enc_len, buffer, &len ) )
+							blen = base16_decoded_len( quoted, enc_len );
+							buffer = CALLOC( blen, sizeof(uint8_t) );
+							CHECK_GOTO( buffer != NULL, fail_notation_parse );
+							if ( !base16_decode( quoted, enc_len, buffer, &blen ) )
 							{
-								FREE( encoded );
 								FREE( buffer );
-								return FALSE;
+								goto fail_notation_parse;
 							}
 							break;
 						case LLSD_BASE64:
-							len = base64_decoded_len( encoded, enc_len );
-							buffer = CALLOC( len, sizeof(uint8_t) );
-							if ( buffer == NULL )
-							{
-								FREE( encoded );
-								return FALSE;
-							}
-							if ( !base64_decode( encoded, enc_len, buffer, &len ) )
+							blen = base64_decoded_len( quoted, enc_len );
+							buffer = CALLOC( blen, sizeof(uint8_t) );
+							CHECK_GOTO( buffer != NULL, fail_notation_parse );
+							if ( !base64_decode( quoted, enc_len, buffer, &blen ) )
 							{
-								FREE( encoded );
 								FREE( buffer );
-								return FALSE;
+								goto fail_notation_parse;
 							}
 							break;
 						case LLSD_BASE85:
-							len = base85_decoded_len( encoded, enc_len );
-							buffer = CALLOC( len, sizeof(uint8_t) );
-							if ( buffer == NULL )
+							blen = base85_decoded_len( quoted, enc_len );
+							buffer = CALLOC( blen, sizeof(uint8_t) );
+							CHECK_GOTO( buffer != NULL, fail_notation_parse );
+							if ( !base85_decode( quoted, enc_len, buffer, &blen ) )
 							{
-								FREE( encoded );
-								return FALSE;
-							}
-							if ( !base85_decode( encoded, enc_len, buffer, &len ) )
-							{
-								FREE( encoded );
 								FREE( buffer );
-								return FALSE;
+								goto fail_notation_parse;
 							}
 							break;
 					}
-					FREE( encoded );
-					encoded = NULL;
 				}
-			
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->binary_fn))( buffer, len, TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_BINARY, parser_state ), FALSE );
+
+				if ( !begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ) )
+				{
+					if ( own_it == TRUE )
+						FREE( buffer );
+					goto fail_notation_parse;
+				}
+				/* tell it to take ownership of the memory, or borrow it */
+				CHECK_GOTO( (*(ops->binary_fn))( buffer, blen, own_it, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_BINARY, parser_state ), fail_notation_parse );
 
 				buffer = NULL;
 				break;
@@ -715,116 +977,139 @@ int llsd_notation_parse_file( FILE * fin, llsd_ops_t * const ops, void * const u
 			case '\'':
 			case '\"':
 				/* read the quoted string */
-				CHECK_RET( llsd_notation_parse_quoted( fin, &buffer, &len, p ), FALSE );
-			
-				CHECK_RET( begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->string_fn))( buffer, TRUE, user_data ), FALSE );
-				CHECK_RET( value( STRING_STATES, LLSD_STRING, parser_state ), FALSE );
+				NEED( llsd_notation_find_quoted( &p, end, &quoted, &blen, t ) );
+				buffer = (parser_state->borrow ? (uint8_t *)quoted : llsd_notation_copy_quoted( quoted, blen ));
+				CHECK_GOTO( buffer != NULL, fail_notation_parse );
+				own_it = (parser_state->borrow ? LLSD_BORROW : TRUE);
 
+				if ( !begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ) )
+				{
+					if ( own_it == TRUE )
+						FREE( buffer );
+					goto fail_notation_parse;
+				}
+				/* tell it to take ownership of the memory, or borrow it */
+				ret = (*(ops->string_fn))( buffer, blen, own_it, user_data );
 				buffer = NULL;
+				CHECK_GOTO( ret, fail_notation_parse );
+				CHECK_GOTO( value( STRING_STATES, LLSD_STRING, parser_state ), fail_notation_parse );
+
+				/* the value after a skipped key is passed over */
+				if ( (ret == LLSD_SKIP) && (TOP == MAP_KEY) )
+					parser_state->skip = TRUE;
 				break;
 
 			case 's':
 				/* it is a string size in parenthesis */
-				CHECK_RET( llsd_notation_parse_paren_size( fin, &len ), FALSE );
+				NEED( llsd_notation_parse_paren_size( &p, end, &blen ) );
 
 				/* read the raw string, add 1 so that it is null terminated */
-				CHECK_RET( llsd_notation_parse_raw( fin, &buffer, len, TRUE ), FALSE );
-
-				CHECK_RET( begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->string_fn))( buffer, TRUE, user_data ), FALSE );
-				CHECK_RET( value( STRING_STATES, LLSD_STRING, parser_state ), FALSE );
+				NEED( HAS_BYTES( p, end, (size_t)blen + 2 ) );
+				CHECK_GOTO( llsd_notation_parse_raw( &p, end, &buffer, blen, TRUE, parser_state->borrow ), fail_notation_parse );
+				own_it = (parser_state->borrow ? LLSD_BORROW : TRUE);
 
+				if ( !begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ) )
+				{
+					if ( own_it == TRUE )
+						FREE( buffer );
+					goto fail_notation_parse;
+				}
+				/* tell it to take ownership of the memory, or borrow it */
+				ret = (*(ops->string_fn))( buffer, blen, own_it, user_data );
 				buffer = NULL;
+				CHECK_GOTO( ret, fail_notation_parse );
+				CHECK_GOTO( value( STRING_STATES, LLSD_STRING, parser_state ), fail_notation_parse );
+
+				/* the value after a skipped key is passed over */
+				if ( (ret == LLSD_SKIP) && (TOP == MAP_KEY) )
+					parser_state->skip = TRUE;
 				break;
 
 			case 'l':
-				/* read the quote character */
-				CHECK_RET( fread( &p, sizeof(uint8_t), 1, fin ) == 1, FALSE );
+				/* skip the quote character */
+				NEED( p < end );
+				p++;
 
 				/* read the uri */
-				CHECK_RET( llsd_notation_parse_quoted( fin, &encoded, &enc_len, '\"' ), FALSE );
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_URI, parser_state ), FALSE );
-				/* tell it to take ownership of the memory */
-				CHECK_RET( (*(ops->uri_fn))( encoded, TRUE, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_URI, parser_state ), FALSE );
+				NEED( llsd_notation_find_quoted( &p, end, &quoted, &enc_len, '\"' ) );
+				encoded = (parser_state->borrow ? (uint8_t *)quoted : llsd_notation_copy_quoted( quoted, enc_len ));
+				CHECK_GOTO( encoded != NULL, fail_notation_parse );
+				own_it = (parser_state->borrow ? LLSD_BORROW : TRUE);
+				if ( !begin_value( BEGIN_VALUE_STATES, LLSD_URI, parser_state ) )
+				{
+					if ( own_it == TRUE )
+						FREE( encoded );
+					goto fail_notation_parse;
+				}
+				/* tell it to take ownership of the memory, or borrow it */
+				CHECK_GOTO( (*(ops->uri_fn))( encoded, enc_len, own_it, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_URI, parser_state ), fail_notation_parse );
 
 				encoded = NULL;
 				break;
 
 			case 'd':
-				/* read the quote character */
-				CHECK_RET( fread( &p, sizeof(uint8_t), 1, fin ) == 1, FALSE );
-
-				/* read in the quoted string */
-				CHECK_RET( llsd_notation_parse_quoted( fin, &encoded, &enc_len, '\"' ), FALSE );
-
-				if ( !llsd_notation_decode_date( encoded, &real_val ) )
-				{
-					FREE( encoded );
-					return FALSE;
-				}
+				/* skip the quote character */
+				NEED( p < end );
+				p++;
 
-				FREE( encoded );
-				encoded = NULL;
+				/* find the quoted string and parse the date in place */
+				NEED( llsd_notation_find_quoted( &p, end, &quoted, &enc_len, '\"' ) );
+				CHECK_GOTO( llsd_date_parse( quoted, enc_len, &real_val ), fail_notation_parse );
 
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_DATE, parser_state ), FALSE );
-				CHECK_RET( (*(ops->date_fn))( real_val, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_DATE, parser_state ), FALSE );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_DATE, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->date_fn))( real_val, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_DATE, parser_state ), fail_notation_parse );
 				break;
 
 			case '[':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ), FALSE );
-				CHECK_RET( (*(ops->array_begin_fn))( 0, user_data ), FALSE );
-				PUSH( ARRAY_BEGIN );
-				PUSHC( 0 );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->array_begin_fn))( 0, user_data ), fail_notation_parse );
+				CHECK_GOTO( PUSH( ARRAY_BEGIN ) && PUSHC( 0 ), fail_notation_parse );
 				break;
 
 			case ']':
 				/* if there were any items in this array, we need to generate the end_value
-				 * callbacks here because there isn't a comma to mark the end of the last 
+				 * callbacks here because there isn't a comma to mark the end of the last
 				 * value */
 				if ( TOPC )
 				{
-					CHECK_RET( end_value( ARRAY_VALUE, parser_state ), FALSE );
+					CHECK_GOTO( end_value( ARRAY_VALUE, parser_state ), fail_notation_parse );
 				}
 
 				POP;
 				POPC;
-				CHECK_RET( (*(ops->array_end_fn))( 0, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_ARRAY, parser_state ), FALSE );
+				CHECK_GOTO( (*(ops->array_end_fn))( 0, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_ARRAY, parser_state ), fail_notation_parse );
 				break;
-			
+
 			case '{':
-				CHECK_RET( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ), FALSE );
-				CHECK_RET( (*(ops->map_begin_fn))( 0, user_data ), FALSE );
-				PUSH( MAP_BEGIN );
-				PUSHC( 0 );
+				CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ), fail_notation_parse );
+				CHECK_GOTO( (*(ops->map_begin_fn))( 0, user_data ), fail_notation_parse );
+				CHECK_GOTO( PUSH( MAP_BEGIN ) && PUSHC( 0 ), fail_notation_parse );
 				break;
 
 			case '}':
 				/* if there were any items in this array, we need to generate the end_value
-				 * callbacks here because there isn't a comma to mark the end of the last 
+				 * callbacks here because there isn't a comma to mark the end of the last
 				 * value */
 				if ( TOPC )
 				{
-					CHECK_RET( end_value( MAP_VALUE, parser_state ), FALSE );
+					CHECK_GOTO( end_value( MAP_VALUE, parser_state ), fail_notation_parse );
 				}
 
 				POP;
 				POPC;
-				CHECK_RET( (*(ops->map_end_fn))( 0, user_data ), FALSE );
-				CHECK_RET( value( VALUE_STATES, LLSD_MAP, parser_state ), FALSE );
+				CHECK_GOTO( (*(ops->map_end_fn))( 0, user_data ), fail_notation_parse );
+				CHECK_GOTO( value( VALUE_STATES, LLSD_MAP, parser_state ), fail_notation_parse );
 				break;
 
 			case ',':
-				CHECK_RET( end_value( (ARRAY_VALUE | MAP_VALUE), parser_state ), FALSE );
+				CHECK_GOTO( end_value( (ARRAY_VALUE | MAP_VALUE), parser_state ), fail_notation_parse );
 				break;
 
 			case ':':
-				CHECK_RET( end_value( MAP_KEY, parser_state ), FALSE );
+				CHECK_GOTO( end_value( MAP_KEY, parser_state ), fail_notation_parse );
 				break;
 
 			/* eat whitespace and commas */
@@ -834,22 +1119,121 @@ int llsd_notation_parse_file( FILE * fin, llsd_ops_t * const ops, void * const u
 			case '\n':
 				break;
 			default:
-				WARN( "garbage byte %c at 0x%08x\n", p, (unsigned int)ftell( fin ) - 1 );
-				return FALSE;
+				WARN( "garbage byte %c at 0x%08x\n", t, (unsigned int)(p - buf) - 1 );
+				goto fail_notation_parse;
 		}
+
+		/* separators and space don't reach the ops as tokens */
+		if ( parser_state->step && (t != ',') && (t != ':') && (t != ' ') && (t != '\t') && (t != '\r') && (t != '\n') )
+			break;
 	}
 
-	/* clean up the count stack */
-	list_delete( parser_state->count_stack );
+need_more:
+	(*used) = (size_t)(p - buf);
+	return TRUE;
 
-	/* clean up the step stack */
-	CHECK_RET( TOP == TOP_LEVEL, FALSE );
-	list_delete( parser_state->state_stack );
+fail_notation_parse:
+	(*used) = (size_t)(p - buf);
+	return FALSE;
+}
 
-	/* free the parser_state */
-	FREE( parser_state );
+int llsd_notation_parse_buffer_ctx( llsd_notation_ctx_t * const ctx, uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	size_t used = 0;
+	size_t skip = 0;
+	ns_state_t * parser_state = ctx;
 
-	return TRUE;
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	notation_state_reset( parser_state, ops, user_data );
+
+	/* skip past signature */
+	if ( llsd_notation_check_sig_buffer( buf, len ) )
+		skip = NOTATION_SIG_LEN;
+
+	CHECK_RET( notation_parse_tokens( parser_state, buf + skip, len - skip, FALSE, &used ), FALSE );
+
+	/* the stacks are emptied by the next parse */
+	return ( TOP == TOP_LEVEL );
 }
 
+llsd_notation_parser_t * llsd_notation_parser_new( llsd_ops_t const * const ops, void * const user_data )
+{
+	ns_state_t * parser_state = NULL;
+
+	CHECK_PTR_RET( ops, NULL );
+
+	parser_state = llsd_notation_ctx_new();
+	CHECK_PTR_RET( parser_state, NULL );
+	notation_state_reset( parser_state, ops, user_data );
+
+	return parser_state;
+}
+
+void llsd_notation_parser_delete( void * p )
+{
+	llsd_notation_ctx_delete( p );
+}
+
+int llsd_notation_parser_feed( llsd_notation_parser_t * const state, uint8_t const * const buf, size_t const len, int const final, size_t * const used )
+{
+	ns_state_t * parser_state = state;
+
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_RET( (buf != NULL) || (len == 0), FALSE );
+	CHECK_PTR_RET( used, FALSE );
+
+	(*used) = 0;
+	if ( len > 0 )
+	{
+		CHECK_RET( notation_parse_tokens( parser_state, buf, len, !final, used ), FALSE );
+	}
+
+	/* the document can't end inside an array or map */
+	return ( !final || (TOP == TOP_LEVEL) );
+}
+
+size_t llsd_notation_parser_need( llsd_notation_parser_t * const state )
+{
+	CHECK_PTR_RET( state, 0 );
+	return state->need;
+}
+
+int llsd_notation_parser_next( llsd_notation_parser_t * const state, uint8_t const * const buf, size_t const len, int * const skip, size_t * const used )
+{
+	int ret = FALSE;
+	ns_state_t * parser_state = state;
+
+	CHECK_PTR_RET( parser_state, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( used, FALSE );
+
+	parser_state->step = TRUE;
+	parser_state->borrow = TRUE;
+	parser_state->skip = ((skip != NULL) && (*skip));
+	ret = notation_parse_tokens( parser_state, buf, len, FALSE, used );
+	if ( skip != NULL )
+		(*skip) = parser_state->skip;
+
+	return ret;
+}
+
+int llsd_notation_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	/* read the whole file into memory and parse it from there */
+	CHECK_RET( llsd_read_file( fin, &buf, &len ), FALSE );
+	ret = llsd_notation_parse_buffer( buf, len, ops, user_data );
+	FREE( buf );
+
+	return ret;
+}
 
@@ -21,7 +21,31 @@
 #include "llsd_parser.h"
 
 int llsd_notation_check_sig_file( FILE * fin );
-int llsd_notation_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data );
+int llsd_notation_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data );
+int llsd_notation_check_sig_buffer( uint8_t const * const buf, size_t const len );
+int llsd_notation_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* the parse state, kept between documents, see llsd_parse_ctx_t */
+typedef struct ns_state_s llsd_notation_ctx_t;
+llsd_notation_ctx_t * llsd_notation_ctx_new( void );
+void llsd_notation_ctx_delete( void * p );
+int llsd_notation_parse_buffer_ctx( llsd_notation_ctx_t * const ctx, uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* push parser, fed with the document after the signature.  each call parses
+ * every whole token in buf and sets (*used) to the bytes it consumed, the
+ * rest must be passed in again with more data.  llsd_notation_parser_need
+ * says how much input to hold before calling again.  pass final as TRUE with
+ * the last of the data. */
+typedef struct ns_state_s llsd_notation_parser_t;
+llsd_notation_parser_t * llsd_notation_parser_new( llsd_ops_t const * const ops, void * const user_data );
+void llsd_notation_parser_delete( void * p );
+int llsd_notation_parser_feed( llsd_notation_parser_t * const state, uint8_t const * const buf, size_t const len, int const final, size_t * const used );
+size_t llsd_notation_parser_need( llsd_notation_parser_t * const state );
+
+/* steps a parser through a whole document for llsd_reader, like
+ * llsd_json_parser_next.  quoted text, uris and raw s(N) and b(N) data are
+ * passed as LLSD_BORROW, only base encoded binary is decoded. */
+int llsd_notation_parser_next( llsd_notation_parser_t * const state, uint8_t const * const buf, size_t const len, int * const skip, size_t * const used );
 
 #endif/*LLSD_NOTATION_PARSER_H*/
 
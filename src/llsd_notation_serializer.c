@@ -15,18 +15,19 @@
  */
 
 #include <math.h>
-#include <time.h>
 #include <inttypes.h>
 
+#include "llsd_date.h"
+#include "llsd_number.h"
 #include "llsd_serializer.h"
 #include "llsd_notation_serializer.h"
-#include "base64.h"
 
 typedef struct ns_state_s
 {
 	int pretty;
 	int indent;
-	FILE * fout;
+	int map_value;
+	llsd_buffer_t * out;
 	list_t * count_stack;
 	list_t * multiline_stack;
 } ns_state_t;
@@ -39,23 +40,21 @@ typedef struct ns_state_s
 #define TOPC	  ((int_t)list_get_head( state->count_stack ))
 #define POPC	  (list_pop_head( state->count_stack ))
 
-#define WRITE_CHAR(x) (fwrite( x, sizeof(uint8_t), 1, state->fout ))
+#define WRITE_CHAR(x) (llsd_buffer_write( state->out, x, 1 ))
 #define COMMA { if(TOPC) WRITE_CHAR(","); }
 #define COLON WRITE_CHAR(":")
 #define NL { if(state->pretty && TOPML) WRITE_CHAR("\n"); }
 
 #define INDENT_SPACES (4)
-#define INDENT { if(state->pretty && state->indent && TOPML) fprintf( state->fout, "%*s", state->indent * INDENT_SPACES, " " ); }
+#define INDENT { if(state->pretty && state->indent && TOPML) llsd_buffer_fill( state->out, ' ', state->indent * INDENT_SPACES ); }
 #define INC_INDENT { if(state->pretty) state->indent++; }
 #define DEC_INDENT { if(state->pretty) state->indent--; }
 
-static int_t map_value = FALSE;
-
 static int_t llsd_notation_undef( void * const user_data )
 {
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fwrite( "!", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "!", 1 ), FALSE );
 	return TRUE;
 }
 
@@ -64,23 +63,27 @@ static int_t llsd_notation_boolean( int const value, void * const user_data )
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	/* NOTE: we use 1 and 0 because the parser is a tiny bit faster */
-	CHECK_RET( fwrite( (value ? "1" : "0"), sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, (value ? "1" : "0"), 1 ), FALSE );
 	return TRUE;
 }
 
 static int_t llsd_notation_integer( int32_t const value, void * const user_data )
 {
+	uint8_t num[LLSD_NUMBER_STR_LEN + 1];
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fprintf( state->fout, "i%d", value ) >= 2, FALSE );
+	num[0] = 'i';
+	CHECK_RET( llsd_buffer_write( state->out, num, llsd_number_format_integer( value, &num[1] ) + 1 ), FALSE );
 	return TRUE;
 }
 
 static int_t llsd_notation_real( double const value, void * const user_data )
 {
+	uint8_t num[LLSD_NUMBER_STR_LEN + 1];
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	CHECK_RET( fprintf( state->fout, "r%F", value ) > 2, FALSE );
+	num[0] = 'r';
+	CHECK_RET( llsd_buffer_write( state->out, num, llsd_number_format_real( value, &num[1] ) + 1 ), FALSE );
 	return TRUE;
 }
 
@@ -89,81 +92,69 @@ static int_t llsd_notation_uuid( uint8_t const value[UUID_LEN], void * const use
 	int ret = 0;
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	ret = fprintf( state->fout, 
+	ret = llsd_buffer_printf( state->out, 
 		"u%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x", 
 		value[0], value[1], value[2], value[3], 
 		value[4], value[5], 
 		value[6], value[7], 
 		value[8], value[9], 
 		value[10], value[11], value[12], value[13], value[14], value[15] );
-	CHECK_RET( ret == 37, FALSE );
+	CHECK_RET( ret, FALSE );
 	return TRUE;
 }
 
-static int_t llsd_notation_string( uint8_t const * str, int const own_it, void * const user_data )
+static int_t llsd_notation_string( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
 {
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
+	CHECK_PTR_RET( str, FALSE );
 	/* use raw string format because the parser is a little faster */
-	fprintf( state->fout, "s(%" PRIuPTR ")\"%s\"", (uintptr_t)strlen(str), str );
+	CHECK_RET( llsd_buffer_printf( state->out, "s(%" PRIuPTR ")\"", (uintptr_t)len ), FALSE );
+	CHECK_RET( llsd_buffer_write_ref( state->out, str, len ), FALSE );
+	CHECK_RET( WRITE_CHAR( "\"" ), FALSE );
 	return TRUE;
 }
 
 static int_t llsd_notation_date( double const value, void * const user_data )
 {
-	double int_time;
-	int32_t useconds;
-	time_t seconds;
-	struct tm parts;
+	/* d"date" */
+	uint8_t date[LLSD_DATE_STR_LEN + 2];
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	int_time = floor( value );
-	seconds = (time_t)int_time;
-	useconds = (int32_t)( ( value - int_time) * 1000000.0 );
-	parts = *gmtime(&seconds);
-	fprintf( state->fout,
-		"d\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"",
-		parts.tm_year + 1900,
-		parts.tm_mon + 1,
-		parts.tm_mday,
-		parts.tm_hour,
-		parts.tm_min,
-		parts.tm_sec,
-		((useconds != 0) ? (int32_t)(useconds / 1000.f + 0.5f) : 0) );
+	date[0] = 'd';
+	date[1] = '\"';
+	CHECK_RET( llsd_date_format( value, &date[2] ) == DATE_STR_LEN, FALSE );
+	date[DATE_STR_LEN + 2] = '\"';
+	CHECK_RET( llsd_buffer_write( state->out, date, DATE_STR_LEN + 3 ), FALSE );
 
 	return TRUE;
 }
 
-static int_t llsd_notation_uri( uint8_t const * uri, int const own_it, void * const user_data )
+static int_t llsd_notation_uri( uint8_t const * uri, uint32_t const len, int const own_it, void * const user_data )
 {
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	CHECK_PTR_RET( uri, FALSE );
-	fprintf( state->fout, "l\"%s\"", uri );
+	CHECK_RET( llsd_buffer_write( state->out, "l\"", 2 ), FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, uri, len ), FALSE );
+	CHECK_RET( WRITE_CHAR( "\"" ), FALSE );
 	return TRUE;
 }
 
 static int_t llsd_notation_binary( uint8_t const * data, uint32_t const len, int const own_it, void * const user_data )
 {
-	uint8_t * buf;
-	uint32_t outlen = 0;
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	if ( len > 0 )
 	{
 		CHECK_PTR_RET( data, FALSE );
-		outlen = BASE64_LENGTH( len );
-		buf = CALLOC( outlen, sizeof(uint8_t) );
-		CHECK_PTR_RET( buf, FALSE );
-		CHECK_RET( base64_encode( data, len, buf, &outlen ), FALSE );
-		CHECK_RET( fwrite( "b64\"", sizeof(uint8_t), 4, state->fout ) == 4, FALSE );
-		CHECK_RET( fwrite( buf, sizeof(uint8_t), outlen, state->fout ) == outlen, FALSE );
-		CHECK_RET( fwrite( "\"", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
-		FREE( buf );
+		CHECK_RET( llsd_buffer_write( state->out, "b64\"", 4 ), FALSE );
+		CHECK_RET( llsd_buffer_write_base64( state->out, data, len ), FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, "\"", 1 ), FALSE );
 	}
 	else
 	{
-		CHECK_RET( fwrite( "b(0)\"\"", sizeof(uint8_t), 6, state->fout ) == 6, FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, "b(0)\"\"", 6 ), FALSE );
 	}
 
 	return TRUE;
@@ -180,13 +171,13 @@ static int_t llsd_notation_array_begin( uint_t const size, void * const user_dat
 	/* if there is > 1 item in this array, we want to output items in multi-line format */
 	PUSHML( (int_t)(size > 1) );
 
-	if ( map_value && (size > 1) )
+	if ( state->map_value && (size > 1) )
 	{
 		NL;
 		INDENT;
 	}
 
-	CHECK_RET( fwrite( "[", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "[", 1 ), FALSE );
 
 	/* increment indent */
 	INC_INDENT;
@@ -224,7 +215,7 @@ static int_t llsd_notation_array_end( uint_t const size, void * const user_data
 	NL;
 	DEC_INDENT;
 	INDENT;
-	CHECK_RET( fwrite( "]", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "]", 1 ), FALSE );
 	POPML;
 	POPC;
 	return TRUE;
@@ -241,13 +232,13 @@ static int_t llsd_notation_map_begin( uint_t const size, void * const user_data
 	/* if there is > 1 item in this array, we want to output items in multi-line format */
 	PUSHML( (int_t)(size > 1) );
 
-	if ( map_value && (size > 1) )
+	if ( state->map_value && (size > 1) )
 	{
 		NL;
 		INDENT;
 	}
 
-	CHECK_RET( fwrite( "{", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "{", 1 ), FALSE );
 
 	/* increment indent */
 	INC_INDENT;
@@ -278,7 +269,7 @@ static int_t llsd_notation_map_value_begin( void * const user_data )
 {
 	ns_state_t * state = (ns_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	map_value = TRUE;
+	state->map_value = TRUE;
 	return TRUE;
 }
 
@@ -290,7 +281,7 @@ static int_t llsd_notation_map_value_end( void * const user_data )
 	c = TOPC;
 	POPC;
 	PUSHC( ++c );
-	map_value = FALSE;
+	state->map_value = FALSE;
 	return TRUE;
 }
 
@@ -301,7 +292,7 @@ static int_t llsd_notation_map_end( uint_t const size, void * const user_data )
 	NL;
 	DEC_INDENT;
 	INDENT;
-	CHECK_RET( fwrite( "}", sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, "}", 1 ), FALSE );
 	POPML;
 	POPC;
 	return TRUE;
@@ -310,10 +301,10 @@ static int_t llsd_notation_map_end( uint_t const size, void * const user_data )
 #define NOTATION_SIG_LEN (18)
 static uint8_t const * const notation_header = "<?llsd/notation?>\n";
 
-int llsd_notation_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pretty, void ** const user_data )
+int llsd_notation_serializer_init( llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data )
 {
 	ns_state_t * state = NULL;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( ops, FALSE );
 	CHECK_PTR_RET( user_data, FALSE );
 
@@ -341,15 +332,15 @@ int llsd_notation_serializer_init( FILE * fout, llsd_ops_t * const ops, int cons
 	};
 
 	/* write out the notation signature */
-	CHECK_RET( fwrite( notation_header, sizeof(uint8_t), NOTATION_SIG_LEN, fout ) == NOTATION_SIG_LEN, FALSE );
+	CHECK_RET( llsd_buffer_write( out, notation_header, NOTATION_SIG_LEN ), FALSE );
 
-	/* allocate the serializer state and store the file pointer */
+	/* allocate the serializer state and store the output buffer */
 	state = CALLOC( 1, sizeof(ns_state_t) );
 	CHECK_PTR_RET( state, FALSE );
 
 	state->pretty = pretty;
 	state->indent = 0;
-	state->fout = fout;
+	state->out = out;
 
 	state->count_stack = list_new( 0, NULL );
 	if ( state->count_stack == NULL )
@@ -374,19 +365,51 @@ int llsd_notation_serializer_init( FILE * fout, llsd_ops_t * const ops, int cons
 }
 
 
-int llsd_notation_serializer_deinit( FILE * fout, void * user_data )
+int llsd_notation_serializer_deinit( llsd_buffer_t * const out, void * user_data )
 {
+	int ret = FALSE;
 	ns_state_t * state = (ns_state_t*)user_data;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( state, FALSE );
 
 	list_delete( state->count_stack );
 
-	CHECK_RET( TOPML == FALSE, FALSE );
+	/* free the state even if the serialization was cut short */
+	ret = (TOPML == FALSE);
 	list_delete( state->multiline_stack );
 
 	FREE( state );
+	CHECK_RET( ret, FALSE );
 	return TRUE;
 }
 
-
+#define WALK_FN	llsd_notation_walk
+#define WALK_STATE_T	ns_state_t
+#define EMIT_UNDEF( s )	llsd_notation_undef( s )
+#define EMIT_BOOLEAN( s, v )	llsd_notation_boolean( v, s )
+#define EMIT_INTEGER( s, v )	llsd_notation_integer( v, s )
+#define EMIT_REAL( s, v )	llsd_notation_real( v, s )
+#define EMIT_DATE( s, v )	llsd_notation_date( v, s )
+#define EMIT_UUID( s, v )	llsd_notation_uuid( v, s )
+#define EMIT_STRING( s, p, len )	llsd_notation_string( p, len, FALSE, s )
+#define EMIT_URI( s, p, len )	llsd_notation_uri( p, len, FALSE, s )
+#define EMIT_BINARY( s, p, len )	llsd_notation_binary( p, len, FALSE, s )
+#define EMIT_ARRAY_BEGIN( s, n )	llsd_notation_array_begin( n, s )
+#define EMIT_ARRAY_VALUE_BEGIN( s )	llsd_notation_array_value_begin( s )
+#define EMIT_ARRAY_VALUE_END( s )	llsd_notation_array_value_end( s )
+#define EMIT_ARRAY_END( s, n )	llsd_notation_array_end( n, s )
+#define EMIT_MAP_BEGIN( s, n )	llsd_notation_map_begin( n, s )
+#define EMIT_MAP_KEY_BEGIN( s )	llsd_notation_map_key_begin( s )
+#define EMIT_MAP_KEY_END( s )	llsd_notation_map_key_end( s )
+#define EMIT_MAP_VALUE_BEGIN( s )	llsd_notation_map_value_begin( s )
+#define EMIT_MAP_VALUE_END( s )	llsd_notation_map_value_end( s )
+#define EMIT_MAP_END( s, n )	llsd_notation_map_end( n, s )
+#include "llsd_walk.h"
+
+int llsd_notation_serializer_walk( llsd_t * const llsd, void * user_data )
+{
+	ns_state_t * state = (ns_state_t*)user_data;
+	CHECK_PTR_RET( llsd, FALSE );
+	CHECK_PTR_RET( state, FALSE );
+	return llsd_notation_walk( llsd, state );
+}
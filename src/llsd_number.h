@@ -0,0 +1,44 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#ifndef LLSD_NUMBER_H
+#define LLSD_NUMBER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* number text for the text formats.  parsing is locale independent and
+ * never allocates; reals are correctly rounded, almost always with the
+ * Eisel-Lemire method.  reals are written with the fewest digits that parse
+ * back to the same bits, found with the Ryu method. */
+
+/* longest number written, with the null */
+#define LLSD_NUMBER_STR_LEN (32)
+
+/* parse [-+]digits.  (*p) is moved past the number.  fails if there are no
+ * digits or the value doesn't fit in 32 bits. */
+int llsd_number_parse_integer( uint8_t const ** p, uint8_t const * const end, int32_t * const v );
+
+/* parse [-+]digits[.digits][(e|E)[-+]digits], or nan, inf or infinity in
+ * any case.  (*p) is moved past the number. */
+int llsd_number_parse_real( uint8_t const ** p, uint8_t const * const end, double * const v );
+
+/* write the number and a null into buf, returns the length without the null */
+size_t llsd_number_format_integer( int32_t const v, uint8_t buf[LLSD_NUMBER_STR_LEN] );
+size_t llsd_number_format_real( double const v, uint8_t buf[LLSD_NUMBER_STR_LEN] );
+
+#endif/*LLSD_NUMBER_H*/
@@ -14,32 +14,67 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
  */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <cutil/debug.h>
 #include <cutil/macros.h>
 
 #include "llsd.h"
 #include "llsd_parser.h"
+#include "llsd_buffer.h"
+#include "llsd_projection.h"
+#include "llsd_stack.h"
 #include "llsd_binary_parser.h"
 #include "llsd_notation_parser.h"
+#include "llsd_xml_parser.h"
 #include "llsd_json_parser.h"
 
 #define VALUE_STATES (TOP_LEVEL | ARRAY_VALUE_BEGIN | MAP_VALUE_BEGIN )
 #define STRING_STATES ( VALUE_STATES | MAP_KEY_BEGIN )
 
-#define PUSH(x) (list_push_head( parser_state->state_stack, (void*)x ))
-#define TOP		((uint_t)list_get_head( parser_state->state_stack ))
-#define POP		(list_pop_head( parser_state->state_stack ))
+#define PUSH(x) (llsd_stack_push( &(parser_state->state_stack), (uintptr_t)(x) ))
+#define TOP		((uint_t)llsd_stack_top( &(parser_state->state_stack) ))
+#define POP		(llsd_stack_pop( &(parser_state->state_stack) ))
+#define SET(x)	(llsd_stack_set_top( &(parser_state->state_stack), (uintptr_t)(x) ))
+
+#define PUSHC(x) (llsd_stack_push( &(parser_state->container_stack), (uintptr_t)(x) ))
+#define TOPC	((llsd_t*)llsd_stack_top( &(parser_state->container_stack) ))
+#define POPC	(llsd_stack_pop( &(parser_state->container_stack) ))
 
-#define PUSHC(x) (list_push_head( parser_state->container_stack, (void*)x ))
-#define TOPC	((llsd_t*)list_get_head( parser_state->container_stack ))
-#define POPC	(list_pop_head( parser_state->container_stack ))
+/* projection of an open container */
+typedef struct proj_frame_s
+{
+	llsd_projection_node_t const * node;
+	uint_t index;			/* index of the next array value */
+} proj_frame_t;
 
 typedef struct parser_state_s
 {
 	llsd_t * llsd;
 	llsd_t * key;
-	list_t * container_stack;
-	list_t * state_stack;
+	llsd_stack_t container_stack;
+	llsd_stack_t state_stack;
+	llsd_arena_t * arena;
+	llsd_intern_t * intern;
+
+	/* projection filtering, see proj_ops */
+	llsd_projection_node_t const * next;	/* selects the value about to start */
+	proj_frame_t * frames;
+	uint_t depth;
+	uint_t size;
+	uint_t skip;			/* nesting inside a skipped value, 0 when not skipping */
+	int key_pending;		/* a map key started, its begin is held until we see it */
+
+	/* record streaming, the elements of the top level array go to record_fn
+	 * one at a time instead of into the array */
+	llsd_record_fn record_fn;
+	void * record_data;
+	llsd_t * record;
+	uint_t record_index;
+
+	int keep;				/* kept in a llsd_parse_ctx_t, finish empties the stacks
+							 * and keeps the frames instead of freeing them */
 
 } parser_state_t;
 
@@ -61,13 +96,15 @@ static int_t add_to_container( llsd_t * const container, llsd_t * const key, lls
 	return TRUE;
 }
 
+/* a value starting right in the top level array is a record */
+#define IS_RECORD( ps ) ( ((ps)->record_fn != NULL) && (TOPC == (ps)->llsd) )
+
 static int_t update_state( uint_t valid_states, void * const user_data, llsd_t * const v )
 {
 	llsd_t * container = NULL;
 	state_t state = TOP_LEVEL;
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* get the current step we're in */
 	state = TOP;
@@ -90,13 +127,14 @@ static int_t update_state( uint_t valid_states, void * const user_data, llsd_t *
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
-					CHECK_RET( add_to_container( TOPC, NULL, v ), FALSE );
+					SET( ARRAY_VALUE );
+					if ( IS_RECORD( parser_state ) )
+						parser_state->record = v;
+					else
+						CHECK_RET( add_to_container( TOPC, NULL, v ), FALSE );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					CHECK_RET( add_to_container( TOPC, parser_state->key, v ), FALSE );
 					parser_state->key = NULL;
 					break;
@@ -110,19 +148,19 @@ static int_t update_state( uint_t valid_states, void * const user_data, llsd_t *
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
-					CHECK_RET( add_to_container( TOPC, NULL, v ), FALSE );
+					SET( ARRAY_VALUE );
+					if ( IS_RECORD( parser_state ) )
+						parser_state->record = v;
+					else
+						CHECK_RET( add_to_container( TOPC, NULL, v ), FALSE );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					CHECK_RET( add_to_container( TOPC, parser_state->key, v ), FALSE );
 					parser_state->key = NULL;
 					break;
 				case MAP_KEY_BEGIN:
-					POP;
-					PUSH( MAP_KEY );
+					SET( MAP_KEY );
 					parser_state->key = v;
 					break;
 				case TOP_LEVEL:
@@ -137,9 +175,11 @@ static int_t update_state( uint_t valid_states, void * const user_data, llsd_t *
 static int_t llsd_undef_fn( void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 	
 	/* create the undef */
-	v = llsd_new_undef();
+	v = llsd_new_in( parser_state->arena, LLSD_UNDEF );
 	CHECK_PTR_RET( v, FALSE );
 	
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -153,9 +193,11 @@ static int_t llsd_undef_fn( void * const user_data )
 static int_t llsd_boolean_fn( int const value, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the boolean */
-	v = llsd_new_boolean( value );
+	v = llsd_new_in( parser_state->arena, LLSD_BOOLEAN, value );
 	CHECK_PTR_RET( v, FALSE );
 	
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -169,9 +211,11 @@ static int_t llsd_boolean_fn( int const value, void * const user_data )
 static int_t llsd_integer_fn( int32_t const value, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the integer */
-	v = llsd_new_integer( value );
+	v = llsd_new_in( parser_state->arena, LLSD_INTEGER, value );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -185,9 +229,11 @@ static int_t llsd_integer_fn( int32_t const value, void * const user_data )
 static int_t llsd_real_fn( double const value, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the real */
-	v = llsd_new_real( value );
+	v = llsd_new_in( parser_state->arena, LLSD_REAL, value );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -201,9 +247,11 @@ static int_t llsd_real_fn( double const value, void * const user_data )
 static int_t llsd_uuid_fn( uint8_t const value[UUID_LEN], void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the uuid */
-	v = llsd_new_uuid( value );
+	v = llsd_new_in( parser_state->arena, LLSD_UUID, value );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -214,12 +262,24 @@ static int_t llsd_uuid_fn( uint8_t const value[UUID_LEN], void * const user_data
 	return TRUE;
 }
 
-static int_t llsd_string_fn( uint8_t const * str, int own_it, void * const user_data )
+static int_t llsd_string_fn( uint8_t const * str, uint32_t const len, int own_it, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
-	/* create the string */
-	v = llsd_new_string( str, own_it );
+	if ( (parser_state->intern != NULL) && (TOP == MAP_KEY_BEGIN) )
+	{
+		/* map keys come from the intern table */
+		v = llsd_intern( parser_state->intern, str, len );
+		if ( own_it == TRUE )
+			FREE( (void*)str );
+	}
+	else
+	{
+		/* create the string */
+		v = llsd_new_in( parser_state->arena, LLSD_STRING, str, len, own_it );
+	}
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( STRING_STATES, user_data, v ) )
@@ -233,9 +293,11 @@ static int_t llsd_string_fn( uint8_t const * str, int own_it, void * const user_
 static int_t llsd_date_fn( double const value, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the date */
-	v = llsd_new_date( value );
+	v = llsd_new_in( parser_state->arena, LLSD_DATE, value );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -246,12 +308,14 @@ static int_t llsd_date_fn( double const value, void * const user_data )
 	return TRUE;
 }
 
-static int_t llsd_uri_fn( uint8_t const * uri, int own_it, void * const user_data )
+static int_t llsd_uri_fn( uint8_t const * uri, uint32_t const len, int own_it, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the uri */
-	v = llsd_new_uri( uri, own_it );
+	v = llsd_new_in( parser_state->arena, LLSD_URI, uri, len, own_it );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -265,9 +329,11 @@ static int_t llsd_uri_fn( uint8_t const * uri, int own_it, void * const user_dat
 static int_t llsd_binary_fn( uint8_t const * data, uint32_t const len, int own_it, void * const user_data )
 {
 	llsd_t * v = NULL;
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	CHECK_PTR_RET( parser_state, FALSE );
 
 	/* create the binary */
-	v = llsd_new_binary( data, len, own_it );
+	v = llsd_new_in( parser_state->arena, LLSD_BINARY, data, len, own_it );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -283,10 +349,9 @@ static int_t llsd_array_begin_fn( uint_t const size, void * const user_data )
 	llsd_t * v = NULL;
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* create the array */
-	v = llsd_new_array( size );
+	v = llsd_new_in( parser_state->arena, LLSD_ARRAY, size );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -295,8 +360,8 @@ static int_t llsd_array_begin_fn( uint_t const size, void * const user_data )
 		return FALSE;
 	}
 
-	PUSHC( v );
-	PUSH( ARRAY_BEGIN );
+	/* v is in the tree already, it goes with it */
+	CHECK_RET( PUSHC( v ) && PUSH( ARRAY_BEGIN ), FALSE );
 	return TRUE;
 }
 
@@ -305,27 +370,33 @@ static int_t llsd_array_value_begin_fn( void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	CHECK_RET( (state & (ARRAY_BEGIN | ARRAY_VALUE_END)), FALSE );
 
-	POP;
-	PUSH( ARRAY_VALUE_BEGIN );
+	SET( ARRAY_VALUE_BEGIN );
 
 	return TRUE;
 }
 
 static int_t llsd_array_value_end_fn( void * const user_data )
 {
+	int_t ret = FALSE;
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	CHECK_RET( (state & ARRAY_VALUE), FALSE );
 
-	POP;
-	PUSH( ARRAY_VALUE_END );
+	SET( ARRAY_VALUE_END );
+
+	/* hand over a finished record and drop it */
+	if ( (parser_state->record != NULL) && (TOPC == parser_state->llsd) )
+	{
+		ret = (*(parser_state->record_fn))( parser_state->record, parser_state->record_index++, parser_state->record_data );
+		llsd_delete( parser_state->record );
+		parser_state->record = NULL;
+		return ret;
+	}
 	return TRUE;
 }
 
@@ -334,7 +405,6 @@ static int_t llsd_array_end_fn( uint_t const size, void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	CHECK_RET( (state & (ARRAY_BEGIN | ARRAY_VALUE_END)), FALSE );
 
@@ -348,10 +418,9 @@ static int_t llsd_map_begin_fn( uint_t const size, void * const user_data )
 	llsd_t * v = NULL;
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* create the map */
-	v = llsd_new_map( size );
+	v = llsd_new_in( parser_state->arena, LLSD_MAP, size );
 	CHECK_PTR_RET( v, FALSE );
 
 	if ( !update_state( VALUE_STATES, user_data, v ) )
@@ -360,8 +429,8 @@ static int_t llsd_map_begin_fn( uint_t const size, void * const user_data )
 		return FALSE;
 	}
 
-	PUSHC( v );
-	PUSH( MAP_BEGIN );
+	/* v is in the tree already, it goes with it */
+	CHECK_RET( PUSHC( v ) && PUSH( MAP_BEGIN ), FALSE );
 	return TRUE;
 }
 
@@ -370,7 +439,6 @@ static int_t llsd_map_key_begin_fn( void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 
 	if ( !(state & (MAP_BEGIN | MAP_VALUE_END)) )
@@ -406,13 +474,11 @@ static int_t llsd_map_key_end_fn( void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	CHECK_RET( (state & MAP_KEY), FALSE );
 	/* TODO: deal with not-started map key */
 
-	POP;
-	PUSH( MAP_KEY_END );
+	SET( MAP_KEY_END );
 	return TRUE;
 }
 
@@ -421,13 +487,11 @@ static int_t llsd_map_value_begin_fn( void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	CHECK_RET( (state & MAP_KEY_END), FALSE );
 	/* TODO: deal with unterminated map key */
 
-	POP;
-	PUSH( MAP_VALUE_BEGIN );
+	SET( MAP_VALUE_BEGIN );
 	return TRUE;
 }
 
@@ -436,13 +500,11 @@ static int_t llsd_map_value_end_fn( void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	CHECK_RET( (state & MAP_VALUE), FALSE );
 	/* TODO: deal with not-started map value */
 
-	POP;
-	PUSH( MAP_VALUE_END );
+	SET( MAP_VALUE_END );
 	return TRUE;
 }
 
@@ -451,7 +513,6 @@ static int_t llsd_map_end_fn( uint_t const size, void * const user_data )
 	parser_state_t * parser_state = (parser_state_t*)user_data;
 	state_t state = TOP_LEVEL;
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 	state = TOP;
 	if ( !(state & (MAP_BEGIN | MAP_VALUE_END)) )
 	{
@@ -481,85 +542,1002 @@ static int_t llsd_map_end_fn( uint_t const size, void * const user_data )
 	return TRUE;
 }
 
-llsd_t * llsd_parse_from_file( FILE * fin )
+#define READ_CHUNK_SIZE (4096)
+
+/* reads the rest of the file into buf, growing it when size is too small.
+ * the buffer is kept on failure so a reused one can be freed by its owner */
+static int read_file( FILE * fin, uint8_t ** const buf, size_t * const size, size_t * const len )
 {
-	int ok = FALSE;
-	parser_state_t state;
-	llsd_ops_t ops = 
-	{
-		&llsd_undef_fn,
-		&llsd_boolean_fn,
-		&llsd_integer_fn,
-		&llsd_real_fn,
-		&llsd_uuid_fn,
-		&llsd_string_fn,
-		&llsd_date_fn,
-		&llsd_uri_fn,
-		&llsd_binary_fn,
-		&llsd_array_begin_fn,
-		&llsd_array_value_begin_fn,
-		&llsd_array_value_end_fn,
-		&llsd_array_end_fn,
-		&llsd_map_begin_fn,
-		&llsd_map_key_begin_fn,
-		&llsd_map_key_end_fn,
-		&llsd_map_value_begin_fn,
-		&llsd_map_value_end_fn,
-		&llsd_map_end_fn
-	};
+	size_t ret = 0;
+	uint8_t * tmp = NULL;
 
-	CHECK_PTR_RET( fin, NULL );
+	(*len) = 0;
 
-	/* initialize the parser state */
-	MEMSET( &state, 0, sizeof( parser_state_t ) );
-	state.container_stack = list_new( 0, &llsd_delete );
-	CHECK_PTR_RET( state.container_stack, NULL );
-	state.state_stack = list_new( 1, NULL );
-	if ( state.state_stack == NULL )
+	do
 	{
-		list_delete( state.container_stack );
-		return NULL;
+		/* grow the buffer geometrically so large files only realloc a few times */
+		if ( (*len) == (*size) )
+		{
+			tmp = REALLOC( (*buf), ((*size) ? ((*size) * 2) : READ_CHUNK_SIZE) );
+			CHECK_PTR_RET( tmp, FALSE );
+			(*buf) = tmp;
+			(*size) = ((*size) ? ((*size) * 2) : READ_CHUNK_SIZE);
+		}
+
+		ret = fread( &((*buf)[(*len)]), sizeof(uint8_t), (*size) - (*len), fin );
+		(*len) += ret;
+
+	} while ( ret > 0 );
+
+	return TRUE;
+}
+
+int llsd_read_file( FILE * fin, uint8_t ** const buf, size_t * const len )
+{
+	size_t size = 0;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( len, FALSE );
+
+	(*buf) = NULL;
+	if ( !read_file( fin, buf, &size, len ) )
+	{
+		FREE( (*buf) );
+		(*buf) = NULL;
+		(*len) = 0;
+		return FALSE;
 	}
-	list_push_head( state.state_stack, (void*)TOP_LEVEL );
-	
-	if ( llsd_binary_check_sig_file( fin ) )
+
+	return TRUE;
+}
+
+int llsd_map_file( FILE * fin, uint8_t const ** const buf, size_t * const len )
+{
+	void * p = NULL;
+	struct stat st;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( len, FALSE );
+
+	CHECK_RET( fstat( fileno( fin ), &st ) == 0, FALSE );
+	CHECK_RET( st.st_size > 0, FALSE );
+
+	p = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno( fin ), 0 );
+	CHECK_RET( p != MAP_FAILED, FALSE );
+
+	(*buf) = (uint8_t const *)p;
+	(*len) = (size_t)st.st_size;
+	return TRUE;
+}
+
+void llsd_unmap_file( uint8_t const * const buf, size_t const len )
+{
+	CHECK_PTR( buf );
+	munmap( (void*)buf, len );
+}
+
+static llsd_ops_t const tree_ops = 
+{
+	&llsd_undef_fn,
+	&llsd_boolean_fn,
+	&llsd_integer_fn,
+	&llsd_real_fn,
+	&llsd_uuid_fn,
+	&llsd_string_fn,
+	&llsd_date_fn,
+	&llsd_uri_fn,
+	&llsd_binary_fn,
+	&llsd_array_begin_fn,
+	&llsd_array_value_begin_fn,
+	&llsd_array_value_end_fn,
+	&llsd_array_end_fn,
+	&llsd_map_begin_fn,
+	&llsd_map_key_begin_fn,
+	&llsd_map_key_end_fn,
+	&llsd_map_value_begin_fn,
+	&llsd_map_value_end_fn,
+	&llsd_map_end_fn
+};
+
+/* projection filtering sits in front of the tree ops.  whether a value is
+ * kept is known when its map key or array slot starts, the events of a
+ * skipped value are dropped until the end of its slot.  a key's string_fn
+ * returns LLSD_SKIP so parsers that can pass over the value's bytes do. */
+static int_t proj_push( parser_state_t * const parser_state )
+{
+	proj_frame_t * tmp = NULL;
+
+	if ( parser_state->depth == parser_state->size )
+	{
+		tmp = REALLOC( parser_state->frames, ((parser_state->size == 0) ? 8 : (parser_state->size * 2)) * sizeof(proj_frame_t) );
+		CHECK_PTR_RET( tmp, FALSE );
+		parser_state->frames = tmp;
+		parser_state->size = ((parser_state->size == 0) ? 8 : (parser_state->size * 2));
+	}
+
+	parser_state->frames[parser_state->depth].node = parser_state->next;
+	parser_state->frames[parser_state->depth].index = 0;
+	parser_state->depth++;
+	return TRUE;
+}
+
+#define PROJ_TOP (&(parser_state->frames[parser_state->depth - 1]))
+
+/* drops the memory of a skipped string, uri or binary */
+#define PROJ_DROP( p, own_it ) \
+	do { \
+		if ( (own_it) == TRUE ) \
+			FREE( (void*)(p) ); \
+	} while(0)
+
+static int_t proj_undef_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_undef_fn( user_data ) );
+}
+
+static int_t proj_boolean_fn( int const value, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_boolean_fn( value, user_data ) );
+}
+
+static int_t proj_integer_fn( int32_t const value, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_integer_fn( value, user_data ) );
+}
+
+static int_t proj_real_fn( double const value, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_real_fn( value, user_data ) );
+}
+
+static int_t proj_uuid_fn( uint8_t const value[UUID_LEN], void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_uuid_fn( value, user_data ) );
+}
+
+static int_t proj_string_fn( uint8_t const * str, uint32_t const len, int own_it, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
 	{
-		ok = llsd_binary_parse_file( fin, &ops, &state );
+		PROJ_DROP( str, own_it );
+		return TRUE;
 	}
-	else if ( llsd_notation_check_sig_file( fin ) )
+
+	if ( parser_state->key_pending )
 	{
-		ok = llsd_notation_parse_file( fin, &ops, &state );
+		parser_state->key_pending = FALSE;
+		parser_state->next = llsd_projection_key( PROJ_TOP->node, str, len );
+		if ( parser_state->next == NULL )
+		{
+			/* not on any path, drop the key and its value */
+			PROJ_DROP( str, own_it );
+			parser_state->skip = 1;
+			return LLSD_SKIP;
+		}
+		if ( !llsd_map_key_begin_fn( user_data ) )
+		{
+			PROJ_DROP( str, own_it );
+			return FALSE;
+		}
 	}
-	else if ( llsd_xml_check_sig_file( fin ) )
+
+	return llsd_string_fn( str, len, own_it, user_data );
+}
+
+static int_t proj_date_fn( double const value, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_date_fn( value, user_data ) );
+}
+
+static int_t proj_uri_fn( uint8_t const * uri, uint32_t const len, int own_it, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
 	{
-		ok = llsd_xml_parse_file( fin, &ops, &state );
+		PROJ_DROP( uri, own_it );
+		return TRUE;
 	}
-	/* NOTE: this *must* be last because JSON files don't have a signature
-	 * so llsd_json_check_sig_file always returns TRUE */
-	else if ( llsd_json_check_sig_file( fin ) )
+	return llsd_uri_fn( uri, len, own_it, user_data );
+}
+
+static int_t proj_binary_fn( uint8_t const * data, uint32_t const len, int own_it, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
+	{
+		PROJ_DROP( data, own_it );
+		return TRUE;
+	}
+	return llsd_binary_fn( data, len, own_it, user_data );
+}
+
+static int_t proj_array_begin_fn( uint_t const size, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
+	{
+		parser_state->skip++;
+		return TRUE;
+	}
+	CHECK_RET( proj_push( parser_state ), FALSE );
+	return llsd_array_begin_fn( size, user_data );
+}
+
+static int_t proj_array_value_begin_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
+		return TRUE;
+
+	parser_state->next = llsd_projection_index( PROJ_TOP->node, PROJ_TOP->index++ );
+	if ( parser_state->next == NULL )
+	{
+		parser_state->skip = 1;
+		return TRUE;
+	}
+	return llsd_array_value_begin_fn( user_data );
+}
+
+static int_t proj_array_value_end_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	/* the end of a skipped slot */
+	if ( parser_state->skip == 1 )
+		parser_state->skip = 0;
+	else if ( parser_state->skip == 0 )
+		return llsd_array_value_end_fn( user_data );
+	return TRUE;
+}
+
+static int_t proj_array_end_fn( uint_t const size, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
+	{
+		parser_state->skip--;
+		return TRUE;
+	}
+	CHECK_RET( parser_state->depth > 0, FALSE );
+	parser_state->depth--;
+	return llsd_array_end_fn( size, user_data );
+}
+
+static int_t proj_map_begin_fn( uint_t const size, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
+	{
+		parser_state->skip++;
+		return TRUE;
+	}
+	CHECK_RET( proj_push( parser_state ), FALSE );
+	return llsd_map_begin_fn( size, user_data );
+}
+
+static int_t proj_map_key_begin_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	/* held until proj_string_fn sees the key */
+	if ( !parser_state->skip )
+		parser_state->key_pending = TRUE;
+	return TRUE;
+}
+
+static int_t proj_map_key_end_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_map_key_end_fn( user_data ) );
+}
+
+static int_t proj_map_value_begin_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+	return ( parser_state->skip ? TRUE : llsd_map_value_begin_fn( user_data ) );
+}
+
+static int_t proj_map_value_end_fn( void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	/* the end of a skipped slot */
+	if ( parser_state->skip == 1 )
+		parser_state->skip = 0;
+	else if ( parser_state->skip == 0 )
+		return llsd_map_value_end_fn( user_data );
+	return TRUE;
+}
+
+static int_t proj_map_end_fn( uint_t const size, void * const user_data )
+{
+	parser_state_t * parser_state = (parser_state_t*)user_data;
+
+	if ( parser_state->skip )
+	{
+		parser_state->skip--;
+		return TRUE;
+	}
+	CHECK_RET( parser_state->depth > 0, FALSE );
+	parser_state->depth--;
+	return llsd_map_end_fn( size, user_data );
+}
+
+static llsd_ops_t const proj_ops = 
+{
+	&proj_undef_fn,
+	&proj_boolean_fn,
+	&proj_integer_fn,
+	&proj_real_fn,
+	&proj_uuid_fn,
+	&proj_string_fn,
+	&proj_date_fn,
+	&proj_uri_fn,
+	&proj_binary_fn,
+	&proj_array_begin_fn,
+	&proj_array_value_begin_fn,
+	&proj_array_value_end_fn,
+	&proj_array_end_fn,
+	&proj_map_begin_fn,
+	&proj_map_key_begin_fn,
+	&proj_map_key_end_fn,
+	&proj_map_value_begin_fn,
+	&proj_map_value_end_fn,
+	&proj_map_end_fn
+};
+
+/* the tree ops, filtered if there is a projection */
+#define PARSE_OPS( opts ) ( ((opts != NULL) && (opts->projection != NULL)) ? &proj_ops : &tree_ops )
+
+#define BINARY_PARSE_TREE( buf, len, opts ) \
+	( (opts != NULL) ? llsd_binary_parse_tree( buf, len, opts->arena, opts->intern, opts->borrow ) \
+					 : llsd_binary_parse_tree( buf, len, NULL, NULL, FALSE ) )
+
+llsd_t * llsd_parse_from_buffer( uint8_t const * const buf, size_t const len )
+{
+	return llsd_parse_from_buffer_ex( buf, len, NULL );
+}
+
+/* sets up the tree building state, the containers are owned by the tree
+ * so the container stack doesn't delete them */
+static int_t parser_state_initialize( parser_state_t * const state, llsd_parse_opts_t const * const opts )
+{
+	CHECK_PTR_RET( state, FALSE );
+
+	MEMSET( state, 0, sizeof( parser_state_t ) );
+	if ( opts != NULL )
+	{
+		state->arena = opts->arena;
+		state->intern = opts->intern;
+		if ( opts->projection != NULL )
+			state->next = llsd_projection_root( opts->projection );
+	}
+	llsd_stack_initialize( &(state->container_stack) );
+	llsd_stack_initialize( &(state->state_stack) );
+	llsd_stack_push( &(state->state_stack), TOP_LEVEL );
+	return TRUE;
+}
+
+/* starts the next document on a state kept in a llsd_parse_ctx_t, finish
+ * has already cleared the tree pointers */
+static void parser_state_restart( parser_state_t * const state, llsd_parse_opts_t const * const opts )
+{
+	llsd_stack_clear( &(state->container_stack) );
+	llsd_stack_clear( &(state->state_stack) );
+	state->arena = NULL;
+	state->intern = NULL;
+	state->next = NULL;
+	state->depth = 0;
+	state->skip = 0;
+	state->key_pending = FALSE;
+	state->record_fn = NULL;
+	state->record_data = NULL;
+	state->record_index = 0;
+	if ( opts != NULL )
 	{
-		ok = llsd_json_parse_file( fin, &ops, &state );
+		state->arena = opts->arena;
+		state->intern = opts->intern;
+		if ( opts->projection != NULL )
+			state->next = llsd_projection_root( opts->projection );
 	}
+	llsd_stack_push( &(state->state_stack), TOP_LEVEL );
+}
+
+/* tears down the tree building state and hands back the tree if the
+ * parse was ok and complete */
+static llsd_t * parser_state_finish( parser_state_t * const state, int ok )
+{
+	llsd_t * llsd = NULL;
+	CHECK_PTR_RET( state, NULL );
 
 	/* make sure we had a complete parse */
-	if ( list_count( state.container_stack ) > 0 )
+	if ( state->container_stack.count > 0 )
 	{
 		ok = FALSE;
 	}
 
-	if ( (state_t)list_get_head( state.state_stack ) != TOP_LEVEL )
+	if ( (state_t)llsd_stack_top( &(state->state_stack) ) != TOP_LEVEL )
 	{
 		ok = FALSE;
 	}
 
-	list_delete( state.container_stack );
-	list_delete( state.state_stack );
+	/* the stacks are left empty, so a finished parser takes no more values */
+	if ( state->keep )
+	{
+		llsd_stack_clear( &(state->container_stack) );
+		llsd_stack_clear( &(state->state_stack) );
+	}
+	else
+	{
+		llsd_stack_deinitialize( &(state->container_stack) );
+		llsd_stack_deinitialize( &(state->state_stack) );
+	}
 
+	llsd = state->llsd;
 	if ( !ok )
 	{
+		/* the root owns everything that was parsed, a dangling key is 
+		 * the only thing that isn't attached to it */
+		if ( state->key != NULL )
+			llsd_delete( state->key );
+		if ( llsd != NULL )
+			llsd_delete( llsd );
+		llsd = NULL;
+	}
+	/* a record cut off by an error isn't in the tree */
+	if ( state->record != NULL )
+		llsd_delete( state->record );
+	state->record = NULL;
+	state->key = NULL;
+	state->llsd = NULL;
+	if ( !state->keep )
+	{
+		FREE( state->frames );
+		state->frames = NULL;
+		state->size = 0;
+	}
+	state->depth = 0;
+
+	return llsd;
+}
+
+static int_t parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const state )
+{
+	if ( llsd_binary_check_sig_buffer( buf, len ) )
+	{
+		return llsd_binary_parse_buffer( buf, len, ops, state );
+	}
+	else if ( llsd_notation_check_sig_buffer( buf, len ) )
+	{
+		return llsd_notation_parse_buffer( buf, len, ops, state );
+	}
+	else if ( llsd_xml_check_sig_buffer( buf, len ) )
+	{
+		return llsd_xml_parse_buffer( buf, len, ops, state );
+	}
+	/* NOTE: this *must* be last because JSON files don't have a signature
+	 * so llsd_json_check_sig_buffer always returns TRUE */
+	else if ( llsd_json_check_sig_buffer( buf, len ) )
+	{
+		return llsd_json_parse_buffer( buf, len, ops, state );
+	}
+	return FALSE;
+}
+
+llsd_t * llsd_parse_from_buffer_ex( uint8_t const * const buf, size_t const len, llsd_parse_opts_t const * const opts )
+{
+	int ok = FALSE;
+	parser_state_t state;
+
+	CHECK_PTR_RET( buf, NULL );
+
+	if ( (opts != NULL) && opts->lazy && (opts->projection == NULL) && llsd_binary_check_sig_buffer( buf, len ) )
+		return llsd_binary_parse_lazy( buf, len, opts->arena );
+
+	/* binary builds the tree itself unless it has to be filtered */
+	if ( ((opts == NULL) || (opts->projection == NULL)) && llsd_binary_check_sig_buffer( buf, len ) )
+		return BINARY_PARSE_TREE( buf, len, opts );
+
+	CHECK_RET( parser_state_initialize( &state, opts ), NULL );
+	
+	/* binary strings can be pointed at right where they are */
+	if ( (opts != NULL) && opts->borrow && llsd_binary_check_sig_buffer( buf, len ) )
+		ok = llsd_binary_parse_buffer_borrowed( buf, len, PARSE_OPS( opts ), &state );
+	else
+		ok = parse_buffer( buf, len, PARSE_OPS( opts ), &state );
+
+	return parser_state_finish( &state, ok );
+}
+
+/* stand-ins for the callbacks a streaming caller leaves NULL, memory that
+ * is handed over is freed right away */
+static int_t skip_fn( void * const user_data ) { return TRUE; }
+static int_t skip_int_fn( int const value, void * const user_data ) { return TRUE; }
+static int_t skip_int32_fn( int32_t const value, void * const user_data ) { return TRUE; }
+static int_t skip_double_fn( double const value, void * const user_data ) { return TRUE; }
+static int_t skip_size_fn( uint_t const size, void * const user_data ) { return TRUE; }
+static int_t skip_uuid_fn( uint8_t const value[UUID_LEN], void * const user_data ) { return TRUE; }
+
+static int_t skip_string_fn( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
+{
+	if ( own_it == TRUE )
+		FREE( (void*)str );
+	return TRUE;
+}
+
+static int_t skip_binary_fn( uint8_t const * data, uint32_t const len, int const own_it, void * const user_data )
+{
+	if ( own_it == TRUE )
+		FREE( (void*)data );
+	return TRUE;
+}
+
+#define DEFAULT_FN( f, d ) ( (ops->f != NULL) ? ops->f : (d) )
+
+int llsd_parse_with_ops( uint8_t const * const buf, size_t const len, llsd_serializer_t const fmt, llsd_ops_t const * const ops, void * const user_data )
+{
+	llsd_ops_t const all_ops =
+	{
+		DEFAULT_FN( undef_fn, &skip_fn ),
+		DEFAULT_FN( boolean_fn, &skip_int_fn ),
+		DEFAULT_FN( integer_fn, &skip_int32_fn ),
+		DEFAULT_FN( real_fn, &skip_double_fn ),
+		DEFAULT_FN( uuid_fn, &skip_uuid_fn ),
+		DEFAULT_FN( string_fn, &skip_string_fn ),
+		DEFAULT_FN( date_fn, &skip_double_fn ),
+		DEFAULT_FN( uri_fn, &skip_string_fn ),
+		DEFAULT_FN( binary_fn, &skip_binary_fn ),
+		DEFAULT_FN( array_begin_fn, &skip_size_fn ),
+		DEFAULT_FN( array_value_begin_fn, &skip_fn ),
+		DEFAULT_FN( array_value_end_fn, &skip_fn ),
+		DEFAULT_FN( array_end_fn, &skip_size_fn ),
+		DEFAULT_FN( map_begin_fn, &skip_size_fn ),
+		DEFAULT_FN( map_key_begin_fn, &skip_fn ),
+		DEFAULT_FN( map_key_end_fn, &skip_fn ),
+		DEFAULT_FN( map_value_begin_fn, &skip_fn ),
+		DEFAULT_FN( map_value_end_fn, &skip_fn ),
+		DEFAULT_FN( map_end_fn, &skip_size_fn )
+	};
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	switch ( fmt )
+	{
+		case LLSD_ENC_AUTODETECT:
+			return parse_buffer( buf, len, &all_ops, user_data );
+		case LLSD_ENC_XML:
+			return llsd_xml_parse_buffer( buf, len, &all_ops, user_data );
+		case LLSD_ENC_BINARY:
+			return llsd_binary_parse_buffer( buf, len, &all_ops, user_data );
+		case LLSD_ENC_NOTATION:
+			return llsd_notation_parse_buffer( buf, len, &all_ops, user_data );
+		case LLSD_ENC_JSON:
+			return llsd_json_parse_buffer( buf, len, &all_ops, user_data );
+		default:
+			break;
+	}
+	return FALSE;
+}
+
+int llsd_parse_file_with_ops( FILE * fin, llsd_serializer_t const fmt, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	/* read the whole file into memory and parse it from there */
+	CHECK_RET( llsd_read_file( fin, &buf, &len ), FALSE );
+	ret = llsd_parse_with_ops( buf, len, fmt, ops, user_data );
+	FREE( buf );
+
+	return ret;
+}
+
+/* the binary signature is the longest one, it is all we need to see before
+ * picking a format */
+#define PARSER_SIG_LEN (18)
+
+struct llsd_parser_s
+{
+	parser_state_t state;
+	llsd_ops_t ops;
+	llsd_buffer_t in;			/* input not parsed yet */
+	llsd_xml_parser_t * xml;	/* set once the document is known to be xml */
+	llsd_binary_parser_t * binary;	/* or one of these once the format is known, */
+	llsd_notation_parser_t * notation;	/* they take what they can from in */
+	llsd_json_parser_t * json;
+	int failed;
+};
+
+llsd_parser_t * llsd_parser_new( llsd_parse_opts_t const * const opts )
+{
+	llsd_parser_t * p = NULL;
+
+	p = (llsd_parser_t*)CALLOC( 1, sizeof(llsd_parser_t) );
+	CHECK_PTR_RET( p, NULL );
+
+	p->ops = *(PARSE_OPS( opts ));
+	if ( !parser_state_initialize( &(p->state), opts ) )
+	{
+		FREE( p );
+		return NULL;
+	}
+	llsd_buffer_initialize( &(p->in), NULL, 0 );
+
+	return p;
+}
+
+void llsd_parser_delete( void * ptr )
+{
+	llsd_parser_t * p = (llsd_parser_t*)ptr;
+	CHECK_PTR( p );
+
+	/* drops anything that was parsed but not finished */
+	parser_state_finish( &(p->state), FALSE );
+	if ( p->xml != NULL )
+		llsd_xml_parser_delete( p->xml );
+	if ( p->binary != NULL )
+		llsd_binary_parser_delete( p->binary );
+	if ( p->notation != NULL )
+		llsd_notation_parser_delete( p->notation );
+	if ( p->json != NULL )
+		llsd_json_parser_delete( p->json );
+	llsd_buffer_deinitialize( &(p->in) );
+	FREE( p );
+}
+
+/* runs the binary, notation or json parser over the held input and keeps
+ * what it couldn't use */
+static int_t llsd_parser_feed_held( llsd_parser_t * const p, int const final )
+{
+	int_t ok = FALSE;
+	size_t need = 0;
+	size_t used = 0;
+
+	if ( p->binary != NULL )
+		need = llsd_binary_parser_need( p->binary );
+	else if ( p->notation != NULL )
+		need = llsd_notation_parser_need( p->notation );
+	else
+		need = llsd_json_parser_need( p->json );
+
+	/* a token cut off last time can't be parsed until all of it is here */
+	if ( !final && (p->in.len < need) )
+		return TRUE;
+
+	if ( p->binary != NULL )
+		ok = llsd_binary_parser_feed( p->binary, p->in.data, p->in.len, final, &used );
+	else if ( p->notation != NULL )
+		ok = llsd_notation_parser_feed( p->notation, p->in.data, p->in.len, final, &used );
+	else
+		ok = llsd_json_parser_feed( p->json, p->in.data, p->in.len, final, &used );
+
+	CHECK_RET( ok, FALSE );
+	return llsd_buffer_consume( &(p->in), used );
+}
+
+int llsd_parser_feed( llsd_parser_t * const p, uint8_t const * const buf, size_t const len )
+{
+	CHECK_PTR_RET( p, FALSE );
+	CHECK_RET( (buf != NULL) || (len == 0), FALSE );
+	CHECK_RET( !p->failed, FALSE );
+
+	/* xml goes straight to expat which keeps its own partial tokens */
+	if ( p->xml != NULL )
+	{
+		if ( !llsd_xml_parser_feed( p->xml, buf, len, FALSE ) )
+			p->failed = TRUE;
+		return !p->failed;
+	}
+
+	if ( !llsd_buffer_write( &(p->in), buf, len ) )
+	{
+		p->failed = TRUE;
+		return FALSE;
+	}
+
+	if ( (p->binary != NULL) || (p->notation != NULL) || (p->json != NULL) )
+	{
+		if ( !llsd_parser_feed_held( p, FALSE ) )
+			p->failed = TRUE;
+		return !p->failed;
+	}
+
+	/* once there is enough for the signature, switch to the push parser for
+	 * the format.  json has no signature, it is whatever the others aren't. */
+	if ( p->in.len >= PARSER_SIG_LEN )
+	{
+		if ( llsd_binary_check_sig_buffer( p->in.data, p->in.len ) )
+		{
+			p->binary = llsd_binary_parser_new( &(p->ops), &(p->state) );
+			if ( (p->binary == NULL) || 
+				 !llsd_buffer_consume( &(p->in), PARSER_SIG_LEN ) ||
+				 !llsd_parser_feed_held( p, FALSE ) )
+				p->failed = TRUE;
+		}
+		else if ( llsd_notation_check_sig_buffer( p->in.data, p->in.len ) )
+		{
+			p->notation = llsd_notation_parser_new( &(p->ops), &(p->state) );
+			if ( (p->notation == NULL) || 
+				 !llsd_buffer_consume( &(p->in), PARSER_SIG_LEN ) ||
+				 !llsd_parser_feed_held( p, FALSE ) )
+				p->failed = TRUE;
+		}
+		else if ( llsd_xml_check_sig_buffer( p->in.data, p->in.len ) )
+		{
+			p->xml = llsd_xml_parser_new( &(p->ops), &(p->state) );
+			if ( (p->xml == NULL) || !llsd_xml_parser_feed( p->xml, p->in.data, p->in.len, FALSE ) )
+				p->failed = TRUE;
+			llsd_buffer_consume( &(p->in), p->in.len );
+		}
+		else
+		{
+			p->json = llsd_json_parser_new( &(p->ops), &(p->state) );
+			if ( (p->json == NULL) || !llsd_parser_feed_held( p, FALSE ) )
+				p->failed = TRUE;
+		}
+	}
+
+	return !p->failed;
+}
+
+llsd_t * llsd_parser_finish( llsd_parser_t * const p )
+{
+	int ok = FALSE;
+	CHECK_PTR_RET( p, NULL );
+
+	if ( !p->failed )
+	{
+		if ( p->xml != NULL )
+			ok = llsd_xml_parser_feed( p->xml, NULL, 0, TRUE );
+		else if ( (p->binary != NULL) || (p->notation != NULL) || (p->json != NULL) )
+			ok = llsd_parser_feed_held( p, TRUE );
+		else if ( p->in.len > 0 )
+			ok = parse_buffer( p->in.data, p->in.len, &(p->ops), &(p->state) );
+	}
+	p->failed = TRUE;
+
+	return parser_state_finish( &(p->state), ok );
+}
+
+/* what is left after streaming the records is the empty top level array */
+static int records_finish( llsd_t * const llsd )
+{
+	int ok = FALSE;
+
+	CHECK_PTR_RET( llsd, FALSE );
+	ok = (llsd_get_type( llsd ) == LLSD_ARRAY);
+	llsd_delete( llsd );
+	return ok;
+}
+
+int llsd_parse_records_from_buffer( uint8_t const * const buf, size_t const len, llsd_record_fn const fn, void * const user_data )
+{
+	int ok = FALSE;
+	parser_state_t state;
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( fn, FALSE );
+
+	CHECK_RET( parser_state_initialize( &state, NULL ), FALSE );
+	state.record_fn = fn;
+	state.record_data = user_data;
+
+	ok = parse_buffer( buf, len, &tree_ops, &state );
+
+	return records_finish( parser_state_finish( &state, ok ) );
+}
+
+int llsd_parse_records_from_file( FILE * fin, llsd_record_fn const fn, void * const user_data )
+{
+	int ok = FALSE;
+	size_t ret = 0;
+	uint8_t const * map = NULL;
+	size_t len = 0;
+	uint8_t chunk[READ_CHUNK_SIZE];
+	llsd_parser_t * p = NULL;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( fn, FALSE );
+
+	/* a mapped file is paged in and out by the kernel as it is parsed.  the
+	 * map starts at the top of the file, so only map it when nothing has
+	 * been read from the stream yet and leave the stream at the end after
+	 * like the reads do */
+	if ( (ftello( fin ) == 0) && llsd_map_file( fin, &map, &len ) )
+	{
+		ok = llsd_parse_records_from_buffer( map, len, fn, user_data );
+		llsd_unmap_file( map, len );
+		return ( (fseeko( fin, 0, SEEK_END ) == 0) && ok );
+	}
+
+	/* pipes and the like are fed in chunks, only the current record and the
+	 * token cut off at the end of a chunk are held */
+	p = llsd_parser_new( NULL );
+	CHECK_PTR_RET( p, FALSE );
+	p->state.record_fn = fn;
+	p->state.record_data = user_data;
+
+	ok = TRUE;
+	while ( ok && ((ret = fread( chunk, sizeof(uint8_t), READ_CHUNK_SIZE, fin )) > 0) )
+	{
+		ok = llsd_parser_feed( p, chunk, ret );
+	}
+	ok = records_finish( llsd_parser_finish( p ) ) && ok && !ferror( fin );
+	llsd_parser_delete( p );
+
+	return ok;
+}
+
+llsd_t * llsd_parse_from_file( FILE * fin )
+{
+	return llsd_parse_from_file_ex( fin, NULL );
+}
+
+llsd_t * llsd_parse_from_file_ex( FILE * fin, llsd_parse_opts_t const * const opts )
+{
+	llsd_t * llsd = NULL;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+	llsd_parse_opts_t copy;
+
+	CHECK_PTR_RET( fin, NULL );
+
+	/* the buffer is gone after the parse so nothing can borrow from it */
+	if ( opts != NULL )
+	{
+		copy = (*opts);
+		copy.borrow = FALSE;
+		copy.lazy = FALSE;
+	}
+
+	/* read the whole file into memory and parse it from there */
+	CHECK_RET( llsd_read_file( fin, &buf, &len ), NULL );
+	llsd = llsd_parse_from_buffer_ex( buf, len, ((opts != NULL) ? &copy : NULL) );
+	FREE( buf );
+
+	return llsd;
+}
+
+struct llsd_parse_ctx_s
+{
+	parser_state_t state;
+	llsd_binary_parser_t * binary;	/* the format parsers are made the first */
+	llsd_notation_ctx_t * notation;	/* time a document needs them */
+	llsd_xml_parser_t * xml;
+	llsd_json_ctx_t * json;
+	uint8_t * file;				/* the last file read, its buffer is reused */
+	size_t file_size;
+};
+
+llsd_parse_ctx_t * llsd_parse_ctx_new( void )
+{
+	llsd_parse_ctx_t * ctx = NULL;
+
+	ctx = (llsd_parse_ctx_t*)CALLOC( 1, sizeof(llsd_parse_ctx_t) );
+	CHECK_PTR_RET( ctx, NULL );
+
+	if ( !parser_state_initialize( &(ctx->state), NULL ) )
+	{
+		FREE( ctx );
 		return NULL;
 	}
+	ctx->state.keep = TRUE;
+
+	return ctx;
+}
+
+void llsd_parse_ctx_delete( void * p )
+{
+	llsd_parse_ctx_t * ctx = (llsd_parse_ctx_t*)p;
+	CHECK_PTR( ctx );
+
+	/* let finish free the stacks and frames this time */
+	ctx->state.keep = FALSE;
+	parser_state_finish( &(ctx->state), FALSE );
+	if ( ctx->binary != NULL )
+		llsd_binary_parser_delete( ctx->binary );
+	if ( ctx->notation != NULL )
+		llsd_notation_ctx_delete( ctx->notation );
+	if ( ctx->xml != NULL )
+		llsd_xml_parser_delete( ctx->xml );
+	if ( ctx->json != NULL )
+		llsd_json_ctx_delete( ctx->json );
+	FREE( ctx->file );
+	FREE( ctx );
+}
+
+/* parse_buffer with the format parsers kept in the context */
+static int_t parse_buffer_ctx( llsd_parse_ctx_t * const ctx, uint8_t const * const buf, size_t const len, int const borrow, llsd_ops_t const * const ops, void * const state )
+{
+	if ( llsd_binary_check_sig_buffer( buf, len ) )
+	{
+		if ( ctx->binary == NULL )
+			ctx->binary = llsd_binary_parser_new( ops, state );
+		CHECK_PTR_RET( ctx->binary, FALSE );
+		return llsd_binary_parse_buffer_ctx( ctx->binary, buf, len, borrow, ops, state );
+	}
+	else if ( llsd_notation_check_sig_buffer( buf, len ) )
+	{
+		if ( ctx->notation == NULL )
+			ctx->notation = llsd_notation_ctx_new();
+		CHECK_PTR_RET( ctx->notation, FALSE );
+		return llsd_notation_parse_buffer_ctx( ctx->notation, buf, len, ops, state );
+	}
+	else if ( llsd_xml_check_sig_buffer( buf, len ) )
+	{
+		if ( ctx->xml == NULL )
+			ctx->xml = llsd_xml_parser_new( ops, state );
+		CHECK_PTR_RET( ctx->xml, FALSE );
+		return llsd_xml_parse_buffer_ctx( ctx->xml, buf, len, ops, state );
+	}
+	/* NOTE: this *must* be last because JSON files don't have a signature
+	 * so llsd_json_check_sig_buffer always returns TRUE */
+	else if ( llsd_json_check_sig_buffer( buf, len ) )
+	{
+		if ( ctx->json == NULL )
+			ctx->json = llsd_json_ctx_new();
+		CHECK_PTR_RET( ctx->json, FALSE );
+		return llsd_json_parse_buffer_ctx( ctx->json, buf, len, ops, state );
+	}
+	return FALSE;
+}
+
+llsd_t * llsd_parse_ctx_from_buffer( llsd_parse_ctx_t * const ctx, uint8_t const * const buf, size_t const len, llsd_parse_opts_t const * const opts )
+{
+	int ok = FALSE;
 
-	return state.llsd;
+	CHECK_PTR_RET( ctx, NULL );
+	CHECK_PTR_RET( buf, NULL );
+
+	if ( (opts != NULL) && opts->lazy && (opts->projection == NULL) && llsd_binary_check_sig_buffer( buf, len ) )
+		return llsd_binary_parse_lazy( buf, len, opts->arena );
+
+	if ( ((opts == NULL) || (opts->projection == NULL)) && llsd_binary_check_sig_buffer( buf, len ) )
+		return BINARY_PARSE_TREE( buf, len, opts );
+
+	parser_state_restart( &(ctx->state), opts );
+	ok = parse_buffer_ctx( ctx, buf, len, ((opts != NULL) && opts->borrow), PARSE_OPS( opts ), &(ctx->state) );
+
+	return parser_state_finish( &(ctx->state), ok );
 }
 
+llsd_t * llsd_parse_ctx_from_file( llsd_parse_ctx_t * const ctx, FILE * fin, llsd_parse_opts_t const * const opts )
+{
+	size_t len = 0;
+	llsd_parse_opts_t copy;
+
+	CHECK_PTR_RET( ctx, NULL );
+	CHECK_PTR_RET( fin, NULL );
+
+	/* the buffer is overwritten by the next file so nothing can borrow from it */
+	if ( opts != NULL )
+	{
+		copy = (*opts);
+		copy.borrow = FALSE;
+		copy.lazy = FALSE;
+	}
+
+	CHECK_RET( read_file( fin, &(ctx->file), &(ctx->file_size), &len ), NULL );
+	return llsd_parse_ctx_from_buffer( ctx, ctx->file, len, ((opts != NULL) ? &copy : NULL) );
+}
@@ -20,8 +20,86 @@
 #include <stdint.h>
 
 #include "llsd.h"
+#include "llsd_projection.h"
 
 llsd_t * llsd_parse_from_file( FILE * fin );
+llsd_t * llsd_parse_from_buffer( uint8_t const * const buf, size_t const len );
+
+/* optional settings for the _ex parse functions, zero it before use */
+typedef struct llsd_parse_opts_s
+{
+	llsd_arena_t * arena;	/* build the tree in this arena instead of on the heap */
+	llsd_intern_t * intern;	/* share map keys from this table, it must outlive the tree */
+	int borrow;				/* binary only: strings, uris and binary values point into the
+							 * parsed buffer, which must outlive the tree, see LLSD_BORROW.
+							 * the file functions read the file into a buffer they free
+							 * or reuse, so they clear borrow and lazy and copy instead */
+	int lazy;				/* binary only: arrays and maps are parsed when first used,
+							 * it borrows like borrow does.  ignored with a projection */
+	llsd_projection_t const * projection;	/* keep only these paths, see llsd_projection_new */
+
+} llsd_parse_opts_t;
+
+llsd_t * llsd_parse_from_file_ex( FILE * fin, llsd_parse_opts_t const * const opts );
+llsd_t * llsd_parse_from_buffer_ex( uint8_t const * const buf, size_t const len, llsd_parse_opts_t const * const opts );
+
+/* streaming parse, the callbacks get the events straight from the format
+ * parser and no tree is built.  fmt is one of the LLSD_ENC_ values or
+ * LLSD_ENC_AUTODETECT.  callbacks left NULL are skipped.  returning FALSE
+ * from a callback stops the parse and it returns FALSE.
+ *
+ * ownership: when string_fn, uri_fn or binary_fn get own_it TRUE the data
+ * was allocated with CALLOC and now belongs to the callback, which must FREE
+ * it or keep it.  with own_it FALSE the data belongs to the parser and is
+ * only valid during the call, copy it to keep it.  strings and uris are
+ * always null terminated at len. */
+int llsd_parse_with_ops( uint8_t const * const buf, size_t const len, llsd_serializer_t const fmt, llsd_ops_t const * const ops, void * const user_data );
+int llsd_parse_file_with_ops( FILE * fin, llsd_serializer_t const fmt, llsd_ops_t const * const ops, void * const user_data );
+
+/* push parser for documents that arrive in pieces, e.g. from a non-blocking
+ * socket.  feed never blocks and takes chunks of any size; finish returns
+ * the tree, or NULL if the document was bad or incomplete, and the parser
+ * can't be fed after that.  every format is parsed as it arrives, only
+ * the token cut off at the end of a chunk is held.  a json document shorter
+ * than the longest signature is held until finish. */
+typedef struct llsd_parser_s llsd_parser_t;
+llsd_parser_t * llsd_parser_new( llsd_parse_opts_t const * const opts );
+void llsd_parser_delete( void * p );
+int llsd_parser_feed( llsd_parser_t * const p, uint8_t const * const buf, size_t const len );
+llsd_t * llsd_parser_finish( llsd_parser_t * const p );
+
+/* parse context for code that parses many documents, e.g. one per message.
+ * the stacks, scratch buffers, expat parser and file buffer are kept and
+ * reset between documents instead of being set up for each one, so after
+ * the first few documents parsing allocates only the tree.  the _ex opts
+ * are passed per document.  a context must only be used by one thread at
+ * a time, keep one per thread. */
+typedef struct llsd_parse_ctx_s llsd_parse_ctx_t;
+llsd_parse_ctx_t * llsd_parse_ctx_new( void );
+void llsd_parse_ctx_delete( void * p );
+llsd_t * llsd_parse_ctx_from_buffer( llsd_parse_ctx_t * const ctx, uint8_t const * const buf, size_t const len, llsd_parse_opts_t const * const opts );
+llsd_t * llsd_parse_ctx_from_file( llsd_parse_ctx_t * const ctx, FILE * fin, llsd_parse_opts_t const * const opts );
+
+/* record streaming for documents whose top level is a huge array.  each
+ * element is built, passed to fn with its index, and deleted when fn
+ * returns, so only one element is in memory at a time.  returning FALSE
+ * from fn stops the parse and it returns FALSE.  the top level must be an
+ * array.  the file version parses from the current position to the end of
+ * the file.  it maps the file instead of reading it in when nothing has been
+ * read from it yet, or feeds it in chunks otherwise or when it can't be
+ * mapped. */
+typedef int_t (*llsd_record_fn)( llsd_t * const record, uint_t const index, void * const user_data );
+int llsd_parse_records_from_buffer( uint8_t const * const buf, size_t const len, llsd_record_fn const fn, void * const user_data );
+int llsd_parse_records_from_file( FILE * fin, llsd_record_fn const fn, void * const user_data );
+
+/* reads everything from the current position to the end of the file into a
+ * newly allocated buffer, the caller must FREE the buffer */
+int llsd_read_file( FILE * fin, uint8_t ** const buf, size_t * const len );
+
+/* maps the whole file read-only into memory, for parsing large documents
+ * with borrow set.  unmap it after the tree is deleted */
+int llsd_map_file( FILE * fin, uint8_t const ** const buf, size_t * const len );
+void llsd_unmap_file( uint8_t const * const buf, size_t const len );
 
 #endif/*LLSD_PARSER_H*/
 
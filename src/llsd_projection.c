@@ -0,0 +1,263 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd.h"
+#include "llsd_projection.h"
+
+#define ANY_INDEX (-1)
+
+/* one step of a path, the paths share their common steps */
+struct llsd_projection_node_s
+{
+	uint8_t * key;		/* map key, NULL for an array step */
+	uint32_t len;
+	int32_t index;		/* array index or ANY_INDEX */
+	int leaf;			/* a path ends here, keep the whole value */
+	llsd_projection_node_t * child;
+	llsd_projection_node_t * next;
+};
+
+struct llsd_projection_s
+{
+	llsd_projection_node_t root;
+};
+
+static void projection_node_deinitialize( llsd_projection_node_t * const node )
+{
+	llsd_projection_node_t * c = node->child;
+	llsd_projection_node_t * n = NULL;
+
+	while ( c != NULL )
+	{
+		n = c->next;
+		projection_node_deinitialize( c );
+		FREE( c );
+		c = n;
+	}
+	FREE( node->key );
+}
+
+/* finds the step under node, adding it if it isn't there */
+static llsd_projection_node_t * projection_step( llsd_projection_node_t * const node, uint8_t const * const key, uint32_t const len, int32_t const index )
+{
+	llsd_projection_node_t * c = NULL;
+
+	for ( c = node->child; c != NULL; c = c->next )
+	{
+		if ( key != NULL )
+		{
+			if ( (c->key != NULL) && (c->len == len) && (MEMCMP( c->key, key, len ) == 0) )
+				return c;
+		}
+		else if ( (c->key == NULL) && (c->index == index) )
+		{
+			return c;
+		}
+	}
+
+	c = (llsd_projection_node_t*)CALLOC( 1, sizeof(llsd_projection_node_t) );
+	CHECK_PTR_RET( c, NULL );
+	if ( key != NULL )
+	{
+		c->key = CALLOC( len + 1, sizeof(uint8_t) );
+		if ( c->key == NULL )
+		{
+			FREE( c );
+			return NULL;
+		}
+		MEMCPY( c->key, key, len );
+		c->len = len;
+	}
+	c->index = index;
+	c->next = node->child;
+	node->child = c;
+	return c;
+}
+
+static int projection_add( llsd_projection_t * const proj, uint8_t const * p )
+{
+	int32_t index;
+	uint8_t const * s = NULL;
+	llsd_projection_node_t * node = &(proj->root);
+
+	while ( (*p) != '\0' )
+	{
+		if ( (*p) == '[' )
+		{
+			p++;
+			if ( (*p) == '*' )
+			{
+				index = ANY_INDEX;
+				p++;
+			}
+			else
+			{
+				CHECK_RET( isdigit( *p ), FALSE );
+				for ( index = 0; isdigit( *p ); p++ )
+					index = (index * 10) + ((*p) - '0');
+			}
+			CHECK_RET( (*p) == ']', FALSE );
+			p++;
+			node = projection_step( node, NULL, 0, index );
+		}
+		else
+		{
+			for ( s = p; ((*p) != '\0') && ((*p) != '.') && ((*p) != '['); p++ ) {}
+			CHECK_RET( p > s, FALSE );
+			node = projection_step( node, s, (uint32_t)(p - s), 0 );
+		}
+		CHECK_PTR_RET( node, FALSE );
+
+		/* a dot goes before the next key */
+		if ( (*p) == '.' )
+		{
+			p++;
+			CHECK_RET( ((*p) != '\0') && ((*p) != '[') && ((*p) != '.'), FALSE );
+		}
+	}
+
+	node->leaf = TRUE;
+	return TRUE;
+}
+
+/* adds the steps under src to dst */
+static int projection_merge( llsd_projection_node_t * const dst, llsd_projection_node_t const * const src )
+{
+	llsd_projection_node_t const * c = NULL;
+	llsd_projection_node_t * d = NULL;
+
+	if ( src->leaf )
+		dst->leaf = TRUE;
+
+	for ( c = src->child; c != NULL; c = c->next )
+	{
+		d = projection_step( dst, c->key, c->len, c->index );
+		CHECK_PTR_RET( d, FALSE );
+		CHECK_RET( projection_merge( d, c ), FALSE );
+	}
+	return TRUE;
+}
+
+/* an exact index also keeps what [*] keeps, so "a[*].x" and "a[1].y" keep
+ * both x and y in a[1].  lookups can then stop at the first match. */
+static int projection_normalize( llsd_projection_node_t * const node )
+{
+	llsd_projection_node_t * c = NULL;
+	llsd_projection_node_t * any = NULL;
+
+	for ( c = node->child; c != NULL; c = c->next )
+	{
+		if ( (c->key == NULL) && (c->index == ANY_INDEX) )
+			any = c;
+	}
+
+	for ( c = node->child; c != NULL; c = c->next )
+	{
+		if ( (any != NULL) && (c != any) && (c->key == NULL) )
+			CHECK_RET( projection_merge( c, any ), FALSE );
+		CHECK_RET( projection_normalize( c ), FALSE );
+	}
+	return TRUE;
+}
+
+llsd_projection_t * llsd_projection_new( uint8_t const * const * const paths, uint_t const count )
+{
+	uint_t i;
+	llsd_projection_t * proj = NULL;
+
+	CHECK_PTR_RET( paths, NULL );
+
+	proj = (llsd_projection_t*)CALLOC( 1, sizeof(llsd_projection_t) );
+	CHECK_PTR_RET( proj, NULL );
+	proj->root.index = ANY_INDEX;
+
+	for ( i = 0; i < count; i++ )
+	{
+		if ( (paths[i] == NULL) || !projection_add( proj, paths[i] ) )
+		{
+			DEBUG( "bad projection path: %s\n", (paths[i] ? (char const *)paths[i] : "(null)") );
+			llsd_projection_delete( proj );
+			return NULL;
+		}
+	}
+
+	if ( !projection_normalize( &(proj->root) ) )
+	{
+		llsd_projection_delete( proj );
+		return NULL;
+	}
+
+	return proj;
+}
+
+void llsd_projection_delete( void * p )
+{
+	llsd_projection_t * proj = (llsd_projection_t*)p;
+	CHECK_PTR( proj );
+	projection_node_deinitialize( &(proj->root) );
+	FREE( proj );
+}
+
+llsd_projection_node_t const * llsd_projection_root( llsd_projection_t const * const proj )
+{
+	CHECK_PTR_RET( proj, NULL );
+	return &(proj->root);
+}
+
+llsd_projection_node_t const * llsd_projection_key( llsd_projection_node_t const * const node, uint8_t const * const key, uint32_t const len )
+{
+	llsd_projection_node_t const * c = NULL;
+
+	CHECK_PTR_RET( node, NULL );
+	if ( node->leaf )
+		return node;
+
+	for ( c = node->child; c != NULL; c = c->next )
+	{
+		if ( (c->key != NULL) && (c->len == len) && (MEMCMP( c->key, key, len ) == 0) )
+			return c;
+	}
+	return NULL;
+}
+
+llsd_projection_node_t const * llsd_projection_index( llsd_projection_node_t const * const node, uint_t const index )
+{
+	llsd_projection_node_t const * c = NULL;
+	llsd_projection_node_t const * any = NULL;
+
+	CHECK_PTR_RET( node, NULL );
+	if ( node->leaf )
+		return node;
+
+	/* an exact index has what [*] has merged into it */
+	for ( c = node->child; c != NULL; c = c->next )
+	{
+		if ( c->key != NULL )
+			continue;
+		if ( c->index == (int32_t)index )
+			return c;
+		if ( c->index == ANY_INDEX )
+			any = c;
+	}
+	return any;
+}
+
@@ -0,0 +1,48 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef LLSD_PROJECTION_H
+#define LLSD_PROJECTION_H
+
+#include <stdint.h>
+
+#include "llsd.h"
+
+/* a set of paths to keep when parsing, everything else is skipped.  paths
+ * are map keys separated by '.', with [n] or [*] to step into an array:
+ *
+ *     region.name
+ *     agents[*].position
+ *     [0].id
+ *
+ * the value at the end of a path is kept whole.  maps and arrays along the
+ * way only get the children that are on a path, so a kept array element
+ * may not be at its original index.  keys can't contain '.' or '['.  an
+ * empty path keeps everything. */
+typedef struct llsd_projection_s llsd_projection_t;
+typedef struct llsd_projection_node_s llsd_projection_node_t;
+
+llsd_projection_t * llsd_projection_new( uint8_t const * const * const paths, uint_t const count );
+void llsd_projection_delete( void * p );
+
+/* walking a projection, the lookups return NULL for a child that isn't on
+ * any path.  everything below the end of a path is kept so lookups there
+ * return the node itself. */
+llsd_projection_node_t const * llsd_projection_root( llsd_projection_t const * const proj );
+llsd_projection_node_t const * llsd_projection_key( llsd_projection_node_t const * const node, uint8_t const * const key, uint32_t const len );
+llsd_projection_node_t const * llsd_projection_index( llsd_projection_node_t const * const node, uint_t const index );
+
+#endif/*LLSD_PROJECTION_H*/
@@ -0,0 +1,361 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd.h"
+#include "llsd_parser.h"
+#include "llsd_binary_parser.h"
+#include "llsd_notation_parser.h"
+#include "llsd_json_parser.h"
+#include "llsd_xml_parser.h"
+#include "llsd_reader.h"
+
+#define BINARY_SIG_LEN (18)
+#define NOTATION_SIG_LEN (18)
+
+struct llsd_reader_s
+{
+	/* the rest of the document */
+	uint8_t const * p;
+	uint8_t const * end;
+
+	/* the tokenizer of the format, stepped one token at a time */
+	llsd_binary_parser_t * binary;
+	llsd_notation_parser_t * notation;
+	llsd_json_parser_t * json;
+	llsd_token_t * token;	/* where the ops put the token */
+	int have;				/* the ops have filled in the token */
+	int key;				/* the next string is a map key */
+	uint_t depth;			/* containers the last token is in */
+	int done;				/* the top level value has ended */
+	uint8_t * scratch;		/* a decoded string, freed by the next call */
+};
+
+/* callbacks that hand the tokenizers' values to the token being read */
+static llsd_token_t * set_token( llsd_reader_t * const r, llsd_token_type_t const type )
+{
+	r->token->type = type;
+	r->have = TRUE;
+	return r->token;
+}
+
+static int_t set_str_token( llsd_reader_t * const r, llsd_token_type_t const type, uint8_t const * str, uint32_t const len, int const own_it )
+{
+	llsd_token_t * t = NULL;
+
+	/* the tokenizers only hand out borrowed slices or decoded strings */
+	CHECK_RET( own_it != FALSE, FALSE );
+
+	/* borrowed slices point into the buffer, decoded ones only live until
+	 * the next call */
+	if ( own_it == TRUE )
+		r->scratch = (uint8_t*)str;
+
+	t = set_token( r, type );
+	t->v.str.ptr = str;
+	t->v.str.len = len;
+	return TRUE;
+}
+
+static int_t reader_nop( void * const user_data )
+{
+	return TRUE;
+}
+
+static int_t reader_undef( void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_UNDEF );
+	return TRUE;
+}
+
+static int_t reader_boolean( int const value, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_BOOLEAN )->v.boolean = value;
+	return TRUE;
+}
+
+static int_t reader_integer( int32_t const value, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_INTEGER )->v.integer = value;
+	return TRUE;
+}
+
+static int_t reader_real( double const value, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_REAL )->v.real = value;
+	return TRUE;
+}
+
+static int_t reader_uuid( uint8_t const value[UUID_LEN], void * const user_data )
+{
+	MEMCPY( set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_UUID )->v.uuid, value, UUID_LEN );
+	return TRUE;
+}
+
+static int_t reader_string( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
+{
+	llsd_reader_t * r = (llsd_reader_t*)user_data;
+	return set_str_token( r, (r->key ? LLSD_TOKEN_KEY : LLSD_TOKEN_STRING), str, len, own_it );
+}
+
+static int_t reader_date( double const value, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_DATE )->v.real = value;
+	return TRUE;
+}
+
+static int_t reader_uri( uint8_t const * uri, uint32_t const len, int const own_it, void * const user_data )
+{
+	return set_str_token( (llsd_reader_t*)user_data, LLSD_TOKEN_URI, uri, len, own_it );
+}
+
+static int_t reader_binary( uint8_t const * data, uint32_t const len, int const own_it, void * const user_data )
+{
+	return set_str_token( (llsd_reader_t*)user_data, LLSD_TOKEN_BINARY, data, len, own_it );
+}
+
+static int_t reader_array_begin( uint_t const size, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_ARRAY_BEGIN )->v.size = size;
+	return TRUE;
+}
+
+static int_t reader_array_end( uint_t const size, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_ARRAY_END );
+	return TRUE;
+}
+
+static int_t reader_map_begin( uint_t const size, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_MAP_BEGIN )->v.size = size;
+	return TRUE;
+}
+
+static int_t reader_map_key_begin( void * const user_data )
+{
+	((llsd_reader_t*)user_data)->key = TRUE;
+	return TRUE;
+}
+
+static int_t reader_map_key_end( void * const user_data )
+{
+	((llsd_reader_t*)user_data)->key = FALSE;
+	return TRUE;
+}
+
+static int_t reader_map_end( uint_t const size, void * const user_data )
+{
+	set_token( (llsd_reader_t*)user_data, LLSD_TOKEN_MAP_END );
+	return TRUE;
+}
+
+/* the tokenizers call every op, the value begin/end ones carry nothing a
+ * reader needs */
+static llsd_ops_t const reader_ops =
+{
+	&reader_undef,
+	&reader_boolean,
+	&reader_integer,
+	&reader_real,
+	&reader_uuid,
+	&reader_string,
+	&reader_date,
+	&reader_uri,
+	&reader_binary,
+	&reader_array_begin,
+	&reader_nop,
+	&reader_nop,
+	&reader_array_end,
+	&reader_map_begin,
+	&reader_map_key_begin,
+	&reader_map_key_end,
+	&reader_nop,
+	&reader_nop,
+	&reader_map_end
+};
+
+/* runs one step of the format's tokenizer */
+static int reader_step( llsd_reader_t * const r, int * const skip, size_t * const used )
+{
+	size_t const len = (size_t)(r->end - r->p);
+
+	if ( r->binary != NULL )
+		return llsd_binary_parser_next( r->binary, r->p, len, skip, used );
+	if ( r->notation != NULL )
+		return llsd_notation_parser_next( r->notation, r->p, len, skip, used );
+	return llsd_json_parser_next( r->json, r->p, len, skip, used );
+}
+
+/* checks that the document was whole once all of it has been stepped */
+static int reader_finish( llsd_reader_t * const r )
+{
+	size_t used = 0;
+
+	if ( r->binary != NULL )
+		return llsd_binary_parser_feed( r->binary, r->p, 0, TRUE, &used );
+	if ( r->notation != NULL )
+		return llsd_notation_parser_feed( r->notation, r->p, 0, TRUE, &used );
+	return llsd_json_parser_feed( r->json, r->p, 0, TRUE, &used );
+}
+
+/* steps the tokenizer until the ops have been handed a token, or a value has
+ * been passed over when skip is set */
+static int reader_next( llsd_reader_t * const r, llsd_token_t * const token, int skip )
+{
+	int skipping = skip;
+	size_t used = 0;
+
+	FREE( r->scratch );
+	r->scratch = NULL;
+	r->token = token;
+	r->have = FALSE;
+
+	while ( !r->have )
+	{
+		if ( r->p >= r->end )
+		{
+			/* there is no value to skip at the end, and running out of data
+			 * is only fine outside of any container */
+			CHECK_RET( !skipping, FALSE );
+			CHECK_RET( reader_finish( r ), FALSE );
+			token->type = LLSD_TOKEN_END;
+			return TRUE;
+		}
+
+		CHECK_RET( reader_step( r, &skip, &used ), FALSE );
+
+		/* a step that neither read a token nor moved on is a stuck parse */
+		CHECK_RET( r->have || (used > 0), FALSE );
+		r->p += used;
+
+		/* the value has been passed over */
+		if ( skipping && !skip )
+		{
+			CHECK_RET( !r->done, FALSE );
+			r->done = (r->depth == 0);
+			return TRUE;
+		}
+	}
+
+	/* only one value is allowed at the top level */
+	CHECK_RET( !r->done, FALSE );
+	switch ( token->type )
+	{
+		case LLSD_TOKEN_ARRAY_BEGIN:
+		case LLSD_TOKEN_MAP_BEGIN:
+			r->depth++;
+			break;
+		case LLSD_TOKEN_ARRAY_END:
+		case LLSD_TOKEN_MAP_END:
+			r->depth--;
+			break;
+		default:
+			break;
+	}
+	r->done = (r->depth == 0);
+
+	return TRUE;
+}
+
+llsd_reader_t * llsd_reader_new( uint8_t const * const buf, size_t const len, llsd_serializer_t const fmt )
+{
+	llsd_reader_t * r = NULL;
+	llsd_serializer_t f = fmt;
+
+	CHECK_PTR_RET( buf, NULL );
+
+	if ( f == LLSD_ENC_AUTODETECT )
+	{
+		if ( llsd_binary_check_sig_buffer( buf, len ) )
+			f = LLSD_ENC_BINARY;
+		else if ( llsd_notation_check_sig_buffer( buf, len ) )
+			f = LLSD_ENC_NOTATION;
+		else if ( llsd_xml_check_sig_buffer( buf, len ) )
+			f = LLSD_ENC_XML;
+		else
+			f = LLSD_ENC_JSON;
+	}
+
+	/* the xml parser runs the whole document through expat and can't be
+	 * stepped one token at a time */
+	CHECK_RET( (f == LLSD_ENC_BINARY) || (f == LLSD_ENC_NOTATION) || (f == LLSD_ENC_JSON), NULL );
+
+	r = (llsd_reader_t*)CALLOC( 1, sizeof(llsd_reader_t) );
+	CHECK_PTR_RET( r, NULL );
+	r->p = buf;
+	r->end = buf + len;
+
+	switch ( f )
+	{
+		case LLSD_ENC_BINARY:
+			/* skip past signature */
+			if ( llsd_binary_check_sig_buffer( buf, len ) )
+				r->p += BINARY_SIG_LEN;
+			r->binary = llsd_binary_parser_new( &reader_ops, r );
+			CHECK_GOTO( r->binary != NULL, fail_reader_new );
+			break;
+
+		case LLSD_ENC_NOTATION:
+			if ( llsd_notation_check_sig_buffer( buf, len ) )
+				r->p += NOTATION_SIG_LEN;
+			r->notation = llsd_notation_parser_new( &reader_ops, r );
+			CHECK_GOTO( r->notation != NULL, fail_reader_new );
+			break;
+
+		default:
+			r->json = llsd_json_parser_new( &reader_ops, r );
+			CHECK_GOTO( r->json != NULL, fail_reader_new );
+			break;
+	}
+
+	return r;
+
+fail_reader_new:
+	llsd_reader_delete( r );
+	return NULL;
+}
+
+void llsd_reader_delete( void * p )
+{
+	llsd_reader_t * r = (llsd_reader_t*)p;
+	CHECK_PTR( r );
+
+	FREE( r->scratch );
+	llsd_binary_parser_delete( r->binary );
+	llsd_notation_parser_delete( r->notation );
+	llsd_json_parser_delete( r->json );
+	FREE( r );
+}
+
+int llsd_reader_next( llsd_reader_t * const r, llsd_token_t * const token )
+{
+	CHECK_PTR_RET( r, FALSE );
+	CHECK_PTR_RET( token, FALSE );
+	return reader_next( r, token, FALSE );
+}
+
+int llsd_reader_skip( llsd_reader_t * const r )
+{
+	llsd_token_t token;
+
+	CHECK_PTR_RET( r, FALSE );
+
+	/* the tokenizers jump a whole value without decoding it */
+	return reader_next( r, &token, TRUE );
+}
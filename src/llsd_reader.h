@@ -0,0 +1,84 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef LLSD_READER_H
+#define LLSD_READER_H
+
+#include <stdint.h>
+
+#include "llsd.h"
+
+/* pull reader, the caller asks for one token at a time instead of being
+ * called back.  the buffer must outlive the reader.  binary, notation and
+ * json documents are read in place, each call steps the format's tokenizer
+ * over one token.  string, uri and binary tokens that need no decoding point
+ * into the buffer and are not null terminated, decoded ones are owned by the
+ * reader.  either way a token is valid until the next call.  anything after
+ * the top level value is an error.  xml can't be stepped through and
+ * llsd_reader_new returns NULL for it. */
+typedef enum llsd_token_type_e
+{
+	LLSD_TOKEN_UNDEF,
+	LLSD_TOKEN_BOOLEAN,
+	LLSD_TOKEN_INTEGER,
+	LLSD_TOKEN_REAL,
+	LLSD_TOKEN_UUID,
+	LLSD_TOKEN_STRING,
+	LLSD_TOKEN_DATE,
+	LLSD_TOKEN_URI,
+	LLSD_TOKEN_BINARY,
+	LLSD_TOKEN_ARRAY_BEGIN,
+	LLSD_TOKEN_ARRAY_END,
+	LLSD_TOKEN_MAP_BEGIN,
+	LLSD_TOKEN_KEY,
+	LLSD_TOKEN_MAP_END,
+	LLSD_TOKEN_END			/* no more tokens in the document */
+
+} llsd_token_type_t;
+
+typedef struct llsd_token_s
+{
+	llsd_token_type_t type;
+	union
+	{
+		int boolean;
+		int32_t integer;
+		double real;		/* reals and dates */
+		uint8_t uuid[UUID_LEN];
+		uint32_t size;		/* array and map begin, 0 if the format has no count */
+		struct
+		{
+			uint8_t const * ptr;
+			uint32_t len;
+		} str;				/* strings, keys, uris and binary */
+	} v;
+
+} llsd_token_t;
+
+typedef struct llsd_reader_s llsd_reader_t;
+
+/* fmt is one of the LLSD_ENC_ values or LLSD_ENC_AUTODETECT */
+llsd_reader_t * llsd_reader_new( uint8_t const * const buf, size_t const len, llsd_serializer_t const fmt );
+void llsd_reader_delete( void * r );
+
+/* gets the next token, returns FALSE if the document is bad */
+int llsd_reader_next( llsd_reader_t * const r, llsd_token_t * const token );
+
+/* skips the next value, a whole array or map if that is what comes next.
+ * call it after a KEY token to pass over a value without looking at it */
+int llsd_reader_skip( llsd_reader_t * const r );
+
+#endif/*LLSD_READER_H*/
@@ -0,0 +1,245 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_AVX2 (1)
+#endif
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd_scan.h"
+
+#define IS_SPACE( c ) ( ((c) == ' ') || ((c) == '\t') || ((c) == '\r') || ((c) == '\n') )
+
+static uint8_t const * find2_scalar( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b )
+{
+	for ( ; p < end; p++ )
+	{
+		if ( ((*p) == a) || ((*p) == b) )
+			return p;
+	}
+	return end;
+}
+
+static uint8_t const * find3_scalar( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b, uint8_t const c )
+{
+	for ( ; p < end; p++ )
+	{
+		if ( ((*p) == a) || ((*p) == b) || ((*p) == c) )
+			return p;
+	}
+	return end;
+}
+
+static uint8_t const * space_scalar( uint8_t const * p, uint8_t const * const end )
+{
+	for ( ; p < end; p++ )
+	{
+		if ( !IS_SPACE( *p ) )
+			return p;
+	}
+	return end;
+}
+
+#if defined(__SSE2__)
+static uint8_t const * find2_sse2( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b )
+{
+	int m;
+	__m128i v;
+	__m128i const va = _mm_set1_epi8( (char)a );
+	__m128i const vb = _mm_set1_epi8( (char)b );
+
+	for ( ; (end - p) >= 16; p += 16 )
+	{
+		v = _mm_loadu_si128( (__m128i const *)p );
+		m = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, va ), _mm_cmpeq_epi8( v, vb ) ) );
+		if ( m != 0 )
+			return p + __builtin_ctz( (unsigned int)m );
+	}
+	return find2_scalar( p, end, a, b );
+}
+
+static uint8_t const * find3_sse2( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b, uint8_t const c )
+{
+	int m;
+	__m128i v;
+	__m128i const va = _mm_set1_epi8( (char)a );
+	__m128i const vb = _mm_set1_epi8( (char)b );
+	__m128i const vc = _mm_set1_epi8( (char)c );
+
+	for ( ; (end - p) >= 16; p += 16 )
+	{
+		v = _mm_loadu_si128( (__m128i const *)p );
+		m = _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, va ), _mm_cmpeq_epi8( v, vb ) ),
+											 _mm_cmpeq_epi8( v, vc ) ) );
+		if ( m != 0 )
+			return p + __builtin_ctz( (unsigned int)m );
+	}
+	return find3_scalar( p, end, a, b, c );
+}
+
+static uint8_t const * space_sse2( uint8_t const * p, uint8_t const * const end )
+{
+	int m;
+	__m128i v;
+	__m128i const sp = _mm_set1_epi8( ' ' );
+	__m128i const tab = _mm_set1_epi8( '\t' );
+	__m128i const cr = _mm_set1_epi8( '\r' );
+	__m128i const lf = _mm_set1_epi8( '\n' );
+
+	for ( ; (end - p) >= 16; p += 16 )
+	{
+		v = _mm_loadu_si128( (__m128i const *)p );
+		m = _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, sp ), _mm_cmpeq_epi8( v, tab ) ),
+											 _mm_or_si128( _mm_cmpeq_epi8( v, cr ), _mm_cmpeq_epi8( v, lf ) ) ) );
+		/* the first byte that isn't a space */
+		m = (~m) & 0xFFFF;
+		if ( m != 0 )
+			return p + __builtin_ctz( (unsigned int)m );
+	}
+	return space_scalar( p, end );
+}
+#endif
+
+#if defined(HAVE_AVX2)
+__attribute__((target("avx2")))
+static uint8_t const * find2_avx2( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b )
+{
+	uint32_t m;
+	__m256i v;
+	__m256i const va = _mm256_set1_epi8( (char)a );
+	__m256i const vb = _mm256_set1_epi8( (char)b );
+
+	for ( ; (end - p) >= 32; p += 32 )
+	{
+		v = _mm256_loadu_si256( (__m256i const *)p );
+		m = (uint32_t)_mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpeq_epi8( v, va ), _mm256_cmpeq_epi8( v, vb ) ) );
+		if ( m != 0 )
+			return p + __builtin_ctz( m );
+	}
+	return find2_scalar( p, end, a, b );
+}
+
+__attribute__((target("avx2")))
+static uint8_t const * find3_avx2( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b, uint8_t const c )
+{
+	uint32_t m;
+	__m256i v;
+	__m256i const va = _mm256_set1_epi8( (char)a );
+	__m256i const vb = _mm256_set1_epi8( (char)b );
+	__m256i const vc = _mm256_set1_epi8( (char)c );
+
+	for ( ; (end - p) >= 32; p += 32 )
+	{
+		v = _mm256_loadu_si256( (__m256i const *)p );
+		m = (uint32_t)_mm256_movemask_epi8( _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( v, va ), _mm256_cmpeq_epi8( v, vb ) ),
+															 _mm256_cmpeq_epi8( v, vc ) ) );
+		if ( m != 0 )
+			return p + __builtin_ctz( m );
+	}
+	return find3_scalar( p, end, a, b, c );
+}
+
+__attribute__((target("avx2")))
+static uint8_t const * space_avx2( uint8_t const * p, uint8_t const * const end )
+{
+	uint32_t m;
+	__m256i v;
+	__m256i const sp = _mm256_set1_epi8( ' ' );
+	__m256i const tab = _mm256_set1_epi8( '\t' );
+	__m256i const cr = _mm256_set1_epi8( '\r' );
+	__m256i const lf = _mm256_set1_epi8( '\n' );
+
+	for ( ; (end - p) >= 32; p += 32 )
+	{
+		v = _mm256_loadu_si256( (__m256i const *)p );
+		m = (uint32_t)_mm256_movemask_epi8( _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( v, sp ), _mm256_cmpeq_epi8( v, tab ) ),
+															 _mm256_or_si256( _mm256_cmpeq_epi8( v, cr ), _mm256_cmpeq_epi8( v, lf ) ) ) );
+		/* the first byte that isn't a space */
+		m = ~m;
+		if ( m != 0 )
+			return p + __builtin_ctz( m );
+	}
+	return space_scalar( p, end );
+}
+#endif
+
+typedef uint8_t const * (*find2_fn)( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b );
+typedef uint8_t const * (*find3_fn)( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b, uint8_t const c );
+typedef uint8_t const * (*space_fn)( uint8_t const * p, uint8_t const * const end );
+
+static find2_fn find2_impl = NULL;
+static find3_fn find3_impl = NULL;
+static space_fn space_impl = NULL;
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+/* picks the widest version the cpu runs */
+static void scan_dispatch( void )
+{
+	find2_fn f = &find2_scalar;
+	find3_fn f3 = &find3_scalar;
+	space_fn s = &space_scalar;
+
+#if defined(__SSE2__)
+	f = &find2_sse2;
+	f3 = &find3_sse2;
+	s = &space_sse2;
+#endif
+#if defined(HAVE_AVX2)
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+	{
+		f = &find2_avx2;
+		f3 = &find3_avx2;
+		s = &space_avx2;
+	}
+#endif
+
+	space_impl = s;
+	find3_impl = f3;
+	find2_impl = f;
+}
+
+uint8_t const * llsd_scan_find2( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b )
+{
+	pthread_once( &dispatch_once, &scan_dispatch );
+	return (*find2_impl)( p, end, a, b );
+}
+
+uint8_t const * llsd_scan_find3( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b, uint8_t const c )
+{
+	pthread_once( &dispatch_once, &scan_dispatch );
+	return (*find3_impl)( p, end, a, b, c );
+}
+
+uint8_t const * llsd_scan_space( uint8_t const * p, uint8_t const * const end )
+{
+	/* most runs of space are short, don't bother with the vector unit */
+	if ( (p < end) && !IS_SPACE( *p ) )
+		return p;
+	pthread_once( &dispatch_once, &scan_dispatch );
+	return (*space_impl)( p, end );
+}
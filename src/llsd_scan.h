@@ -0,0 +1,37 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#ifndef LLSD_SCAN_H
+#define LLSD_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* byte scanning for the text parsers, 16 or 32 bytes at a time with SSE2 or
+ * AVX2 when the cpu has them, one at a time otherwise.  the cpu is checked
+ * the first time a scan is done.  they return end if nothing is found. */
+
+/* returns the first byte in [p, end) that is a or b */
+uint8_t const * llsd_scan_find2( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b );
+
+/* returns the first byte in [p, end) that is a, b or c */
+uint8_t const * llsd_scan_find3( uint8_t const * p, uint8_t const * const end, uint8_t const a, uint8_t const b, uint8_t const c );
+
+/* returns the first byte in [p, end) that isn't a space, tab, cr or lf */
+uint8_t const * llsd_scan_space( uint8_t const * p, uint8_t const * const end );
+
+#endif/*LLSD_SCAN_H*/
@@ -26,10 +26,7 @@
 #include "llsd_notation_serializer.h"
 #include "llsd_json_serializer.h"
 
-/* forward decl of private serializer driver */
-static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const ops, void * user_data );
-
-serializer_init_fn const init_fns[LLSD_ENC_COUNT] =
+static serializer_init_fn const init_fns[LLSD_ENC_COUNT] =
 {
 	&llsd_xml_serializer_init,
 	&llsd_binary_serializer_init,
@@ -37,7 +34,7 @@ serializer_init_fn const init_fns[LLSD_ENC_COUNT] =
 	&llsd_json_serializer_init
 };
 
-serializer_deinit_fn const deinit_fns[LLSD_ENC_COUNT] =
+static serializer_deinit_fn const deinit_fns[LLSD_ENC_COUNT] =
 {
 	&llsd_xml_serializer_deinit,
 	&llsd_binary_serializer_deinit,
@@ -45,28 +42,112 @@ serializer_deinit_fn const deinit_fns[LLSD_ENC_COUNT] =
 	&llsd_json_serializer_deinit,
 };
 
+/* per format walkers with the emitters called directly, see llsd_walk.h */
+static serializer_walk_fn const walk_fns[LLSD_ENC_COUNT] =
+{
+	&llsd_xml_serializer_walk,
+	&llsd_binary_serializer_walk,
+	&llsd_notation_serializer_walk,
+	&llsd_json_serializer_walk
+};
+
+int llsd_serializer_init( llsd_serializer_t const fmt, llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data )
+{
+	CHECK_RET( IS_VALID_SERIALIZER( fmt ), FALSE );
+	CHECK_PTR_RET( init_fns[fmt], FALSE );
+	return (*(init_fns[fmt]))( out, ops, pretty, user_data );
+}
+
+int llsd_serializer_deinit( llsd_serializer_t const fmt, llsd_buffer_t * const out, void * user_data )
+{
+	CHECK_RET( IS_VALID_SERIALIZER( fmt ), FALSE );
+	CHECK_PTR_RET( deinit_fns[fmt], FALSE );
+	return (*(deinit_fns[fmt]))( out, user_data );
+}
+
 int llsd_serialize_to_file( llsd_t * const llsd, FILE * fout, llsd_serializer_t const fmt, int const pretty )
+{
+	llsd_buffer_t out;
+	CHECK_PTR_RET( llsd, FALSE );
+	CHECK_PTR_RET( fout, FALSE );
+	CHECK_RET( IS_VALID_SERIALIZER( fmt ), FALSE );
+
+	/* serialize into memory and hand it to stdio in a single write */
+	CHECK_RET( llsd_buffer_initialize( &out, NULL, 0 ), FALSE );
+	CHECK_GOTO( llsd_serialize_to_buffer( llsd, &out, fmt, pretty ), fail_serialize_to_file );
+	CHECK_GOTO( fwrite( out.data, sizeof(uint8_t), out.len, fout ) == out.len, fail_serialize_to_file );
+
+	llsd_buffer_deinitialize( &out );
+	return TRUE;
+
+fail_serialize_to_file:
+	llsd_buffer_deinitialize( &out );
+	return FALSE;
+}
+
+int llsd_serialize_to_buffer( llsd_t * const llsd, llsd_buffer_t * const out, llsd_serializer_t const fmt, int const pretty )
 {
 	void * user_data = NULL;
 	llsd_ops_t ops;
 	CHECK_PTR_RET( llsd, FALSE );
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_RET( IS_VALID_SERIALIZER( fmt ), FALSE );
 
 	/* initialize the serializer */
 	CHECK_PTR_RET( init_fns[fmt], FALSE );
-	CHECK_RET( (*(init_fns[fmt]))( fout, &ops, pretty, &user_data ), FALSE );
+	CHECK_RET( (*(init_fns[fmt]))( out, &ops, pretty, &user_data ), FALSE );
 
-	/* serialize out the llsd */
-	CHECK_RET( llsd_serialize( llsd, fout, &ops, user_data ), FALSE );
+	/* serialize out the llsd, the ops are only needed by custom sinks */
+	CHECK_PTR_RET( walk_fns[fmt], FALSE );
+	if ( !(*(walk_fns[fmt]))( llsd, user_data ) )
+	{
+		(*(deinit_fns[fmt]))( out, user_data );
+		return FALSE;
+	}
 
 	/* deinitializer the serializer */
-	CHECK_RET( (*(deinit_fns[fmt]))( fout, user_data ), FALSE );
+	CHECK_RET( (*(deinit_fns[fmt]))( out, user_data ), FALSE );
+
+	/* the formatting macros don't check every write, so catch dropped bytes here */
+	CHECK_RET( !out->failed, FALSE );
 
 	return TRUE;
 }
 
-static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const ops, void * user_data )
+size_t llsd_serialized_size( llsd_t * const llsd, llsd_serializer_t const fmt, int const pretty )
+{
+	size_t size = 0;
+	llsd_buffer_t out;
+	CHECK_PTR_RET( llsd, 0 );
+	CHECK_RET( IS_VALID_SERIALIZER( fmt ), 0 );
+
+	/* run the real serializer into a buffer that only counts bytes */
+	CHECK_RET( llsd_buffer_initialize_counter( &out ), 0 );
+	if ( llsd_serialize_to_buffer( llsd, &out, fmt, pretty ) )
+		size = out.len;
+	llsd_buffer_deinitialize( &out );
+
+	return size;
+}
+
+size_t llsd_format_zero_copy( llsd_t * const llsd, llsd_serializer_t const fmt, struct iovec ** const iov, int const pretty )
+{
+	size_t count = 0;
+	llsd_buffer_t out;
+	CHECK_PTR_RET( llsd, 0 );
+	CHECK_PTR_RET( iov, 0 );
+	CHECK_RET( IS_VALID_SERIALIZER( fmt ), 0 );
+
+	/* framing is copied, large payloads are only referenced */
+	CHECK_RET( llsd_buffer_initialize_zero_copy( &out ), 0 );
+	if ( llsd_serialize_to_buffer( llsd, &out, fmt, pretty ) )
+		count = llsd_buffer_gather( &out, iov );
+	llsd_buffer_deinitialize( &out );
+
+	return count;
+}
+
+int llsd_serialize_with_ops( llsd_t * const llsd, llsd_ops_t * const ops, void * user_data )
 {
 	int32_t i;
 	double d;
@@ -76,7 +157,6 @@ static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const
 	llsd_t * k, * v;
 	llsd_itr_t itr, end;
 	CHECK_PTR_RET( llsd, FALSE );
-	CHECK_PTR_RET( fout, FALSE );
 	CHECK_PTR_RET( ops, FALSE );
 	
 	switch( llsd_get_type( llsd ) )
@@ -118,14 +198,14 @@ static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const
 
 		case LLSD_STRING:
 			CHECK_PTR_RET( ops->string_fn, FALSE );
-			CHECK_GOTO( llsd_as_string( llsd, &s ), fail_llsd_serialize );
-			CHECK_GOTO( (*(ops->string_fn))( s, FALSE, user_data ), fail_llsd_serialize );
+			CHECK_GOTO( llsd_as_binary( llsd, &s, &len ), fail_llsd_serialize );
+			CHECK_GOTO( (*(ops->string_fn))( s, len, FALSE, user_data ), fail_llsd_serialize );
 			break;
 
 		case LLSD_URI:
 			CHECK_PTR_RET( ops->uri_fn, FALSE );
-			CHECK_GOTO( llsd_as_string( llsd, &s ), fail_llsd_serialize );
-			CHECK_GOTO( (*(ops->uri_fn))( s, FALSE, user_data ), fail_llsd_serialize );
+			CHECK_GOTO( llsd_as_binary( llsd, &s, &len ), fail_llsd_serialize );
+			CHECK_GOTO( (*(ops->uri_fn))( s, len, FALSE, user_data ), fail_llsd_serialize );
 			break;
 
 		case LLSD_BINARY:
@@ -155,7 +235,7 @@ static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const
 				CHECK_GOTO( (*(ops->array_value_begin_fn))( user_data ), fail_llsd_serialize );
 
 				/* recurse for the array value */
-				CHECK_GOTO( llsd_serialize( v, fout, ops, user_data ), fail_llsd_serialize );
+				CHECK_GOTO( llsd_serialize_with_ops( v, ops, user_data ), fail_llsd_serialize );
 
 				/* call array value end callback */
 				CHECK_GOTO( (*(ops->array_value_end_fn))( user_data ), fail_llsd_serialize );
@@ -191,7 +271,7 @@ static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const
 				CHECK_GOTO( (*(ops->map_key_begin_fn))( user_data ), fail_llsd_serialize );
 
 				/* recurse for the map key */
-				CHECK_GOTO( llsd_serialize( k, fout, ops, user_data ), fail_llsd_serialize );
+				CHECK_GOTO( llsd_serialize_with_ops( k, ops, user_data ), fail_llsd_serialize );
 
 				/* call key end callback */
 				CHECK_GOTO( (*(ops->map_key_end_fn))( user_data ), fail_llsd_serialize );
@@ -200,7 +280,7 @@ static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const
 				CHECK_GOTO( (*(ops->map_value_begin_fn))( user_data ), fail_llsd_serialize );
 
 				/* recurse for the map value */
-				CHECK_GOTO( llsd_serialize( v, fout, ops, user_data ), fail_llsd_serialize );
+				CHECK_GOTO( llsd_serialize_with_ops( v, ops, user_data ), fail_llsd_serialize );
 
 				/* call map value end callback */
 				CHECK_GOTO( (*(ops->map_value_end_fn))( user_data ), fail_llsd_serialize );
@@ -218,7 +298,6 @@ static int llsd_serialize( llsd_t * const llsd, FILE * fout, llsd_ops_t * const
 
 fail_llsd_serialize:
 	WARN( "Failed to serialize %s\n", llsd_get_type_string( llsd_get_type( llsd ) ) );
-	llsd_serialize( llsd, fout, ops, user_data );
 	return FALSE;
 }
 
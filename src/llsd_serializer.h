@@ -18,13 +18,43 @@
 #define LLSD_SERIALIZER_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "llsd.h"
+#include "llsd_buffer.h"
 
-typedef int (*serializer_init_fn)( FILE *, llsd_ops_t * const, int const, void ** const );
-typedef int (*serializer_deinit_fn)( FILE *, void * );
+typedef int (*serializer_init_fn)( llsd_buffer_t * const, llsd_ops_t * const, int const, void ** const );
+typedef int (*serializer_deinit_fn)( llsd_buffer_t * const, void * );
+typedef int (*serializer_walk_fn)( llsd_t * const, void * );
 
 int llsd_serialize_to_file( llsd_t * const llsd, FILE * fout, llsd_serializer_t const fmt, int const pretty );
 
+/* appends the serialized llsd to the buffer, on success out->data and out->len
+ * hold the bytes ready to be handed to write()/send() */
+int llsd_serialize_to_buffer( llsd_t * const llsd, llsd_buffer_t * const out, llsd_serializer_t const fmt, int const pretty );
+
+/* walks the llsd calling the ops for every value, for sinks that aren't one
+ * of the built in formats.  every callback must be set.  the built in formats
+ * don't go through here, they each have a walker that calls their emitters
+ * directly */
+int llsd_serialize_with_ops( llsd_t * const llsd, llsd_ops_t * const ops, void * user_data );
+
+/* set up and tear down a built in format's ops, so they can be driven by
+ * llsd_serialize_with_ops or wrapped by another sink.  deinit must be called
+ * for every successful init, it writes any trailer and frees the state */
+int llsd_serializer_init( llsd_serializer_t const fmt, llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data );
+int llsd_serializer_deinit( llsd_serializer_t const fmt, llsd_buffer_t * const out, void * user_data );
+
+/* returns the exact number of bytes the llsd serializes to, or 0 on failure.
+ * nothing is stored, so it can size an output buffer or a frame header */
+size_t llsd_serialized_size( llsd_t * const llsd, llsd_serializer_t const fmt, int const pretty );
+
+/* serializes into an iovec array ready for writev().  large string and binary
+ * payloads point into the llsd itself, so it must not change or go away
+ * until the data is written.  the count can exceed IOV_MAX, so large outputs
+ * need several writev() calls.  returns the number of iovecs, 0 on failure,
+ * and the caller must FREE (*iov) */
+size_t llsd_format_zero_copy( llsd_t * const llsd, llsd_serializer_t const fmt, struct iovec ** const iov, int const pretty );
+
 #endif/*LLSD_SERIALIZER_H*/
 
@@ -0,0 +1,75 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include "llsd.h"
+#include "llsd_stack.h"
+
+void llsd_stack_initialize( llsd_stack_t * const s )
+{
+	CHECK_PTR( s );
+	s->items = s->inline_items;
+	s->count = 0;
+	s->size = LLSD_STACK_INLINE;
+}
+
+void llsd_stack_deinitialize( llsd_stack_t * const s )
+{
+	CHECK_PTR( s );
+	if ( s->items != s->inline_items )
+		FREE( s->items );
+	llsd_stack_initialize( s );
+}
+
+/* only called from llsd_stack_push when the stack is full */
+int llsd_stack_grow( llsd_stack_t * const s )
+{
+	uint_t size = 0;
+	uintptr_t * tmp = NULL;
+
+	CHECK_PTR_RET( s, FALSE );
+
+	/* documents nested deeper than this are refused, the extra entry is
+	 * for the top level state under the containers */
+	if ( s->size > LLSD_MAX_DEPTH )
+	{
+		WARN( "nesting deeper than %d\n", LLSD_MAX_DEPTH );
+		return FALSE;
+	}
+
+	size = s->size * 2;
+	if ( size > (LLSD_MAX_DEPTH + 1) )
+		size = LLSD_MAX_DEPTH + 1;
+
+	if ( s->items == s->inline_items )
+	{
+		tmp = (uintptr_t*)CALLOC( size, sizeof(uintptr_t) );
+		CHECK_PTR_RET( tmp, FALSE );
+		MEMCPY( tmp, s->inline_items, s->count * sizeof(uintptr_t) );
+	}
+	else
+	{
+		tmp = (uintptr_t*)REALLOC( s->items, size * sizeof(uintptr_t) );
+		CHECK_PTR_RET( tmp, FALSE );
+	}
+
+	s->items = tmp;
+	s->size = size;
+	return TRUE;
+}
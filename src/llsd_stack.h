@@ -0,0 +1,78 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#ifndef LLSD_STACK_H
+#define LLSD_STACK_H
+
+#include <stdint.h>
+
+#include "llsd.h"
+
+/* the state, count and container stacks of the parsers.  the first
+ * LLSD_STACK_INLINE entries are stored in the stack itself and deeper
+ * documents spill over to the heap.  documents nested deeper than
+ * LLSD_MAX_DEPTH containers fail to parse, so hostile nesting can't run away
+ * with memory.  the stack
+ * points into itself, initialize it where it will stay and don't copy it. */
+#define LLSD_STACK_INLINE (32)
+#define LLSD_MAX_DEPTH (1024)
+
+typedef struct llsd_stack_s
+{
+	uintptr_t * items;		/* inline_items until it spills over */
+	uint_t count;
+	uint_t size;
+	uintptr_t inline_items[LLSD_STACK_INLINE];
+} llsd_stack_t;
+
+void llsd_stack_initialize( llsd_stack_t * const s );
+void llsd_stack_deinitialize( llsd_stack_t * const s );
+int llsd_stack_grow( llsd_stack_t * const s );
+
+static inline int llsd_stack_push( llsd_stack_t * const s, uintptr_t const v )
+{
+	if ( (s->count == s->size) && !llsd_stack_grow( s ) )
+		return FALSE;
+	s->items[s->count++] = v;
+	return TRUE;
+}
+
+/* the top of an empty stack is 0 */
+static inline uintptr_t llsd_stack_top( llsd_stack_t const * const s )
+{
+	return ( (s->count > 0) ? s->items[s->count - 1] : 0 );
+}
+
+static inline void llsd_stack_pop( llsd_stack_t * const s )
+{
+	if ( s->count > 0 )
+		s->count--;
+}
+
+/* replaces the top, the state machines do this on nearly every token */
+static inline void llsd_stack_set_top( llsd_stack_t * const s, uintptr_t const v )
+{
+	if ( s->count > 0 )
+		s->items[s->count - 1] = v;
+}
+
+static inline void llsd_stack_clear( llsd_stack_t * const s )
+{
+	s->count = 0;
+}
+
+#endif/*LLSD_STACK_H*/
@@ -0,0 +1,174 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/*
+ * tree walker template.  a serializer defines the macros below and then
+ * includes this file to get a static walker that calls its emitters directly
+ * instead of going through an llsd_ops_t.  there is no include guard, the
+ * macros are undefined at the end so a file can build more than one walker.
+ * llsd_serialize_to_buffer uses the walker, the format's llsd_ops_t stays
+ * for llsd_serialize_with_ops.
+ *
+ *   WALK_FN                            name of the generated function
+ *   WALK_STATE_T                       serializer state type
+ *   EMIT_UNDEF( s )
+ *   EMIT_BOOLEAN( s, v )               EMIT_INTEGER( s, v )
+ *   EMIT_REAL( s, v )                  EMIT_DATE( s, v )
+ *   EMIT_UUID( s, v )
+ *   EMIT_STRING( s, p, len )           also used for map keys
+ *   EMIT_URI( s, p, len )              EMIT_BINARY( s, p, len )
+ *   EMIT_ARRAY_BEGIN( s, n )           EMIT_ARRAY_END( s, n )
+ *   EMIT_ARRAY_VALUE_BEGIN( s )        EMIT_ARRAY_VALUE_END( s )
+ *   EMIT_MAP_BEGIN( s, n )             EMIT_MAP_END( s, n )
+ *   EMIT_MAP_KEY_BEGIN( s )            EMIT_MAP_KEY_END( s )
+ *   EMIT_MAP_VALUE_BEGIN( s )          EMIT_MAP_VALUE_END( s )
+ *
+ * each EMIT_ is an expression that is FALSE on failure.  hooks a format has
+ * no use for are defined as TRUE so they compile away.
+ */
+
+#if !defined(WALK_FN) || !defined(WALK_STATE_T)
+#error "define WALK_FN and WALK_STATE_T before including llsd_walk.h"
+#endif
+
+static int WALK_FN( llsd_t * const llsd, WALK_STATE_T * const state )
+{
+	int32_t i;
+	double d;
+	uint8_t * s;
+	uint8_t	uuid[UUID_LEN];
+	uint32_t len;
+	llsd_t * k, * v;
+	llsd_itr_t itr, end;
+	CHECK_PTR_RET( llsd, FALSE );
+	CHECK_PTR_RET( state, FALSE );
+
+	switch( llsd_get_type( llsd ) )
+	{
+		case LLSD_UNDEF:
+			CHECK_GOTO( EMIT_UNDEF( state ), fail_walk );
+			break;
+
+		case LLSD_BOOLEAN:
+			CHECK_GOTO( llsd_as_integer( llsd, &i ), fail_walk );
+			CHECK_GOTO( EMIT_BOOLEAN( state, i ), fail_walk );
+			break;
+
+		case LLSD_INTEGER:
+			CHECK_GOTO( llsd_as_integer( llsd, &i ), fail_walk );
+			CHECK_GOTO( EMIT_INTEGER( state, i ), fail_walk );
+			break;
+
+		case LLSD_REAL:
+			CHECK_GOTO( llsd_as_double( llsd, &d ), fail_walk );
+			CHECK_GOTO( EMIT_REAL( state, d ), fail_walk );
+			break;
+
+		case LLSD_DATE:
+			CHECK_GOTO( llsd_as_double( llsd, &d ), fail_walk );
+			CHECK_GOTO( EMIT_DATE( state, d ), fail_walk );
+			break;
+
+		case LLSD_UUID:
+			CHECK_GOTO( llsd_as_uuid( llsd, uuid ), fail_walk );
+			CHECK_GOTO( EMIT_UUID( state, uuid ), fail_walk );
+			break;
+
+		case LLSD_STRING:
+			CHECK_GOTO( llsd_as_binary( llsd, &s, &len ), fail_walk );
+			CHECK_GOTO( EMIT_STRING( state, s, len ), fail_walk );
+			break;
+
+		case LLSD_URI:
+			CHECK_GOTO( llsd_as_binary( llsd, &s, &len ), fail_walk );
+			CHECK_GOTO( EMIT_URI( state, s, len ), fail_walk );
+			break;
+
+		case LLSD_BINARY:
+			CHECK_GOTO( llsd_as_binary( llsd, &s, &len ), fail_walk );
+			CHECK_GOTO( EMIT_BINARY( state, s, len ), fail_walk );
+			break;
+
+		case LLSD_ARRAY:
+			CHECK_GOTO( EMIT_ARRAY_BEGIN( state, llsd_get_count( llsd ) ), fail_walk );
+
+			end = llsd_itr_end( llsd );
+			for ( itr = llsd_itr_begin( llsd ); !LLSD_ITR_EQ( itr, end ); itr = llsd_itr_next( llsd, itr ) )
+			{
+				CHECK_RET( llsd_get( llsd, itr, &v, &k ), FALSE );
+				CHECK_PTR_RET( v, FALSE );
+
+				CHECK_GOTO( EMIT_ARRAY_VALUE_BEGIN( state ), fail_walk );
+				CHECK_GOTO( WALK_FN( v, state ), fail_walk );
+				CHECK_GOTO( EMIT_ARRAY_VALUE_END( state ), fail_walk );
+			}
+
+			CHECK_GOTO( EMIT_ARRAY_END( state, llsd_get_count( llsd ) ), fail_walk );
+			break;
+
+		case LLSD_MAP:
+			CHECK_GOTO( EMIT_MAP_BEGIN( state, llsd_get_count( llsd ) ), fail_walk );
+
+			end = llsd_itr_end( llsd );
+			for ( itr = llsd_itr_begin( llsd ); !LLSD_ITR_EQ( itr, end ); itr = llsd_itr_next( llsd, itr ) )
+			{
+				CHECK_RET( llsd_get( llsd, itr, &v, &k ), FALSE );
+				CHECK_PTR_RET( k, FALSE );
+				CHECK_PTR_RET( v, FALSE );
+
+				/* keys are always strings, so skip the type switch */
+				CHECK_GOTO( llsd_as_binary( k, &s, &len ), fail_walk );
+				CHECK_GOTO( EMIT_MAP_KEY_BEGIN( state ), fail_walk );
+				CHECK_GOTO( EMIT_STRING( state, s, len ), fail_walk );
+				CHECK_GOTO( EMIT_MAP_KEY_END( state ), fail_walk );
+
+				CHECK_GOTO( EMIT_MAP_VALUE_BEGIN( state ), fail_walk );
+				CHECK_GOTO( WALK_FN( v, state ), fail_walk );
+				CHECK_GOTO( EMIT_MAP_VALUE_END( state ), fail_walk );
+			}
+
+			CHECK_GOTO( EMIT_MAP_END( state, llsd_get_count( llsd ) ), fail_walk );
+			break;
+	}
+
+	return TRUE;
+
+fail_walk:
+	WARN( "Failed to serialize %s\n", llsd_get_type_string( llsd_get_type( llsd ) ) );
+	return FALSE;
+}
+
+#undef WALK_FN
+#undef WALK_STATE_T
+#undef EMIT_UNDEF
+#undef EMIT_BOOLEAN
+#undef EMIT_INTEGER
+#undef EMIT_REAL
+#undef EMIT_DATE
+#undef EMIT_UUID
+#undef EMIT_STRING
+#undef EMIT_URI
+#undef EMIT_BINARY
+#undef EMIT_ARRAY_BEGIN
+#undef EMIT_ARRAY_VALUE_BEGIN
+#undef EMIT_ARRAY_VALUE_END
+#undef EMIT_ARRAY_END
+#undef EMIT_MAP_BEGIN
+#undef EMIT_MAP_KEY_BEGIN
+#undef EMIT_MAP_KEY_END
+#undef EMIT_MAP_VALUE_BEGIN
+#undef EMIT_MAP_VALUE_END
+#undef EMIT_MAP_END
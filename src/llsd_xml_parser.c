@@ -14,16 +14,19 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
  */
 
-#include <time.h>
 #include <expat.h>
 
 #include <cutil/debug.h>
 #include <cutil/macros.h>
-#include <cutil/list.h>
 #include <cutil/buffer.h>
 
 #include "llsd.h"
 #include "llsd_xml_parser.h"
+#include "llsd_buffer.h"
+#include "llsd_date.h"
+#include "llsd_number.h"
+#include "llsd_scan.h"
+#include "llsd_stack.h"
 
 #define XML_SIG_LEN (5)
 static uint8_t const * const xml_header = "<?xml";
@@ -45,19 +48,128 @@ int llsd_xml_check_sig_file( FILE * fin )
 	return ( memcmp( sig, xml_header, XML_SIG_LEN ) == 0 );
 }
 
+/* an open element in the native tokenizer */
+typedef struct xml_name_s
+{
+	uint8_t const * p;
+	size_t len;
+	llsd_type_t t;
+} xml_name_t;
+
 typedef struct xp_state_s
 {
 	llsd_bin_enc_t enc;
-	list_t * state_stack;
+	llsd_stack_t state_stack;
 	buffer_t * buf;
-	llsd_ops_t * ops;
+	llsd_ops_t const * ops;
 	void * user_data;
-	XML_Parser p;
+	XML_Parser p;				/* only created once a document needs expat */
+
+	/* a value skipped for a key is still parsed, but against the skip ops */
+	int skip;					/* the string_fn for a key asked to skip its value */
+	llsd_ops_t const * kept_ops;	/* the caller's ops while it is skipped */
+	uint_t skip_level;			/* the depth of the map it is in */
+
+	/* native tokenizer */
+	uint8_t const * doc;		/* start of the document, NULL when expat is running */
+	uint8_t const * pos;		/* the markup being handled */
+	uint8_t const * text;		/* element text left in the document */
+	size_t text_len;
+	int in_scratch;				/* TRUE once the text is in scratch instead */
+	llsd_buffer_t scratch;
+	xml_name_t * names;
+	size_t names_size;
+	size_t depth;
 } xp_state_t;
 
-#define PUSH(x) (list_push_head( parser_state->state_stack, (void*)x ))
-#define TOP		((uint_t)list_get_head( parser_state->state_stack ))
-#define POP		(list_pop_head( parser_state->state_stack))
+#define PUSH(x) (llsd_stack_push( &(parser_state->state_stack), (uintptr_t)(x) ))
+#define TOP		((uint_t)llsd_stack_top( &(parser_state->state_stack) ))
+#define POP		(llsd_stack_pop( &(parser_state->state_stack) ))
+#define SET(x)	(llsd_stack_set_top( &(parser_state->state_stack), (uintptr_t)(x) ))
+
+static int_t skip_nop( void * const user_data )
+{
+	return TRUE;
+}
+
+static int_t skip_boolean( int const value, void * const user_data )
+{
+	return TRUE;
+}
+
+static int_t skip_integer( int32_t const value, void * const user_data )
+{
+	return TRUE;
+}
+
+static int_t skip_real( double const value, void * const user_data )
+{
+	return TRUE;
+}
+
+static int_t skip_uuid( uint8_t const value[UUID_LEN], void * const user_data )
+{
+	return TRUE;
+}
+
+static int_t skip_text( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
+{
+	/* binary values are decoded for the ops to own */
+	if ( own_it == TRUE )
+		FREE( str );
+	return TRUE;
+}
+
+static int_t skip_size( uint_t const size, void * const user_data )
+{
+	return TRUE;
+}
+
+/* a skipped value is checked like any other, it just isn't reported */
+static llsd_ops_t const xml_skip_ops =
+{
+	&skip_nop,
+	&skip_boolean,
+	&skip_integer,
+	&skip_real,
+	&skip_uuid,
+	&skip_text,
+	&skip_real,
+	&skip_text,
+	&skip_text,
+	&skip_size,
+	&skip_nop,
+	&skip_nop,
+	&skip_size,
+	&skip_size,
+	&skip_nop,
+	&skip_nop,
+	&skip_nop,
+	&skip_nop,
+	&skip_size
+};
+
+/* called once a key's value has begun, a skipped one goes to the skip ops
+ * until it ends in the same map */
+static void skip_begin( xp_state_t * const parser_state )
+{
+	if ( !parser_state->skip )
+		return;
+
+	parser_state->skip = FALSE;
+	parser_state->kept_ops = parser_state->ops;
+	parser_state->ops = &xml_skip_ops;
+	parser_state->skip_level = parser_state->state_stack.count;
+}
+
+static void skip_end( xp_state_t * const parser_state )
+{
+	if ( (parser_state->kept_ops == NULL) || (parser_state->state_stack.count != parser_state->skip_level) )
+		return;
+
+	parser_state->ops = parser_state->kept_ops;
+	parser_state->kept_ops = NULL;
+}
 
 #define BEGIN_VALUE_STATES ( TOP_LEVEL | ARRAY_BEGIN | ARRAY_VALUE_END | MAP_KEY_END )
 #define BEGIN_STRING_STATES ( BEGIN_VALUE_STATES | MAP_VALUE_END | MAP_BEGIN )
@@ -70,7 +182,6 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, xp_state_t * par
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -94,13 +205,12 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, xp_state_t * par
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
+					skip_begin( parser_state );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -113,19 +223,17 @@ static int begin_value( uint_t valid_states, llsd_type_t type_, xp_state_t * par
 				case ARRAY_BEGIN:
 				case ARRAY_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->array_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_BEGIN );
+					SET( ARRAY_VALUE_BEGIN );
 					break;
 				case MAP_BEGIN:
 				case MAP_VALUE_END:
 					CHECK_RET( (*(parser_state->ops->map_key_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_KEY_BEGIN );
+					SET( MAP_KEY_BEGIN );
 					break;
 				case MAP_KEY_END:
 					CHECK_RET( (*(parser_state->ops->map_value_begin_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_BEGIN );
+					SET( MAP_VALUE_BEGIN );
+					skip_begin( parser_state );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -147,7 +255,6 @@ static int value( uint_t valid_states, llsd_type_t type_, xp_state_t * parser_st
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -169,12 +276,10 @@ static int value( uint_t valid_states, llsd_type_t type_, xp_state_t * parser_st
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -185,16 +290,13 @@ static int value( uint_t valid_states, llsd_type_t type_, xp_state_t * parser_st
 			switch( state )
 			{
 				case ARRAY_VALUE_BEGIN:
-					POP;
-					PUSH( ARRAY_VALUE );
+					SET( ARRAY_VALUE );
 					break;
 				case MAP_VALUE_BEGIN:
-					POP;
-					PUSH( MAP_VALUE );
+					SET( MAP_VALUE );
 					break;
 				case MAP_KEY_BEGIN:
-					POP;
-					PUSH( MAP_KEY );
+					SET( MAP_KEY );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -216,7 +318,6 @@ static int end_value( uint_t valid_states, llsd_type_t type_, xp_state_t * parse
 	
 	/* make sure we have a valid state object pointer */
 	CHECK_PTR_RET( parser_state, FALSE );
-	CHECK_PTR_RET( parser_state->state_stack, FALSE );
 
 	/* make sure we're in a valid state */
 	state = TOP;
@@ -239,13 +340,12 @@ static int end_value( uint_t valid_states, llsd_type_t type_, xp_state_t * parse
 			{
 				case ARRAY_VALUE:
 					CHECK_RET( (*(parser_state->ops->array_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_END );
+					SET( ARRAY_VALUE_END );
 					break;
 				case MAP_VALUE:
+					skip_end( parser_state );
 					CHECK_RET( (*(parser_state->ops->map_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_END );
+					SET( MAP_VALUE_END );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -257,18 +357,16 @@ static int end_value( uint_t valid_states, llsd_type_t type_, xp_state_t * parse
 			{
 				case ARRAY_VALUE:
 					CHECK_RET( (*(parser_state->ops->array_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( ARRAY_VALUE_END );
+					SET( ARRAY_VALUE_END );
 					break;
 				case MAP_VALUE:
+					skip_end( parser_state );
 					CHECK_RET( (*(parser_state->ops->map_value_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_VALUE_END );
+					SET( MAP_VALUE_END );
 					break;
 				case MAP_KEY:
 					CHECK_RET( (*(parser_state->ops->map_key_end_fn))( parser_state->user_data ), FALSE );
-					POP;
-					PUSH( MAP_KEY_END );
+					SET( MAP_KEY_END );
 					break;
 				case TOP_LEVEL:
 					break;
@@ -343,11 +441,11 @@ static llsd_type_t llsd_type_from_tag( char const * tag )
 	return LLSD_TYPE_INVALID;
 }
 
-static int boolean_from_buf( buffer_t * const buf )
+static int boolean_from_text( uint8_t const * const text, size_t const len )
 {
-	CHECK_PTR_RET( buf, FALSE );
-	CHECK_RET( buf->iov_len > 0, FALSE );
-	switch ( ((uint8_t*)buf->iov_base)[0] )
+	CHECK_PTR_RET( text, FALSE );
+	CHECK_RET( len > 0, FALSE );
+	switch ( text[0] )
 	{
 		case '1':
 		case 't':
@@ -357,38 +455,49 @@ static int boolean_from_buf( buffer_t * const buf )
 	return FALSE;
 }
 
-static int integer_from_buf( buffer_t * const buf, int * ival )
+/* the text between the tags, without the white space around it */
+static void trim_text( uint8_t const * const text, size_t const len, uint8_t const ** start, uint8_t const ** end )
 {
-	CHECK_PTR_RET( buf, FALSE );
+	(*start) = text;
+	(*end) = text + len;
+	while ( ((*start) < (*end)) && isspace( **start ) )
+		(*start)++;
+	while ( ((*end) > (*start)) && ((*((*end) - 1) == '\0') || isspace( *((*end) - 1) )) )
+		(*end)--;
+}
+
+static int integer_from_text( uint8_t const * const text, size_t const len, int * ival )
+{
+	int32_t v = 0;
+	uint8_t const * p = NULL;
+	uint8_t const * end = NULL;
+	CHECK_PTR_RET( text, FALSE );
 	CHECK_PTR_RET( ival, FALSE );
 	(*ival) = 0;
 
-	if ( buf->iov_len > 0 )
+	trim_text( text, len, &p, &end );
+	if ( p < end )
 	{
-		if ( ((uint8_t*)buf->iov_base)[buf->iov_len-1] != '\0' )
-		{
-			/* zero terminate the string */
-			buffer_append( buf, "\0", 1 );
-		}
-		CHECK_RET( sscanf( buf->iov_base, "%d", ival ) == 1, FALSE );
+		CHECK_RET( llsd_number_parse_integer( &p, end, &v ), FALSE );
+		CHECK_RET( p == end, FALSE );
+		(*ival) = v;
 	}
 	return TRUE;
 }
 
-static int real_from_buf( buffer_t * const buf, double * rval )
+static int real_from_text( uint8_t const * const text, size_t const len, double * rval )
 {
-	CHECK_PTR_RET( buf, FALSE );
+	uint8_t const * p = NULL;
+	uint8_t const * end = NULL;
+	CHECK_PTR_RET( text, FALSE );
 	CHECK_PTR_RET( rval, FALSE );
 	(*rval) = 0.0;
 
-	if ( buf->iov_len > 0 )
+	trim_text( text, len, &p, &end );
+	if ( p < end )
 	{
-		if ( ((uint8_t*)buf->iov_base)[buf->iov_len-1] != '\0' )
-		{
-			/* zero terminate the string */
-			buffer_append( buf, "\0", 1 );
-		}
-		CHECK_RET( sscanf( buf->iov_base, "%lf", rval ) == 1, FALSE );
+		CHECK_RET( llsd_number_parse_real( &p, end, rval ), FALSE );
+		CHECK_RET( p == end, FALSE );
 	}
 	return TRUE;
 }
@@ -414,21 +523,21 @@ static uint8_t hex_to_byte( uint8_t hi, uint8_t lo )
 	}
 }
 
-static int uuid_from_buf( buffer_t * const buf, uint8_t uuid[UUID_LEN] )
+static int uuid_from_text( uint8_t const * const text, size_t const len, uint8_t uuid[UUID_LEN] )
 {
 	int i;
-	uint8_t * p;
+	uint8_t const * p;
 
-	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( text, FALSE );
 	CHECK_PTR_RET( uuid, FALSE );
 
 	/* zero out the uuid */
 	MEMSET(uuid, 0, UUID_LEN);
 
-	if ( buf->iov_len < UUID_STR_LEN )
+	if ( len < UUID_STR_LEN )
 		return TRUE;
 
-	p = (uint8_t*)buf->iov_base;
+	p = text;
 
 	/* check for 8-4-4-4-12 */
 	for ( i = 0; i < UUID_STR_LEN; i++ )
@@ -479,9 +588,9 @@ static int uuid_from_buf( buffer_t * const buf, uint8_t uuid[UUID_LEN] )
 	return TRUE;
 }
 
-static int binary_from_buf( buffer_t * const buf, llsd_bin_enc_t enc, uint8_t ** data, uint32_t * len)
+static int binary_from_text( uint8_t const * const text, size_t const text_len, llsd_bin_enc_t enc, uint8_t ** data, uint32_t * len )
 {
-	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( text, FALSE );
 	CHECK_PTR_RET( data, FALSE );
 	CHECK_PTR_RET( len, FALSE );
 
@@ -489,17 +598,17 @@ static int binary_from_buf( buffer_t * const buf, llsd_bin_enc_t enc, uint8_t **
 	(*data) = NULL;
 
 	/* empty binary tag */
-	if ( buf->iov_len == 0 )
+	if ( text_len == 0 )
 		return TRUE;
 
 	/* decode the binary */
 	switch( enc )
 	{
 		case LLSD_BASE16:
-			(*len) = base16_decoded_len( buf->iov_base, buf->iov_len );
+			(*len) = base16_decoded_len( text, text_len );
 			(*data) = CALLOC( (*len), sizeof(uint8_t) );
 			CHECK_PTR_RET( (*data), FALSE );
-			if ( !base16_decode( buf->iov_base, buf->iov_len, (*data), len ) )
+			if ( !base16_decode( text, text_len, (*data), len ) )
 			{
 				FREE( (*data) );
 				(*data) = NULL;
@@ -507,10 +616,10 @@ static int binary_from_buf( buffer_t * const buf, llsd_bin_enc_t enc, uint8_t **
 			}
 			break;
 		case LLSD_BASE64:
-			(*len) = base64_decoded_len( buf->iov_base, buf->iov_len );
+			(*len) = base64_decoded_len( text, text_len );
 			(*data) = CALLOC( (*len), sizeof(uint8_t) );
 			CHECK_PTR_RET( (*data), FALSE );
-			if ( !base64_decode( buf->iov_base, buf->iov_len, (*data), len ) )
+			if ( !base64_decode( text, text_len, (*data), len ) )
 			{
 				FREE( (*data) );
 				(*data) = NULL;
@@ -518,10 +627,10 @@ static int binary_from_buf( buffer_t * const buf, llsd_bin_enc_t enc, uint8_t **
 			}
 			break;
 		case LLSD_BASE85:
-			(*len) = base85_decoded_len( buf->iov_base, buf->iov_len );
+			(*len) = base85_decoded_len( text, text_len );
 			(*data) = CALLOC( (*len), sizeof(uint8_t) );
 			CHECK_PTR_RET( (*data), FALSE );
-			if ( !base85_decode( buf->iov_base, buf->iov_len, (*data), len ) )
+			if ( !base85_decode( text, text_len, (*data), len ) )
 			{
 				FREE( (*data) );
 				(*data) = NULL;
@@ -532,47 +641,20 @@ static int binary_from_buf( buffer_t * const buf, llsd_bin_enc_t enc, uint8_t **
 	return TRUE;
 }
 
-static int date_from_buf( buffer_t * const buf, double * rval )
+static int date_from_text( uint8_t const * const text, size_t const len, double * rval )
 {
-	int useconds;
-	struct tm parts;
-	double seconds;
-	uint32_t tmp = 0;
-
-	CHECK_PTR_RET( buf, FALSE );
+	uint8_t const * p = NULL;
+	uint8_t const * end = NULL;
+	CHECK_PTR_RET( text, FALSE );
 	CHECK_PTR_RET( rval, FALSE );
-	
 	(*rval) = 0.0;
 
 	/* empty date tag */
-	if ( buf->iov_len == 0 )
-		return TRUE;
-
-	MEMSET( &parts, 0, sizeof(struct tm) );
-
-	if ( ((uint8_t*)buf->iov_base)[buf->iov_len-1] != '\0' )
+	trim_text( text, len, &p, &end );
+	if ( p < end )
 	{
-		/* zero terminate the string */
-		buffer_append( buf, "\0", 1 );
+		CHECK_RET( llsd_date_parse( p, (size_t)(end - p), rval ), FALSE );
 	}
-	CHECK_RET( sscanf( buf->iov_base, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", &parts.tm_year, &parts.tm_mon, &parts.tm_mday, &parts.tm_hour, &parts.tm_min, &parts.tm_sec, &useconds ) == 7, FALSE );
-
-	/* adjust a few things */
-	parts.tm_year -= 1900;
-	parts.tm_mon -= 1;
-
-	/* convert to seconds */
-	tmp = mktime(&parts);
-	
-	/* correct for localtime variation */
-	tmp -= timezone;
-
-	/* convert to double */
-	(*rval) = (double)tmp;
-
-	/* add in the miliseconds */
-	(*rval) += ((double)useconds * 1000.0);
-
 	return TRUE;
 }
 
@@ -701,16 +783,36 @@ static int string_from_buf( buffer_t * const buf, uint8_t ** const str, uint32_t
 }
 #endif
 
-static void XMLCALL llsd_xml_start_tag( void * data, char const * el, char const ** attr )
+/* the position of the token being handled, for error messages */
+static void xml_position( xp_state_t * const parser_state, int * const line, int * const col )
 {
-	uint32_t size = 0;
-	llsd_type_t t = LLSD_UNDEF;
-	xp_state_t * parser_state = (xp_state_t*)data;
+	uint8_t const * p;
+	uint8_t const * bol;
 
-	CHECK_PTR( parser_state );
+	if ( parser_state->doc == NULL )
+	{
+		(*line) = (int)XML_GetCurrentLineNumber( parser_state->p );
+		(*col) = (int)XML_GetCurrentColumnNumber( parser_state->p );
+		return;
+	}
 
-	/* get the type */
-	t = llsd_type_from_tag( el );
+	/* the tokenizer only counts lines when something goes wrong */
+	(*line) = 1;
+	bol = parser_state->doc;
+	for ( p = parser_state->doc; p < parser_state->pos; p++ )
+	{
+		if ( *p == '\n' )
+		{
+			(*line)++;
+			bol = p + 1;
+		}
+	}
+	(*col) = (int)(parser_state->pos - bol);
+}
+
+static int xml_start_element( xp_state_t * const parser_state, llsd_type_t const t, uint32_t const size, llsd_bin_enc_t const enc )
+{
+	int line, col;
 
 	switch( t )
 	{
@@ -724,65 +826,46 @@ static void XMLCALL llsd_xml_start_tag( void * data, char const * el, char const
 		case LLSD_UUID:
 		case LLSD_DATE:
 		case LLSD_URI:
-			CHECK( begin_value( BEGIN_VALUE_STATES, t, parser_state ) );
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, t, parser_state ), xml_start_tag_fail );
 			break;
 		case LLSD_KEY:
 		case LLSD_STRING:
-			CHECK( begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ) );
+			CHECK_GOTO( begin_value( BEGIN_STRING_STATES, LLSD_STRING, parser_state ), xml_start_tag_fail );
 			break;
 		case LLSD_BINARY:
-			/* try to get the encoding attribute if there is one */
-			parser_state->enc = LLSD_BASE64;
-			if ( (attr[0] != NULL) && (strncmp( attr[0], "encoding", 9 ) == 0) )
-			{
-				parser_state->enc = llsd_bin_enc_from_attr( attr[1] );
-			}
-			CHECK( begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ) );
+			parser_state->enc = enc;
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_BINARY, parser_state ), xml_start_tag_fail );
 			break;
 		case LLSD_ARRAY:
-			/* try to get the size attribute if there is one */
-			if ( (attr[0] != NULL) && (strncmp( attr[0], "size", 5 ) == 0) )
-			{
-				size = atoi( attr[1] );
-			}
-			CHECK( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ) );
-			CHECK( (*(parser_state->ops->array_begin_fn))( size, parser_state->user_data ) );
-			PUSH( ARRAY_BEGIN );
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_ARRAY, parser_state ), xml_start_tag_fail );
+			CHECK_GOTO( (*(parser_state->ops->array_begin_fn))( size, parser_state->user_data ), xml_start_tag_fail );
+			CHECK_GOTO( PUSH( ARRAY_BEGIN ), xml_start_tag_fail );
 			break;
 		case LLSD_MAP:
-			/* try to get the size attribute if there is one */
-			if ( (attr[0] != NULL) && (strncmp( attr[0], "size", 5 ) == 0) )
-			{
-				size = atoi( attr[1] );
-			}
-			CHECK( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ) );
-			CHECK( (*(parser_state->ops->map_begin_fn))( size, parser_state->user_data ) );
-			PUSH( MAP_BEGIN );
+			CHECK_GOTO( begin_value( BEGIN_VALUE_STATES, LLSD_MAP, parser_state ), xml_start_tag_fail );
+			CHECK_GOTO( (*(parser_state->ops->map_begin_fn))( size, parser_state->user_data ), xml_start_tag_fail );
+			CHECK_GOTO( PUSH( MAP_BEGIN ), xml_start_tag_fail );
 			break;
 	}
+	return TRUE;
 
-	/* reset the buffer */
-	buffer_deinitialize( parser_state->buf );
+xml_start_tag_fail:
+	xml_position( parser_state, &line, &col );
+	WARN( "Failed %s step while processing %s tag. (line: %d, col: %d)\n", check_err_str_, TYPE_TO_STRING( t ), line, col );
+	return FALSE;
 }
 
-
-static void XMLCALL llsd_xml_end_tag( void * data, char const * el )
+/* text is everything between the tags, it is never NULL */
+static int xml_end_element( xp_state_t * const parser_state, llsd_type_t const t, uint8_t const * const text, size_t const text_len )
 {
+	int line, col;
 	int bool_val;
 	int int_val;
 	double real_val;
 	uint8_t uuid_val[UUID_LEN];
-	uint8_t * encoded = NULL;
-	uint32_t enc_len = 0;
 	uint8_t * buffer = NULL;
 	uint32_t len = 0;
-	llsd_type_t t = LLSD_UNDEF;
-	xp_state_t * parser_state = (xp_state_t*)data;
-
-	CHECK_PTR( parser_state );
-
-	/* get the type */
-	t = llsd_type_from_tag( el );
+	int_t ret;
 
 	switch( t )
 	{
@@ -795,57 +878,54 @@ static void XMLCALL llsd_xml_end_tag( void * data, char const * el )
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_UNDEF, parser_state ), xml_end_tag_fail );
 			break;
 		case LLSD_BOOLEAN:
-			bool_val = boolean_from_buf( parser_state->buf );
+			bool_val = boolean_from_text( text, text_len );
 			CHECK_GOTO( (*(parser_state->ops->boolean_fn))( bool_val, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_BOOLEAN, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_BOOLEAN, parser_state ), xml_end_tag_fail );
 			break;
 		case LLSD_INTEGER:
-			CHECK_GOTO( integer_from_buf( parser_state->buf, &int_val ), xml_end_tag_fail );
+			CHECK_GOTO( integer_from_text( text, text_len, &int_val ), xml_end_tag_fail );
 			CHECK_GOTO( (*(parser_state->ops->integer_fn))( int_val, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_INTEGER, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_INTEGER, parser_state ), xml_end_tag_fail );
 			break;
 		case LLSD_REAL:
-			CHECK_GOTO( real_from_buf( parser_state->buf, &real_val ), xml_end_tag_fail );
+			CHECK_GOTO( real_from_text( text, text_len, &real_val ), xml_end_tag_fail );
 			CHECK_GOTO( (*(parser_state->ops->real_fn))( real_val, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_REAL, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_REAL, parser_state ), xml_end_tag_fail );
 			break;
 		case LLSD_UUID:
-			CHECK_GOTO( uuid_from_buf( parser_state->buf, uuid_val ), xml_end_tag_fail );
+			CHECK_GOTO( uuid_from_text( text, text_len, uuid_val ), xml_end_tag_fail );
 			CHECK_GOTO( (*(parser_state->ops->uuid_fn))( uuid_val, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_UUID, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_UUID, parser_state ), xml_end_tag_fail );
 			break;
 		case LLSD_DATE:
-			CHECK_GOTO( date_from_buf( parser_state->buf, &real_val ), xml_end_tag_fail );
+			CHECK_GOTO( date_from_text( text, text_len, &real_val ), xml_end_tag_fail );
 			CHECK_GOTO( (*(parser_state->ops->date_fn))( real_val, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_DATE, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_DATE, parser_state ), xml_end_tag_fail );
 			break;
 		case LLSD_KEY:
 		case LLSD_STRING:
-			/* zero terminate the string */
-			buffer_append( parser_state->buf, "\0", 1 );
-			CHECK_GOTO( (*(parser_state->ops->string_fn))( (uint8_t*)parser_state->buf->iov_base, FALSE, parser_state->user_data ), xml_end_tag_fail );
+			/* the string is copied out of the text */
+			ret = (*(parser_state->ops->string_fn))( text, (uint32_t)text_len, FALSE, parser_state->user_data );
+			CHECK_GOTO( ret, xml_end_tag_fail );
 			CHECK_GOTO( value( STRING_STATES, LLSD_STRING, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_STRING_STATES, LLSD_STRING, parser_state ), xml_end_tag_fail );
-			buffer = NULL;
-			len = 0;
+
+			/* the value after a skipped key goes to the skip ops */
+			if ( (ret == LLSD_SKIP) && (t == LLSD_KEY) )
+				parser_state->skip = TRUE;
 			break;
 		case LLSD_URI:
-			/* zero terminate the string */
-			buffer_append( parser_state->buf, "\0", 1 );
-			CHECK_GOTO( (*(parser_state->ops->uri_fn))( (uint8_t*)parser_state->buf->iov_base, FALSE, parser_state->user_data ), xml_end_tag_fail );
+			CHECK_GOTO( (*(parser_state->ops->uri_fn))( text, (uint32_t)text_len, FALSE, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_URI, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_URI, parser_state ), xml_end_tag_fail );
-			buffer = NULL;
-			enc_len = 0;
-			len = 0;
 			break;
 		case LLSD_BINARY:
-			CHECK_GOTO( binary_from_buf( parser_state->buf, parser_state->enc, &buffer, &len ), xml_end_tag_fail );
+			CHECK_GOTO( binary_from_text( text, text_len, parser_state->enc, &buffer, &len ), xml_end_tag_fail );
 			CHECK_GOTO( (*(parser_state->ops->binary_fn))( buffer, len, TRUE, parser_state->user_data ), xml_end_tag_fail );
 			CHECK_GOTO( value( VALUE_STATES, LLSD_BINARY, parser_state ), xml_end_tag_fail );
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_BINARY, parser_state ), xml_end_tag_fail );
@@ -865,13 +945,58 @@ static void XMLCALL llsd_xml_end_tag( void * data, char const * el )
 			CHECK_GOTO( end_value( END_VALUE_STATES, LLSD_MAP, parser_state ), xml_end_tag_fail );
 			break;
 	}
+	return TRUE;
+
+xml_end_tag_fail:
+	xml_position( parser_state, &line, &col );
+	WARN( "Failed %s step while processing %s data. (line: %d, col: %d)\n", check_err_str_, TYPE_TO_STRING( t ), line, col );
+	return FALSE;
+}
+
+static void XMLCALL llsd_xml_start_tag( void * data, char const * el, char const ** attr )
+{
+	int i;
+	uint32_t size = 0;
+	llsd_bin_enc_t enc = LLSD_BASE64;
+	llsd_type_t t = LLSD_UNDEF;
+	xp_state_t * parser_state = (xp_state_t*)data;
+
+	CHECK_PTR( parser_state );
+
+	/* get the type */
+	t = llsd_type_from_tag( el );
+
+	/* the size of arrays and maps and the encoding of binary */
+	for ( i = 0; attr[i] != NULL; i += 2 )
+	{
+		if ( strncmp( attr[i], "size", 5 ) == 0 )
+			size = atoi( attr[i + 1] );
+		else if ( strncmp( attr[i], "encoding", 9 ) == 0 )
+			enc = llsd_bin_enc_from_attr( attr[i + 1] );
+	}
+
+	if ( !xml_start_element( parser_state, t, size, enc ) )
+		XML_StopParser( parser_state->p, XML_FALSE );
 
 	/* reset the buffer */
 	buffer_deinitialize( parser_state->buf );
-	return;
+}
 
-xml_end_tag_fail:
-	WARN( "Failed %s step while processing %s data. (line: %d, col: %d)\n", check_err_str_, TYPE_TO_STRING( t ), (int)XML_GetCurrentLineNumber( parser_state->p ), (int)XML_GetCurrentColumnNumber( parser_state->p ) );
+static void XMLCALL llsd_xml_end_tag( void * data, char const * el )
+{
+	xp_state_t * parser_state = (xp_state_t*)data;
+
+	CHECK_PTR( parser_state );
+
+	/* zero terminate the text for string_fn and uri_fn */
+	if ( (buffer_append( parser_state->buf, "\0", 1 ) == NULL) ||
+		 !xml_end_element( parser_state, llsd_type_from_tag( el ), (uint8_t const *)parser_state->buf->iov_base, parser_state->buf->iov_len - 1 ) )
+	{
+		XML_StopParser( parser_state->p, XML_FALSE );
+	}
+
+	/* reset the buffer */
+	buffer_deinitialize( parser_state->buf );
 }
 
 static void XMLCALL llsd_xml_data_handler( void * data, char const * s, int len )
@@ -886,71 +1011,720 @@ static void XMLCALL llsd_xml_data_handler( void * data, char const * s, int len
 	CHECK_PTR( buf );
 }
 
-#define XML_BUF_SIZE (4096)
+/*
+ * native tokenizer
+ *
+ * LLSD XML is a dozen element names, two attributes and no DTD, so whole
+ * buffers are tokenized here instead of going through expat.  markup is found
+ * with llsd_scan_find2 and tag names are matched with a perfect hash.  element
+ * text is handed to the value functions where it lies in the document unless
+ * it has to be put back together from entities, CDATA sections or line ends,
+ * then it is decoded into a scratch buffer that is reused for the whole
+ * document.  a DOCTYPE or an encoding other than UTF-8 sends the document to
+ * expat before any callbacks are made.
+ */
+
+#define IS_XML_SPACE( c ) ( ((c) == ' ') || ((c) == '\t') || ((c) == '\r') || ((c) == '\n') )
+
+/* ((t)[0] + (t)[n - 1] + 8n) & 31 is collision free for the LLSD names */
+#define TAG_HASH( t, n ) ( ((t)[0] + (t)[(n) - 1] + ((n) << 3)) & 31 )
+#define TAG_MIN_LEN (3)
+#define TAG_MAX_LEN (7)
 
-int llsd_xml_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data )
+typedef struct xml_tag_s
 {
-	static uint8_t buf[XML_BUF_SIZE];
-	int done;
-	size_t len;
-	XML_Parser p;
-	xp_state_t state;
+	char const * name;
+	uint32_t len;
+	llsd_type_t t;
+} xml_tag_t;
 
-	CHECK_PTR_RET( fin, FALSE );
-	CHECK_PTR_RET( ops, FALSE );
+static xml_tag_t const xml_tags[32] =
+{
+	[2] = { "array", 5, LLSD_ARRAY },
+	[3] = { "undef", 5, LLSD_UNDEF },
+	[8] = { "boolean", 7, LLSD_BOOLEAN },
+	[9] = { "date", 4, LLSD_DATE },
+	[10] = { "string", 6, LLSD_STRING },
+	[11] = { "binary", 6, LLSD_BINARY },
+	[16] = { "llsd", 4, LLSD_LLSD },
+	[19] = { "integer", 7, LLSD_INTEGER },
+	[21] = { "map", 3, LLSD_MAP },
+	[22] = { "uri", 3, LLSD_URI },
+	[25] = { "uuid", 4, LLSD_UUID },
+	[28] = { "key", 3, LLSD_KEY },
+	[30] = { "real", 4, LLSD_REAL }
+};
+
+static llsd_type_t xml_tag_type( uint8_t const * const name, size_t const len )
+{
+	xml_tag_t const * tag;
+	if ( (len < TAG_MIN_LEN) || (len > TAG_MAX_LEN) )
+		return LLSD_TYPE_INVALID;
+	tag = &xml_tags[ TAG_HASH( name, len ) ];
+	if ( (tag->len != len) || (MEMCMP( tag->name, name, len ) != 0) )
+		return LLSD_TYPE_INVALID;
+	return tag->t;
+}
 
-	MEMSET( &state, 0, sizeof( xp_state_t ) );
+static uint8_t const * xml_skip_space( uint8_t const * p, uint8_t const * const end )
+{
+	while ( (p < end) && IS_XML_SPACE( *p ) )
+		p++;
+	return p;
+}
 
-	/* create the parser */
-	p = XML_ParserCreate( NULL );
-	CHECK_PTR_RET( p, FALSE );
-	state.p = p;
+/* finds the terminator of a comment, PI or CDATA section, returns NULL if it
+ * isn't there */
+static uint8_t const * xml_find( uint8_t const * p, uint8_t const * const end, char const * const s, size_t const n )
+{
+	while ( (p = (uint8_t const *)memchr( p, s[0], (size_t)(end - p) )) != NULL )
+	{
+		if ( ((size_t)(end - p) >= n) && (MEMCMP( p, s, n ) == 0) )
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+static int xml_match( uint8_t const * const p, uint8_t const * const end, char const * const s, size_t const n )
+{
+	return ( ((size_t)(end - p) >= n) && (MEMCMP( p, s, n ) == 0) );
+}
+
+/* the element text is a single span of the document until something has to
+ * be copied, then it is collected in the scratch buffer */
+static int xml_text( xp_state_t * const state, uint8_t const * const p, size_t const len, int const copy )
+{
+	if ( len == 0 )
+		return TRUE;
+
+	if ( !state->in_scratch )
+	{
+		if ( (state->text_len == 0) && !copy )
+		{
+			state->text = p;
+			state->text_len = len;
+			return TRUE;
+		}
+		state->scratch.len = 0;
+		CHECK_RET( llsd_buffer_write( &(state->scratch), state->text, state->text_len ), FALSE );
+		state->in_scratch = TRUE;
+	}
+	return llsd_buffer_write( &(state->scratch), p, len );
+}
+
+/* character data up to the next markup, line ends become \n like expat does */
+static int xml_char_data( xp_state_t * const state, uint8_t const * p, uint8_t const * const end )
+{
+	uint8_t const * cr;
+
+	while ( (cr = (uint8_t const *)memchr( p, '\r', (size_t)(end - p) )) != NULL )
+	{
+		CHECK_RET( xml_text( state, p, (size_t)(cr - p), TRUE ), FALSE );
+		CHECK_RET( xml_text( state, (uint8_t const *)"\n", 1, TRUE ), FALSE );
+		p = cr + 1;
+		if ( (p < end) && (*p == '\n') )
+			p++;
+	}
+	return xml_text( state, p, (size_t)(end - p), FALSE );
+}
+
+static size_t xml_utf8( uint32_t const c, uint8_t out[4] )
+{
+	if ( c < 0x80 )
+	{
+		out[0] = (uint8_t)c;
+		return 1;
+	}
+	if ( c < 0x800 )
+	{
+		out[0] = (uint8_t)(0xC0 | (c >> 6));
+		out[1] = (uint8_t)(0x80 | (c & 0x3F));
+		return 2;
+	}
+	if ( c < 0x10000 )
+	{
+		out[0] = (uint8_t)(0xE0 | (c >> 12));
+		out[1] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+		out[2] = (uint8_t)(0x80 | (c & 0x3F));
+		return 3;
+	}
+	out[0] = (uint8_t)(0xF0 | (c >> 18));
+	out[1] = (uint8_t)(0x80 | ((c >> 12) & 0x3F));
+	out[2] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+	out[3] = (uint8_t)(0x80 | (c & 0x3F));
+	return 4;
+}
+
+/* decodes the entity or character reference at (*p) into the text */
+static int xml_entity( xp_state_t * const state, uint8_t const ** p, uint8_t const * const end )
+{
+	uint8_t const * q = (*p) + 1;
+	uint8_t const * semi;
+	uint8_t out[4];
+	uint32_t c = 0;
+	int hex = FALSE;
+
+	semi = (uint8_t const *)memchr( q, ';', (size_t)(end - q) );
+	CHECK_PTR_RET( semi, FALSE );
+	CHECK_RET( semi > q, FALSE );
+
+	if ( *q == '#' )
+	{
+		q++;
+		if ( (q < semi) && (*q == 'x') )
+		{
+			hex = TRUE;
+			q++;
+		}
+		CHECK_RET( (q < semi) && ((semi - q) <= 8), FALSE );
+		for ( ; q < semi; q++ )
+		{
+			if ( (*q >= '0') && (*q <= '9') )
+				c = (c * (hex ? 16 : 10)) + (*q - '0');
+			else if ( hex && (((*q | 0x20) >= 'a') && ((*q | 0x20) <= 'f')) )
+				c = (c * 16) + (10 + ((*q | 0x20) - 'a'));
+			else
+				return FALSE;
+		}
+
+		/* the characters XML allows */
+		CHECK_RET( (c != 0) && (c <= 0x10FFFF) && ((c < 0xD800) || (c > 0xDFFF)), FALSE );
+		CHECK_RET( xml_text( state, out, xml_utf8( c, out ), TRUE ), FALSE );
+	}
+	else
+	{
+		switch ( semi - q )
+		{
+			case 2:
+				if ( MEMCMP( q, "lt", 2 ) == 0 )
+					out[0] = '<';
+				else if ( MEMCMP( q, "gt", 2 ) == 0 )
+					out[0] = '>';
+				else
+					return FALSE;
+				break;
+			case 3:
+				CHECK_RET( MEMCMP( q, "amp", 3 ) == 0, FALSE );
+				out[0] = '&';
+				break;
+			case 4:
+				if ( MEMCMP( q, "quot", 4 ) == 0 )
+					out[0] = '\"';
+				else if ( MEMCMP( q, "apos", 4 ) == 0 )
+					out[0] = '\'';
+				else
+					return FALSE;
+				break;
+			default:
+				/* nothing else can be declared without a DTD */
+				return FALSE;
+		}
+		CHECK_RET( xml_text( state, out, 1, TRUE ), FALSE );
+	}
+
+	(*p) = semi + 1;
+	return TRUE;
+}
+
+/* name="value" pairs up to the end of the start tag */
+static int xml_attributes( uint8_t const ** p, uint8_t const * const end, uint32_t * const size, llsd_bin_enc_t * const enc, int * const empty )
+{
+	uint8_t const * name;
+	uint8_t const * v;
+	uint8_t const * q;
+	size_t nlen;
+	int32_t ival;
+
+	while ( TRUE )
+	{
+		(*p) = xml_skip_space( (*p), end );
+		CHECK_RET( (*p) < end, FALSE );
+
+		if ( **p == '>' )
+		{
+			(*p)++;
+			(*empty) = FALSE;
+			return TRUE;
+		}
+		if ( **p == '/' )
+		{
+			CHECK_RET( ((*p) + 1 < end) && ((*p)[1] == '>'), FALSE );
+			(*p) += 2;
+			(*empty) = TRUE;
+			return TRUE;
+		}
+
+		/* the name, = and a quoted value */
+		name = (*p);
+		while ( ((*p) < end) && (**p != '=') && (**p != '>') && (**p != '/') && !IS_XML_SPACE( **p ) )
+			(*p)++;
+		nlen = (size_t)((*p) - name);
+		CHECK_RET( nlen > 0, FALSE );
+		(*p) = xml_skip_space( (*p), end );
+		CHECK_RET( ((*p) < end) && (**p == '='), FALSE );
+		(*p) = xml_skip_space( (*p) + 1, end );
+		CHECK_RET( ((*p) < end) && ((**p == '\"') || (**p == '\'')), FALSE );
+		v = (*p) + 1;
+		q = (uint8_t const *)memchr( v, **p, (size_t)(end - v) );
+		CHECK_PTR_RET( q, FALSE );
+		(*p) = q + 1;
+
+		if ( (nlen == 4) && (MEMCMP( name, "size", 4 ) == 0) )
+		{
+			v = xml_skip_space( v, q );
+			if ( llsd_number_parse_integer( &v, q, &ival ) && (ival > 0) )
+				(*size) = (uint32_t)ival;
+		}
+		else if ( (nlen == 8) && (MEMCMP( name, "encoding", 8 ) == 0) )
+		{
+			if ( (q - v) >= 6 )
+				(*enc) = llsd_bin_enc_from_attr( (char const *)v );
+		}
+	}
+	return FALSE;
+}
+
+/* the encoding in the XML declaration, anything but UTF-8 or ASCII goes to expat */
+static int xml_utf8_decl( uint8_t const * p, uint8_t const * const end )
+{
+	uint8_t const * v;
+	uint8_t const * q;
+	size_t i, n;
+	static char const * const utf8_names[] = { "utf-8", "utf8", "us-ascii", "ascii" };
+
+	p = xml_find( p, end, "encoding", 8 );
+	if ( p == NULL )
+		return TRUE;
+	p = xml_skip_space( p + 8, end );
+	CHECK_RET( (p < end) && (*p == '='), FALSE );
+	p = xml_skip_space( p + 1, end );
+	CHECK_RET( (p < end) && ((*p == '\"') || (*p == '\'')), FALSE );
+	v = p + 1;
+	q = (uint8_t const *)memchr( v, *p, (size_t)(end - v) );
+	CHECK_PTR_RET( q, FALSE );
+
+	for ( n = 0; n < (sizeof(utf8_names) / sizeof(utf8_names[0])); n++ )
+	{
+		if ( strlen( utf8_names[n] ) != (size_t)(q - v) )
+			continue;
+		for ( i = 0; (v + i < q) && (tolower( v[i] ) == utf8_names[n][i]); i++ ) {}
+		if ( v + i == q )
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* comments, PIs and white space outside of the root element.  a DOCTYPE or a
+ * declaration of another encoding sets fallback. */
+static int xml_misc( uint8_t const ** p, uint8_t const * const end, int * const fallback )
+{
+	uint8_t const * q;
+
+	while ( TRUE )
+	{
+		(*p) = xml_skip_space( (*p), end );
+		if ( ((*p) == end) || (**p != '<') || ((*p) + 1 == end) )
+			return TRUE;
+
+		if ( (*p)[1] == '?' )
+		{
+			q = xml_find( (*p) + 2, end, "?>", 2 );
+			CHECK_PTR_RET( q, FALSE );
+			if ( xml_match( (*p) + 2, q, "xml", 3 ) && ((*p) + 5 < q) && IS_XML_SPACE( (*p)[5] ) && !xml_utf8_decl( (*p) + 5, q ) )
+			{
+				(*fallback) = TRUE;
+				return FALSE;
+			}
+			(*p) = q + 2;
+		}
+		else if ( xml_match( (*p), end, "<!--", 4 ) )
+		{
+			q = xml_find( (*p) + 4, end, "-->", 3 );
+			CHECK_PTR_RET( q, FALSE );
+			(*p) = q + 3;
+		}
+		else if ( (*p)[1] == '!' )
+		{
+			/* DOCTYPE and its entity declarations are left to expat */
+			(*fallback) = TRUE;
+			return FALSE;
+		}
+		else
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* a stack of the open element names for matching end tags */
+static int xml_push_name( xp_state_t * const state, uint8_t const * const name, size_t const len, llsd_type_t const t )
+{
+	xml_name_t * names;
+	size_t size;
+
+	if ( state->depth == state->names_size )
+	{
+		size = (state->names_size ? (state->names_size * 2) : 16);
+		names = (xml_name_t*)REALLOC( state->names, size * sizeof(xml_name_t) );
+		CHECK_PTR_RET( names, FALSE );
+		state->names = names;
+		state->names_size = size;
+	}
+	state->names[state->depth].p = name;
+	state->names[state->depth].len = len;
+	state->names[state->depth].t = t;
+	state->depth++;
+	return TRUE;
+}
+
+static int xml_native_parse( xp_state_t * const state, uint8_t const * const buf, size_t const len, int * const fallback )
+{
+	uint8_t const * p = buf;
+	uint8_t const * const end = buf + len;
+	uint8_t const * q;
+	uint8_t const * name;
+	uint8_t const * text;
+	size_t nlen;
+	uint32_t size;
+	llsd_bin_enc_t enc;
+	llsd_type_t t;
+	int empty;
+
+	(*fallback) = FALSE;
+	state->doc = buf;
+
+	/* byte order mark and prolog */
+	if ( xml_match( p, end, "\xEF\xBB\xBF", 3 ) )
+		p += 3;
+	CHECK_RET( xml_misc( &p, end, fallback ), FALSE );
+	CHECK_RET( (p < end) && (*p == '<'), FALSE );
+
+	do
+	{
+		/* character data */
+		q = llsd_scan_find2( p, end, '<', '&' );
+		if ( q > p )
+		{
+			CHECK_RET( xml_char_data( state, p, q ), FALSE );
+		}
+		p = q;
+		CHECK_RET( p < end, FALSE );
+		state->pos = p;
+
+		if ( *p == '&' )
+		{
+			CHECK_RET( xml_entity( state, &p, end ), FALSE );
+			continue;
+		}
+
+		CHECK_RET( p + 1 < end, FALSE );
+		switch ( p[1] )
+		{
+			case '/':
+				/* end tag, it has to match the open element */
+				CHECK_RET( state->depth > 0, FALSE );
+				name = p + 2;
+				nlen = state->names[state->depth - 1].len;
+				CHECK_RET( xml_match( name, end, (char const *)state->names[state->depth - 1].p, nlen ), FALSE );
+				p = xml_skip_space( name + nlen, end );
+				CHECK_RET( (p < end) && (*p == '>'), FALSE );
+				p++;
+
+				state->depth--;
+				t = state->names[state->depth].t;
+				if ( (t == LLSD_STRING) || (t == LLSD_KEY) || (t == LLSD_URI) )
+				{
+					/* strings and uris go to the ops zero terminated */
+					CHECK_RET( xml_text( state, (uint8_t const *)"", 1, TRUE ), FALSE );
+					state->scratch.len--;
+				}
+				text = (state->in_scratch ? state->scratch.data : state->text);
+				CHECK_RET( xml_end_element( state, t, (text ? text : (uint8_t const *)""), (state->in_scratch ? state->scratch.len : state->text_len) ), FALSE );
+				break;
+
+			case '!':
+				if ( xml_match( p, end, "<!--", 4 ) )
+				{
+					q = xml_find( p + 4, end, "-->", 3 );
+					CHECK_PTR_RET( q, FALSE );
+					p = q + 3;
+				}
+				else
+				{
+					/* CDATA is text as it is, apart from line ends */
+					CHECK_RET( xml_match( p, end, "<![CDATA[", 9 ), FALSE );
+					q = xml_find( p + 9, end, "]]>", 3 );
+					CHECK_PTR_RET( q, FALSE );
+					CHECK_RET( xml_char_data( state, p + 9, q ), FALSE );
+					p = q + 3;
+				}
+				/* comments and CDATA don't end the text */
+				continue;
+
+			case '?':
+				q = xml_find( p + 2, end, "?>", 2 );
+				CHECK_PTR_RET( q, FALSE );
+				p = q + 2;
+				continue;
+
+			default:
+				/* start tag */
+				name = p + 1;
+				for ( q = name; (q < end) && (*q != '>') && (*q != '/') && !IS_XML_SPACE( *q ); q++ ) {}
+				nlen = (size_t)(q - name);
+				CHECK_RET( nlen > 0, FALSE );
+				t = xml_tag_type( name, nlen );
+				size = 0;
+				enc = LLSD_BASE64;
+				p = q;
+				CHECK_RET( xml_attributes( &p, end, &size, &enc, &empty ), FALSE );
+
+				CHECK_RET( xml_start_element( state, t, size, enc ), FALSE );
+				if ( empty )
+				{
+					/* reset the text */
+					state->text_len = 0;
+					state->in_scratch = FALSE;
+					CHECK_RET( xml_end_element( state, t, (uint8_t const *)"", 0 ), FALSE );
+				}
+				else
+				{
+					CHECK_RET( xml_push_name( state, name, nlen, t ), FALSE );
+				}
+				break;
+		}
+
+		/* every tag resets the text */
+		state->text_len = 0;
+		state->in_scratch = FALSE;
+
+	} while ( state->depth > 0 );
+
+	/* nothing but comments, PIs and white space may follow the root, it is
+	 * too late to hand the document to expat */
+	state->pos = p;
+	if ( !xml_misc( &p, end, fallback ) || (p != end) )
+	{
+		(*fallback) = FALSE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int llsd_xml_check_sig_buffer( uint8_t const * const buf, size_t const len )
+{
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_RET( len >= XML_SIG_LEN, FALSE );
+
+	/* if it matches the signature, return TRUE, otherwise FALSE */
+	return ( memcmp( buf, xml_header, XML_SIG_LEN ) == 0 );
+}
+
+/* the state shared by expat and the native tokenizer */
+static xp_state_t * xml_state_new( llsd_ops_t const * const ops, void * const user_data )
+{
+	xp_state_t * state = NULL;
+
+	CHECK_PTR_RET( ops, NULL );
+
+	state = (xp_state_t*)CALLOC( 1, sizeof( xp_state_t ) );
+	CHECK_PTR_RET( state, NULL );
 
 	/* set up step stack, used to synthesize array value end, map key end, 
 	 * and map value end callbacks */
-	state.state_stack = list_new( 1, NULL );
-	CHECK_PTR_RET( state.state_stack, FALSE );
+	llsd_stack_initialize( &(state->state_stack) );
 
 	/* create the buffer */
-	state.buf = buffer_new( NULL, 0 );
-	CHECK_PTR_RET( state.buf, FALSE );
+	state->buf = buffer_new( NULL, 0 );
+	CHECK_GOTO( state->buf != NULL, fail_xml_state_new );
+
+	/* growable scratch buffer for text the tokenizer has to decode */
+	CHECK_GOTO( llsd_buffer_initialize( &(state->scratch), NULL, 0 ), fail_xml_state_new );
 
 	/* store the ops callback pointers */
-	state.ops = ops;
+	state->ops = ops;
 
 	/* store user data pointer to pass back to callbacks */
-	state.user_data = user_data;
+	state->user_data = user_data;
 
-	/* set the tag handlers */
-	XML_SetElementHandler( p, &llsd_xml_start_tag, &llsd_xml_end_tag );
-	XML_SetCharacterDataHandler( p, &llsd_xml_data_handler );
-	XML_SetUserData( p, (void*)(&state) );
+	return state;
 
-	/* seek past signature */
-	/*fseek( fin, XML_SIG_LEN, SEEK_SET );*/
+fail_xml_state_new:
+	llsd_xml_parser_delete( state );
+	return NULL;
+}
 
-	do
+/* puts the state back to the start of a document, keeping its stack, buffers
+ * and expat parser */
+static void xml_state_reset( xp_state_t * const state, llsd_ops_t const * const ops, void * const user_data )
+{
+	llsd_stack_clear( &(state->state_stack) );
+	buffer_deinitialize( state->buf );
+	state->enc = 0;
+	state->ops = ops;
+	state->user_data = user_data;
+	state->skip = FALSE;
+	state->kept_ops = NULL;
+	state->skip_level = 0;
+	state->doc = NULL;
+	state->pos = NULL;
+	state->text = NULL;
+	state->text_len = 0;
+	state->in_scratch = FALSE;
+	state->scratch.len = 0;
+	state->depth = 0;
+}
+
+/* creates the expat parser the first time and resets it after that */
+static int xml_expat_start( xp_state_t * const state )
+{
+	if ( state->p == NULL )
 	{
-		/* read the type marker */
-		len = fread( buf, sizeof(uint8_t), XML_BUF_SIZE, fin );
-		done = (len < XML_BUF_SIZE);
+		state->p = XML_ParserCreate( NULL );
+		CHECK_PTR_RET( state->p, FALSE );
+	}
+	else
+	{
+		/* resetting drops the handlers and user data */
+		CHECK_RET( XML_ParserReset( state->p, NULL ) == XML_TRUE, FALSE );
+	}
 
-		if ( XML_Parse( p, buf, len, done ) == XML_STATUS_ERROR )
-		{
-			DEBUG( "%s\n", XML_ErrorString(XML_GetErrorCode(p)) );
-		}
-		
-	} while ( !done );
+	/* set the tag handlers */
+	XML_SetElementHandler( state->p, &llsd_xml_start_tag, &llsd_xml_end_tag );
+	XML_SetCharacterDataHandler( state->p, &llsd_xml_data_handler );
+	XML_SetUserData( state->p, (void*)state );
+
+	return TRUE;
+}
+
+llsd_xml_parser_t * llsd_xml_parser_new( llsd_ops_t const * const ops, void * const user_data )
+{
+	xp_state_t * state = NULL;
+
+	state = xml_state_new( ops, user_data );
+	CHECK_PTR_RET( state, NULL );
+
+	/* create the parser */
+	CHECK_GOTO( xml_expat_start( state ), fail_xml_parser_new );
+
+	return state;
+
+fail_xml_parser_new:
+	llsd_xml_parser_delete( state );
+	return NULL;
+}
+
+void llsd_xml_parser_delete( void * p )
+{
+	xp_state_t * state = (xp_state_t*)p;
+	CHECK_PTR( state );
 
 	/* clean up the step stack */
-	list_delete( state.state_stack );
+	llsd_stack_deinitialize( &(state->state_stack) );
 
 	/* clean up the buffer */
-	buffer_delete( state.buf );
+	if ( state->buf != NULL )
+		buffer_delete( state->buf );
+
+	/* clean up the tokenizer's scratch buffer and name stack */
+	llsd_buffer_deinitialize( &(state->scratch) );
+	FREE( state->names );
 
 	/* free the parser */
-	XML_ParserFree( p );
+	if ( state->p != NULL )
+		XML_ParserFree( state->p );
+
+	FREE( state );
+}
+
+int llsd_xml_parser_feed( llsd_xml_parser_t * const state, uint8_t const * const buf, size_t const len, int const final )
+{
+	CHECK_PTR_RET( state, FALSE );
+	CHECK_PTR_RET( state->p, FALSE );
+	CHECK_RET( (buf != NULL) || (len == 0), FALSE );
 
+	/* expat keeps partial tokens and the element state between calls */
+	if ( XML_Parse( state->p, (char const *)buf, (int)len, final ) == XML_STATUS_ERROR )
+	{
+		DEBUG( "%s\n", XML_ErrorString(XML_GetErrorCode(state->p)) );
+		return FALSE;
+	}
 	return TRUE;
 }
 
+int llsd_xml_parse_buffer_expat( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	llsd_xml_parser_t * state = NULL;
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	state = llsd_xml_parser_new( ops, user_data );
+	CHECK_PTR_RET( state, FALSE );
+
+	/* expat takes the whole document in one call */
+	ret = llsd_xml_parser_feed( state, buf, len, TRUE );
+
+	llsd_xml_parser_delete( state );
+
+	return ret;
+}
+
+int llsd_xml_parse_buffer_ctx( llsd_xml_parser_t * const state, uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	int fallback = FALSE;
+
+	CHECK_PTR_RET( state, FALSE );
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	xml_state_reset( state, ops, user_data );
+	ret = xml_native_parse( state, buf, len, &fallback );
+	if ( !fallback )
+		return ret;
+
+	/* nothing has been handed to the ops yet */
+	xml_state_reset( state, ops, user_data );
+	CHECK_RET( xml_expat_start( state ), FALSE );
+	return llsd_xml_parser_feed( state, buf, len, TRUE );
+}
+
+int llsd_xml_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	xp_state_t * state = NULL;
+
+	CHECK_PTR_RET( buf, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	state = xml_state_new( ops, user_data );
+	CHECK_PTR_RET( state, FALSE );
+
+	ret = llsd_xml_parse_buffer_ctx( state, buf, len, ops, user_data );
+
+	llsd_xml_parser_delete( state );
+
+	return ret;
+}
+
+int llsd_xml_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data )
+{
+	int ret = FALSE;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+
+	CHECK_PTR_RET( fin, FALSE );
+	CHECK_PTR_RET( ops, FALSE );
+
+	/* read the whole file into memory and parse it from there */
+	CHECK_RET( llsd_read_file( fin, &buf, &len ), FALSE );
+	ret = llsd_xml_parse_buffer( buf, len, ops, user_data );
+	FREE( buf );
+
+	return ret;
+}
+
@@ -21,7 +21,26 @@
 #include "llsd_parser.h"
 
 int llsd_xml_check_sig_file( FILE * fin );
-int llsd_xml_parse_file( FILE * fin, llsd_ops_t * const ops, void * const user_data );
+int llsd_xml_parse_file( FILE * fin, llsd_ops_t const * const ops, void * const user_data );
+int llsd_xml_check_sig_buffer( uint8_t const * const buf, size_t const len );
+int llsd_xml_parse_buffer( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* llsd_xml_parse_buffer tokenizes LLSD XML itself and only uses expat for
+ * documents with a DOCTYPE or in an encoding other than UTF-8.  this always
+ * uses expat. */
+int llsd_xml_parse_buffer_expat( uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
+
+/* push parser, the document can be fed in chunks of any size.  pass final
+ * as TRUE with the last chunk (which may be empty). */
+typedef struct xp_state_s llsd_xml_parser_t;
+llsd_xml_parser_t * llsd_xml_parser_new( llsd_ops_t const * const ops, void * const user_data );
+void llsd_xml_parser_delete( void * p );
+int llsd_xml_parser_feed( llsd_xml_parser_t * const state, uint8_t const * const buf, size_t const len, int const final );
+
+/* llsd_xml_parse_buffer on a parser that is kept between documents.  it is
+ * reset for each one and expat, when a document needs it, is only created
+ * once and reset with XML_ParserReset after that. */
+int llsd_xml_parse_buffer_ctx( llsd_xml_parser_t * const state, uint8_t const * const buf, size_t const len, llsd_ops_t const * const ops, void * const user_data );
 
 #endif/*LLSD_XML_PARSER_H*/
 
@@ -15,12 +15,12 @@
  */
 
 #include <math.h>
-#include <time.h>
 
 #include "llsd.h"
+#include "llsd_date.h"
+#include "llsd_number.h"
 #include "llsd_serializer.h"
 #include "llsd_xml_serializer.h"
-#include "base64.h"
 
 #define PUSHML(x) (list_push_head( state->multiline_stack, (void*)x ))
 #define TOPML	  ((int_t)list_get_head( state->multiline_stack ))
@@ -31,17 +31,17 @@ typedef struct xs_state_s
 	int pretty;
 	int indent;
 	int key;
-	FILE * fout;
+	llsd_buffer_t * out;
 	list_t * multiline_stack;
 } xs_state_t;
 
-#define WRITE_STR(x,y) (fwrite( x, sizeof(uint8_t), y, state->fout ))
+#define WRITE_STR(x,y) (llsd_buffer_write( state->out, x, y ))
 #define COMMA WRITE_STR(",",1)
 #define COLON WRITE_STR(":",1)
 #define NL { if(state->pretty && TOPML) WRITE_STR("\n",1); }
 
 #define INDENT_SPACES (4)
-#define INDENT { if(state->pretty && state->indent && TOPML) fprintf( state->fout, "%*s", state->indent * INDENT_SPACES, " " ); }
+#define INDENT { if(state->pretty && state->indent && TOPML) llsd_buffer_fill( state->out, ' ', state->indent * INDENT_SPACES ); }
 #define INC_INDENT { if(state->pretty) state->indent++; }
 #define DEC_INDENT { if(state->pretty) state->indent--; }
 
@@ -94,13 +94,14 @@ static int_t llsd_xml_boolean( int const value, void * const user_data )
 	CHECK_PTR_RET( state, FALSE );
 	/* NOTE: we use 1 and 0 because the parser is a tiny bit faster */
 	BOOLEAN_BEGIN;
-	CHECK_RET( fwrite( (value ? "1" : "0"), sizeof(uint8_t), 1, state->fout ) == 1, FALSE );
+	CHECK_RET( llsd_buffer_write( state->out, (value ? "1" : "0"), 1 ), FALSE );
 	BOOLEAN_END;
 	return TRUE;
 }
 
 static int_t llsd_xml_integer( int32_t const value, void * const user_data )
 {
+	uint8_t num[LLSD_NUMBER_STR_LEN];
 	xs_state_t * state = (xs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	if ( value == 0 )
@@ -110,7 +111,7 @@ static int_t llsd_xml_integer( int32_t const value, void * const user_data )
 	else
 	{
 		INTEGER_BEGIN;
-		CHECK_RET( fprintf( state->fout, "%d", value ) >= 1, FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, num, llsd_number_format_integer( value, num ) ), FALSE );
 		INTEGER_END;
 	}
 	return TRUE;
@@ -118,6 +119,7 @@ static int_t llsd_xml_integer( int32_t const value, void * const user_data )
 
 static int_t llsd_xml_real( double const value, void * const user_data )
 {
+	uint8_t num[LLSD_NUMBER_STR_LEN];
 	xs_state_t * state = (xs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	if ( value == 0.0 )
@@ -127,7 +129,7 @@ static int_t llsd_xml_real( double const value, void * const user_data )
 	else
 	{
 		REAL_BEGIN;
-		CHECK_RET( fprintf( state->fout, "%F", value ) >= 1, FALSE );
+		CHECK_RET( llsd_buffer_write( state->out, num, llsd_number_format_real( value, num ) ), FALSE );
 		REAL_END;
 	}
 	return TRUE;
@@ -147,14 +149,14 @@ static int_t llsd_xml_uuid( uint8_t const value[UUID_LEN], void * const user_dat
 	else
 	{
 		UUID_BEGIN;
-		ret = fprintf( state->fout, 
+		ret = llsd_buffer_printf( state->out, 
 			"%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x", 
 			value[0], value[1], value[2], value[3], 
 			value[4], value[5], 
 			value[6], value[7], 
 			value[8], value[9], 
 			value[10], value[11], value[12], value[13], value[14], value[15] );
-		CHECK_RET( ret == 36, FALSE );
+		CHECK_RET( ret, FALSE );
 		UUID_END;
 	}
 
@@ -201,13 +203,11 @@ static void llsd_xml_write_string( uint8_t const * str, uint32_t len, xs_state_t
 	}
 }
 
-static int_t llsd_xml_string( uint8_t const * str, int const own_it, void * const user_data )
+static int_t llsd_xml_string( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
 {
 	uint8_t * xml_encoded = NULL;
-	size_t len = 0;
 	xs_state_t * state = (xs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	len = strlen( str );
 	if ( state->key )
 	{
 		llsd_xml_write_string( str, len, state );
@@ -231,48 +231,31 @@ static int_t llsd_xml_string( uint8_t const * str, int const own_it, void * cons
 
 static int_t llsd_xml_date( double const value, void * const user_data )
 {
-	double int_time;
-	int32_t useconds;
-	time_t seconds;
-	struct tm parts;
+	uint8_t date[LLSD_DATE_STR_LEN];
 	xs_state_t * state = (xs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
-	int_time = floor( value );
-	seconds = (time_t)int_time;
-	useconds = (int32_t)( ( value - int_time) * 1000000.0 );
-	if ( (seconds == 0) && (useconds == 0) )
+	if ( value == 0.0 )
 	{
 		DATE_EMPTY; /* epoch */
 	}
 	else
 	{
-		parts = *gmtime(&seconds);
-
+		CHECK_RET( llsd_date_format( value, date ) == DATE_STR_LEN, FALSE );
 		DATE_BEGIN;
-		fprintf( state->fout,
-			"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
-			parts.tm_year + 1900,
-			parts.tm_mon + 1,
-			parts.tm_mday,
-			parts.tm_hour,
-			parts.tm_min,
-			parts.tm_sec,
-			((useconds != 0) ? (int32_t)(useconds / 1000.f + 0.5f) : 0) );
+		CHECK_RET( llsd_buffer_write( state->out, date, DATE_STR_LEN ), FALSE );
 		DATE_END;
 	}
 
 	return TRUE;
 }
 
-static int_t llsd_xml_uri( uint8_t const * uri, int const own_it, void * const user_data )
+static int_t llsd_xml_uri( uint8_t const * uri, uint32_t const len, int const own_it, void * const user_data )
 {
 	xs_state_t * state = (xs_state_t*)user_data;
-	size_t len;
 	uint8_t * escaped = NULL;
 	uint32_t esc_len = 0;
 	CHECK_PTR_RET( state, FALSE );
 	CHECK_PTR_RET( uri, FALSE );
-	len = strlen(uri);
 	if ( len == 0 )
 	{
 		URI_EMPTY;
@@ -290,8 +273,6 @@ static int_t llsd_xml_uri( uint8_t const * uri, int const own_it, void * const u
 
 static int_t llsd_xml_binary( uint8_t const * data, uint32_t const len, int const own_it, void * const user_data )
 {
-	uint8_t * buf;
-	uint32_t outlen = 0;
 	xs_state_t * state = (xs_state_t*)user_data;
 	CHECK_PTR_RET( state, FALSE );
 	if ( len == 0 )
@@ -301,15 +282,10 @@ static int_t llsd_xml_binary( uint8_t const * data, uint32_t const len, int cons
 	else
 	{
 		CHECK_PTR_RET( data, FALSE );
-		outlen = BASE64_LENGTH( len );
-		buf = CALLOC( outlen, sizeof(uint8_t) );
-		CHECK_PTR_RET( buf, FALSE );
-		CHECK_RET( base64_encode( data, len, buf, &outlen ), FALSE );
 		BINARY_BEGIN;
 		WRITE_STR("base64\">",8);
-		CHECK_RET( fwrite( buf, sizeof(uint8_t), outlen, state->fout ) == outlen, FALSE );
+		CHECK_RET( llsd_buffer_write_base64( state->out, data, len ), FALSE );
 		BINARY_END;
-		FREE( buf );
 	}
 
 	return TRUE;
@@ -450,10 +426,10 @@ static int_t llsd_xml_map_end( uint_t const size, void * const user_data )
 #define XML_SIG_LEN (39)
 static uint8_t const * const xml_header = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
 
-int llsd_xml_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pretty, void ** const user_data )
+int llsd_xml_serializer_init( llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data )
 {
 	xs_state_t * state = NULL;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( ops, FALSE );
 	CHECK_PTR_RET( user_data, FALSE );
 
@@ -480,14 +456,14 @@ int llsd_xml_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pre
 		&llsd_xml_map_end 
 	};
 
-	/* allocate the serializer state and store the file pointer */
+	/* allocate the serializer state and store the output buffer */
 	state = CALLOC( 1, sizeof(xs_state_t) );
 	CHECK_PTR_RET( state, FALSE );
 
 	state->pretty = pretty;
 	state->indent = 1;
 	state->key = FALSE;
-	state->fout = fout;
+	state->out = out;
 
 	state->multiline_stack = list_new( 1, NULL );
 	if ( state->multiline_stack == NULL )
@@ -497,11 +473,13 @@ int llsd_xml_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pre
 	}
 	PUSHML( TRUE );
 
-	/* write out the xml signature */
-	CHECK_RET( fwrite( xml_header, sizeof(uint8_t), XML_SIG_LEN, fout ) == XML_SIG_LEN, FALSE );
-	
-	/* write out <llsd> tag */
-	LLSD_BEGIN;
+	/* write out the xml signature and the <llsd> tag */
+	if ( !llsd_buffer_write( out, xml_header, XML_SIG_LEN ) || !LLSD_BEGIN )
+	{
+		list_delete( state->multiline_stack );
+		FREE(state);
+		return FALSE;
+	}
 
 	/* return the state as the user_date */
 	(*user_data) = state;
@@ -510,21 +488,53 @@ int llsd_xml_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pre
 }
 
 
-int llsd_xml_serializer_deinit( FILE * fout, void * user_data )
+int llsd_xml_serializer_deinit( llsd_buffer_t * const out, void * user_data )
 {
+	int ret = FALSE;
 	xs_state_t * state = (xs_state_t*)user_data;
-	CHECK_PTR_RET( fout, FALSE );
+	CHECK_PTR_RET( out, FALSE );
 	CHECK_PTR_RET( state, FALSE );
 
 	/* write out </llsd> tag */
 	NL;
 	LLSD_END;
 
-	CHECK_RET( TOPML == TRUE, FALSE );
+	/* free the state even if the serialization was cut short */
+	ret = (TOPML == TRUE);
 	list_delete( state->multiline_stack );
 
 	FREE( state );
+	CHECK_RET( ret, FALSE );
 	return TRUE;
 }
 
-
+#define WALK_FN	llsd_xml_walk
+#define WALK_STATE_T	xs_state_t
+#define EMIT_UNDEF( s )	llsd_xml_undef( s )
+#define EMIT_BOOLEAN( s, v )	llsd_xml_boolean( v, s )
+#define EMIT_INTEGER( s, v )	llsd_xml_integer( v, s )
+#define EMIT_REAL( s, v )	llsd_xml_real( v, s )
+#define EMIT_DATE( s, v )	llsd_xml_date( v, s )
+#define EMIT_UUID( s, v )	llsd_xml_uuid( v, s )
+#define EMIT_STRING( s, p, len )	llsd_xml_string( p, len, FALSE, s )
+#define EMIT_URI( s, p, len )	llsd_xml_uri( p, len, FALSE, s )
+#define EMIT_BINARY( s, p, len )	llsd_xml_binary( p, len, FALSE, s )
+#define EMIT_ARRAY_BEGIN( s, n )	llsd_xml_array_begin( n, s )
+#define EMIT_ARRAY_VALUE_BEGIN( s )	llsd_xml_array_value_begin( s )
+#define EMIT_ARRAY_VALUE_END( s )	TRUE
+#define EMIT_ARRAY_END( s, n )	llsd_xml_array_end( n, s )
+#define EMIT_MAP_BEGIN( s, n )	llsd_xml_map_begin( n, s )
+#define EMIT_MAP_KEY_BEGIN( s )	llsd_xml_map_key_begin( s )
+#define EMIT_MAP_KEY_END( s )	llsd_xml_map_key_end( s )
+#define EMIT_MAP_VALUE_BEGIN( s )	TRUE
+#define EMIT_MAP_VALUE_END( s )	TRUE
+#define EMIT_MAP_END( s, n )	llsd_xml_map_end( n, s )
+#include "llsd_walk.h"
+
+int llsd_xml_serializer_walk( llsd_t * const llsd, void * user_data )
+{
+	xs_state_t * state = (xs_state_t*)user_data;
+	CHECK_PTR_RET( llsd, FALSE );
+	CHECK_PTR_RET( state, FALSE );
+	return llsd_xml_walk( llsd, state );
+}
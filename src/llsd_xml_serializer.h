@@ -19,8 +19,9 @@
 
 #include "llsd_serializer.h"
 
-int llsd_xml_serializer_init( FILE * fout, llsd_ops_t * const ops, int const pretty, void ** const user_data );
-int llsd_xml_serializer_deinit( FILE * fout, void * user_data );
+int llsd_xml_serializer_init( llsd_buffer_t * const out, llsd_ops_t * const ops, int const pretty, void ** const user_data );
+int llsd_xml_serializer_deinit( llsd_buffer_t * const out, void * user_data );
+int llsd_xml_serializer_walk( llsd_t * const llsd, void * user_data );
 
 #endif/*LLSD_XML_SERIALIZER_H*/
 
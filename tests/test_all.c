@@ -33,9 +33,14 @@
 #include "test_flags.h"
 #include "test_macros.h"
 
+SUITE( arena );
 SUITE( base16 );
 SUITE( base64 );
 SUITE( base85 );
+SUITE( hash );
+SUITE( date );
+SUITE( number );
+SUITE( scan );
 SUITE( binary );
 SUITE( notation );
 SUITE( xml );
@@ -48,9 +53,14 @@ int main()
 		return CU_get_error();
 
 	/* add each suite of tests */
+	ADD_SUITE( arena );
 	ADD_SUITE( base16 );
 	ADD_SUITE( base64 );
 	ADD_SUITE( base85 );
+	ADD_SUITE( hash );
+	ADD_SUITE( date );
+	ADD_SUITE( number );
+	ADD_SUITE( scan );
 	ADD_SUITE( binary );
 	ADD_SUITE( notation );
 	ADD_SUITE( xml );
@@ -0,0 +1,211 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include <llsd.h>
+#include <llsd_arena.h>
+
+#include "test_macros.h"
+
+static int cleanup_order[4];
+static int cleanup_count;
+
+static int init_arena_suite( void )
+{
+	return 0;
+}
+
+static int deinit_arena_suite( void )
+{
+	return 0;
+}
+
+static void record_cleanup( void * p )
+{
+	cleanup_order[cleanup_count++] = (int)(intptr_t)p;
+}
+
+static void test_arena_alloc( void )
+{
+	int i;
+	uint8_t * p = NULL;
+	uint8_t * big = NULL;
+	llsd_arena_t * arena = NULL;
+
+	arena = llsd_arena_new( 1024 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( arena );
+
+	/* small allocations are aligned and spill into new blocks */
+	for ( i = 1; i < 200; i++ )
+	{
+		p = llsd_arena_alloc( arena, i );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( p );
+		CU_ASSERT_EQUAL( ((uintptr_t)p) % 16, 0 );
+		MEMSET( p, 0xAA, i );
+	}
+
+	/* a large allocation gets its own block */
+	big = llsd_arena_alloc( arena, 64 * 1024 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( big );
+	MEMSET( big, 0x55, 64 * 1024 );
+
+	/* copies are NUL terminated */
+	p = llsd_arena_memdup( arena, "hello", 5 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( p );
+	CU_ASSERT_EQUAL( STRCMP( p, "hello" ), 0 );
+
+	/* the arena is reusable after a reset */
+	llsd_arena_reset( arena );
+	p = llsd_arena_alloc( arena, 100 );
+	CU_ASSERT_PTR_NOT_NULL( p );
+
+	llsd_arena_delete( arena );
+}
+
+static void test_arena_cleanup( void )
+{
+	llsd_arena_t * arena = NULL;
+
+	arena = llsd_arena_new( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( arena );
+
+	/* cleanups run in reverse order on reset */
+	cleanup_count = 0;
+	CU_ASSERT_TRUE( llsd_arena_add_cleanup( arena, &record_cleanup, (void*)1 ) );
+	CU_ASSERT_TRUE( llsd_arena_add_cleanup( arena, &record_cleanup, (void*)2 ) );
+	CU_ASSERT_TRUE( llsd_arena_add_cleanup( arena, &record_cleanup, (void*)3 ) );
+	llsd_arena_reset( arena );
+	CU_ASSERT_EQUAL( cleanup_count, 3 );
+	CU_ASSERT_EQUAL( cleanup_order[0], 3 );
+	CU_ASSERT_EQUAL( cleanup_order[1], 2 );
+	CU_ASSERT_EQUAL( cleanup_order[2], 1 );
+
+	/* and only once */
+	llsd_arena_reset( arena );
+	CU_ASSERT_EQUAL( cleanup_count, 3 );
+
+	/* delete runs them too */
+	CU_ASSERT_TRUE( llsd_arena_add_cleanup( arena, &record_cleanup, (void*)4 ) );
+	llsd_arena_delete( arena );
+	CU_ASSERT_EQUAL( cleanup_count, 4 );
+	CU_ASSERT_EQUAL( cleanup_order[3], 4 );
+}
+
+static void test_arena_llsd( void )
+{
+	int i;
+	uint8_t * s = NULL;
+	uint8_t * owned = NULL;
+	uint8_t bits[UUID_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+	uint32_t len = 0;
+	llsd_arena_t * arena = NULL;
+	llsd_t * map = NULL;
+	llsd_t * arr = NULL;
+	llsd_t * v = NULL;
+
+	arena = llsd_arena_new( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( arena );
+
+	for ( i = 0; i < 2; i++ )
+	{
+		map = llsd_new_in( arena, LLSD_MAP, 0 );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( map );
+		arr = llsd_new_in( arena, LLSD_ARRAY, 0 );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( arr );
+
+		/* one of every type in the array */
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_UNDEF ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_BOOLEAN, TRUE ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_INTEGER, 42 ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_REAL, 3.5 ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_UUID, bits ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_STRING, "borrowed", LLSD_NUL_TERMINATED, FALSE ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_DATE, 1.0 ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_URI, "http://example.com", LLSD_NUL_TERMINATED, FALSE ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_BINARY, bits, UUID_LEN, FALSE ) ) );
+
+		/* heap data handed over with own_it is moved into the arena */
+		owned = strdup( "owned" );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( owned );
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_in( arena, LLSD_STRING, owned, LLSD_NUL_TERMINATED, TRUE ) ) );
+
+		/* a heap node put in an arena container is deleted with the arena */
+		CU_ASSERT_TRUE( llsd_array_append( arr, llsd_new_string( "heap", FALSE ) ) );
+
+		CU_ASSERT_TRUE( llsd_map_insert( map, llsd_new_in( arena, LLSD_STRING, "array", LLSD_NUL_TERMINATED, FALSE ), arr ) );
+		CU_ASSERT_TRUE( llsd_map_insert( map, llsd_new_in( arena, LLSD_STRING, "other", LLSD_NUL_TERMINATED, FALSE ), 
+										 llsd_new_in( arena, LLSD_INTEGER, 7 ) ) );
+		CU_ASSERT_EQUAL( llsd_get_count( arr ), 11 );
+		CU_ASSERT_EQUAL( llsd_get_count( map ), 2 );
+
+		/* look things back up */
+		CU_ASSERT_PTR_EQUAL( llsd_map_find( map, "array" ), arr );
+		v = llsd_map_find( map, "other" );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( v );
+		CU_ASSERT_EQUAL( llsd_get_type( v ), LLSD_INTEGER );
+
+		CU_ASSERT_TRUE( llsd_map_remove( map, llsd_new_in( arena, LLSD_STRING, "other", LLSD_NUL_TERMINATED, FALSE ) ) );
+		CU_ASSERT_EQUAL( llsd_get_count( map ), 1 );
+
+		/* deleting arena nodes is harmless */
+		llsd_delete( map );
+
+		llsd_arena_reset( arena );
+	}
+
+	/* values copied into the arena are intact */
+	arr = llsd_new_in( arena, LLSD_BINARY, bits, UUID_LEN, FALSE );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( arr );
+	CU_ASSERT_TRUE( llsd_as_binary( arr, &s, &len ) );
+	CU_ASSERT_EQUAL( len, UUID_LEN );
+	CU_ASSERT_EQUAL( MEMCMP( s, bits, UUID_LEN ), 0 );
+	CU_ASSERT_PTR_NOT_EQUAL( s, bits );
+
+	llsd_arena_delete( arena );
+}
+
+static CU_pSuite add_arena_tests( CU_pSuite pSuite )
+{
+	ADD_TEST( "arena allocation", test_arena_alloc );
+	ADD_TEST( "arena cleanups", test_arena_cleanup );
+	ADD_TEST( "llsd objects in an arena", test_arena_llsd );
+	return pSuite;
+}
+
+CU_pSuite add_arena_test_suite()
+{
+	CU_pSuite pSuite = NULL;
+
+	/* add the suite to the registry */
+	pSuite = CU_add_suite("Arena Tests", init_arena_suite, deinit_arena_suite);
+	CHECK_PTR_RET( pSuite, NULL );
+
+	/* add in arena specific tests */
+	CHECK_PTR_RET( add_arena_tests( pSuite ), NULL );
+
+	return pSuite;
+}
+
@@ -15,6 +15,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -29,6 +30,9 @@
 
 #include <llsd.h>
 #include <llsd_parser.h>
+#include <llsd_reader.h>
+#include <llsd_serializer.h>
+#include <llsd_stack.h>
 
 #include "test_macros.h"
 
@@ -93,8 +97,338 @@ static int deinit_binary_suite( void )
 	return 0;
 }
 
+static void test_embedded_nul_string( void )
+{
+	static uint8_t const str[] = { 'a', '\0', 'b', '\0', 'c' };
+	uint8_t * s = NULL;
+	uint32_t len = 0;
+	llsd_buffer_t out;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	llsd_out = llsd_new_string_len( (uint8_t*)str, sizeof(str), FALSE );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+	CU_ASSERT_EQUAL( llsd_get_count( llsd_out ), sizeof(str) );
+
+	/* the binary format is length prefixed so the nulls must survive */
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, FALSE ) );
+	llsd_in = llsd_parse_from_buffer( out.data, out.len );
+	llsd_buffer_deinitialize( &out );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+
+	CU_ASSERT_TRUE( llsd_as_binary( llsd_in, &s, &len ) );
+	CU_ASSERT_EQUAL( len, sizeof(str) );
+	CU_ASSERT_EQUAL( MEMCMP( s, str, sizeof(str) ), 0 );
+	CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+
+	llsd_delete( llsd_in );
+	llsd_delete( llsd_out );
+}
+
+static void test_short_string_boundary( void )
+{
+	static uint8_t const str[] = "0123456789abcdefghij";
+	uint32_t len;
+	uint8_t * s = NULL;
+	llsd_t * l = NULL;
+	llsd_t * r = NULL;
+
+	/* strings on either side of the inline storage limit */
+	for ( len = 0; len < sizeof(str); len++ )
+	{
+		l = llsd_new_string_len( (uint8_t*)str, len, FALSE );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( l );
+		s = CALLOC( len + 1, sizeof(uint8_t) );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( s );
+		MEMCPY( s, str, len );
+		r = llsd_new_string_len( s, len, TRUE );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( r );
+
+		CU_ASSERT_EQUAL( llsd_get_count( l ), len );
+		CU_ASSERT_TRUE( llsd_as_string( l, &s ) );
+		CU_ASSERT_EQUAL( MEMCMP( s, str, len ), 0 );
+		CU_ASSERT_EQUAL( s[len], '\0' );
+		CU_ASSERT_TRUE( llsd_equal( l, r ) );
+
+		llsd_delete( l );
+		llsd_delete( r );
+	}
+}
+
+static void test_empty_binary_equal( void )
+{
+	llsd_t * l = NULL;
+	llsd_t * r = NULL;
+
+	/* neither has a buffer */
+	l = llsd_new_binary( NULL, 0, LLSD_BORROW );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( l );
+	r = llsd_new_binary( NULL, 0, LLSD_BORROW );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( r );
+	CU_ASSERT_TRUE( llsd_equal( l, r ) );
+
+	llsd_delete( l );
+	llsd_delete( r );
+}
+
+static void test_borrowed_parse( void )
+{
+	/* long enough to not be stored inline */
+	static uint8_t const num[] = "000000000000000000001234";
+	static uint8_t const uri[] = "http://example.com/assets/manifest";
+	static uint8_t const key[] = "a key longer than inline storage";
+	static uint8_t const bin[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	int32_t i = 0;
+	uint8_t * s = NULL;
+	uint32_t len = 0;
+	uint8_t const * map = NULL;
+	size_t map_len = 0;
+	llsd_serializer_t fmt;
+	llsd_buffer_t out;
+	llsd_buffer_t l;
+	llsd_buffer_t r;
+	llsd_parse_opts_t opts;
+	llsd_itr_t itr;
+	llsd_t * v = NULL;
+	llsd_t * k = NULL;
+	llsd_t * m = NULL;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	/* [ num, true, uri, bin, { key: num } ], the true right after the number
+	 * string is a '1' byte that must not be read as part of the number */
+	llsd_out = llsd_new_array( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+	llsd_array_append( llsd_out, llsd_new_string( (uint8_t*)num, FALSE ) );
+	llsd_array_append( llsd_out, llsd_new_boolean( TRUE ) );
+	llsd_array_append( llsd_out, llsd_new_uri( (uint8_t*)uri, FALSE ) );
+	llsd_array_append( llsd_out, llsd_new_binary( (uint8_t*)bin, sizeof(bin) - 1, FALSE ) );
+	m = llsd_new_map( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( m );
+	llsd_map_insert( m, llsd_new_string( (uint8_t*)key, FALSE ), llsd_new_string( (uint8_t*)num, FALSE ) );
+	llsd_array_append( llsd_out, m );
+
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, FALSE ) );
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.borrow = TRUE;
+	llsd_in = llsd_parse_from_buffer_ex( out.data, out.len, &opts );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+	CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+
+	/* the string points into the buffer and still converts right */
+	itr = llsd_itr_begin( llsd_in );
+	CU_ASSERT_TRUE_FATAL( llsd_get( llsd_in, itr, &v, &k ) );
+	CU_ASSERT_TRUE( llsd_as_binary( v, &s, &len ) );
+	CU_ASSERT_EQUAL( len, sizeof(num) - 1 );
+	CU_ASSERT_TRUE( (s > out.data) && ((s + len) < (out.data + out.len)) );
+	CU_ASSERT_TRUE( llsd_as_integer( v, &i ) );
+	CU_ASSERT_EQUAL( i, 1234 );
+
+	/* but it isn't null terminated, so it can't be handed out as a string */
+	CU_ASSERT_FALSE( llsd_as_string( v, &s ) );
+
+	/* borrowed values serialize the same as copied ones in every format */
+	for ( fmt = LLSD_ENC_FIRST; fmt < LLSD_ENC_LAST; fmt++ )
+	{
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &l, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &r, NULL, 0 ) );
+		CU_ASSERT_TRUE( llsd_serialize_to_buffer( llsd_out, &l, fmt, FALSE ) );
+		CU_ASSERT_TRUE( llsd_serialize_to_buffer( llsd_in, &r, fmt, FALSE ) );
+		CU_ASSERT_EQUAL( l.len, r.len );
+		if ( l.len == r.len )
+			CU_ASSERT_EQUAL( MEMCMP( l.data, r.data, l.len ), 0 );
+		llsd_buffer_deinitialize( &l );
+		llsd_buffer_deinitialize( &r );
+	}
+	llsd_delete( llsd_in );
+
+	/* parse straight out of a mapped file */
+	tmpf = fopen( "test.llsd", "w+b" );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+	CU_ASSERT_EQUAL( fwrite( out.data, sizeof(uint8_t), out.len, tmpf ), out.len );
+	fflush( tmpf );
+	CU_ASSERT_TRUE_FATAL( llsd_map_file( tmpf, &map, &map_len ) );
+	CU_ASSERT_EQUAL( map_len, out.len );
+	llsd_in = llsd_parse_from_buffer_ex( map, map_len, &opts );
+	CU_ASSERT_PTR_NOT_NULL( llsd_in );
+	CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+	llsd_delete( llsd_in );
+	llsd_unmap_file( map, map_len );
+	fclose( tmpf );
+
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+}
+
+static void test_lazy_parse( void )
+{
+	/* { "a": 1, "b": { 5: 6 } }, the inner map has an integer for a key so it
+	 * only fails once something looks inside it */
+	static uint8_t const bad_[] = 
+	{
+		'<', '?', ' ', 'L', 'L', 'S', 'D', '/', 'B', 'i', 'n', 'a', 'r', 'y', ' ', '?', '>', '\n',
+		'{', 0x00, 0x00, 0x00, 0x02,
+			's', 0x00, 0x00, 0x00, 0x01, 'a', 'i', 0x00, 0x00, 0x00, 0x01,
+			's', 0x00, 0x00, 0x00, 0x01, 'b', '{', 0x00, 0x00, 0x00, 0x01,
+				'i', 0x00, 0x00, 0x00, 0x05, 'i', 0x00, 0x00, 0x00, 0x06,
+			'}',
+		'}'
+	};
+	static uint8_t const str[] = "a string too long to be stored inline";
+	int i;
+	int32_t n = 0;
+	uint8_t key[8];
+	llsd_buffer_t out;
+	llsd_buffer_t again;
+	llsd_parse_opts_t opts;
+	llsd_arena_t * arena = NULL;
+	llsd_t * m = NULL;
+	llsd_t * a = NULL;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.lazy = TRUE;
+
+	/* untouched subtrees are never parsed */
+	CU_ASSERT_PTR_NULL( llsd_parse_from_buffer( bad_, sizeof(bad_) ) );
+	llsd_in = llsd_parse_from_buffer_ex( bad_, sizeof(bad_), &opts );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+	CU_ASSERT_TRUE( llsd_as_integer( llsd_map_find( llsd_in, "a" ), &n ) );
+	CU_ASSERT_EQUAL( n, 1 );
+	CU_ASSERT_EQUAL( llsd_get_count( llsd_map_find( llsd_in, "b" ) ), 0 );
+	llsd_delete( llsd_in );
+
+	/* { "k0": [ str, 0, { "x": 0 } ], "k1": ... } */
+	llsd_out = llsd_new_map( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+	for ( i = 0; i < 16; i++ )
+	{
+		snprintf( key, sizeof(key), "k%d", i );
+		a = llsd_new_array( 0 );
+		llsd_array_append( a, llsd_new_string( (uint8_t*)str, FALSE ) );
+		llsd_array_append( a, llsd_new_integer( i ) );
+		m = llsd_new_map( 0 );
+		llsd_map_insert( m, llsd_new_string( "x", FALSE ), llsd_new_integer( i ) );
+		llsd_array_append( a, m );
+		llsd_map_insert( llsd_out, llsd_new_string( key, FALSE ), a );
+	}
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, FALSE ) );
+
+	/* on the heap and in an arena */
+	arena = llsd_arena_new( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( arena );
+	for ( i = 0; i < 2; i++ )
+	{
+		opts.arena = (i ? arena : NULL);
+		llsd_in = llsd_parse_from_buffer_ex( out.data, out.len, &opts );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+
+		/* reach into one subtree, then compare and write out the whole thing */
+		a = llsd_map_find( llsd_in, "k7" );
+		CU_ASSERT_EQUAL( llsd_get_count( a ), 3 );
+		CU_ASSERT_TRUE( llsd_equal( a, llsd_map_find( llsd_out, "k7" ) ) );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &again, NULL, 0 ) );
+		CU_ASSERT_TRUE( llsd_serialize_to_buffer( llsd_in, &again, format, FALSE ) );
+		CU_ASSERT_EQUAL( again.len, out.len );
+		llsd_buffer_deinitialize( &again );
+
+		llsd_delete( llsd_in );
+	}
+	llsd_arena_delete( arena );
+
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+}
+
+/* the push parser still builds the tree through the ops */
+static llsd_t * parse_with_ops( uint8_t const * const doc, size_t const len )
+{
+	llsd_t * llsd = NULL;
+	llsd_parser_t * p = NULL;
+	p = llsd_parser_new( NULL );
+	CHECK_PTR_RET( p, NULL );
+	if ( llsd_parser_feed( p, doc, len ) )
+		llsd = llsd_parser_finish( p );
+	llsd_parser_delete( p );
+	return llsd;
+}
+
+#define NUM_RECORDS (20000)
+
+static void test_tree_builder( void )
+{
+	int i;
+	llsd_t * doc = NULL;
+	llsd_t * rec = NULL;
+	llsd_t * tree = NULL;
+	llsd_t * ops = NULL;
+	llsd_buffer_t out;
+	static struct { char const * p; size_t len; } const bad[] =
+	{
+#define BAD( s ) { s, sizeof(s) - 1 }
+		BAD( "<? LLSD/Binary ?>\n[\x00\x00\x00\x01i\x00\x00\x00\x01}" ),		/* wrong end */
+		BAD( "<? LLSD/Binary ?>\n{\x00\x00\x00\x01s\x00\x00\x00\x01k}" ),		/* key without a value */
+		BAD( "<? LLSD/Binary ?>\n{\x00\x00\x00\x01i\x00\x00\x00\x01!}" ),		/* key that isn't a string */
+		BAD( "<? LLSD/Binary ?>\n[\x00\x00\x00\x01s\x00\x00\x00\x09" "abc]" ),	/* string past the end */
+		BAD( "<? LLSD/Binary ?>\n[\x00\x00\x00\x00" ),							/* never closed */
+		BAD( "<? LLSD/Binary ?>\n!!" ),											/* two values */
+		BAD( "<? LLSD/Binary ?>\n]" )											/* end of nothing */
+#undef BAD
+	};
+
+	/* a telemetry style document, an array of small maps */
+	doc = llsd_new_array( NUM_RECORDS );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( doc );
+	for ( i = 0; i < NUM_RECORDS; i++ )
+	{
+		rec = llsd_new_map( 4 );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( rec );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "id", FALSE ), llsd_new_integer( i ) ) );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "value", FALSE ), llsd_new_real( i * 0.25 ) ) );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "name", FALSE ), llsd_new_string( "a sensor with a longer name", FALSE ) ) );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "time", FALSE ), llsd_new_date( 1400000000.0 + i ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( doc, rec ) );
+	}
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( doc, &out, format, FALSE ) );
+
+	ops = parse_with_ops( out.data, out.len );
+	tree = llsd_parse_from_buffer( out.data, out.len );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( tree );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( ops );
+	CU_ASSERT_TRUE( llsd_equal( tree, doc ) );
+	CU_ASSERT_TRUE( llsd_equal( tree, ops ) );
+
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( tree );
+	llsd_delete( ops );
+	llsd_delete( doc );
+
+	/* bad documents fail */
+	for ( i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++ )
+	{
+		tree = llsd_parse_from_buffer( (uint8_t const *)bad[i].p, bad[i].len );
+		CU_ASSERT_PTR_NULL( tree );
+		if ( tree != NULL )
+			llsd_delete( tree );
+	}
+}
+
 static CU_pSuite add_binary_tests( CU_pSuite pSuite )
 {
+	ADD_TEST( "strings with embedded nulls", test_embedded_nul_string );
+	ADD_TEST( "strings around the inline size", test_short_string_boundary );
+	ADD_TEST( "empty binaries are equal", test_empty_binary_equal );
+	ADD_TEST( "parsing with borrowed strings", test_borrowed_parse );
+	ADD_TEST( "lazy parsing", test_lazy_parse );
+	ADD_TEST( "building the tree without the ops", test_tree_builder );
 	return pSuite;
 }
 
@@ -623,73 +623,1038 @@ static void test_random_serialize( void )
 	}
 }
 
-#if 0
-static void test_random_serialize_zero_copy( void )
+static void test_random_parse_from_buffer( void )
 {
-	ssize_t ret;
-	const uint32_t seed = 0xDEADBEEF;
-	const uint32_t size = 16384;
-	size_t s = 0;
-	struct iovec * iov;
+	int i;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	uint8_t * buf = NULL;
+	size_t len = 0;
 	llsd_t * llsd_out = NULL;
 	llsd_t * llsd_in = NULL;
 
-	/* get the initial heap size */
-	/*size_t heap_size = get_heap_size();*/
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
 
-	/* generate a repeatable, random llsd object */
-	llsd_out = get_random_llsd( size, seed );
+		tmpf = fopen( "test.llsd", "w+b" );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+
+		CU_ASSERT_TRUE( llsd_serialize_to_file( llsd_out, tmpf, format, TRUE ) );
+
+		/* read the serialized bytes back into memory */
+		rewind( tmpf );
+		CU_ASSERT_TRUE_FATAL( llsd_read_file( tmpf, &buf, &len ) );
+		fclose( tmpf );
+		tmpf = NULL;
+
+		/* parse straight from the buffer */
+		llsd_in = llsd_parse_from_buffer( buf, len );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		FREE( buf );
+		buf = NULL;
+
+		/* make sure the two llsd structures are equivilent */
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+		llsd_delete( llsd_in );
+		llsd_in = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+}
+
+static void test_random_parse_into_arena( void )
+{
+	int i;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	llsd_buffer_t out;
+	llsd_parse_opts_t opts;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.arena = llsd_arena_new( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( opts.arena );
+
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		/* parse it into the arena, the same arena is reused every time */
+		llsd_in = llsd_parse_from_buffer_ex( out.data, out.len, &opts );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+		llsd_buffer_deinitialize( &out );
+
+		/* drop the whole parsed document at once */
+		llsd_arena_reset( opts.arena );
+		llsd_in = NULL;
+
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+
+	llsd_arena_delete( opts.arena );
+}
+
+static void test_random_parse_with_intern( void )
+{
+	int i;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	llsd_buffer_t out;
+	llsd_parse_opts_t opts;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.intern = llsd_intern_new( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( opts.intern );
+
+	/* the same key always comes back as the same object */
+	CU_ASSERT_PTR_EQUAL( llsd_intern( opts.intern, "key", LLSD_NUL_TERMINATED ), 
+						 llsd_intern( opts.intern, "key", 3 ) );
+
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		/* parse it with the keys shared across every parse */
+		llsd_in = llsd_parse_from_buffer_ex( out.data, out.len, &opts );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+		llsd_buffer_deinitialize( &out );
+
+		llsd_delete( llsd_in );
+		llsd_in = NULL;
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+
+	llsd_intern_delete( opts.intern );
+}
+
+static void test_random_parse_with_ctx( void )
+{
+	int i;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	llsd_buffer_t out;
+	llsd_parse_ctx_t * ctx = NULL;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	ctx = llsd_parse_ctx_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL( ctx );
+
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		/* a document cut in half fails and leaves the context dirty */
+		if ( i == 6 )
+			CU_ASSERT_PTR_NULL( llsd_parse_ctx_from_buffer( ctx, out.data, out.len / 2, NULL ) );
+
+		/* the same context parses every document */
+		llsd_in = llsd_parse_ctx_from_buffer( ctx, out.data, out.len, NULL );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+		llsd_delete( llsd_in );
+		llsd_in = NULL;
+
+		/* and files, through the buffer it keeps */
+		tmpf = fopen( "test.llsd", "w+b" );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+		CU_ASSERT_TRUE( llsd_serialize_to_file( llsd_out, tmpf, format, TRUE ) );
+		rewind( tmpf );
+		llsd_in = llsd_parse_ctx_from_file( ctx, tmpf, NULL );
+		fclose( tmpf );
+		tmpf = NULL;
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+		llsd_delete( llsd_in );
+		llsd_in = NULL;
+
+		llsd_buffer_deinitialize( &out );
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+
+	llsd_parse_ctx_delete( ctx );
+}
+
+/* nests count arrays with an integer in the innermost */
+static llsd_t * get_nested_arrays( uint_t const count )
+{
+	uint_t i;
+	llsd_t * llsd = NULL;
+	llsd_t * inner = NULL;
+
+	llsd = llsd_new_integer( 42 );
+	for ( i = 0; (llsd != NULL) && (i < count); i++ )
+	{
+		inner = llsd;
+		llsd = llsd_new_array( 1 );
+		if ( (llsd == NULL) || !llsd_array_append( llsd, inner ) )
+		{
+			llsd_delete( inner );
+			if ( llsd != NULL )
+				llsd_delete( llsd );
+			return NULL;
+		}
+	}
+	return llsd;
+}
+
+static void test_nesting_depth( void )
+{
+	uint_t const depths[] = { 1, LLSD_STACK_INLINE, LLSD_STACK_INLINE + 1, LLSD_MAX_DEPTH };
+	uint_t i;
+	llsd_buffer_t out;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	/* the stacks spill over to the heap, up to the limit */
+	for ( i = 0; i < (sizeof(depths) / sizeof(depths[0])); i++ )
+	{
+		llsd_out = get_nested_arrays( depths[i] );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		llsd_in = llsd_parse_from_buffer( out.data, out.len );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+
+		llsd_delete( llsd_in );
+		llsd_buffer_deinitialize( &out );
+		llsd_delete( llsd_out );
+	}
+
+	/* and one past it is refused */
+	llsd_out = get_nested_arrays( LLSD_MAX_DEPTH + 1 );
 	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+	CU_ASSERT_PTR_NULL( llsd_parse_from_buffer( out.data, out.len ) );
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+}
 
-	tmpf = fopen( "testzc.llsd", "w+b" );
-	CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+static void test_random_parse_in_chunks( void )
+{
+	static size_t const chunk_sizes[] = { 1, 7, 4096 };
+	int i;
+	int c;
+	size_t off;
+	size_t n;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	llsd_buffer_t out;
+	llsd_parser_t * parser = NULL;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
 
-	/* get the zero copy list of iovec structs */
-	s = llsd_format_zero_copy( llsd_out, format, &iov, TRUE );
+	for ( i = 0; i < 8; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		for ( c = 0; c < (sizeof(chunk_sizes) / sizeof(chunk_sizes[0])); c++ )
+		{
+			/* feed it in pieces like it was coming off of a socket */
+			parser = llsd_parser_new( NULL );
+			CU_ASSERT_PTR_NOT_NULL_FATAL( parser );
+			for ( off = 0; off < out.len; off += n )
+			{
+				n = ((out.len - off) < chunk_sizes[c]) ? (out.len - off) : chunk_sizes[c];
+				CU_ASSERT_TRUE_FATAL( llsd_parser_feed( parser, out.data + off, n ) );
+			}
+			llsd_in = llsd_parser_finish( parser );
+			llsd_parser_delete( parser );
+			CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+			CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+			llsd_delete( llsd_in );
+			llsd_in = NULL;
+		}
+
+		/* a document that stops short must not parse */
+		parser = llsd_parser_new( NULL );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( parser );
+		llsd_parser_feed( parser, out.data, out.len / 2 );
+		CU_ASSERT_PTR_NULL( llsd_parser_finish( parser ) );
+		llsd_parser_delete( parser );
+
+		llsd_buffer_deinitialize( &out );
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+}
+
+typedef struct sax_counts_s
+{
+	uint_t containers;
+	uint_t integers;
+	uint_t strings;
+	int64_t sum;
+} sax_counts_t;
 
-	if ( format == LLSD_ENC_XML )
+static void count_llsd( llsd_t * llsd, sax_counts_t * const counts )
+{
+	llsd_itr_t itr;
+	llsd_t * k = NULL;
+	llsd_t * v = NULL;
+	int32_t i = 0;
+
+	switch ( llsd_get_type( llsd ) )
 	{
-		CU_ASSERT_EQUAL( s, 3 );
+		case LLSD_INTEGER:
+			llsd_as_integer( llsd, &i );
+			counts->integers++;
+			counts->sum += i;
+			break;
+		case LLSD_STRING:
+			counts->strings++;
+			break;
+		case LLSD_ARRAY:
+		case LLSD_MAP:
+			counts->containers++;
+			itr = llsd_itr_begin( llsd );
+			for ( ; !LLSD_ITR_EQ( itr, llsd_itr_end( llsd ) ); itr = llsd_itr_next( llsd, itr ) )
+			{
+				llsd_get( llsd, itr, &v, &k );
+				if ( k != NULL )
+					count_llsd( k, counts );
+				count_llsd( v, counts );
+			}
+			break;
+		default:
+			break;
 	}
-	else
+}
+
+static int_t sax_integer_fn( int32_t const value, void * const user_data )
+{
+	sax_counts_t * counts = (sax_counts_t*)user_data;
+	counts->integers++;
+	counts->sum += value;
+	return TRUE;
+}
+
+static int_t sax_string_fn( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
+{
+	sax_counts_t * counts = (sax_counts_t*)user_data;
+	counts->strings++;
+	if ( own_it )
+		FREE( (void*)str );
+	return TRUE;
+}
+
+/* asks for the value of every key named skip to be passed over */
+static int_t sax_skip_fn( uint8_t const * str, uint32_t const len, int const own_it, void * const user_data )
+{
+	int_t ret = TRUE;
+	sax_counts_t * counts = (sax_counts_t*)user_data;
+	counts->strings++;
+	if ( (len == 4) && (memcmp( str, "skip", 4 ) == 0) )
+		ret = LLSD_SKIP;
+	if ( own_it )
+		FREE( (void*)str );
+	return ret;
+}
+
+static int_t sax_container_fn( uint_t const size, void * const user_data )
+{
+	sax_counts_t * counts = (sax_counts_t*)user_data;
+	counts->containers++;
+	return TRUE;
+}
+
+static int_t sax_stop_fn( uint_t const size, void * const user_data )
+{
+	return FALSE;
+}
+
+static void test_random_parse_with_ops( void )
+{
+	int i;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	llsd_buffer_t out;
+	llsd_ops_t ops;
+	sax_counts_t expected;
+	sax_counts_t counts;
+	llsd_t * llsd_out = NULL;
+
+	/* only the callbacks we care about, the rest are skipped */
+	MEMSET( &ops, 0, sizeof(llsd_ops_t) );
+	ops.integer_fn = &sax_integer_fn;
+	ops.string_fn = &sax_string_fn;
+	ops.array_begin_fn = &sax_container_fn;
+	ops.map_begin_fn = &sax_container_fn;
+
+	for ( i = 0; i < 8; i++ )
 	{
-		/* use gather write to write to file */
-		ret = writev( fileno( tmpf ), iov, s );
-		if ( ret == -1 )
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		MEMSET( &expected, 0, sizeof(sax_counts_t) );
+		count_llsd( llsd_out, &expected );
+
+		/* the events must match the tree, by format and by autodetect */
+		MEMSET( &counts, 0, sizeof(sax_counts_t) );
+		CU_ASSERT_TRUE( llsd_parse_with_ops( out.data, out.len, format, &ops, &counts ) );
+		CU_ASSERT_EQUAL( counts.containers, expected.containers );
+		CU_ASSERT_EQUAL( counts.integers, expected.integers );
+		CU_ASSERT_EQUAL( counts.strings, expected.strings );
+		CU_ASSERT_EQUAL( counts.sum, expected.sum );
+
+		MEMSET( &counts, 0, sizeof(sax_counts_t) );
+		CU_ASSERT_TRUE( llsd_parse_with_ops( out.data, out.len, LLSD_ENC_AUTODETECT, &ops, &counts ) );
+		CU_ASSERT_EQUAL( counts.containers, expected.containers );
+		CU_ASSERT_EQUAL( counts.integers, expected.integers );
+		CU_ASSERT_EQUAL( counts.strings, expected.strings );
+		CU_ASSERT_EQUAL( counts.sum, expected.sum );
+
+		llsd_buffer_deinitialize( &out );
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+
+	/* a callback returning FALSE stops the parse */
+	llsd_out = get_random_llsd( 4, seed );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+	if ( llsd_is_array( llsd_out ) || llsd_is_map( llsd_out ) )
+	{
+		ops.array_begin_fn = &sax_stop_fn;
+		ops.map_begin_fn = &sax_stop_fn;
+		MEMSET( &counts, 0, sizeof(sax_counts_t) );
+		CU_ASSERT_FALSE( llsd_parse_with_ops( out.data, out.len, format, &ops, &counts ) );
+	}
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+}
+
+static void test_parse_with_ops_skip( void )
+{
+	llsd_buffer_t out;
+	llsd_ops_t ops;
+	sax_counts_t counts;
+	llsd_t * llsd_out = NULL;
+	llsd_t * skipped = NULL;
+	llsd_t * nested = NULL;
+
+	/* { skip: [ 1, 2, { a: 4 }, "s" ], keep: 8, also: { skip: 16, n: 32 } } */
+	llsd_out = llsd_new_map( 0 );
+	skipped = llsd_new_array( 0 );
+	llsd_array_append( skipped, llsd_new_integer( 1 ) );
+	llsd_array_append( skipped, llsd_new_integer( 2 ) );
+	nested = llsd_new_map( 0 );
+	llsd_map_insert( nested, llsd_new_string( "a", FALSE ), llsd_new_integer( 4 ) );
+	llsd_array_append( skipped, nested );
+	llsd_array_append( skipped, llsd_new_string( "s", FALSE ) );
+	llsd_map_insert( llsd_out, llsd_new_string( "skip", FALSE ), skipped );
+	llsd_map_insert( llsd_out, llsd_new_string( "keep", FALSE ), llsd_new_integer( 8 ) );
+	nested = llsd_new_map( 0 );
+	llsd_map_insert( nested, llsd_new_string( "skip", FALSE ), llsd_new_integer( 16 ) );
+	llsd_map_insert( nested, llsd_new_string( "n", FALSE ), llsd_new_integer( 32 ) );
+	llsd_map_insert( llsd_out, llsd_new_string( "also", FALSE ), nested );
+
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+	MEMSET( &ops, 0, sizeof(llsd_ops_t) );
+	ops.integer_fn = &sax_integer_fn;
+	ops.string_fn = &sax_skip_fn;
+	ops.array_begin_fn = &sax_container_fn;
+	ops.map_begin_fn = &sax_container_fn;
+
+	MEMSET( &counts, 0, sizeof(sax_counts_t) );
+	CU_ASSERT_TRUE( llsd_parse_with_ops( out.data, out.len, format, &ops, &counts ) );
+
+	/* nothing inside a skipped value reaches the ops */
+	CU_ASSERT_EQUAL( counts.sum, 40 );
+	CU_ASSERT_EQUAL( counts.integers, 2 );
+	CU_ASSERT_EQUAL( counts.strings, 5 );
+	CU_ASSERT_EQUAL( counts.containers, 2 );
+
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+}
+
+static void test_random_read_tokens( void )
+{
+	int i;
+	int depth;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	llsd_buffer_t out;
+	llsd_token_t token;
+	llsd_reader_t * r = NULL;
+	sax_counts_t expected;
+	sax_counts_t counts;
+	llsd_t * llsd_out = NULL;
+
+	for ( i = 0; i < 8; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		MEMSET( &expected, 0, sizeof(sax_counts_t) );
+		count_llsd( llsd_out, &expected );
+
+		/* xml can't be stepped through a token at a time */
+		if ( format == LLSD_ENC_XML )
 		{
-			perror(NULL);
-			fclose(tmpf);
-			tmpf = NULL;
+			CU_ASSERT_PTR_NULL( llsd_reader_new( out.data, out.len, LLSD_ENC_AUTODETECT ) );
+			CU_ASSERT_PTR_NULL( llsd_reader_new( out.data, out.len, format ) );
+			llsd_buffer_deinitialize( &out );
 			llsd_delete( llsd_out );
 			llsd_out = NULL;
-			return;
+			size <<= 1;
+			continue;
 		}
-		CU_ASSERT_NOT_EQUAL( ret, -1 );
-		fclose( tmpf );
-		tmpf = NULL;
 
-		tmpf = fopen( "testzc.llsd", "r+b" );
-		CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+		/* pull every token and count them like the tree */
+		r = llsd_reader_new( out.data, out.len, LLSD_ENC_AUTODETECT );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( r );
+		MEMSET( &counts, 0, sizeof(sax_counts_t) );
+		do
+		{
+			CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+			switch ( token.type )
+			{
+				case LLSD_TOKEN_INTEGER:
+					counts.integers++;
+					counts.sum += token.v.integer;
+					break;
+				case LLSD_TOKEN_STRING:
+				case LLSD_TOKEN_KEY:
+					counts.strings++;
+					break;
+				case LLSD_TOKEN_ARRAY_BEGIN:
+				case LLSD_TOKEN_MAP_BEGIN:
+					counts.containers++;
+					break;
+				default:
+					break;
+			}
+		} while ( token.type != LLSD_TOKEN_END );
+		llsd_reader_delete( r );
+		CU_ASSERT_EQUAL( counts.containers, expected.containers );
+		CU_ASSERT_EQUAL( counts.integers, expected.integers );
+		CU_ASSERT_EQUAL( counts.strings, expected.strings );
+		CU_ASSERT_EQUAL( counts.sum, expected.sum );
+
+		/* skip every value inside the top level container */
+		r = llsd_reader_new( out.data, out.len, format );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( r );
+		CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+		if ( token.type == LLSD_TOKEN_MAP_BEGIN )
+		{
+			for ( depth = 0; depth < llsd_get_count( llsd_out ); depth++ )
+			{
+				CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+				CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_KEY );
+				CU_ASSERT_TRUE_FATAL( llsd_reader_skip( r ) );
+			}
+			CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+			CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_MAP_END );
+		}
+		else if ( token.type == LLSD_TOKEN_ARRAY_BEGIN )
+		{
+			for ( depth = 0; depth < llsd_get_count( llsd_out ); depth++ )
+				CU_ASSERT_TRUE_FATAL( llsd_reader_skip( r ) );
+			CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+			CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_ARRAY_END );
+		}
+		CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+		CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_END );
+		llsd_reader_delete( r );
 
-		llsd_in = llsd_parse( tmpf );
-		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		/* a document that stops short must fail before the end */
+		r = llsd_reader_new( out.data, out.len / 2, format );
+		if ( r != NULL )
+		{
+			do
+			{
+				if ( !llsd_reader_next( r, &token ) )
+					break;
+			} while ( token.type != LLSD_TOKEN_END );
+			CU_ASSERT_NOT_EQUAL( token.type, LLSD_TOKEN_END );
+			llsd_reader_delete( r );
+		}
+
+		/* nothing may follow the top level value */
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+		r = llsd_reader_new( out.data, out.len, format );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( r );
+		do
+		{
+			if ( !llsd_reader_next( r, &token ) )
+				break;
+		} while ( token.type != LLSD_TOKEN_END );
+		CU_ASSERT_NOT_EQUAL( token.type, LLSD_TOKEN_END );
+		llsd_reader_delete( r );
+
+		llsd_buffer_deinitialize( &out );
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+}
+
+/* builds { region: { name, size }, agents: [ { position, name } x3 ], extra: ... }
+ * or, when trimmed, only what the paths in test_projection_parse keep */
+static llsd_t * get_projection_llsd( int const trimmed )
+{
+	int i;
+	llsd_t * root = llsd_new_map( 0 );
+	llsd_t * region = llsd_new_map( 0 );
+	llsd_t * agents = llsd_new_array( 0 );
+	llsd_t * agent = NULL;
+	llsd_t * pos = NULL;
+	llsd_t * extra = NULL;
+
+	llsd_map_insert( region, llsd_new_string( "name", FALSE ), llsd_new_string( "Ahern", FALSE ) );
+	if ( !trimmed )
+		llsd_map_insert( region, llsd_new_string( "size", FALSE ), llsd_new_integer( 256 ) );
+	llsd_map_insert( root, llsd_new_string( "region", FALSE ), region );
+
+	for ( i = 0; i < 3; i++ )
+	{
+		agent = llsd_new_map( 0 );
+		pos = llsd_new_array( 0 );
+		llsd_array_append( pos, llsd_new_real( (double)i ) );
+		llsd_array_append( pos, llsd_new_real( 128.0 ) );
+		llsd_map_insert( agent, llsd_new_string( "position", FALSE ), pos );
+		if ( !trimmed || (i == 1) )
+			llsd_map_insert( agent, llsd_new_string( "name", FALSE ), llsd_new_string( "agent", FALSE ) );
+		llsd_array_append( agents, agent );
+	}
+	llsd_map_insert( root, llsd_new_string( "agents", FALSE ), agents );
+
+	if ( !trimmed )
+	{
+		/* nested containers that get skipped whole */
+		extra = llsd_new_array( 0 );
+		llsd_array_append( extra, llsd_new_map( 0 ) );
+		llsd_array_append( extra, llsd_new_uri( "http://example.com/", FALSE ) );
+		llsd_array_append( extra, llsd_new_boolean( TRUE ) );
+		llsd_map_insert( root, llsd_new_string( "extra", FALSE ), extra );
+	}
+
+	return root;
+}
 
+static void test_projection_parse( void )
+{
+	uint8_t const * paths[] = 
+	{
+		(uint8_t const *)"region.name",
+		(uint8_t const *)"agents[*].position",
+		(uint8_t const *)"agents[1].name"
+	};
+	llsd_buffer_t out;
+	llsd_parse_opts_t opts;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+	llsd_t * expected = NULL;
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.projection = llsd_projection_new( paths, 3 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( opts.projection );
+
+	llsd_out = get_projection_llsd( FALSE );
+	expected = get_projection_llsd( TRUE );
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+	/* only the selected paths come back */
+	llsd_in = llsd_parse_from_buffer_ex( out.data, out.len, &opts );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+	CU_ASSERT_TRUE( llsd_equal( expected, llsd_in ) );
+	llsd_delete( llsd_in );
+
+	/* an empty path keeps everything */
+	llsd_projection_delete( (void*)opts.projection );
+	paths[0] = (uint8_t const *)"";
+	opts.projection = llsd_projection_new( paths, 1 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( opts.projection );
+	llsd_in = llsd_parse_from_buffer_ex( out.data, out.len, &opts );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+	CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
+	llsd_delete( llsd_in );
+
+	llsd_buffer_deinitialize( &out );
+	llsd_projection_delete( (void*)opts.projection );
+	llsd_delete( expected );
+	llsd_delete( llsd_out );
+}
+
+typedef struct records_s
+{
+	llsd_t * expected;
+	llsd_itr_t itr;
+	uint_t count;
+	uint_t stop;
+	int equal;
+} records_t;
+
+/* each record must match the next element of the array it came from */
+static int_t check_record( llsd_t * const record, uint_t const index, void * const user_data )
+{
+	records_t * r = (records_t*)user_data;
+	llsd_t * expected = NULL;
+	llsd_t * key = NULL;
+
+	if ( (index != r->count) || !llsd_get( r->expected, r->itr, &expected, &key ) || !llsd_equal( expected, record ) )
+		r->equal = FALSE;
+	r->itr = llsd_itr_next( r->expected, r->itr );
+	r->count++;
+
+	return ( r->count != r->stop );
+}
+
+static void test_random_parse_records( void )
+{
+	uint_t i;
+	uint_t const count = 8;
+	records_t r;
+	llsd_buffer_t out;
+	llsd_t * llsd_out = NULL;
+
+	/* a top level array of random records */
+	llsd_out = llsd_new_array( 0 );
+	for ( i = 0; i < count; i++ )
+	{
+		CU_ASSERT_TRUE_FATAL( llsd_array_append( llsd_out, get_random_llsd( 16, 0xDEADBEEF + i ) ) );
+	}
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+	MEMSET( &r, 0, sizeof(records_t) );
+	r.expected = llsd_out;
+	r.itr = llsd_itr_begin( llsd_out );
+	r.equal = TRUE;
+	CU_ASSERT_TRUE( llsd_parse_records_from_buffer( out.data, out.len, &check_record, &r ) );
+	CU_ASSERT_EQUAL( r.count, count );
+	CU_ASSERT_TRUE( r.equal );
+
+	/* same from a file */
+	tmpf = fopen( "test.llsd", "w+b" );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+	CU_ASSERT_EQUAL_FATAL( fwrite( out.data, sizeof(uint8_t), out.len, tmpf ), out.len );
+	fflush( tmpf );
+	rewind( tmpf );
+	r.count = 0;
+	r.itr = llsd_itr_begin( llsd_out );
+	CU_ASSERT_TRUE( llsd_parse_records_from_file( tmpf, &check_record, &r ) );
+	CU_ASSERT_EQUAL( r.count, count );
+	CU_ASSERT_TRUE( r.equal );
+	fclose( tmpf );
+	tmpf = NULL;
+
+	/* and from the middle of a file, after a header the caller read */
+	tmpf = fopen( "test.llsd", "w+b" );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+	CU_ASSERT_EQUAL_FATAL( fwrite( "header\n", sizeof(uint8_t), 7, tmpf ), 7 );
+	CU_ASSERT_EQUAL_FATAL( fwrite( out.data, sizeof(uint8_t), out.len, tmpf ), out.len );
+	fflush( tmpf );
+	rewind( tmpf );
+	CU_ASSERT_EQUAL_FATAL( fseek( tmpf, 7, SEEK_SET ), 0 );
+	r.count = 0;
+	r.itr = llsd_itr_begin( llsd_out );
+	CU_ASSERT_TRUE( llsd_parse_records_from_file( tmpf, &check_record, &r ) );
+	CU_ASSERT_EQUAL( r.count, count );
+	CU_ASSERT_TRUE( r.equal );
+	fclose( tmpf );
+	tmpf = NULL;
+
+	/* returning FALSE stops it */
+	r.count = 0;
+	r.itr = llsd_itr_begin( llsd_out );
+	r.stop = 3;
+	CU_ASSERT_FALSE( llsd_parse_records_from_buffer( out.data, out.len, &check_record, &r ) );
+	CU_ASSERT_EQUAL( r.count, 3 );
+	CU_ASSERT_TRUE( r.equal );
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+
+	/* the top level has to be an array */
+	llsd_out = llsd_new_map( 0 );
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+	CU_ASSERT_FALSE( llsd_parse_records_from_buffer( out.data, out.len, &check_record, &r ) );
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( llsd_out );
+}
+
+static void test_random_serialize_to_buffer( void )
+{
+	int i;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	uint8_t * buf = NULL;
+	size_t len = 0;
+	uint8_t small[16];
+	llsd_buffer_t out;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		/* serialize into a growable buffer */
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+		CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+
+		/* it must be byte for byte what goes to a file */
+		tmpf = fopen( "test.llsd", "w+b" );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+		CU_ASSERT_TRUE( llsd_serialize_to_file( llsd_out, tmpf, format, TRUE ) );
+		rewind( tmpf );
+		CU_ASSERT_TRUE_FATAL( llsd_read_file( tmpf, &buf, &len ) );
 		fclose( tmpf );
 		tmpf = NULL;
+		CU_ASSERT_EQUAL( len, out.len );
+		CU_ASSERT_EQUAL( MEMCMP( buf, out.data, len ), 0 );
+		FREE( buf );
+		buf = NULL;
 
-		/* make sure the two llsd structures are equivilent */
-		CU_ASSERT( llsd_equal( llsd_out, llsd_in ) );
-
+		/* and it must parse back into the same llsd */
+		llsd_in = llsd_parse_from_buffer( out.data, out.len );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+		CU_ASSERT_TRUE( llsd_equal( llsd_out, llsd_in ) );
 		llsd_delete( llsd_in );
 		llsd_in = NULL;
+
+		/* a caller supplied buffer that is big enough gets the same bytes */
+		buf = CALLOC( out.len, sizeof(uint8_t) );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( buf );
+		len = out.len;
+		llsd_buffer_deinitialize( &out );
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, buf, len ) );
+		CU_ASSERT_TRUE( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+		CU_ASSERT_EQUAL( out.len, len );
+		llsd_buffer_deinitialize( &out );
+		FREE( buf );
+		buf = NULL;
+
+		/* one that is too small must fail instead of overflowing */
+		CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, small, sizeof(small) ) );
+		CU_ASSERT_FALSE( llsd_serialize_to_buffer( llsd_out, &out, format, TRUE ) );
+		CU_ASSERT_TRUE( out.len <= sizeof(small) );
+		llsd_buffer_deinitialize( &out );
+
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
 	}
+}
+
+static void test_random_serialized_size( void )
+{
+	int i;
+	int pretty;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	size_t len = 0;
+	uint8_t * buf = NULL;
+	llsd_buffer_t out;
+	llsd_t * llsd_out = NULL;
+
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+		for ( pretty = FALSE; pretty <= TRUE; pretty++ )
+		{
+			len = llsd_serialized_size( llsd_out, format, pretty );
+			CU_ASSERT_NOT_EQUAL( len, 0 );
+
+			/* caller storage of exactly that size must hold the whole thing */
+			buf = MALLOC( len );
+			CU_ASSERT_PTR_NOT_NULL_FATAL( buf );
+			CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, buf, len ) );
+			CU_ASSERT_TRUE( llsd_serialize_to_buffer( llsd_out, &out, format, pretty ) );
+			CU_ASSERT_EQUAL( out.len, len );
+			llsd_buffer_deinitialize( &out );
+			FREE( buf );
+			buf = NULL;
+		}
 
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
+}
+
+#ifndef IOV_MAX
+#define IOV_MAX (1024)
+#endif
+
+static void test_random_serialize_zero_copy( void )
+{
+	ssize_t ret;
+	const uint32_t seed = 0xDEADBEEF;
+	const uint32_t size = 16384;
+	size_t i = 0;
+	size_t s = 0;
+	size_t n = 0;
+	size_t total = 0;
+	size_t written = 0;
+	struct iovec * iov = NULL;
+	llsd_t * llsd_out = NULL;
+	llsd_t * llsd_in = NULL;
+
+	/* generate a repeatable, random llsd object */
+	llsd_out = get_random_llsd( size, seed );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
+
+	tmpf = fopen( "testzc.llsd", "w+b" );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( tmpf );
+
+	/* get the zero copy list of iovec structs */
+	s = llsd_format_zero_copy( llsd_out, format, &iov, TRUE );
+	CU_ASSERT_NOT_EQUAL_FATAL( s, 0 );
+	for ( i = 0; i < s; i++ )
+		total += iov[i].iov_len;
+
+	/* use gather write to write to file, writev takes at most IOV_MAX at a time */
+	for ( i = 0; i < s; i += n )
+	{
+		n = ((s - i) < IOV_MAX) ? (s - i) : IOV_MAX;
+		ret = writev( fileno( tmpf ), &(iov[i]), n );
+		CU_ASSERT_NOT_EQUAL_FATAL( ret, -1 );
+		written += ret;
+	}
+	CU_ASSERT_EQUAL( written, total );
+	FREE( iov );
+	iov = NULL;
+
+	/* parse it back in */
+	rewind( tmpf );
+	llsd_in = llsd_parse_from_file( tmpf );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_in );
+
+	fclose( tmpf );
+	tmpf = NULL;
+
+	/* make sure the two llsd structures are equivilent */
+	CU_ASSERT( llsd_equal( llsd_out, llsd_in ) );
+
+	llsd_delete( llsd_in );
+	llsd_in = NULL;
 	llsd_delete( llsd_out );
 	llsd_out = NULL;
+}
+
+static void test_random_serialize_with_ops( void )
+{
+	int i;
+	int pretty;
+	uint32_t const seed = 0xDEADBEEF;
+	uint32_t size = 1;
+	void * user_data = NULL;
+	llsd_ops_t ops;
+	llsd_buffer_t walked;
+	llsd_buffer_t out;
+	llsd_t * llsd_out = NULL;
+
+	for ( i = 0; i < 12; i++ )
+	{
+		/* generate a repeatable, random llsd object */
+		llsd_out = get_random_llsd( size, seed );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd_out );
 
-	/*CU_ASSERT_EQUAL( heap_size, get_heap_size() );*/
+		for ( pretty = FALSE; pretty <= TRUE; pretty++ )
+		{
+			/* the format's own walker */
+			CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &walked, NULL, 0 ) );
+			CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( llsd_out, &walked, format, pretty ) );
+
+			/* the same emitters driven through the ops must match byte for byte */
+			CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+			CU_ASSERT_TRUE_FATAL( llsd_serializer_init( format, &out, &ops, pretty, &user_data ) );
+			CU_ASSERT_TRUE( llsd_serialize_with_ops( llsd_out, &ops, user_data ) );
+			CU_ASSERT_TRUE( llsd_serializer_deinit( format, &out, user_data ) );
+			CU_ASSERT_EQUAL( out.len, walked.len );
+			CU_ASSERT_EQUAL( MEMCMP( out.data, walked.data, walked.len ), 0 );
+
+			llsd_buffer_deinitialize( &out );
+			llsd_buffer_deinitialize( &walked );
+		}
+
+		llsd_delete( llsd_out );
+		llsd_out = NULL;
+
+		/* double the size */
+		size <<= 1;
+	}
 }
-#endif
 
 static CU_pSuite add_tests( CU_pSuite pSuite )
 {
@@ -698,11 +1663,21 @@ static CU_pSuite add_tests( CU_pSuite pSuite )
 	ADD_TEST( "new/delete of all types", test_newdel );
 	ADD_TEST( "serialization of all types", test_serialization );
 	ADD_TEST( "serialization of random llsd", test_random_serialize );
-#if 0
-	CHECK_PTR_RET( CU_add_test( pSuite, "zero copy serialization of random llsd", test_random_serialize_zero_copy), NULL );
-	if ( format != LLSD_ENC_XML )
-		CHECK_PTR_RET( CU_add_test( pSuite, "serialization of random llsd zero copy", test_random_serialize_zero_copy), NULL );
-#endif
+	ADD_TEST( "parsing of random llsd from a buffer", test_random_parse_from_buffer );
+	ADD_TEST( "parsing of random llsd into an arena", test_random_parse_into_arena );
+	ADD_TEST( "parsing of random llsd with interned keys", test_random_parse_with_intern );
+	ADD_TEST( "parsing of random llsd with a reused context", test_random_parse_with_ctx );
+	ADD_TEST( "parsing of deeply nested llsd", test_nesting_depth );
+	ADD_TEST( "parsing of random llsd fed in chunks", test_random_parse_in_chunks );
+	ADD_TEST( "streaming parse of random llsd with ops", test_random_parse_with_ops );
+	ADD_TEST( "streaming parse skipping values with ops", test_parse_with_ops_skip );
+	ADD_TEST( "pull reading of random llsd", test_random_read_tokens );
+	ADD_TEST( "projection parsing of selected paths", test_projection_parse );
+	ADD_TEST( "record streaming of a random top level array", test_random_parse_records );
+	ADD_TEST( "serialization of random llsd to a buffer", test_random_serialize_to_buffer );
+	ADD_TEST( "serialization of random llsd with ops", test_random_serialize_with_ops );
+	ADD_TEST( "serialized size of random llsd", test_random_serialized_size );
+	ADD_TEST( "zero copy serialization of random llsd", test_random_serialize_zero_copy );
 	return pSuite;
 }
 
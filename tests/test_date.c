@@ -0,0 +1,206 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <CUnit/Basic.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include <llsd.h>
+#include <llsd_date.h>
+
+#include "test_macros.h"
+
+#define DATE_ROUNDS (100000)
+#define NUM_DATES (200000)
+
+static int init_date_suite( void )
+{
+	return 0;
+}
+
+static int deinit_date_suite( void )
+{
+	return 0;
+}
+
+static int parse_date_str( char const * const s, double * const v )
+{
+	return llsd_date_parse( (uint8_t const *)s, strlen( s ), v );
+}
+
+/* random seconds between the years 0000 and 9999 */
+static int64_t random_seconds( void )
+{
+	int64_t r = ((int64_t)rand() << 31) ^ (int64_t)rand();
+	return (r % 315569520000LL) - 62167219200LL;
+}
+
+static void test_date_format( void )
+{
+	int i;
+	time_t t;
+	struct tm parts;
+	uint8_t buf[LLSD_DATE_STR_LEN];
+	char expected[64];
+
+	CU_ASSERT_EQUAL( llsd_date_format( 0.0, buf ), DATE_STR_LEN );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "1970-01-01T00:00:00.000Z" );
+	llsd_date_format( 1.5, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "1970-01-01T00:00:01.500Z" );
+	llsd_date_format( -0.25, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "1969-12-31T23:59:59.750Z" );
+	llsd_date_format( 951782400.0, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "2000-02-29T00:00:00.000Z" );
+
+	/* rounding carries all the way into the year */
+	llsd_date_format( 946684799.9996, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "2000-01-01T00:00:00.000Z" );
+
+	/* not representable */
+	CU_ASSERT_EQUAL( llsd_date_format( NAN, buf ), 0 );
+	CU_ASSERT_EQUAL( llsd_date_format( INFINITY, buf ), 0 );
+	CU_ASSERT_EQUAL( llsd_date_format( -62167219201.0, buf ), 0 );
+	CU_ASSERT_EQUAL( llsd_date_format( 253402300800.0, buf ), 0 );
+	CU_ASSERT_EQUAL( llsd_date_format( 253402300799.9999, buf ), 0 );
+	CU_ASSERT_EQUAL( llsd_date_format( 253402300799.999, buf ), DATE_STR_LEN );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "9999-12-31T23:59:59.999Z" );
+
+	/* agrees with the C library */
+	for ( i = 0; i < DATE_ROUNDS; i++ )
+	{
+		t = (time_t)random_seconds();
+		CU_ASSERT_PTR_NOT_NULL_FATAL( gmtime_r( &t, &parts ) );
+		snprintf( expected, sizeof(expected), "%04d-%02d-%02dT%02d:%02d:%02d.000Z",
+				  parts.tm_year + 1900, parts.tm_mon + 1, parts.tm_mday,
+				  parts.tm_hour, parts.tm_min, parts.tm_sec );
+		CU_ASSERT_EQUAL( llsd_date_format( (double)t, buf ), DATE_STR_LEN );
+		CU_ASSERT_STRING_EQUAL( (char const *)buf, expected );
+	}
+}
+
+static void test_date_parse( void )
+{
+	int i;
+	int64_t s;
+	double v;
+	uint8_t buf[LLSD_DATE_STR_LEN];
+
+	CU_ASSERT_TRUE( parse_date_str( "1970-01-01T00:00:01.000Z", &v ) );
+	CU_ASSERT_EQUAL( v, 1.0 );
+
+	/* the fraction is in seconds, not thousands of seconds */
+	CU_ASSERT_TRUE( parse_date_str( "1970-01-01T00:00:01.500Z", &v ) );
+	CU_ASSERT_EQUAL( v, 1.5 );
+	CU_ASSERT_TRUE( parse_date_str( "2006-02-01T14:29:53.43Z", &v ) );
+	CU_ASSERT_EQUAL( v, 1138804193.43 );
+	CU_ASSERT_TRUE( parse_date_str( "2006-02-01T14:29:53Z", &v ) );
+	CU_ASSERT_EQUAL( v, 1138804193.0 );
+	CU_ASSERT_TRUE( parse_date_str( "1969-12-31T23:59:59.750Z", &v ) );
+	CU_ASSERT_EQUAL( v, -0.25 );
+	CU_ASSERT_TRUE( parse_date_str( "2000-02-29T00:00:00.000Z", &v ) );
+	CU_ASSERT_EQUAL( v, 951782400.0 );
+
+	CU_ASSERT_FALSE( parse_date_str( "1900-02-29T00:00:00.000Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-13-01T00:00:00.000Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-04-31T00:00:00.000Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-04-30T24:00:00.000Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-04-30T00:00:00.000", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-04-30T00:00:00.Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-04-30T00:00:00.000Zx", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-4-30T00:00:00.000Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "2001-04-30 00:00:00.000Z", &v ) );
+	CU_ASSERT_FALSE( parse_date_str( "", &v ) );
+
+	/* round trips to the millisecond */
+	for ( i = 0; i < DATE_ROUNDS; i++ )
+	{
+		s = random_seconds();
+		CU_ASSERT_EQUAL( llsd_date_format( (double)s + 0.125, buf ), DATE_STR_LEN );
+		CU_ASSERT_TRUE( llsd_date_parse( buf, DATE_STR_LEN, &v ) );
+		CU_ASSERT_EQUAL( v, (double)s + 0.125 );
+	}
+}
+
+/* the sscanf/timegm path the text formats used to take */
+static int libc_date_parse( char const * const s, double * const v )
+{
+	int ms;
+	struct tm parts;
+	MEMSET( &parts, 0, sizeof(struct tm) );
+	CHECK_RET( sscanf( s, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", &parts.tm_year, &parts.tm_mon, &parts.tm_mday, &parts.tm_hour, &parts.tm_min, &parts.tm_sec, &ms ) == 7, FALSE );
+	parts.tm_year -= 1900;
+	parts.tm_mon -= 1;
+	(*v) = (double)timegm( &parts ) + ((double)ms / 1000.0);
+	return TRUE;
+}
+
+static void test_date_against_libc( void )
+{
+	int i;
+	double v, libc_v;
+	uint8_t out[LLSD_DATE_STR_LEN];
+	uint8_t * dates = NULL;
+
+	/* a telemetry sized batch of dates a few ms apart */
+	dates = CALLOC( NUM_DATES, LLSD_DATE_STR_LEN );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( dates );
+	for ( i = 0; i < NUM_DATES; i++ )
+		CU_ASSERT_EQUAL( llsd_date_format( 1400000000.0 + (i * 0.017), &dates[i * LLSD_DATE_STR_LEN] ), DATE_STR_LEN );
+
+	/* both parse to the same millisecond and the string comes back unchanged */
+	for ( i = 0; i < NUM_DATES; i++ )
+	{
+		CU_ASSERT_TRUE( libc_date_parse( (char const *)&dates[i * LLSD_DATE_STR_LEN], &libc_v ) );
+		CU_ASSERT_TRUE( llsd_date_parse( &dates[i * LLSD_DATE_STR_LEN], DATE_STR_LEN, &v ) );
+		CU_ASSERT_DOUBLE_EQUAL( v, libc_v, 0.0005 );
+		CU_ASSERT_EQUAL( llsd_date_format( v, out ), DATE_STR_LEN );
+		CU_ASSERT_EQUAL( MEMCMP( out, &dates[i * LLSD_DATE_STR_LEN], DATE_STR_LEN ), 0 );
+	}
+
+	FREE( dates );
+}
+
+static CU_pSuite add_date_tests( CU_pSuite pSuite )
+{
+	ADD_TEST( "date formatting", test_date_format );
+	ADD_TEST( "date parsing", test_date_parse );
+	ADD_TEST( "date codec agrees with libc", test_date_against_libc );
+	return pSuite;
+}
+
+CU_pSuite add_date_test_suite()
+{
+	CU_pSuite pSuite = NULL;
+
+	/* add the suite to the registry */
+	pSuite = CU_add_suite("Date Tests", init_date_suite, deinit_date_suite);
+	CHECK_PTR_RET( pSuite, NULL );
+
+	/* add in date specific tests */
+	CHECK_PTR_RET( add_date_tests( pSuite ), NULL );
+
+	return pSuite;
+}
+
@@ -0,0 +1,199 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include <llsd.h>
+#include <llsd_hash.h>
+
+#include "test_macros.h"
+
+#define PREFIX_LEN (128)
+#define NUM_KEYS (20000)
+
+static int init_hash_suite( void )
+{
+	return 0;
+}
+
+static int deinit_hash_suite( void )
+{
+	return 0;
+}
+
+static int cmp_hash32( void const * a, void const * b )
+{
+	uint32_t const l = *(uint32_t const *)a;
+	uint32_t const r = *(uint32_t const *)b;
+	return (l > r) - (l < r);
+}
+
+static void test_hash_full_length( void )
+{
+	static uint8_t const key1[LLSD_HASH_KEY_LEN] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	static uint8_t const key2[LLSD_HASH_KEY_LEN] = { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+	static uint8_t const zero[LLSD_HASH_KEY_LEN] = { 0 };
+	static uint8_t const msg[] = "0123456789abcdef_xyz";
+	uint8_t a[PREFIX_LEN + 8];
+	uint8_t b[PREFIX_LEN + 8];
+
+	/* the SipHash-1-3 reference vector, key 00..0f and an empty message */
+	CU_ASSERT_EQUAL( llsd_hash_keyed( key1, NULL, 0 ), 0xabac0158050fc4dcULL );
+
+	/* a message with full words and a tail, checked against CPython's
+	 * siphash13 run with a zero key (PYTHONHASHSEED=0) */
+	CU_ASSERT_EQUAL( llsd_hash_keyed( zero, msg, sizeof(msg) - 1 ), 9106955042406798597ULL );
+
+	MEMSET( a, 'x', sizeof(a) );
+	MEMSET( b, 'x', sizeof(b) );
+	b[sizeof(b) - 1] = 'y';
+
+	/* same bytes, same hash */
+	CU_ASSERT_EQUAL( llsd_hash( a, sizeof(a) ), llsd_hash( a, sizeof(a) ) );
+
+	/* the last byte and the length both matter */
+	CU_ASSERT_NOT_EQUAL( llsd_hash( a, sizeof(a) ), llsd_hash( b, sizeof(b) ) );
+	CU_ASSERT_NOT_EQUAL( llsd_hash( a, sizeof(a) ), llsd_hash( a, sizeof(a) - 1 ) );
+
+	/* a different key gives different hashes */
+	CU_ASSERT_NOT_EQUAL( llsd_hash_keyed( key1, a, sizeof(a) ), llsd_hash_keyed( key2, a, sizeof(a) ) );
+}
+
+#define NUM_BUCKETS (1024)
+static void test_hash_shared_prefix_inserts( void )
+{
+	int i;
+	uint_t collisions = 0;
+	uint_t max_load = 0;
+	uint8_t key[PREFIX_LEN + 16];
+	uint32_t * hashes = NULL;
+	uint_t * buckets = NULL;
+	llsd_t * map = NULL;
+	llsd_t * k = NULL;
+
+	hashes = CALLOC( NUM_KEYS, sizeof(uint32_t) );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( hashes );
+	buckets = CALLOC( NUM_BUCKETS, sizeof(uint_t) );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( buckets );
+	map = llsd_new_map( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( map );
+
+	/* the worst case for a prefix hash, every key shares a long prefix */
+	MEMSET( key, 'k', PREFIX_LEN );
+	for ( i = 0; i < NUM_KEYS; i++ )
+	{
+		snprintf( (char*)&key[PREFIX_LEN], 16, "%d", i );
+		hashes[i] = (uint32_t)llsd_hash( key, strlen( (char*)key ) );
+		buckets[hashes[i] % NUM_BUCKETS]++;
+		k = llsd_new_string( key, FALSE );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( k );
+		CU_ASSERT_TRUE_FATAL( llsd_map_insert( map, k, llsd_new_integer( i ) ) );
+	}
+
+	/* the 32 bits a map keeps should almost never collide, about 0.05 are
+	 * expected for this many keys and the key changes every run */
+	qsort( hashes, NUM_KEYS, sizeof(uint32_t), &cmp_hash32 );
+	for ( i = 1; i < NUM_KEYS; i++ )
+	{
+		if ( hashes[i] == hashes[i - 1] )
+			collisions++;
+	}
+	CU_ASSERT_TRUE( collisions <= 3 );
+
+	/* and the keys spread evenly, about 20 per bucket and the fullest one
+	 * nowhere near three times that */
+	for ( i = 0; i < NUM_BUCKETS; i++ )
+	{
+		if ( buckets[i] > max_load )
+			max_load = buckets[i];
+	}
+	CU_ASSERT_TRUE( max_load < (3 * NUM_KEYS / NUM_BUCKETS) );
+
+	CU_ASSERT_EQUAL( llsd_get_count( map ), NUM_KEYS );
+	snprintf( (char*)&key[PREFIX_LEN], 16, "%d", NUM_KEYS - 1 );
+	CU_ASSERT_PTR_NOT_NULL( llsd_map_find( map, key ) );
+	snprintf( (char*)&key[PREFIX_LEN], 16, "%d", NUM_KEYS );
+	CU_ASSERT_PTR_NULL( llsd_map_find( map, key ) );
+
+	llsd_delete( map );
+	FREE( buckets );
+	FREE( hashes );
+}
+
+static void test_map_find_by_key( void )
+{
+	static uint8_t const nul_key[] = { 'a', '\0', 'b' };
+	llsd_key_t agent_id;
+	llsd_key_t position;
+	llsd_key_t missing;
+	llsd_t * map = NULL;
+	llsd_t * v = NULL;
+
+	map = llsd_new_map( 0 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( map );
+	CU_ASSERT_TRUE_FATAL( llsd_map_insert( map, llsd_new_string( "agent_id", FALSE ), llsd_new_integer( 1 ) ) );
+	CU_ASSERT_TRUE_FATAL( llsd_map_insert( map, llsd_new_string( "position", FALSE ), llsd_new_integer( 2 ) ) );
+	CU_ASSERT_TRUE_FATAL( llsd_map_insert( map, llsd_new_string_len( (uint8_t*)nul_key, sizeof(nul_key), FALSE ), llsd_new_integer( 3 ) ) );
+
+	/* lookups by pointer and length don't need a null terminator */
+	v = llsd_map_find_len( map, "agent_id_and_more", 8 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( v );
+	CU_ASSERT_EQUAL( llsd_get_type( v ), LLSD_INTEGER );
+	CU_ASSERT_PTR_NOT_NULL( llsd_map_find_len( map, nul_key, sizeof(nul_key) ) );
+	CU_ASSERT_PTR_NULL( llsd_map_find_len( map, nul_key, 1 ) );
+
+	/* precomputed keys */
+	CU_ASSERT_TRUE_FATAL( llsd_key_initialize( &agent_id, "agent_id", LLSD_NUL_TERMINATED ) );
+	CU_ASSERT_TRUE_FATAL( llsd_key_initialize( &position, "position", 8 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_key_initialize( &missing, "velocity", LLSD_NUL_TERMINATED ) );
+	CU_ASSERT_PTR_EQUAL( llsd_map_find_key( map, &agent_id ), v );
+	CU_ASSERT_PTR_EQUAL( llsd_map_find_key( map, &position ), llsd_map_find( map, "position" ) );
+	CU_ASSERT_PTR_NULL( llsd_map_find_key( map, &missing ) );
+
+	llsd_delete( map );
+}
+
+static CU_pSuite add_hash_tests( CU_pSuite pSuite )
+{
+	ADD_TEST( "hashing is keyed and covers the full length", test_hash_full_length );
+	ADD_TEST( "keys with a shared prefix spread across buckets", test_hash_shared_prefix_inserts );
+	ADD_TEST( "map lookups by length and by precomputed key", test_map_find_by_key );
+	return pSuite;
+}
+
+CU_pSuite add_hash_test_suite()
+{
+	CU_pSuite pSuite = NULL;
+
+	/* add the suite to the registry */
+	pSuite = CU_add_suite("Hash Tests", init_hash_suite, deinit_hash_suite);
+	CHECK_PTR_RET( pSuite, NULL );
+
+	/* add in hash specific tests */
+	CHECK_PTR_RET( add_hash_tests( pSuite ), NULL );
+
+	return pSuite;
+}
+
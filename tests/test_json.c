@@ -15,6 +15,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -29,6 +30,9 @@
 
 #include <llsd.h>
 #include <llsd_parser.h>
+#include <llsd_reader.h>
+#include <llsd_serializer.h>
+#include <llsd_stack.h>
 
 #include "test_macros.h"
 
@@ -40,7 +44,7 @@ static size_t expected_sizes[ LLSD_TYPE_COUNT ] =
 	4,		/* LLSD_UNDEF	*/
 	4,		/* LLSD_BOOLEAN */
 	1,		/* LLSD_INTEGER */
-	8,		/* LLSD_REAL	*/
+	3,		/* LLSD_REAL	*/
 	38,		/* LLSD_UUID	*/
 	14,		/* LLSD_STRING	*/
 	26,		/* LLSD_DATE	*/
@@ -53,7 +57,7 @@ static size_t expected_sizes[ LLSD_TYPE_COUNT ] =
 static uint8_t const undef_[] = "null";
 static uint8_t const boolean_[] = "true";
 static uint8_t const integer_[] = "1";
-static uint8_t const real_[] = "1.000000";
+static uint8_t const real_[] = "1.0";
 static uint8_t const uuid_[] = "\"01020304-0506-0708-0900-010203040506\"";
 static uint8_t const string_[] = "\"Hello World!\"";
 static uint8_t const date_[] = "\"1970-01-01T00:00:01.000Z\"";
@@ -91,8 +95,115 @@ static int deinit_json_suite( void )
 	return 0;
 }
 
+static void test_quoted_strings( void )
+{
+	size_t i;
+	uint8_t * str = NULL;
+	uint8_t buf[128];
+	llsd_t * llsd = NULL;
+
+	/* escaped quotes and backslashes land at every offset of a vector */
+	for ( i = 0; i < 40; i++ )
+	{
+		MEMSET( buf, 0, sizeof(buf) );
+		buf[0] = '\"';
+		MEMSET( &buf[1], 'a', i );
+		MEMCPY( &buf[1 + i], "\\\"b\\\\c\"", 7 );
+
+		llsd = llsd_parse_from_buffer( buf, i + 8 );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd );
+		CU_ASSERT_EQUAL( llsd_get_type( llsd ), LLSD_STRING );
+		CU_ASSERT_TRUE( llsd_as_string( llsd, &str ) );
+		CU_ASSERT_EQUAL( strlen( (char*)str ), i + 4 );
+		CU_ASSERT_EQUAL( memcmp( str + i, "\"b\\c", 4 ), 0 );
+		llsd_delete( llsd );
+	}
+
+	/* an escaped closing quote leaves the string open */
+	CU_ASSERT_PTR_NULL( llsd_parse_from_buffer( (uint8_t const *)"[\"abc\\\"]", 8 ) );
+}
+
+static void test_reader_strings( void )
+{
+	static uint8_t const doc[] = "{\"a\":\"plain\", \"skip\":[1,{\"x\":2}], \"b\":\"e\\\"q\"}";
+	size_t const len = sizeof(doc) - 1;
+	llsd_token_t token;
+	llsd_reader_t * r = NULL;
+
+	r = llsd_reader_new( doc, len, format );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( r );
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_MAP_BEGIN );
+
+	/* keys and strings without escapes point into the document */
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_KEY );
+	CU_ASSERT_PTR_EQUAL( token.v.str.ptr, &doc[2] );
+	CU_ASSERT_EQUAL( token.v.str.len, 1 );
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_STRING );
+	CU_ASSERT_PTR_EQUAL( token.v.str.ptr, &doc[6] );
+	CU_ASSERT_EQUAL( token.v.str.len, 5 );
+
+	/* the array is passed over whole */
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_KEY );
+	CU_ASSERT_TRUE_FATAL( llsd_reader_skip( r ) );
+
+	/* an escaped string is decoded by the reader */
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_KEY );
+	CU_ASSERT_EQUAL( memcmp( token.v.str.ptr, "b", 1 ), 0 );
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_STRING );
+	CU_ASSERT_EQUAL( token.v.str.len, 3 );
+	CU_ASSERT_EQUAL( memcmp( token.v.str.ptr, "e\"q", 3 ), 0 );
+	CU_ASSERT_TRUE( (token.v.str.ptr < doc) || (token.v.str.ptr >= (doc + len)) );
+
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_MAP_END );
+	CU_ASSERT_TRUE_FATAL( llsd_reader_next( r, &token ) );
+	CU_ASSERT_EQUAL( token.type, LLSD_TOKEN_END );
+	llsd_reader_delete( r );
+}
+
+static void test_projection_rejects( void )
+{
+	size_t i;
+	uint8_t const * path = (uint8_t const *)"region";
+	uint8_t const * const docs[] =
+	{
+		(uint8_t const *)"{\"agents\":[1,}2],\"region\":1}",
+		(uint8_t const *)"{\"agents\":{\"a\":1],\"region\":1}",
+		(uint8_t const *)"{\"agents\":[1 2],\"region\":1}",
+		(uint8_t const *)"{\"agents\":[1,],\"region\":1}",
+		(uint8_t const *)"{\"agents\":{\"a\" 1},\"region\":1}",
+		(uint8_t const *)"{\"agents\":{1:2},\"region\":1}",
+		(uint8_t const *)"{\"agents\":nul,\"region\":1}",
+		(uint8_t const *)"{\"agents\":trux,\"region\":1}",
+		(uint8_t const *)"{\"agents\":-x,\"region\":1}"
+	};
+	llsd_parse_opts_t opts;
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.projection = llsd_projection_new( &path, 1 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( opts.projection );
+
+	/* a skipped value is held to the same grammar as a parsed one */
+	for ( i = 0; i < (sizeof(docs) / sizeof(docs[0])); i++ )
+	{
+		CU_ASSERT_PTR_NULL( llsd_parse_from_buffer( docs[i], strlen( (char const *)docs[i] ) ) );
+		CU_ASSERT_PTR_NULL( llsd_parse_from_buffer_ex( docs[i], strlen( (char const *)docs[i] ), &opts ) );
+	}
+
+	llsd_projection_delete( (void*)opts.projection );
+}
+
 static CU_pSuite add_json_tests( CU_pSuite pSuite )
 {
+	ADD_TEST( "quoted strings with escapes", test_quoted_strings );
+	ADD_TEST( "pull reading of borrowed and decoded strings", test_reader_strings );
+	ADD_TEST( "projection rejecting bad skipped values", test_projection_rejects );
 	return pSuite;
 }
 
@@ -15,6 +15,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -29,6 +30,9 @@
 
 #include <llsd.h>
 #include <llsd_parser.h>
+#include <llsd_reader.h>
+#include <llsd_serializer.h>
+#include <llsd_stack.h>
 
 #include "test_macros.h"
 
@@ -42,7 +46,7 @@ static size_t expected_sizes[ LLSD_TYPE_COUNT ] =
 	1,		/* LLSD_UNDEF	*/
 	1,		/* LLSD_BOOLEAN */
 	2,		/* LLSD_INTEGER */
-	9,		/* LLSD_REAL	*/
+	4,		/* LLSD_REAL	*/
 	37,		/* LLSD_UUID	*/
 	19,		/* LLSD_STRING	*/
 	27,		/* LLSD_DATE	*/
@@ -55,7 +59,7 @@ static size_t expected_sizes[ LLSD_TYPE_COUNT ] =
 static uint8_t const undef_[] = "!";
 static uint8_t const boolean_[] = "1";
 static uint8_t const integer_[] = "i1";
-static uint8_t const real_[] = "r1.000000";
+static uint8_t const real_[] = "r1.0";
 static uint8_t const uuid_[] = "u01020304-0506-0708-0900-010203040506";
 static uint8_t const string_[] = "s(12)\"Hello World!\"";
 static uint8_t const date_[] = "d\"1970-01-01T00:00:01.000Z\"";
@@ -93,8 +97,41 @@ static int deinit_notation_suite( void )
 	return 0;
 }
 
+static void test_projection_rejects( void )
+{
+	size_t i;
+	uint8_t const * path = (uint8_t const *)"region";
+	uint8_t const * const docs[] =
+	{
+		(uint8_t const *)"{'agents':[i1,}i2],'region':i1}",
+		(uint8_t const *)"{'agents':{'a':i1],'region':i1}",
+		(uint8_t const *)"{'agents':[i1 i2],'region':i1}",
+		(uint8_t const *)"{'agents':{'a' i1},'region':i1}",
+		(uint8_t const *)"{'agents':{i1:i2},'region':i1}",
+		(uint8_t const *)"{'agents':ix,'region':i1}",
+		(uint8_t const *)"{'agents':u0102,'region':i1}",
+		(uint8_t const *)"{'agents':d\"nope\",'region':i1}",
+		(uint8_t const *)"{'agents':x,'region':i1}"
+	};
+	llsd_parse_opts_t opts;
+
+	MEMSET( &opts, 0, sizeof(llsd_parse_opts_t) );
+	opts.projection = llsd_projection_new( &path, 1 );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( opts.projection );
+
+	/* a skipped value is held to the same grammar as a parsed one */
+	for ( i = 0; i < (sizeof(docs) / sizeof(docs[0])); i++ )
+	{
+		CU_ASSERT_PTR_NULL( llsd_parse_from_buffer( docs[i], strlen( (char const *)docs[i] ) ) );
+		CU_ASSERT_PTR_NULL( llsd_parse_from_buffer_ex( docs[i], strlen( (char const *)docs[i] ), &opts ) );
+	}
+
+	llsd_projection_delete( (void*)opts.projection );
+}
+
 static CU_pSuite add_notation_tests( CU_pSuite pSuite )
 {
+	ADD_TEST( "projection rejecting bad skipped values", test_projection_rejects );
 	return pSuite;
 }
 
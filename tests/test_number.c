@@ -0,0 +1,215 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include <llsd.h>
+#include <llsd_number.h>
+
+#include "test_macros.h"
+
+#define NUMBER_ROUNDS (100000)
+
+static int init_number_suite( void )
+{
+	return 0;
+}
+
+static int deinit_number_suite( void )
+{
+	return 0;
+}
+
+static int parse_integer_str( char const * const s, int32_t * const v )
+{
+	uint8_t const * p = (uint8_t const *)s;
+	uint8_t const * const end = p + strlen( s );
+	return llsd_number_parse_integer( &p, end, v ) && (p == end);
+}
+
+static int parse_real_str( char const * const s, double * const v )
+{
+	uint8_t const * p = (uint8_t const *)s;
+	uint8_t const * const end = p + strlen( s );
+	return llsd_number_parse_real( &p, end, v ) && (p == end);
+}
+
+static void test_number_integer( void )
+{
+	int i;
+	int32_t v, iv;
+	uint8_t buf[LLSD_NUMBER_STR_LEN];
+	static int32_t const edges[] = { 0, 1, -1, 9, 10, -10, INT32_MAX, INT32_MIN };
+
+	CU_ASSERT_TRUE( parse_integer_str( "2147483647", &v ) );
+	CU_ASSERT_EQUAL( v, INT32_MAX );
+	CU_ASSERT_TRUE( parse_integer_str( "-2147483648", &v ) );
+	CU_ASSERT_EQUAL( v, INT32_MIN );
+	CU_ASSERT_TRUE( parse_integer_str( "+007", &v ) );
+	CU_ASSERT_EQUAL( v, 7 );
+
+	/* out of range or no digits */
+	CU_ASSERT_FALSE( parse_integer_str( "2147483648", &v ) );
+	CU_ASSERT_FALSE( parse_integer_str( "-2147483649", &v ) );
+	CU_ASSERT_FALSE( parse_integer_str( "99999999999999999999", &v ) );
+	CU_ASSERT_FALSE( parse_integer_str( "-", &v ) );
+	CU_ASSERT_FALSE( parse_integer_str( "", &v ) );
+
+	for ( i = 0; i < (int)(sizeof(edges) / sizeof(edges[0])); i++ )
+	{
+		llsd_number_format_integer( edges[i], buf );
+		CU_ASSERT_TRUE( parse_integer_str( (char const *)buf, &v ) );
+		CU_ASSERT_EQUAL( v, edges[i] );
+	}
+
+	for ( i = 0; i < NUMBER_ROUNDS; i++ )
+	{
+		iv = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+		CU_ASSERT_EQUAL( llsd_number_format_integer( iv, buf ), strlen( (char const *)buf ) );
+		CU_ASSERT_TRUE( parse_integer_str( (char const *)buf, &v ) );
+		CU_ASSERT_EQUAL( v, iv );
+	}
+}
+
+static void test_number_real_format( void )
+{
+	int i;
+	uint8_t buf[LLSD_NUMBER_STR_LEN];
+	static struct { double d; char const * s; } const cases[] =
+	{
+		{ 0.0, "0.0" },
+		{ -0.0, "-0.0" },
+		{ 1.0, "1.0" },
+		{ -2.5, "-2.5" },
+		{ 0.1, "0.1" },
+		{ 0.3, "0.3" },
+		{ 0.0001, "0.0001" },
+		{ 0.00001, "1e-5" },
+		{ 123456.789, "123456.789" },
+		{ 1e15, "1000000000000000.0" },
+		{ 1e16, "1e+16" },
+		{ 5e-324, "5e-324" },
+		{ DBL_MAX, "1.7976931348623157e+308" },
+		{ DBL_MIN, "2.2250738585072014e-308" }
+	};
+
+	for ( i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++ )
+	{
+		CU_ASSERT_EQUAL( llsd_number_format_real( cases[i].d, buf ), strlen( cases[i].s ) );
+		CU_ASSERT_STRING_EQUAL( (char const *)buf, cases[i].s );
+	}
+
+	llsd_number_format_real( NAN, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "NAN" );
+	llsd_number_format_real( INFINITY, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "INF" );
+	llsd_number_format_real( -INFINITY, buf );
+	CU_ASSERT_STRING_EQUAL( (char const *)buf, "-INF" );
+}
+
+static void test_number_real_parse( void )
+{
+	double v;
+
+	CU_ASSERT_TRUE( parse_real_str( "1", &v ) );
+	CU_ASSERT_EQUAL( v, 1.0 );
+	CU_ASSERT_TRUE( parse_real_str( "-1.5e3", &v ) );
+	CU_ASSERT_EQUAL( v, -1500.0 );
+	CU_ASSERT_TRUE( parse_real_str( "+.5E-1", &v ) );
+	CU_ASSERT_EQUAL( v, 0.05 );
+	CU_ASSERT_TRUE( parse_real_str( "2.2250738585072011e-308", &v ) );
+	CU_ASSERT_EQUAL( v, strtod( "2.2250738585072011e-308", NULL ) );
+	CU_ASSERT_TRUE( parse_real_str( "1e400", &v ) );
+	CU_ASSERT_TRUE( isinf( v ) );
+	CU_ASSERT_TRUE( parse_real_str( "1e-400", &v ) );
+	CU_ASSERT_EQUAL( v, 0.0 );
+
+	/* halfway between two doubles needs more than 19 digits to decide */
+	CU_ASSERT_TRUE( parse_real_str( "9007199254740993", &v ) );
+	CU_ASSERT_EQUAL( v, 9007199254740992.0 );
+	CU_ASSERT_TRUE( parse_real_str( "9007199254740993.0000000000000000000001", &v ) );
+	CU_ASSERT_EQUAL( v, 9007199254740994.0 );
+
+	CU_ASSERT_TRUE( parse_real_str( "NaN", &v ) );
+	CU_ASSERT_TRUE( isnan( v ) );
+	CU_ASSERT_TRUE( parse_real_str( "-Infinity", &v ) );
+	CU_ASSERT_TRUE( isinf( v ) && (v < 0.0) );
+	CU_ASSERT_TRUE( parse_real_str( "inf", &v ) );
+	CU_ASSERT_TRUE( isinf( v ) && (v > 0.0) );
+
+	CU_ASSERT_FALSE( parse_real_str( "", &v ) );
+	CU_ASSERT_FALSE( parse_real_str( ".", &v ) );
+	CU_ASSERT_FALSE( parse_real_str( "-", &v ) );
+}
+
+static void test_number_real_round_trip( void )
+{
+	int i;
+	uint64_t bits;
+	double d, v;
+	uint8_t buf[LLSD_NUMBER_STR_LEN];
+
+	for ( i = 0; i < NUMBER_ROUNDS; i++ )
+	{
+		/* random bit patterns cover every exponent */
+		bits = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+		MEMCPY( &d, &bits, sizeof(d) );
+		if ( isnan( d ) || isinf( d ) )
+			continue;
+
+		llsd_number_format_real( d, buf );
+		CU_ASSERT_TRUE( parse_real_str( (char const *)buf, &v ) );
+		CU_ASSERT_EQUAL( memcmp( &d, &v, sizeof(d) ), 0 );
+
+		/* matches the C library bit for bit */
+		CU_ASSERT_EQUAL( v, strtod( (char const *)buf, NULL ) );
+	}
+}
+
+static CU_pSuite add_number_tests( CU_pSuite pSuite )
+{
+	ADD_TEST( "integer parsing and formatting", test_number_integer );
+	ADD_TEST( "shortest real formatting", test_number_real_format );
+	ADD_TEST( "real parsing", test_number_real_parse );
+	ADD_TEST( "real round trip", test_number_real_round_trip );
+	return pSuite;
+}
+
+CU_pSuite add_number_test_suite()
+{
+	CU_pSuite pSuite = NULL;
+
+	/* add the suite to the registry */
+	pSuite = CU_add_suite("Number Tests", init_number_suite, deinit_number_suite);
+	CHECK_PTR_RET( pSuite, NULL );
+
+	/* add in number specific tests */
+	CHECK_PTR_RET( add_number_tests( pSuite ), NULL );
+
+	return pSuite;
+}
+
@@ -0,0 +1,134 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with main.c; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+
+#include <llsd.h>
+#include <llsd_scan.h>
+
+#include "test_macros.h"
+
+#define SCAN_LEN (100)
+
+static int init_scan_suite( void )
+{
+	return 0;
+}
+
+static int deinit_scan_suite( void )
+{
+	return 0;
+}
+
+static void test_scan_find2( void )
+{
+	size_t i, j;
+	uint8_t buf[SCAN_LEN];
+
+	MEMSET( buf, 'x', sizeof(buf) );
+
+	/* nothing to find */
+	CU_ASSERT_PTR_EQUAL( llsd_scan_find2( buf, buf + SCAN_LEN, '"', '\\' ), buf + SCAN_LEN );
+	CU_ASSERT_PTR_EQUAL( llsd_scan_find2( buf, buf, '"', '\\' ), buf );
+
+	/* every start and match position, across the vector widths */
+	for ( i = 0; i < 40; i++ )
+	{
+		for ( j = i; j < SCAN_LEN; j++ )
+		{
+			buf[j] = ((j & 1) ? '"' : '\\');
+			CU_ASSERT_PTR_EQUAL( llsd_scan_find2( buf + i, buf + SCAN_LEN, '"', '\\' ), buf + j );
+
+			/* a match past the end isn't found */
+			CU_ASSERT_PTR_EQUAL( llsd_scan_find2( buf + i, buf + j, '"', '\\' ), buf + j );
+			buf[j] = 'x';
+		}
+	}
+}
+
+static void test_scan_find3( void )
+{
+	size_t i, j;
+	static uint8_t const match[3] = { '"', '[', ']' };
+	uint8_t buf[SCAN_LEN];
+
+	MEMSET( buf, 'x', sizeof(buf) );
+	CU_ASSERT_PTR_EQUAL( llsd_scan_find3( buf, buf + SCAN_LEN, '"', '[', ']' ), buf + SCAN_LEN );
+
+	for ( i = 0; i < 40; i++ )
+	{
+		for ( j = i; j < SCAN_LEN; j++ )
+		{
+			buf[j] = match[j % 3];
+			CU_ASSERT_PTR_EQUAL( llsd_scan_find3( buf + i, buf + SCAN_LEN, '"', '[', ']' ), buf + j );
+			CU_ASSERT_PTR_EQUAL( llsd_scan_find3( buf + i, buf + j, '"', '[', ']' ), buf + j );
+			buf[j] = 'x';
+		}
+	}
+}
+
+static void test_scan_space( void )
+{
+	size_t i, j;
+	static uint8_t const ws[4] = { ' ', '\t', '\r', '\n' };
+	uint8_t buf[SCAN_LEN];
+
+	for ( i = 0; i < 40; i++ )
+	{
+		for ( j = i; j < SCAN_LEN; j++ )
+		{
+			/* all space up to j */
+			MEMSET( buf, ' ', sizeof(buf) );
+			buf[(i + j) / 2] = ws[j & 3];
+			buf[j] = '{';
+			CU_ASSERT_PTR_EQUAL( llsd_scan_space( buf + i, buf + SCAN_LEN ), buf + j );
+			CU_ASSERT_PTR_EQUAL( llsd_scan_space( buf + i, buf + j ), buf + j );
+		}
+	}
+}
+
+static CU_pSuite add_scan_tests( CU_pSuite pSuite )
+{
+	ADD_TEST( "finding either of two bytes", test_scan_find2 );
+	ADD_TEST( "finding any of three bytes", test_scan_find3 );
+	ADD_TEST( "skipping white space", test_scan_space );
+	return pSuite;
+}
+
+CU_pSuite add_scan_test_suite()
+{
+	CU_pSuite pSuite = NULL;
+
+	/* add the suite to the registry */
+	pSuite = CU_add_suite("Scan Tests", init_scan_suite, deinit_scan_suite);
+	CHECK_PTR_RET( pSuite, NULL );
+
+	/* add in scan specific tests */
+	CHECK_PTR_RET( add_scan_tests( pSuite ), NULL );
+
+	return pSuite;
+}
+
@@ -15,6 +15,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -29,6 +30,9 @@
 
 #include <llsd.h>
 #include <llsd_parser.h>
+#include <llsd_reader.h>
+#include <llsd_serializer.h>
+#include <llsd_stack.h>
 
 #include "test_macros.h"
 
@@ -42,7 +46,7 @@ static size_t expected_sizes[ LLSD_TYPE_COUNT ] =
 	22,		/* LLSD_UNDEF */
 	33,		/* LLSD_BOOLEAN */
 	33,		/* LLSD_INTEGER */
-	34,		/* LLSD_REAL */
+	29,		/* LLSD_REAL */
 	62,		/* LLSD_UUID */
 	42,		/* LLSD_STRING '<string>' + 'Hello World!' + '</string>' */
 	50,		/* LLSD_DATE */
@@ -55,7 +59,7 @@ static size_t expected_sizes[ LLSD_TYPE_COUNT ] =
 static uint8_t const undef_[] = "<llsd><undef /></llsd>";
 static uint8_t const boolean_[] = "<llsd><boolean>1</boolean></llsd>";
 static uint8_t const integer_[] = "<llsd><integer>1</integer></llsd>";
-static uint8_t const real_[] = "<llsd><real>1.000000</real></llsd>";
+static uint8_t const real_[] = "<llsd><real>1.0</real></llsd>";
 static uint8_t const uuid_[] = "<llsd><uuid>01020304-0506-0708-0900-010203040506</uuid></llsd>";
 static uint8_t const string_[] = "<llsd><string>Hello World!</string></llsd>";
 static uint8_t const date_[] = "<llsd><date>1970-01-01T00:00:01.000Z</date></llsd>";
@@ -99,6 +103,168 @@ static void test_unrecoverable_xml_error_1( void )
 	fin = NULL;
 }
 
+/* expat is still behind the push parser, so the same document can be parsed
+ * both ways */
+static llsd_t * parse_with_expat( uint8_t const * const doc, size_t const len )
+{
+	llsd_t * llsd = NULL;
+	llsd_parser_t * p = NULL;
+	p = llsd_parser_new( NULL );
+	CHECK_PTR_RET( p, NULL );
+	if ( llsd_parser_feed( p, doc, len ) )
+		llsd = llsd_parser_finish( p );
+	llsd_parser_delete( p );
+	return llsd;
+}
+
+static void check_same_as_expat( char const * const doc )
+{
+	llsd_t * native = NULL;
+	llsd_t * expat = NULL;
+
+	native = llsd_parse_from_buffer( (uint8_t const *)doc, strlen( doc ) );
+	expat = parse_with_expat( (uint8_t const *)doc, strlen( doc ) );
+	CU_ASSERT_PTR_NOT_NULL( native );
+	CU_ASSERT_PTR_NOT_NULL( expat );
+	if ( (native != NULL) && (expat != NULL) )
+	{
+		CU_ASSERT_TRUE( llsd_equal( native, expat ) );
+	}
+	if ( native != NULL )
+		llsd_delete( native );
+	if ( expat != NULL )
+		llsd_delete( expat );
+}
+
+static void test_xml_native_tokenizer( void )
+{
+	int i;
+	uint8_t * str = NULL;
+	llsd_t * llsd = NULL;
+	llsd_parse_ctx_t * ctx = NULL;
+	static char const doctype[] = "<?xml version=\"1.0\"?><!DOCTYPE llsd [<!ENTITY who \"world\">]>"
+		"<llsd><string>hello &who;</string></llsd>";
+	static char const latin1[] = "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>"
+		"<llsd><string>caf\xE9</string></llsd>";
+	static char const * const bad[] =
+	{
+		"<?xml version=\"1.0\"?><llsd><map></array></llsd>",
+		"<?xml version=\"1.0\"?><llsd><string>a<!-- b</string></llsd>",
+		"<?xml version=\"1.0\"?><llsd><string>&nbsp;</string></llsd>",
+		"<?xml version=\"1.0\"?><llsd><string>&#0;</string></llsd>",
+		"<?xml version=\"1.0\"?><llsd><undef /></llsd>junk",
+		"<?xml version=\"1.0\"?><llsd><array size=3></array></llsd>",
+		"<?xml version=\"1.0\"?><llsd><array>"
+	};
+
+	/* entities, character references, CDATA, comments and line ends */
+	check_same_as_expat( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<llsd><map>"
+		"<key>a&amp;b</key><string>&lt;x&gt; &quot;q&quot; &apos;s&apos; &#65;&#x263A;</string>"
+		"<key>cdata</key><string>x<![CDATA[<raw> & stuff]]> tail</string>"
+		"<key>crlf</key><string>l1\r\nl2\rl3</string>"
+		"<key>comment</key><string>a<!-- note -->b</string>"
+		"<key>empty</key><string></string>"
+		"<key>uri</key><uri>http://x/?a=1&amp;b=2</uri>"
+		"</map></llsd>" );
+
+	/* attributes, empty elements and every type */
+	check_same_as_expat( "<?xml version='1.0'?><llsd><array size='9'>"
+		"<integer> 42 </integer><real/><binary encoding=\"base16\">0102</binary>"
+		"<undef /><boolean>true</boolean><real>-1.5e3</real>"
+		"<uuid>d7f4aeca-88f1-42a1-b385-b9db18abb255</uuid>"
+		"<date>2006-02-01T14:29:53.460Z</date><map ></map >"
+		"</array></llsd>" );
+
+	/* comments and PIs around the root */
+	check_same_as_expat( "<?xml version=\"1.0\"?><!-- before --><?pi x?>\n"
+		"<llsd><string>hi</string></llsd>\n<!-- after -->\n" );
+
+	/* a DOCTYPE with an entity is left to expat */
+	llsd = llsd_parse_from_buffer( (uint8_t const *)doctype, strlen( doctype ) );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd );
+	CU_ASSERT_TRUE( llsd_as_string( llsd, &str ) );
+	CU_ASSERT_STRING_EQUAL( (char const *)str, "hello world" );
+	llsd_delete( llsd );
+
+	/* and so is another encoding */
+	llsd = llsd_parse_from_buffer( (uint8_t const *)latin1, strlen( latin1 ) );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( llsd );
+	CU_ASSERT_TRUE( llsd_as_string( llsd, &str ) );
+	CU_ASSERT_STRING_EQUAL( (char const *)str, "caf\xC3\xA9" );
+	llsd_delete( llsd );
+
+	for ( i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++ )
+	{
+		llsd = llsd_parse_from_buffer( (uint8_t const *)bad[i], strlen( bad[i] ) );
+		CU_ASSERT_PTR_NULL( llsd );
+		if ( llsd != NULL )
+			llsd_delete( llsd );
+	}
+
+	/* a context resets the expat parser it kept for the next document that
+	 * needs it, with bad and native documents in between */
+	ctx = llsd_parse_ctx_new();
+	CU_ASSERT_PTR_NOT_NULL_FATAL( ctx );
+	for ( i = 0; i < 3; i++ )
+	{
+		llsd = llsd_parse_ctx_from_buffer( ctx, (uint8_t const *)doctype, strlen( doctype ), NULL );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd );
+		CU_ASSERT_TRUE( llsd_as_string( llsd, &str ) );
+		CU_ASSERT_STRING_EQUAL( (char const *)str, "hello world" );
+		llsd_delete( llsd );
+
+		CU_ASSERT_PTR_NULL( llsd_parse_ctx_from_buffer( ctx, (uint8_t const *)bad[i], strlen( bad[i] ), NULL ) );
+
+		llsd = llsd_parse_ctx_from_buffer( ctx, (uint8_t const *)latin1, strlen( latin1 ), NULL );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( llsd );
+		CU_ASSERT_TRUE( llsd_as_string( llsd, &str ) );
+		CU_ASSERT_STRING_EQUAL( (char const *)str, "caf\xC3\xA9" );
+		llsd_delete( llsd );
+	}
+	llsd_parse_ctx_delete( ctx );
+}
+
+#define NUM_RECORDS (20000)
+
+static void test_xml_native_matches_expat( void )
+{
+	int i;
+	llsd_t * doc = NULL;
+	llsd_t * rec = NULL;
+	llsd_t * native = NULL;
+	llsd_t * expat = NULL;
+	llsd_buffer_t out;
+
+	/* a telemetry style document, an array of small maps */
+	doc = llsd_new_array( NUM_RECORDS );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( doc );
+	for ( i = 0; i < NUM_RECORDS; i++ )
+	{
+		rec = llsd_new_map( 4 );
+		CU_ASSERT_PTR_NOT_NULL_FATAL( rec );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "id", FALSE ), llsd_new_integer( i ) ) );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "value", FALSE ), llsd_new_real( i * 0.25 ) ) );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "name", FALSE ), llsd_new_string( "sensor <a> & \"b\"", FALSE ) ) );
+		CU_ASSERT_TRUE( llsd_map_insert( rec, llsd_new_string( "time", FALSE ), llsd_new_date( 1400000000.0 + i ) ) );
+		CU_ASSERT_TRUE( llsd_array_append( doc, rec ) );
+	}
+	CU_ASSERT_TRUE_FATAL( llsd_buffer_initialize( &out, NULL, 0 ) );
+	CU_ASSERT_TRUE_FATAL( llsd_serialize_to_buffer( doc, &out, LLSD_ENC_XML, FALSE ) );
+
+	expat = parse_with_expat( out.data, out.len );
+	native = llsd_parse_from_buffer( out.data, out.len );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( native );
+	CU_ASSERT_PTR_NOT_NULL_FATAL( expat );
+	CU_ASSERT_TRUE( llsd_equal( native, doc ) );
+	CU_ASSERT_TRUE( llsd_equal( native, expat ) );
+
+	llsd_buffer_deinitialize( &out );
+	llsd_delete( native );
+	llsd_delete( expat );
+	llsd_delete( doc );
+}
+
 static int init_xml_suite( void )
 {
 	format = LLSD_ENC_XML;
@@ -113,6 +279,8 @@ static int deinit_xml_suite( void )
 static CU_pSuite add_xml_tests( CU_pSuite pSuite )
 {
 	ADD_TEST( "test unrecoverable xml error 1", test_unrecoverable_xml_error_1 );
+	ADD_TEST( "native tokenizer matches expat", test_xml_native_tokenizer );
+	ADD_TEST( "native tokenizer matches expat", test_xml_native_matches_expat );
 	return pSuite;
 }
 